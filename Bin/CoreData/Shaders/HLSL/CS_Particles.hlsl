@@ -0,0 +1,263 @@
+// GPU particle kernels, selected with the EMIT, SIMULATE and EXPAND defines. The CPU reference implementation in
+// ParticleKernels.cpp must be kept in sync with these.
+
+#define GROUP_SIZE 64
+#define MAX_FRAMES 8
+#define EMITTER_BOX 1
+#define EMITTER_RING 2
+#define DEGTORAD 0.017453292
+
+struct Particle
+{
+    float3 position;
+    float timer;
+    float3 velocity;
+    float timeToLive;
+    float2 size;
+    float rotation;
+    float rotationSpeed;
+    float scale;
+    float3 padding;
+};
+
+cbuffer ParticleParams : register(b0)
+{
+    float4 cEmitTransform[3];
+    float4 cEmitRotation;
+    float3 cPositionScale;
+    float cTimeStep;
+    float3 cConstantForce;
+    float cDampingForce;
+    float3 cEmitterSize;
+    uint cEmitterType;
+    float3 cDirectionMin;
+    uint cEmitIndex;
+    float3 cDirectionMax;
+    uint cEmitCount;
+    float3 cTravelDelta;
+    uint cSeed;
+    float2 cSizeMin;
+    float2 cSizeMax;
+    float cVelocityMin;
+    float cVelocityMax;
+    float cTimeToLiveMin;
+    float cTimeToLiveMax;
+    float cRotationMin;
+    float cRotationMax;
+    float cRotationSpeedMin;
+    float cRotationSpeedMax;
+    float cSizeAdd;
+    float cSizeMul;
+    float2 cBillboardScale;
+    uint cNumParticles;
+    uint cNumColorFrames;
+    uint cNumTextureFrames;
+    uint cPadding;
+    float4 cColors[MAX_FRAMES];
+    float4 cTextureUVs[MAX_FRAMES];
+    float4 cFrameTimes[MAX_FRAMES];
+}
+
+RWStructuredBuffer<Particle> particles : register(u0);
+RWStructuredBuffer<uint> aliveList : register(u1);
+RWStructuredBuffer<uint> aliveCount : register(u2);
+RWBuffer<float4> vertices : register(u3);
+RWStructuredBuffer<uint> deadList : register(u4);
+RWStructuredBuffer<int> deadCount : register(u5);
+
+uint Hash(uint value)
+{
+    uint state = value * 747796405u + 2891336453u;
+    uint word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+    return (word >> 22u) ^ word;
+}
+
+float NextRandom(inout uint state)
+{
+    state = Hash(state);
+    return (float)(state >> 8u) * (1.0 / 16777216.0);
+}
+
+float3 SafeNormalize(float3 v)
+{
+    float len = length(v);
+    return len > 0.0 ? v / len : v;
+}
+
+float3 RotateVector(float4 q, float3 v)
+{
+    return v + 2.0 * cross(q.xyz, cross(q.xyz, v) + q.w * v);
+}
+
+uint PackColor(float4 color)
+{
+    uint4 c = (uint4)(saturate(color) * 255.0);
+    return c.r | (c.g << 8) | (c.b << 16) | (c.a << 24);
+}
+
+#ifdef EMIT
+[numthreads(GROUP_SIZE, 1, 1)]
+void CS(uint3 id : SV_DispatchThreadID)
+{
+    uint thread = id.x;
+    if (thread >= cEmitCount)
+        return;
+
+    // Take a free slot from the dead list. When all slots are alive the particle is dropped
+    int remaining;
+    InterlockedAdd(deadCount[0], -1, remaining);
+    if (remaining <= 0)
+    {
+        InterlockedAdd(deadCount[0], 1);
+        return;
+    }
+    uint slot = deadList[remaining - 1];
+
+    uint rng = Hash(cSeed ^ Hash(cEmitIndex + thread));
+    Particle particle;
+
+    float3 direction;
+    direction.x = lerp(cDirectionMin.x, cDirectionMax.x, NextRandom(rng));
+    direction.y = lerp(cDirectionMin.y, cDirectionMax.y, NextRandom(rng));
+    direction.z = lerp(cDirectionMin.z, cDirectionMax.z, NextRandom(rng));
+    direction = SafeNormalize(direction);
+    float speed = lerp(cVelocityMin, cVelocityMax, NextRandom(rng));
+
+    float3 position;
+    float3 velocity = direction * speed;
+    if (cEmitterType == EMITTER_BOX)
+    {
+        float x = NextRandom(rng) - 0.5;
+        float y = NextRandom(rng) - 0.5;
+        float z = NextRandom(rng) - 0.5;
+        position = float3(x, y, z) * cEmitterSize;
+    }
+    else if (cEmitterType == EMITTER_RING)
+    {
+        float angle = lerp(cEmitterSize.x, cEmitterSize.y, NextRandom(rng)) * DEGTORAD;
+        float3 ringDirection = float3(sin(angle), 0.0, cos(angle));
+        position = ringDirection * max(cEmitterSize.z, 0.2) * 0.5;
+        velocity = ringDirection * abs(speed);
+    }
+    else
+    {
+        float x = NextRandom(rng) * 2.0 - 1.0;
+        float y = NextRandom(rng) * 2.0 - 1.0;
+        float z = NextRandom(rng) * 2.0 - 1.0;
+        position = cEmitterSize * SafeNormalize(float3(x, y, z)) * 0.5;
+    }
+
+    float interpDelta = cEmitCount > 1 ? (float)thread / (float)(cEmitCount - 1) : 0.0;
+    float4 localPos = float4(position, 1.0);
+
+    particle.position = float3(dot(cEmitTransform[0], localPos), dot(cEmitTransform[1], localPos),
+        dot(cEmitTransform[2], localPos)) + cTravelDelta * interpDelta;
+    particle.timer = 0.0;
+    particle.velocity = RotateVector(cEmitRotation, velocity);
+    particle.timeToLive = lerp(cTimeToLiveMin, cTimeToLiveMax, NextRandom(rng));
+    particle.size = lerp(cSizeMin, cSizeMax, NextRandom(rng));
+    particle.rotation = lerp(cRotationMin, cRotationMax, NextRandom(rng));
+    particle.rotationSpeed = lerp(cRotationSpeedMin, cRotationSpeedMax, NextRandom(rng));
+    particle.scale = 1.0;
+    particle.padding = float3(0.0, 0.0, 0.0);
+
+    particles[slot] = particle;
+}
+#endif
+
+#ifdef SIMULATE
+[numthreads(GROUP_SIZE, 1, 1)]
+void CS(uint3 id : SV_DispatchThreadID)
+{
+    uint thread = id.x;
+    if (thread >= cNumParticles)
+        return;
+
+    Particle particle = particles[thread];
+    if (particle.timer >= particle.timeToLive)
+        return;
+
+    particle.timer += cTimeStep;
+    if (particle.timer < particle.timeToLive)
+    {
+        particle.velocity += cConstantForce * cTimeStep;
+        particle.velocity *= 1.0 - cTimeStep * cDampingForce;
+        particle.position += particle.velocity * cPositionScale * cTimeStep;
+        particle.rotation += particle.rotationSpeed * cTimeStep;
+        particle.scale = max(particle.scale + cSizeAdd * cTimeStep, 0.0) * ((cSizeMul - 1.0) * cTimeStep + 1.0);
+
+        // Compact the survivors into the alive list
+        uint index;
+        InterlockedAdd(aliveCount[0], 1, index);
+        aliveList[index] = thread;
+    }
+    else
+    {
+        // Return the expired slot to the dead list
+        int index;
+        InterlockedAdd(deadCount[0], 1, index);
+        deadList[index] = thread;
+    }
+
+    particles[thread] = particle;
+}
+#endif
+
+#ifdef EXPAND
+[numthreads(GROUP_SIZE, 1, 1)]
+void CS(uint3 id : SV_DispatchThreadID)
+{
+    uint thread = id.x;
+    if (thread >= cNumParticles)
+        return;
+
+    // Each vertex is two float4s: position and packed color, then UV and rotated size
+    uint dest = thread * 8;
+    if (thread >= aliveCount[0])
+    {
+        for (uint i = 0; i < 8; ++i)
+            vertices[dest + i] = float4(0.0, 0.0, 0.0, 0.0);
+        return;
+    }
+
+    Particle particle = particles[aliveList[thread]];
+
+    float4 color = float4(1.0, 1.0, 1.0, 1.0);
+    if (cNumColorFrames > 0)
+    {
+        uint index = 0;
+        while (index + 1 < cNumColorFrames && particle.timer >= cFrameTimes[index + 1].x)
+            ++index;
+        color = cColors[index];
+        if (index + 1 < cNumColorFrames)
+        {
+            float interval = cFrameTimes[index + 1].x - cFrameTimes[index].x;
+            if (interval > 0.0)
+                color = lerp(color, cColors[index + 1], (particle.timer - cFrameTimes[index].x) / interval);
+        }
+    }
+
+    float4 uv = float4(0.0, 0.0, 1.0, 1.0);
+    if (cNumTextureFrames > 0)
+    {
+        uint index = 0;
+        while (index + 1 < cNumTextureFrames && particle.timer >= cFrameTimes[index + 1].y)
+            ++index;
+        uv = cTextureUVs[index];
+    }
+
+    float2 size = particle.size * particle.scale * cBillboardScale;
+    float s, c;
+    sincos(particle.rotation * DEGTORAD, s, c);
+    float4 positionColor = float4(particle.position, asfloat(PackColor(color)));
+
+    vertices[dest + 0] = positionColor;
+    vertices[dest + 1] = float4(uv.x, uv.y, -size.x * c + size.y * s, size.x * s + size.y * c);
+    vertices[dest + 2] = positionColor;
+    vertices[dest + 3] = float4(uv.z, uv.y, size.x * c + size.y * s, -size.x * s + size.y * c);
+    vertices[dest + 4] = positionColor;
+    vertices[dest + 5] = float4(uv.z, uv.w, size.x * c - size.y * s, -size.x * s - size.y * c);
+    vertices[dest + 6] = positionColor;
+    vertices[dest + 7] = float4(uv.x, uv.w, -size.x * c - size.y * s, size.x * s - size.y * c);
+}
+#endif
@@ -0,0 +1,73 @@
+#if defined(COMPILEPS) && defined(CLUSTERED) && defined(D3D11)
+
+// Layout of the clustered light tables built by LightTiler
+struct ClusterInfo
+{
+    float3 minVec;
+    float nearDist;
+    float3 maxVec;
+    float farDist;
+    int3 tiles;
+    uint itemsPerCell;
+    float4 headPosition;
+    float4 angles;
+    float4 headRows[3]; // world to head space transform
+};
+
+struct ClusteredLight
+{
+    float4 position;  // xyz = world position, w = range
+    float4 shapeData; // xyz = world direction, w = cosine of the spot half angle, -1 for point lights
+    float4 color;     // rgb = effective color, w = specular intensity
+    int4 data;        // light type, light mask
+};
+
+// Bound to the light texture units, which the base pass does not otherwise use
+StructuredBuffer<uint4> ClusterCells : register(t8);
+StructuredBuffer<ClusteredLight> ClusterLights : register(t9);
+StructuredBuffer<uint> ClusterLightIndices : register(t10);
+StructuredBuffer<ClusterInfo> ClusterInfos : register(t14);
+
+uint GetClusterIndex(ClusterInfo info, float3 worldPos)
+{
+    // Spherical cells around the head: azimuth and inclination columns, logarithmic depth slices. The grid is laid out in
+    // head space, as LightTiler bins the lights
+    float4 pos = float4(worldPos, 1.0);
+    float3 headVec = float3(dot(info.headRows[0], pos), dot(info.headRows[1], pos), dot(info.headRows[2], pos));
+    float dist = max(length(headVec), 0.0001);
+    float3 dir = headVec / dist;
+
+    int x = clamp(int(floor((atan2(dir.x, dir.z) - info.angles.x) / info.angles.z)), 0, info.tiles.x - 1);
+    int y = clamp(int(floor((asin(-dir.y) - info.angles.y) / info.angles.w)), 0, info.tiles.y - 1);
+    float logFrac = log(info.farDist / info.nearDist);
+    int z = clamp(int(floor((log(max(dist, info.nearDist)) - log(info.nearDist)) * info.tiles.z / logFrac)), 0, info.tiles.z - 1);
+
+    return x + (y * info.tiles.x) + (z * info.tiles.x * info.tiles.y);
+}
+
+// Sum the diffuse lighting of all point and spot lights in the cell of a position
+float3 GetClusteredLighting(float3 worldPos, float3 normal)
+{
+    ClusterInfo info = ClusterInfos[0];
+    uint cell = GetClusterIndex(info, worldPos);
+    uint numLights = min(ClusterCells[cell].x, info.itemsPerCell);
+
+    float3 lighting = 0.0;
+    for (uint i = 0; i < numLights; ++i)
+    {
+        ClusteredLight light = ClusterLights[ClusterLightIndices[cell * info.itemsPerCell + i]];
+
+        float3 lightVec = (light.position.xyz - worldPos) / light.position.w;
+        float lightDist = length(lightVec);
+        float3 localDir = lightVec / max(lightDist, 0.0001);
+        float atten = saturate(1.0 - lightDist * lightDist);
+        if (light.shapeData.w > -1.0)
+            atten *= saturate((dot(-localDir, light.shapeData.xyz) - light.shapeData.w) / max(1.0 - light.shapeData.w, 0.0001));
+
+        lighting += max(dot(normal, localDir), 0.0) * atten * light.color.rgb;
+    }
+
+    return lighting;
+}
+
+#endif
@@ -0,0 +1,22 @@
+#include "Uniforms.hlsl"
+#include "Samplers.hlsl"
+#include "Transform.hlsl"
+
+// Copies the depth texture bound as the depth buffer texel for texel into the current depth-stencil, within the viewport.
+// Used on Direct3D11, which can not copy a region of a depth-stencil texture.
+
+void VS(float4 iPos : POSITION,
+    out float4 oPos : OUTPOSITION)
+{
+    float4x3 modelMatrix = iModelMatrix;
+    float3 worldPos = GetWorldPos(modelMatrix);
+    oPos = GetClipPos(worldPos);
+}
+
+#ifdef D3D11
+void PS(float4 iPos : SV_POSITION,
+    out float oDepth : SV_DEPTH)
+{
+    oDepth = tDepthBuffer.Load(int3(iPos.xy, 0)).r;
+}
+#endif
@@ -287,10 +287,12 @@ float GetPointShadow(float3 lightVec)
     const float factor = 1.0 / 256.0;
     lightVec += factor * axis * lightVec;
 
-    // Read the 2D UV coordinates, adjust according to shadow map size and add face offset
+    // Read the 2D UV coordinates, adjust according to shadow map size and add face offset, scaled to the light's region of the
+    // shadow map
     float4 indirectPos = SampleCube(IndirectionCubeMap, lightVec);
     indirectPos.xy *= cShadowCubeAdjust.xy;
-    indirectPos.xy += float2(cShadowCubeAdjust.z + indirectPos.z * 0.5, cShadowCubeAdjust.w + indirectPos.w);
+    indirectPos.xy += float2(cShadowCubeAdjust.z + indirectPos.z * 0.5 * cShadowCubeUVScale.x,
+        cShadowCubeAdjust.w + indirectPos.w * cShadowCubeUVScale.y);
 
     float4 shadowPos = float4(indirectPos.xy, cShadowDepthFade.x + cShadowDepthFade.y / depth, 1.0);
     return GetShadow(shadowPos);
@@ -22,7 +22,7 @@ cbuffer CustomPS : register(b6)
 #ifdef COMPILEVS
 
 void VS(float4 iPos : POSITION,
-    #if !defined(BILLBOARD) && !defined(TRAILFACECAM) && !defined(POINTBILLBOARD)
+    #if !defined(BILLBOARD) && !defined(TRAILFACECAM) && !defined(POINTBILLBOARD) && !defined(SWAYBILLBOARD)
         float3 iNormal : NORMAL,
     #endif
     #ifndef NOUV
@@ -35,13 +35,16 @@ void VS(float4 iPos : POSITION,
     #ifdef VERTEXCOLOR
         float4 iColor : COLOR0,
     #endif
-    #if defined(BILLBOARD) || defined(DIRBILLBOARD)
+    #ifdef INSTANCED
+        float4x3 iModelInstance : TEXCOORD4,
+    #endif
+    #if defined(BILLBOARD) || defined(DIRBILLBOARD) || defined(SWAYBILLBOARD)
         float2 iSize : TEXCOORD1,
     #endif
     #if defined(POINTBILLBOARD) || defined(POINTDIRBILLBOARD)
         float4 iSize : TEXCOORD1,
     #endif
-    #if defined(TRAILFACECAM) || defined(TRAILBONE)
+    #if defined(TRAILFACECAM) || defined(TRAILBONE) || defined(SWAYBILLBOARD)
         float4 iTangent : TANGENT,
     #endif
     #if defined(POINTBILLBOARD) || defined(POINTDIRBILLBOARD)
@@ -3,6 +3,7 @@
 #include "Transform.hlsl"
 #include "ScreenPos.hlsl"
 #include "Lighting.hlsl"
+#include "Clustered.hlsl"
 #include "Fog.hlsl"
 
 void VS(float4 iPos : POSITION,
@@ -327,6 +328,11 @@ void PS(
             finalColor += Sample2D(EmissiveMap, iTexCoord2).rgb * cAmbientColor.rgb * diffColor.rgb;
         #endif
 
+        #if defined(CLUSTERED) && defined(D3D11)
+            // Add all point and spot lights from the clustered light tables
+            finalColor += GetClusteredLighting(iWorldPos.xyz, normal) * diffColor.rgb;
+        #endif
+
         #ifdef MATERIAL
             // Add light pre-pass accumulation result
             // Lights are accumulated at half intensity. Bring back to full intensity now
@@ -57,6 +57,29 @@ float3 GetBillboardNormal()
 }
 #endif
 
+#ifdef SWAYBILLBOARD
+float3x3 GetSwayBillboardRot()
+{
+#ifdef VR
+    return (float3x3)cViewInv[2];
+#else
+    return (float3x3)cViewInv;
+#endif
+}
+
+// iSway holds phase, angular speed, amplitude and base rotation. The world position offsets the phase so that instances
+// of the same geometry do not sway in unison
+float3 GetSwayBillboardPos(float4 iPos, float2 iSize, float4 iSway, float4x3 modelMatrix)
+{
+    float3 center = mul(iPos, modelMatrix);
+    float angle = iSway.w + iSway.z * sin(cElapsedTime * iSway.y + iSway.x + dot(center.xz, float2(0.37, 0.61)));
+    float s, c;
+    sincos(angle, s, c);
+    float2 corner = float2(iSize.x * c + iSize.y * s, iSize.y * c - iSize.x * s) * length(modelMatrix[0]);
+    return center + mul(float3(corner, 0.0), GetSwayBillboardRot());
+}
+#endif
+
 #if defined(DIRBILLBOARD) || defined(POINTDIRBILLBOARD)
 float3x3 GetFaceCameraRotation(float3 position, float3 direction)
 {
@@ -122,7 +145,9 @@ float3 GetTrailNormal(float4 iPos, float3 iParentPos, float3 iForward)
     #define iModelMatrix cModel
 #endif
 
-#if defined(BILLBOARD) || defined(POINTBILLBOARD)
+#if defined(SWAYBILLBOARD)
+    #define GetWorldPos(modelMatrix) GetSwayBillboardPos(iPos, iSize, iTangent, modelMatrix)
+#elif defined(BILLBOARD) || defined(POINTBILLBOARD)
     #define GetWorldPos(modelMatrix) GetBillboardPos(iPos, iSize, modelMatrix)
 #elif defined(DIRBILLBOARD) || defined(POINTDIRBILLBOARD)
     #define GetWorldPos(modelMatrix) GetBillboardPos(iPos, iSize, iNormal, modelMatrix)
@@ -134,7 +159,9 @@ float3 GetTrailNormal(float4 iPos, float3 iParentPos, float3 iForward)
     #define GetWorldPos(modelMatrix) mul(iPos, modelMatrix)
 #endif
 
-#if defined(BILLBOARD)
+#if defined(SWAYBILLBOARD)
+    #define GetWorldNormal(modelMatrix) -GetSwayBillboardRot()[2]
+#elif defined(BILLBOARD)
     #define GetWorldNormal(modelMatrix) GetBillboardNormal()
 #elif defined(DIRBILLBOARD)
     #define GetWorldNormal(modelMatrix) GetBillboardNormal(iPos, iNormal, modelMatrix)
@@ -146,7 +173,9 @@ float3 GetTrailNormal(float4 iPos, float3 iParentPos, float3 iForward)
     #define GetWorldNormal(modelMatrix) normalize(mul(iNormal, (float3x3)modelMatrix))
 #endif
 
-#if defined(BILLBOARD)
+#if defined(SWAYBILLBOARD)
+    #define GetWorldTangent(modelMatrix) float4(normalize(GetSwayBillboardRot()[0]), 1.0)
+#elif defined(BILLBOARD)
     #define GetWorldTangent(modelMatrix) float4(normalize(mul(float3(1.0, 0.0, 0.0), cBillboardRot)), 1.0)
 #elif defined(DIRBILLBOARD)
     #define GetWorldTangent(modelMatrix) float4(normalize(mul(float3(1.0, 0.0, 0.0), (float3x3)modelMatrix)), 1.0)
@@ -68,6 +68,7 @@ uniform float3 cZoneMax;
 uniform float cNearClipPS;
 uniform float cFarClipPS;
 uniform float4 cShadowCubeAdjust;
+uniform float2 cShadowCubeUVScale;
 uniform float4 cShadowDepthFade;
 uniform float2 cShadowIntensity;
 uniform float2 cShadowMapInvSize;
@@ -196,6 +197,7 @@ cbuffer LightPS : register(b3)
     float3 cLightDirPS;
     float4 cNormalOffsetScalePS;
     float4 cShadowCubeAdjust;
+    float2 cShadowCubeUVScale;
     float4 cShadowDepthFade;
     float2 cShadowIntensity;
     float2 cShadowMapInvSize;
@@ -36,7 +36,7 @@ void VS(float4 iPos : POSITION,
     #ifdef INSTANCED
         float4x3 iModelInstance : TEXCOORD4,
     #endif
-    #if defined(BILLBOARD) || defined(DIRBILLBOARD)
+    #if defined(BILLBOARD) || defined(DIRBILLBOARD) || defined(SWAYBILLBOARD)
         float2 iSize : TEXCOORD1,
     #elif defined(POINTBILLBOARD) || defined(POINTDIRBILLBOARD)
         float4 iSize : TEXCOORD1,
@@ -44,7 +44,7 @@ void VS(float4 iPos : POSITION,
     #if defined(DIRBILLBOARD) || defined(TRAILBONE) || defined(POINTDIRBILLBOARD)
         float3 iNormal : NORMAL,
     #endif
-    #if defined(TRAILFACECAM) || defined(TRAILBONE)
+    #if defined(TRAILFACECAM) || defined(TRAILBONE) || defined(SWAYBILLBOARD)
         float4 iTangent : TANGENT,
     #endif
     
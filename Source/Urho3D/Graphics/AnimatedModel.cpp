@@ -24,6 +24,7 @@
 
 #include "../Core/Context.h"
 #include "../Core/Profiler.h"
+#include "../Core/Thread.h"
 #include "../Graphics/AnimatedModel.h"
 #include "../Graphics/Animation.h"
 #include "../Graphics/AnimationState.h"
@@ -42,6 +43,10 @@
 #include "../Resource/ResourceEvents.h"
 #include "../Scene/Scene.h"
 
+#ifdef URHO3D_SSE
+#include <xmmintrin.h>
+#endif
+
 #include "../DebugNew.h"
 
 namespace Urho3D
@@ -67,6 +72,44 @@ static bool CompareAnimationOrder(const SharedPtr<AnimationState>& lhs, const Sh
 
 static const unsigned MAX_ANIMATION_STATES = 256;
 
+static void AccumulateMorphDeltas(float* dest, unsigned stride, const unsigned* indices, unsigned rangeStart, const float* deltas,
+    unsigned count, float weight)
+{
+    unsigned i = 0;
+
+#ifdef URHO3D_SSE
+    const __m128 weights = _mm_set1_ps(weight);
+
+    // The deltas of four vertices are twelve contiguous floats, weighted with three multiplies. Only the adds are scalar, as
+    // the vertices are scattered and SSE has no scatter
+    for (; i + 4 <= count; i += 4)
+    {
+        const float* s = deltas + i * 3;
+        float weighted[12];
+        _mm_storeu_ps(weighted, _mm_mul_ps(_mm_loadu_ps(s), weights));
+        _mm_storeu_ps(weighted + 4, _mm_mul_ps(_mm_loadu_ps(s + 4), weights));
+        _mm_storeu_ps(weighted + 8, _mm_mul_ps(_mm_loadu_ps(s + 8), weights));
+
+        for (unsigned j = 0; j < 4; ++j)
+        {
+            float* d = dest + (indices[i + j] - rangeStart) * stride;
+            d[0] += weighted[j * 3];
+            d[1] += weighted[j * 3 + 1];
+            d[2] += weighted[j * 3 + 2];
+        }
+    }
+#endif
+
+    for (; i < count; ++i)
+    {
+        float* d = dest + (indices[i] - rangeStart) * stride;
+        const float* s = deltas + i * 3;
+        d[0] += s[0] * weight;
+        d[1] += s[1] * weight;
+        d[2] += s[2] * weight;
+    }
+}
+
 AnimatedModel::AnimatedModel(Context* context) :
     StaticModel(context),
     animationLodFrameNumber_(0),
@@ -78,6 +121,7 @@ AnimatedModel::AnimatedModel(Context* context) :
     animationDirty_(false),
     animationOrderDirty_(false),
     morphsDirty_(false),
+    morphUploadPending_(false),
     skinningDirty_(true),
     boneBoundingBoxDirty_(true),
     isMaster_(true),
@@ -276,7 +320,7 @@ void AnimatedModel::UpdateBatches(const FrameInfo& frame)
     // determination so that animation does not change the scale
     BoundingBox transformedBoundingBox = boundingBox_.Transformed(worldTransform);
     float scale = transformedBoundingBox.Size().DotProduct(DOT_SCALE);
-    float newLodDistance = frame.camera_->GetLodDistance(distance_, scale, lodBias_);
+    float newLodDistance = frame.camera_->GetLodDistance(distance_, scale, frame.GetLodBias(lodBias_));
 
     // If model is rendered from several views, use the minimum LOD distance for animation LOD
     if (frame.frameNumber_ != animationLodFrameNumber_)
@@ -287,10 +331,10 @@ void AnimatedModel::UpdateBatches(const FrameInfo& frame)
     else
         animationLodDistance_ = Min(animationLodDistance_, newLodDistance);
 
-    if (newLodDistance != lodDistance_)
+    if (newLodDistance != lodDistance_ || lodSwitchPending_)
     {
         lodDistance_ = newLodDistance;
-        CalculateLodLevels();
+        CalculateLodLevels(frame.lodPolicy_);
     }
 }
 
@@ -306,14 +350,26 @@ void AnimatedModel::UpdateGeometry(const FrameInfo& frame)
     if (morphsDirty_)
         UpdateMorphs();
 
+    // If updating in the main thread, there will be no separate commit
+    if (morphUploadPending_ && Thread::IsMainThread())
+        CommitMorphs();
+
     if (skinningDirty_)
         UpdateSkinning();
 }
 
+void AnimatedModel::CommitGeometry(const FrameInfo& frame)
+{
+    if (morphUploadPending_)
+        CommitMorphs();
+}
+
 UpdateGeometryType AnimatedModel::GetUpdateGeometryType()
 {
-    if (morphsDirty_ || forceAnimationUpdate_)
+    if (forceAnimationUpdate_)
         return UPDATE_MAIN_THREAD;
+    else if (morphsDirty_ || morphUploadPending_)
+        return UPDATE_WORKER_THREAD_STAGED;
     else if (skinningDirty_)
         return UPDATE_WORKER_THREAD;
     else
@@ -369,6 +425,8 @@ void AnimatedModel::SetModel(Model* model, bool createBones)
 
         // Copy morphs. Note: morph vertex buffers will be created later on-demand
         morphVertexBuffers_.Clear();
+        morphStagingData_.Clear();
+        morphUploadPending_ = false;
         morphs_.Clear();
         const Vector<ModelMorph>& morphs = model->GetMorphs();
         morphs_.Reserve(morphs.Size());
@@ -431,6 +489,8 @@ void AnimatedModel::SetModel(Model* model, bool createBones)
         SetNumGeometries(0);
         geometryBoneMappings_.Clear();
         morphVertexBuffers_.Clear();
+        morphStagingData_.Clear();
+        morphUploadPending_ = false;
         morphs_.Clear();
         morphElementMask_ = 0;
         SetBoundingBox(BoundingBox());
@@ -1107,6 +1167,7 @@ void AnimatedModel::CloneGeometries()
     const Vector<SharedPtr<VertexBuffer> >& originalVertexBuffers = model_->GetVertexBuffers();
     HashMap<VertexBuffer*, SharedPtr<VertexBuffer> > clonedVertexBuffers;
     morphVertexBuffers_.Resize(originalVertexBuffers.Size());
+    morphStagingData_.Resize(originalVertexBuffers.Size());
 
     for (unsigned i = 0; i < originalVertexBuffers.Size(); ++i)
     {
@@ -1124,9 +1185,13 @@ void AnimatedModel::CloneGeometries()
             }
             clonedVertexBuffers[original] = clone;
             morphVertexBuffers_[i] = clone;
+            morphStagingData_[i].Resize(model_->GetMorphRangeCount(i) * clone->GetVertexSize() / sizeof(float));
         }
         else
+        {
             morphVertexBuffers_[i].Reset();
+            morphStagingData_[i].Clear();
+        }
     }
 
     // Geometries will always be cloned fully. They contain only references to buffer, so they are relatively light
@@ -1347,86 +1412,82 @@ void AnimatedModel::UpdateMorphs()
 
     if (morphs_.Size())
     {
-        // Reset the morph data range from all morphable vertex buffers, then apply morphs
+        // Reset the morph data range from all morphable vertex buffers, then apply morphs. This only touches CPU-side data,
+        // the upload happens later in CommitMorphs()
         for (unsigned i = 0; i < morphVertexBuffers_.Size(); ++i)
         {
             VertexBuffer* buffer = morphVertexBuffers_[i];
-            if (buffer)
+            PODVector<float>& staging = morphStagingData_[i];
+            if (buffer && staging.Size())
             {
                 VertexBuffer* originalBuffer = model_->GetVertexBuffers()[i];
                 unsigned morphStart = model_->GetMorphRangeStart(i);
                 unsigned morphCount = model_->GetMorphRangeCount(i);
+                float* dest = &staging[0];
 
-                void* dest = buffer->Lock(morphStart, morphCount);
-                if (dest)
-                {
-                    // Reset morph range by copying data from the original vertex buffer
-                    CopyMorphVertices(dest, originalBuffer->GetShadowData() + morphStart * originalBuffer->GetVertexSize(),
-                        morphCount, buffer, originalBuffer);
+                // Reset morph range by copying data from the original vertex buffer
+                CopyMorphVertices(dest, originalBuffer->GetShadowData() + morphStart * originalBuffer->GetVertexSize(),
+                    morphCount, buffer, originalBuffer);
 
-                    for (unsigned j = 0; j < morphs_.Size(); ++j)
+                for (unsigned j = 0; j < morphs_.Size(); ++j)
+                {
+                    if (morphs_[j].weight_ != 0.0f)
                     {
-                        if (morphs_[j].weight_ != 0.0f)
-                        {
-                            HashMap<unsigned, VertexBufferMorph>::Iterator k = morphs_[j].buffers_.Find(i);
-                            if (k != morphs_[j].buffers_.End())
-                                ApplyMorph(buffer, dest, morphStart, k->second_, morphs_[j].weight_);
-                        }
+                        HashMap<unsigned, VertexBufferMorph>::Iterator k = morphs_[j].buffers_.Find(i);
+                        if (k != morphs_[j].buffers_.End())
+                            ApplyMorph(buffer, dest, morphStart, k->second_, morphs_[j].weight_);
                     }
-
-                    buffer->Unlock();
                 }
             }
         }
+
+        morphUploadPending_ = true;
     }
 
     morphsDirty_ = false;
 }
 
-void AnimatedModel::ApplyMorph(VertexBuffer* buffer, void* destVertexData, unsigned morphRangeStart, const VertexBufferMorph& morph,
+void AnimatedModel::CommitMorphs()
+{
+    URHO3D_PROFILE(CommitMorphs);
+
+    for (unsigned i = 0; i < morphVertexBuffers_.Size(); ++i)
+    {
+        VertexBuffer* buffer = morphVertexBuffers_[i];
+        const PODVector<float>& staging = morphStagingData_[i];
+        if (buffer && staging.Size())
+            buffer->SetDataRange(&staging[0], model_->GetMorphRangeStart(i), model_->GetMorphRangeCount(i));
+    }
+
+    morphUploadPending_ = false;
+}
+
+void AnimatedModel::ApplyMorph(VertexBuffer* buffer, float* destVertexData, unsigned morphRangeStart, const VertexBufferMorph& morph,
     float weight)
 {
+    const unsigned* indices = morph.indices_.Get();
+    if (!indices)
+        return;
+
     unsigned elementMask = morph.elementMask_ & buffer->GetElementMask();
     unsigned vertexCount = morph.vertexCount_;
-    unsigned normalOffset = buffer->GetElementOffset(SEM_NORMAL);
-    unsigned tangentOffset = buffer->GetElementOffset(SEM_TANGENT);
-    unsigned vertexSize = buffer->GetVertexSize();
-
-    unsigned char* srcData = morph.morphData_;
-    auto* destData = (unsigned char*)destVertexData;
+    unsigned stride = buffer->GetVertexSize() / sizeof(float);
 
-    while (vertexCount--)
+    // Accumulate one element at a time from the decoded delta streams
+    if ((elementMask & MASK_POSITION) && morph.positionDeltas_)
     {
-        unsigned vertexIndex = *((unsigned*)srcData) - morphRangeStart;
-        srcData += sizeof(unsigned);
-
-        if (elementMask & MASK_POSITION)
-        {
-            auto* dest = (float*)(destData + vertexIndex * vertexSize);
-            auto* src = (float*)srcData;
-            dest[0] += src[0] * weight;
-            dest[1] += src[1] * weight;
-            dest[2] += src[2] * weight;
-            srcData += 3 * sizeof(float);
-        }
-        if (elementMask & MASK_NORMAL)
-        {
-            auto* dest = (float*)(destData + vertexIndex * vertexSize + normalOffset);
-            auto* src = (float*)srcData;
-            dest[0] += src[0] * weight;
-            dest[1] += src[1] * weight;
-            dest[2] += src[2] * weight;
-            srcData += 3 * sizeof(float);
-        }
-        if (elementMask & MASK_TANGENT)
-        {
-            auto* dest = (float*)(destData + vertexIndex * vertexSize + tangentOffset);
-            auto* src = (float*)srcData;
-            dest[0] += src[0] * weight;
-            dest[1] += src[1] * weight;
-            dest[2] += src[2] * weight;
-            srcData += 3 * sizeof(float);
-        }
+        AccumulateMorphDeltas(destVertexData + buffer->GetElementOffset(SEM_POSITION) / sizeof(float), stride, indices,
+            morphRangeStart, morph.positionDeltas_.Get(), vertexCount, weight);
+    }
+    if ((elementMask & MASK_NORMAL) && morph.normalDeltas_)
+    {
+        AccumulateMorphDeltas(destVertexData + buffer->GetElementOffset(SEM_NORMAL) / sizeof(float), stride, indices,
+            morphRangeStart, morph.normalDeltas_.Get(), vertexCount, weight);
+    }
+    if ((elementMask & MASK_TANGENT) && morph.tangentDeltas_)
+    {
+        AccumulateMorphDeltas(destVertexData + buffer->GetElementOffset(SEM_TANGENT) / sizeof(float), stride, indices,
+            morphRangeStart, morph.tangentDeltas_.Get(), vertexCount, weight);
     }
 }
 
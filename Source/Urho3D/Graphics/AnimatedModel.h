@@ -63,6 +63,8 @@ public:
     void UpdateBatches(const FrameInfo& frame) override;
     /// Prepare geometry for rendering. Called from a worker thread if possible (no GPU update.)
     void UpdateGeometry(const FrameInfo& frame) override;
+    /// Upload morphed vertices prepared by UpdateGeometry(). Called from the main thread.
+    void CommitGeometry(const FrameInfo& frame) override;
     /// Return whether a geometry update is necessary, and if it can happen in a worker thread.
     UpdateGeometryType GetUpdateGeometryType() override;
     /// Visualize the component as debug geometry.
@@ -201,11 +203,13 @@ private:
     void UpdateAnimation(const FrameInfo& frame);
     /// Recalculate skinning.
     void UpdateSkinning();
-    /// Reapply all vertex morphs.
+    /// Reapply all vertex morphs into the staging data. May be called from a worker thread.
     void UpdateMorphs();
+    /// Upload the staging data to the morph vertex buffers. Must be called from the main thread.
+    void CommitMorphs();
     /// Apply a vertex morph.
     void ApplyMorph
-        (VertexBuffer* buffer, void* destVertexData, unsigned morphRangeStart, const VertexBufferMorph& morph, float weight);
+        (VertexBuffer* buffer, float* destVertexData, unsigned morphRangeStart, const VertexBufferMorph& morph, float weight);
     /// Handle model reload finished.
     void HandleModelReloadFinished(StringHash eventType, VariantMap& eventData);
 
@@ -213,6 +217,8 @@ private:
     Skeleton skeleton_;
     /// Morph vertex buffers.
     Vector<SharedPtr<VertexBuffer> > morphVertexBuffers_;
+    /// Morphed vertex data per morph vertex buffer, covering the morph range. Filled in worker threads and uploaded in the main thread.
+    Vector<PODVector<float> > morphStagingData_;
     /// Vertex morphs.
     Vector<ModelMorph> morphs_;
     /// Animation states.
@@ -247,6 +253,8 @@ private:
     bool animationOrderDirty_;
     /// Vertex morphs dirty flag.
     bool morphsDirty_;
+    /// Staged morph data waiting for upload flag.
+    bool morphUploadPending_;
     /// Skinning dirty flag.
     bool skinningDirty_;
     /// Bone bounding box dirty flag.
@@ -442,9 +442,11 @@ void Batch::Prepare(View* view, Camera* camera, bool setModelTransform, bool all
             if (shadowMap)
             {
                 {
-                    // Calculate point light shadow sampling offsets (unrolled cube map)
-                    auto faceWidth = (unsigned)(shadowMap->GetWidth() / 2);
-                    auto faceHeight = (unsigned)(shadowMap->GetHeight() / 3);
+                    // Calculate point light shadow sampling offsets (unrolled cube map). The faces occupy the light's region of
+                    // the shadow map, which is only a part of the texture when using the shadow atlas
+                    const IntRect& region = lightQueue_->shadowMapRegion_;
+                    auto faceWidth = (unsigned)(region.Width() / 2);
+                    auto faceHeight = (unsigned)(region.Height() / 3);
                     auto width = (float)shadowMap->GetWidth();
                     auto height = (float)shadowMap->GetHeight();
 #ifdef URHO3D_OPENGL
@@ -464,7 +466,15 @@ void Batch::Prepare(View* view, Camera* camera, bool setModelTransform, bool all
                         addX -= 0.5f / width;
                         addY -= 0.5f / height;
                     }
+                    addX += (float)region.left_ / width;
+#ifdef URHO3D_OPENGL
+                    addY += (height - (float)region.bottom_) / height;
+#else
+                    addY += (float)region.top_ / height;
+#endif
                     graphics->SetShaderParameter(PSP_SHADOWCUBEADJUST, Vector4(mulX, mulY, addX, addY));
+                    graphics->SetShaderParameter(PSP_SHADOWCUBEUVSCALE,
+                        Vector2((float)region.Width() / width, (float)region.Height() / height));
                 }
 
                 {
@@ -930,4 +940,14 @@ unsigned BatchQueue::GetNumInstances() const
     return total;
 }
 
+unsigned BatchQueue::GetNumBatches() const
+{
+    unsigned total = batches_.Size();
+
+    for (HashMap<BatchGroupKey, BatchGroup>::ConstIterator i = batchGroups_.Begin(); i != batchGroups_.End(); ++i)
+        total += i->second_.instances_.Size();
+
+    return total;
+}
+
 }
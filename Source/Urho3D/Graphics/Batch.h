@@ -40,6 +40,7 @@ class Material;
 class Matrix3x4;
 class Pass;
 class ShaderVariation;
+class ShadowMapCache;
 class Texture2D;
 class VertexBuffer;
 class View;
@@ -259,6 +260,8 @@ public:
     void Draw(View* view, Camera* camera, bool markToStencil, bool usingLightOptimization, bool allowDepthWrite, unsigned stencilWriteValue = 0, unsigned stencilTestValue = 0, bool isVR = false) const;
     /// Return the combined amount of instances.
     unsigned GetNumInstances() const;
+    /// Return the number of batches, counting each instance of the batch groups.
+    unsigned GetNumBatches() const;
 
     /// Return whether the batch group is empty.
     bool IsEmpty() const { return batches_.Empty() && batchGroups_.Empty(); }
@@ -315,6 +318,8 @@ struct ShadowBatchQueue
     IntRect shadowViewport_;
     /// Shadow caster draw calls.
     BatchQueue shadowBatches_;
+    /// Static shadow caster draw calls. Filled only on frames when the light's static shadow cache must be re-rendered; otherwise they are built on demand if the cache can not be copied.
+    BatchQueue staticShadowBatches_;
     /// Directional light cascade near split distance.
     float nearSplit_;
     /// Directional light cascade far split distance.
@@ -330,6 +335,10 @@ struct LightBatchQueue
     bool negative_;
     /// Shadow map depth texture.
     Texture2D* shadowMap_;
+    /// Region of the shadow map used by the light. Covers the whole texture unless allocated from the shadow atlas.
+    IntRect shadowMapRegion_;
+    /// Static shadow caster cache, or null if not used.
+    ShadowMapCache* shadowCache_;
     /// Lit geometry draw calls, base (replace blend mode)
     BatchQueue litBaseBatches_;
     /// Lit geometry draw calls, non-base (additive)
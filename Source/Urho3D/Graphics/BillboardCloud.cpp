@@ -2,11 +2,63 @@
 #include "BillboardCloud.h"
 
 #include "../Core/Context.h"
+#include "../Graphics/Camera.h"
+#include "../Graphics/Geometry.h"
+#include "../Graphics/IndexBuffer.h"
+#include "../Graphics/VertexBuffer.h"
+#include "../IO/VectorBuffer.h"
+#include "../Scene/Node.h"
 
 namespace Urho3D
 {
 
-BillboardCloud::BillboardCloud(Context* ctx) : BillboardSet(ctx)
+BillboardCloudCache::BillboardCloudCache(Context* context) :
+    Object(context)
+{
+}
+
+SharedPtr<Geometry> BillboardCloudCache::GetGeometry(const PODVector<unsigned char>& key)
+{
+    MutexLock lock(mutex_);
+
+    HashMap<unsigned, Entry>::Iterator i = geometries_.Find(HashKey(key));
+    if (i != geometries_.End() && i->second_.key_ == key)
+        return i->second_.geometry_.Lock();
+    return SharedPtr<Geometry>();
+}
+
+void BillboardCloudCache::StoreGeometry(const PODVector<unsigned char>& key, Geometry* geometry)
+{
+    MutexLock lock(mutex_);
+
+    // Drop geometries no cloud uses anymore. On a hash collision with a live geometry keep the new one private
+    for (HashMap<unsigned, Entry>::Iterator i = geometries_.Begin(); i != geometries_.End();)
+    {
+        if (i->second_.geometry_.Expired())
+            i = geometries_.Erase(i);
+        else
+            ++i;
+    }
+
+    unsigned hash = HashKey(key);
+    if (!geometries_.Contains(hash))
+    {
+        Entry& entry = geometries_[hash];
+        entry.key_ = key;
+        entry.geometry_ = geometry;
+    }
+}
+
+unsigned BillboardCloudCache::HashKey(const PODVector<unsigned char>& key)
+{
+    unsigned hash = 0;
+    for (unsigned i = 0; i < key.Size(); ++i)
+        hash = SDBMHash(hash, key[i]);
+    return hash;
+}
+
+BillboardCloud::BillboardCloud(Context* ctx) : BillboardSet(ctx),
+    gpuSway_(false)
 {
 
 }
@@ -23,6 +75,10 @@ void BillboardCloud::Register(Context* ctx)
 
 void BillboardCloud::Update(const FrameInfo& frame)
 {
+    // The vertex shader animates the billboards in GPU sway mode
+    if (gpuSway_)
+        return;
+
     int seed = seed_;
     for (unsigned i = 0; i < billboards_.Size(); ++i)
     {
@@ -34,6 +90,51 @@ void BillboardCloud::Update(const FrameInfo& frame)
     }
 }
 
+void BillboardCloud::UpdateBatches(const FrameInfo& frame)
+{
+    if (!gpuSway_)
+    {
+        BillboardSet::UpdateBatches(frame);
+        return;
+    }
+
+    // The geometry is static and in model space, so draw it like a static model to let the renderer instance it
+    distance_ = frame.camera_->GetDistance(GetWorldBoundingBox().Center());
+    batches_[0].distance_ = distance_;
+    batches_[0].worldTransform_ = &node_->GetWorldTransform();
+    batches_[0].numWorldTransforms_ = 1;
+}
+
+void BillboardCloud::UpdateGeometry(const FrameInfo& frame)
+{
+    if (!gpuSway_)
+        BillboardSet::UpdateGeometry(frame);
+}
+
+UpdateGeometryType BillboardCloud::GetUpdateGeometryType()
+{
+    return gpuSway_ ? UPDATE_NONE : BillboardSet::GetUpdateGeometryType();
+}
+
+void BillboardCloud::SetGPUSway(bool enable)
+{
+    if (enable == gpuSway_)
+        return;
+
+    gpuSway_ = enable;
+
+    if (gpuSway_)
+        UpdateGPUGeometry();
+    else
+    {
+        gpuGeometry_.Reset();
+        batches_[0].geometry_ = geometry_;
+        batches_[0].worldTransform_ = &transforms_[0];
+        // Restores the billboard geometry type and marks the vertex buffer for rewrite
+        SetGeneratePoints(IsGeneratePoints());
+    }
+}
+
 VariantVector BillboardCloud::GetSpheresAttribute() const
 {
 	VariantVector ret;
@@ -72,6 +173,151 @@ void BillboardCloud::Populate()
         billboards[i].enabled_ = true;
         billboards[i].size_ = Vector2(RandomSeeded(widthRange_.x_, widthRange_.y_, seed), RandomSeeded(heightRange_.x_, heightRange_.y_, seed));
 	}
+
+    if (gpuSway_)
+        UpdateGPUGeometry();
+}
+
+void BillboardCloud::UpdateGPUGeometry()
+{
+    VectorBuffer keyBuffer;
+    GetGeometryKey(keyBuffer);
+    const PODVector<unsigned char>& key = keyBuffer.GetBuffer();
+
+    auto* cache = GetSubsystem<BillboardCloudCache>();
+    if (!cache)
+    {
+        cache = new BillboardCloudCache(context_);
+        context_->RegisterSubsystem(cache);
+    }
+
+    gpuGeometry_ = cache->GetGeometry(key);
+
+    if (!gpuGeometry_)
+    {
+        unsigned numBillboards = 0;
+        for (unsigned i = 0; i < billboards_.Size(); ++i)
+        {
+            if (billboards_[i].enabled_)
+                ++numBillboards;
+        }
+
+        // Center, color, UV, unrotated corner offset and sway parameters (phase, angular speed, amplitude, base rotation)
+        PODVector<VertexElement> elements;
+        elements.Push(VertexElement(TYPE_VECTOR3, SEM_POSITION));
+        elements.Push(VertexElement(TYPE_UBYTE4_NORM, SEM_COLOR));
+        elements.Push(VertexElement(TYPE_VECTOR2, SEM_TEXCOORD, 0));
+        elements.Push(VertexElement(TYPE_VECTOR2, SEM_TEXCOORD, 1));
+        elements.Push(VertexElement(TYPE_VECTOR4, SEM_TANGENT));
+
+        SharedPtr<VertexBuffer> vertexBuffer(new VertexBuffer(context_));
+        SharedPtr<IndexBuffer> indexBuffer(new IndexBuffer(context_));
+        vertexBuffer->SetShadowed(true);
+        indexBuffer->SetShadowed(true);
+        vertexBuffer->SetSize(numBillboards * 4, elements, false);
+        indexBuffer->SetSize(numBillboards * 6, numBillboards * 4 >= 65536, false);
+
+        PODVector<float> vertexData(numBillboards * 4 * vertexBuffer->GetVertexSize() / sizeof(float));
+        PODVector<unsigned char> indexData(numBillboards * 6 * indexBuffer->GetIndexSize());
+        float* dest = vertexData.Buffer();
+        bool largeIndices = indexBuffer->GetIndexSize() == sizeof(unsigned);
+
+        // Match the average rotation speed of the CPU sway, which bounces between -swayMax_ and swayMax_ degrees
+        int seed = seed_;
+        unsigned vertexIndex = 0;
+        unsigned index = 0;
+        for (unsigned i = 0; i < billboards_.Size(); ++i)
+        {
+            const Billboard& billboard = billboards_[i];
+            float speed = Lerp(swayRange_.x_, swayRange_.y_, RandomSeeded(0.0f, 1.0f, seed));
+            if (!billboard.enabled_)
+                continue;
+
+            float amplitude = Abs(swayMax_);
+            float angularSpeed = amplitude > M_EPSILON ? M_PI * Abs(speed) / (2.0f * amplitude) : 0.0f;
+            float phase = amplitude > M_EPSILON ? asinf(Clamp(billboard.rotation_ / amplitude, -1.0f, 1.0f)) : 0.0f;
+            float baseRotation = amplitude > M_EPSILON ? 0.0f : billboard.rotation_ * M_DEGTORAD;
+            unsigned color = billboard.color_.ToUInt();
+
+            const Vector2 corners[4] =
+            {
+                Vector2(-billboard.size_.x_, billboard.size_.y_),
+                Vector2(billboard.size_.x_, billboard.size_.y_),
+                Vector2(billboard.size_.x_, -billboard.size_.y_),
+                Vector2(-billboard.size_.x_, -billboard.size_.y_)
+            };
+            const Vector2 uvs[4] =
+            {
+                Vector2(billboard.uv_.min_.x_, billboard.uv_.min_.y_),
+                Vector2(billboard.uv_.max_.x_, billboard.uv_.min_.y_),
+                Vector2(billboard.uv_.max_.x_, billboard.uv_.max_.y_),
+                Vector2(billboard.uv_.min_.x_, billboard.uv_.max_.y_)
+            };
+
+            for (unsigned j = 0; j < 4; ++j)
+            {
+                dest[0] = billboard.position_.x_;
+                dest[1] = billboard.position_.y_;
+                dest[2] = billboard.position_.z_;
+                ((unsigned&)dest[3]) = color;
+                dest[4] = uvs[j].x_;
+                dest[5] = uvs[j].y_;
+                dest[6] = corners[j].x_;
+                dest[7] = corners[j].y_;
+                dest[8] = phase;
+                dest[9] = angularSpeed;
+                dest[10] = amplitude * M_DEGTORAD;
+                dest[11] = baseRotation;
+                dest += 12;
+            }
+
+            const unsigned quad[6] = { vertexIndex, vertexIndex + 1, vertexIndex + 2, vertexIndex + 2, vertexIndex + 3, vertexIndex };
+            for (unsigned j = 0; j < 6; ++j)
+            {
+                if (largeIndices)
+                    ((unsigned*)indexData.Buffer())[index++] = quad[j];
+                else
+                    ((unsigned short*)indexData.Buffer())[index++] = (unsigned short)quad[j];
+            }
+            vertexIndex += 4;
+        }
+
+        if (numBillboards)
+        {
+            vertexBuffer->SetData(vertexData.Buffer());
+            indexBuffer->SetData(indexData.Buffer());
+        }
+
+        gpuGeometry_ = new Geometry(context_);
+        gpuGeometry_->SetVertexBuffer(0, vertexBuffer);
+        gpuGeometry_->SetIndexBuffer(indexBuffer);
+        gpuGeometry_->SetDrawRange(TRIANGLE_LIST, 0, numBillboards * 6, false);
+        cache->StoreGeometry(key, gpuGeometry_);
+    }
+
+    batches_[0].geometry_ = gpuGeometry_;
+    batches_[0].geometryType_ = GEOM_STATIC;
+    OnMarkedDirty(node_);
+}
+
+void BillboardCloud::GetGeometryKey(VectorBuffer& dest) const
+{
+    dest.WriteUInt(seed_);
+    dest.WriteVector2(swayRange_);
+    dest.WriteFloat(swayMax_);
+    dest.WriteVLE(billboards_.Size());
+    for (unsigned i = 0; i < billboards_.Size(); ++i)
+    {
+        const Billboard& billboard = billboards_[i];
+        dest.WriteBool(billboard.enabled_);
+        if (!billboard.enabled_)
+            continue;
+        dest.WriteVector3(billboard.position_);
+        dest.WriteVector2(billboard.size_);
+        dest.WriteRect(billboard.uv_);
+        dest.WriteColor(billboard.color_);
+        dest.WriteFloat(billboard.rotation_);
+    }
 }
 
 }
\ No newline at end of file
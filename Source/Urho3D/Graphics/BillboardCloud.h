@@ -1,11 +1,47 @@
 #pragma once
 
+#include <Urho3D/Core/Mutex.h>
 #include <Urho3D/Graphics/BillboardSet.h>
 #include <Urho3D/Math/Sphere.h>
 
 namespace Urho3D
 {
-    
+
+class Geometry;
+
+/// Subsystem holding the static GPU sway geometries, so that clouds with the same billboards share one. Created by the first
+/// cloud that enters GPU sway mode.
+class URHO3D_API BillboardCloudCache : public Object
+{
+    URHO3D_OBJECT(BillboardCloudCache, Object);
+public:
+    /// Construct.
+    explicit BillboardCloudCache(Context* context);
+
+    /// Return the live geometry built for a key, or null.
+    SharedPtr<Geometry> GetGeometry(const PODVector<unsigned char>& key);
+    /// Store a geometry built for a key, unless a live one is already stored for the same hash. Drops expired geometries.
+    void StoreGeometry(const PODVector<unsigned char>& key, Geometry* geometry);
+
+private:
+    /// Return hash of a key.
+    static unsigned HashKey(const PODVector<unsigned char>& key);
+
+    /// Geometry shared between clouds.
+    struct Entry
+    {
+        /// Billboard and sway parameters the geometry was built from.
+        PODVector<unsigned char> key_;
+        /// Geometry. Expires when no cloud uses it.
+        WeakPtr<Geometry> geometry_;
+    };
+
+    /// Geometries by key hash.
+    HashMap<unsigned, Entry> geometries_;
+    /// Mutex for clouds updated from several threads.
+    Mutex mutex_;
+};
+
 class URHO3D_API BillboardCloud : public BillboardSet
 {
     URHO3D_OBJECT(BillboardCloud, BillboardSet);
@@ -15,6 +51,19 @@ public:
     static void Register(Context*);
     
     void Update(const FrameInfo& frame) override;
+    /// Calculate distance and prepare batches for rendering. May be called from worker thread(s), possibly re-entrantly.
+    void UpdateBatches(const FrameInfo& frame) override;
+    /// Prepare geometry for rendering. Nothing to do in GPU sway mode.
+    void UpdateGeometry(const FrameInfo& frame) override;
+    /// Return whether a geometry update is necessary, and if it can happen in a worker thread.
+    UpdateGeometryType GetUpdateGeometryType() override;
+
+    /// Set whether sway and camera facing are evaluated in the vertex shader. The billboards are then uploaded once into a
+    /// static buffer shared by all clouds with the same population parameters, and clouds sharing a material draw as
+    /// instances. Requires a material whose passes define SWAYBILLBOARD for the vertex shader. Default false.
+    void SetGPUSway(bool enable);
+    /// Return whether sway is evaluated in the vertex shader.
+    bool IsGPUSway() const { return gpuSway_; }
     
     unsigned GetSeed() const { return seed_; }
     void SetSeed(unsigned seed) { seed_ = seed; Populate(); }
@@ -35,6 +84,10 @@ public:
     
 private:
     void Populate();
+    /// Find or build the static GPU sway geometry for the current population parameters.
+    void UpdateGPUGeometry();
+    /// Write the billboard and sway parameters that determine the GPU sway geometry.
+    void GetGeometryKey(VectorBuffer& dest) const;
 
     PODVector<Rect> uvSets_;
     PODVector<Sphere> spheres_;
@@ -45,6 +98,10 @@ private:
     Vector2 widthRange_;
     Vector2 heightRange_;
     float swayMax_;
+    /// GPU sway mode flag.
+    bool gpuSway_;
+    /// Static geometry used in GPU sway mode. Shared with other clouds that have the same billboards.
+    SharedPtr<Geometry> gpuGeometry_;
 };
     
 }
\ No newline at end of file
@@ -24,6 +24,7 @@
 
 #include "../Core/Context.h"
 #include "../Core/Profiler.h"
+#include "../Core/Thread.h"
 #include "../Graphics/Batch.h"
 #include "../Graphics/BillboardSet.h"
 #include "../Graphics/Camera.h"
@@ -70,10 +71,14 @@ static const StringVector billboardsStructureElementNames =
     "   Is Enabled"
 };
 
-inline bool CompareBillboards(Billboard* lhs, Billboard* rhs)
-{
-    return lhs->sortDistance_ > rhs->sortDistance_;
-}
+/// Camera movement relative to distance under which the previous sort order is refined with an insertion sort.
+static const float SORT_COHERENCE_THRESHOLD = 0.05f;
+/// Average insertion sort moves per billboard before falling back to a full radix sort.
+static const unsigned MAX_INSERTION_SORT_MOVES = 8;
+/// Bits per radix sort pass. Two passes sort the quantized depth.
+static const unsigned SORT_RADIX_BITS = 11;
+static const unsigned SORT_RADIX_SIZE = 1u << SORT_RADIX_BITS;
+static const unsigned SORT_KEY_MAX = (1u << (SORT_RADIX_BITS * 2)) - 1;
 
 BillboardSet::BillboardSet(Context* context) :
     Drawable(context, DRAWABLE_GEOMETRY),
@@ -89,7 +94,10 @@ BillboardSet::BillboardSet(Context* context) :
     vertexBuffer_(new VertexBuffer(context_)),
     indexBuffer_(new IndexBuffer(context_)),
     bufferSizeDirty_(true),
+    stagedVertexCount_(0),
+    stagedDrawCount_(0),
     bufferDirty_(true),
+    vertexUploadPending_(false),
     forceUpdate_(false),
     geometryTypeUpdate_(false),
     sortThisFrame_(false),
@@ -243,14 +251,30 @@ void BillboardSet::UpdateGeometry(const FrameInfo& frame)
 
     if (bufferDirty_ || sortThisFrame_ || vertexBuffer_->IsDataLost())
         UpdateVertexBuffer(frame);
+
+    // If updating in the main thread, there will be no separate commit
+    if (vertexUploadPending_ && Thread::IsMainThread())
+        CommitVertexBuffer();
+}
+
+void BillboardSet::CommitGeometry(const FrameInfo& frame)
+{
+    if (vertexUploadPending_)
+        CommitVertexBuffer();
 }
 
 UpdateGeometryType BillboardSet::GetUpdateGeometryType()
 {
-    // If using camera facing, always need some kind of geometry update, in case the billboard set is rendered from several views
-    if (bufferDirty_ || bufferSizeDirty_ || vertexBuffer_->IsDataLost() || indexBuffer_->IsDataLost() || sortThisFrame_ ||
-        faceCameraMode_ != FC_NONE || fixedScreenSize_)
+    // Resizing the buffers and rewriting the indices need the main thread. Vertex data can be written in a worker thread and
+    // uploaded afterward
+    if (bufferSizeDirty_ || indexBuffer_->IsDataLost())
         return UPDATE_MAIN_THREAD;
+    // Fixed screen size may dirty the vertex data during the geometry update when rendered from several views
+    else if (bufferDirty_ || vertexBuffer_->IsDataLost() || sortThisFrame_ || vertexUploadPending_ || fixedScreenSize_)
+        return UPDATE_WORKER_THREAD_STAGED;
+    // If using camera facing, always need some kind of geometry update, in case the billboard set is rendered from several views
+    else if (faceCameraMode_ != FC_NONE)
+        return UPDATE_WORKER_THREAD;
     else
         return UPDATE_NONE;
 }
@@ -672,43 +696,35 @@ void BillboardSet::UpdateVertexBuffer(const FrameInfo& frame)
             ++enabledBillboards;
     }
 
-    sortedBillboards_.Resize(enabledBillboards);
-    unsigned index = 0;
-
-    // Then set initial sort order and distances
-    for (unsigned i = 0; i < numBillboards; ++i)
+    // Then set the drawing order, sorted back to front if necessary
+    if (sorted_)
+        SortBillboards(frame, billboardTransform, enabledBillboards);
+    else
     {
-        Billboard& billboard = billboards_[i];
-        if (billboard.enabled_)
+        sortedBillboards_.Resize(enabledBillboards);
+        unsigned index = 0;
+        for (unsigned i = 0; i < numBillboards; ++i)
         {
-            sortedBillboards_[index++] = &billboard;
-            if (sorted_)
-                billboard.sortDistance_ = frame.camera_->GetDistanceSquared(billboardTransform * billboards_[i].position_);
+            if (billboards_[i].enabled_)
+                sortedBillboards_[index++] = i;
         }
     }
 
-    if (generatePoints_)
-        batches_[0].geometry_->SetDrawRange(POINT_LIST, 0, enabledBillboards, false);
-    else
-        batches_[0].geometry_->SetDrawRange(TRIANGLE_LIST, 0, enabledBillboards * 6, false);
-
+    // The draw range is applied with the upload, as the geometry may only be changed in the main thread
     bufferDirty_ = false;
     forceUpdate_ = false;
+    stagedDrawCount_ = enabledBillboards * (generatePoints_ ? 1 : 6);
+    vertexUploadPending_ = true;
     if (!enabledBillboards)
-        return;
-
-    if (sorted_)
     {
-        Sort(sortedBillboards_.Begin(), sortedBillboards_.End(), CompareBillboards);
-        Vector3 worldPos = node_->GetWorldPosition();
-        // Store the "last sorted position" now
-        previousOffset_ = (worldPos - frame.camera_->GetNode()->GetWorldPosition());
+        stagedVertexCount_ = 0;
+        return;
     }
 
     const unsigned vertexCt = enabledBillboards * (generatePoints_ ? 1 : 4);
-    auto* dest = (float*)vertexBuffer_->Lock(0, vertexCt, true);
-    if (!dest)
-        return;
+    vertexStaging_.Resize(vertexCt * vertexBuffer_->GetVertexSize() / sizeof(float));
+    stagedVertexCount_ = vertexCt;
+    float* dest = &vertexStaging_[0];
 
     if (generatePoints_)
     {
@@ -716,7 +732,7 @@ void BillboardSet::UpdateVertexBuffer(const FrameInfo& frame)
         {
             for (unsigned i = 0; i < enabledBillboards; ++i)
             {
-                Billboard& billboard = *sortedBillboards_[i];
+                const Billboard& billboard = billboards_[sortedBillboards_[i]];
 
                 Vector2 size(billboard.size_.x_ * billboardScale.x_, billboard.size_.y_ * billboardScale.y_);
                 unsigned color = billboard.color_.ToUInt();
@@ -745,7 +761,7 @@ void BillboardSet::UpdateVertexBuffer(const FrameInfo& frame)
         {
             for (unsigned i = 0; i < enabledBillboards; ++i)
             {
-                Billboard& billboard = *sortedBillboards_[i];
+                const Billboard& billboard = billboards_[sortedBillboards_[i]];
 
                 Vector2 size(billboard.size_.x_ * billboardScale.x_, billboard.size_.y_ * billboardScale.y_);
                 unsigned color = billboard.color_.ToUInt();
@@ -780,7 +796,7 @@ void BillboardSet::UpdateVertexBuffer(const FrameInfo& frame)
         {
             for (unsigned i = 0; i < enabledBillboards; ++i)
             {
-                Billboard& billboard = *sortedBillboards_[i];
+                const Billboard& billboard = billboards_[sortedBillboards_[i]];
 
                 Vector2 size(billboard.size_.x_ * billboardScale.x_, billboard.size_.y_ * billboardScale.y_);
                 unsigned color = billboard.color_.ToUInt();
@@ -835,7 +851,7 @@ void BillboardSet::UpdateVertexBuffer(const FrameInfo& frame)
         {
             for (unsigned i = 0; i < enabledBillboards; ++i)
             {
-                Billboard& billboard = *sortedBillboards_[i];
+                const Billboard& billboard = billboards_[sortedBillboards_[i]];
 
                 Vector2 size(billboard.size_.x_ * billboardScale.x_, billboard.size_.y_ * billboardScale.y_);
                 unsigned color = billboard.color_.ToUInt();
@@ -899,9 +915,157 @@ void BillboardSet::UpdateVertexBuffer(const FrameInfo& frame)
             }
         }
     }
+}
+
+void BillboardSet::SortBillboards(const FrameInfo& frame, const Matrix3x4& billboardTransform, unsigned enabledBillboards)
+{
+    URHO3D_PROFILE(SortBillboards);
+
+    unsigned numBillboards = billboards_.Size();
+    Vector3 offset = node_->GetWorldPosition() - frame.camera_->GetNode()->GetWorldPosition();
+
+    // If the camera has barely moved, the previous order is nearly sorted and can be refined. It is valid only if it still
+    // covers exactly the enabled billboards
+    bool coherent = sortedBillboards_.Size() == enabledBillboards &&
+        (offset - previousOffset_).Length() <= distance_ * SORT_COHERENCE_THRESHOLD;
+    for (unsigned i = 0; coherent && i < enabledBillboards; ++i)
+    {
+        unsigned index = sortedBillboards_[i];
+        if (index >= numBillboards || !billboards_[index].enabled_)
+            coherent = false;
+    }
+
+    if (!coherent)
+    {
+        sortedBillboards_.Resize(enabledBillboards);
+        unsigned index = 0;
+        for (unsigned i = 0; i < numBillboards; ++i)
+        {
+            if (billboards_[i].enabled_)
+                sortedBillboards_[index++] = i;
+        }
+    }
+
+    // Store the "last sorted position" now
+    previousOffset_ = offset;
+
+    // Calculate distances in the current order
+    sortDistances_.Resize(enabledBillboards);
+    float minDistance = M_INFINITY;
+    float maxDistance = 0.0f;
+    for (unsigned i = 0; i < enabledBillboards; ++i)
+    {
+        Billboard& billboard = billboards_[sortedBillboards_[i]];
+        float distance = frame.camera_->GetDistanceSquared(billboardTransform * billboard.position_);
+        billboard.sortDistance_ = distance;
+        sortDistances_[i] = distance;
+        minDistance = Min(minDistance, distance);
+        maxDistance = Max(maxDistance, distance);
+    }
+
+    if (coherent)
+    {
+        // Insertion sort back to front, giving up if the order has changed too much
+        unsigned moves = 0;
+        unsigned maxMoves = enabledBillboards * MAX_INSERTION_SORT_MOVES;
+        for (unsigned i = 1; i < enabledBillboards && moves <= maxMoves; ++i)
+        {
+            float distance = sortDistances_[i];
+            unsigned index = sortedBillboards_[i];
+            unsigned j = i;
+            while (j > 0 && sortDistances_[j - 1] < distance)
+            {
+                sortDistances_[j] = sortDistances_[j - 1];
+                sortedBillboards_[j] = sortedBillboards_[j - 1];
+                --j;
+            }
+            sortDistances_[j] = distance;
+            sortedBillboards_[j] = index;
+            moves += i - j;
+        }
+
+        if (moves <= maxMoves)
+            return;
+    }
+
+    // Radix sort on quantized depth, inverted so that the farthest billboards come first. The sort is stable, so billboards at
+    // equal quantized depth keep their previous relative order
+    float range = maxDistance - minDistance;
+    float scale = range > 0.0f ? (float)SORT_KEY_MAX / range : 0.0f;
+    sortKeys_.Resize(enabledBillboards);
+    sortScratch_.Resize(enabledBillboards * 2);
+    for (unsigned i = 0; i < enabledBillboards; ++i)
+        sortKeys_[i] = SORT_KEY_MAX - Min((unsigned)((sortDistances_[i] - minDistance) * scale), SORT_KEY_MAX);
+
+    unsigned* srcKeys = &sortKeys_[0];
+    unsigned* srcIndices = &sortedBillboards_[0];
+    unsigned* destKeys = &sortScratch_[0];
+    unsigned* destIndices = &sortScratch_[enabledBillboards];
+    unsigned offsets[SORT_RADIX_SIZE];
+
+    for (unsigned pass = 0; pass < 2; ++pass)
+    {
+        unsigned shift = pass * SORT_RADIX_BITS;
+
+        memset(offsets, 0, sizeof offsets);
+        for (unsigned i = 0; i < enabledBillboards; ++i)
+            ++offsets[(srcKeys[i] >> shift) & (SORT_RADIX_SIZE - 1)];
+
+        unsigned total = 0;
+        for (unsigned i = 0; i < SORT_RADIX_SIZE; ++i)
+        {
+            unsigned count = offsets[i];
+            offsets[i] = total;
+            total += count;
+        }
+
+        for (unsigned i = 0; i < enabledBillboards; ++i)
+        {
+            unsigned dest = offsets[(srcKeys[i] >> shift) & (SORT_RADIX_SIZE - 1)]++;
+            destKeys[dest] = srcKeys[i];
+            destIndices[dest] = srcIndices[i];
+        }
 
-    vertexBuffer_->Unlock();
+        // After an even number of passes the result is back in the original arrays
+        Swap(srcKeys, destKeys);
+        Swap(srcIndices, destIndices);
+    }
+}
+
+void BillboardSet::CommitVertexBuffer()
+{
+    PrimitiveType type = generatePoints_ ? POINT_LIST : TRIANGLE_LIST;
+    if (!stagedVertexCount_)
+        batches_[0].geometry_->SetDrawRange(type, 0, 0, false);
+    else if (vertexBuffer_->SetDataRange(&vertexStaging_[0], 0, stagedVertexCount_, true))
+    {
+        vertexBuffer_->ClearDataLost();
+        // Keep drawing the previous range if the upload failed, as it matches the data still in the buffer
+        batches_[0].geometry_->SetDrawRange(type, 0, stagedDrawCount_, false);
+    }
+
+    vertexUploadPending_ = false;
+}
+
+VertexBuffer* BillboardSet::PrepareGPUVertexBuffer()
+{
+    if (bufferSizeDirty_ || indexBuffer_->IsDataLost())
+        UpdateBufferSize();
+
+    // Compute shaders can not write to a dynamic buffer. Flag the geometry type so that the CPU path recreates it if used again
+    unsigned vertexCount = billboards_.Size() * 4;
+    if (vertexBuffer_->IsDynamic() || vertexBuffer_->GetVertexCount() != vertexCount)
+    {
+        vertexBuffer_->SetSize(vertexCount, MASK_POSITION | MASK_COLOR | MASK_TEXCOORD1 | MASK_TEXCOORD2, false);
+        geometry_->SetVertexBuffer(0, vertexBuffer_);
+        geometryTypeUpdate_ = true;
+    }
+
+    geometry_->SetDrawRange(TRIANGLE_LIST, 0, billboards_.Size() * 6, false);
+    vertexUploadPending_ = false;
     vertexBuffer_->ClearDataLost();
+
+    return vertexBuffer_;
 }
 
 void BillboardSet::MarkPositionsDirty()
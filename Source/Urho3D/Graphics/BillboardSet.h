@@ -76,6 +76,8 @@ public:
     void UpdateBatches(const FrameInfo& frame) override;
     /// Prepare geometry for rendering. Called from a worker thread if possible (no GPU update.)
     void UpdateGeometry(const FrameInfo& frame) override;
+    /// Upload the vertex data prepared by UpdateGeometry(). Called from the main thread.
+    void CommitGeometry(const FrameInfo& frame) override;
     /// Return whether a geometry update is necessary, and if it can happen in a worker thread.
     UpdateGeometryType GetUpdateGeometryType() override;
 
@@ -158,6 +160,9 @@ protected:
     void OnWorldBoundingBoxUpdate() override;
     /// Mark billboard vertex buffer to need an update.
     void MarkPositionsDirty();
+    /// Prepare the buffers for quad vertex data written on the GPU instead of from the billboards, and return the vertex
+    /// buffer. All billboard slots are drawn. Must be called from the main thread.
+    VertexBuffer* PrepareGPUVertexBuffer();
 
     /// Billboards.
     PODVector<Billboard> billboards_;
@@ -177,27 +182,39 @@ protected:
     FaceCameraMode faceCameraMode_;
     /// Minimal angle between billboard normal and look-at direction.
     float minAngle_;
+    /// Geometry.
+    SharedPtr<Geometry> geometry_;
+    /// Transform matrices for position and billboard orientation.
+    Matrix3x4 transforms_[2];
 
 private:
     /// Resize billboard vertex and index buffers.
     void UpdateBufferSize();
-    /// Rewrite billboard vertex buffer.
+    /// Rewrite billboard vertex data into the staging buffer.
     void UpdateVertexBuffer(const FrameInfo& frame);
+    /// Sort enabled billboards back to front into sortedBillboards_.
+    void SortBillboards(const FrameInfo& frame, const Matrix3x4& billboardTransform, unsigned enabledBillboards);
+    /// Upload the staging buffer to the vertex buffer and apply the staged draw range. Must be called from the main thread.
+    void CommitVertexBuffer();
     /// Calculate billboard scale factors in fixed screen size mode.
     void CalculateFixedScreenSize(const FrameInfo& frame);
 
-    /// Geometry.
-    SharedPtr<Geometry> geometry_;
     /// Vertex buffer.
     SharedPtr<VertexBuffer> vertexBuffer_;
     /// Index buffer.
     SharedPtr<IndexBuffer> indexBuffer_;
-    /// Transform matrices for position and billboard orientation.
-    Matrix3x4 transforms_[2];
     /// Buffers need resize flag.
     bool bufferSizeDirty_;
+    /// Vertex data written in UpdateGeometry() and uploaded in the main thread.
+    PODVector<float> vertexStaging_;
+    /// Number of vertices in the staging buffer.
+    unsigned stagedVertexCount_;
+    /// Number of indices, or points in point mode, to draw once the staging buffer is uploaded.
+    unsigned stagedDrawCount_;
     /// Vertex buffer needs rewrite flag.
     bool bufferDirty_;
+    /// Staging buffer waiting for upload flag.
+    bool vertexUploadPending_;
     /// Force update flag (ignore animation LOD momentarily.)
     bool forceUpdate_;
     /// Update billboard geometry type
@@ -212,8 +229,14 @@ private:
     unsigned sortFrameNumber_;
     /// Previous offset to camera for determining whether sorting is necessary.
     Vector3 previousOffset_;
-    /// Billboard pointers for sorting.
-    Vector<Billboard*> sortedBillboards_;
+    /// Indices of enabled billboards in drawing order. Kept between updates so that a nearly unchanged order can be refined.
+    PODVector<unsigned> sortedBillboards_;
+    /// Distances to camera in drawing order for sorting.
+    PODVector<float> sortDistances_;
+    /// Quantized depth keys for sorting.
+    PODVector<unsigned> sortKeys_;
+    /// Scratch space for radix sort passes.
+    PODVector<unsigned> sortScratch_;
     /// Attribute buffer for network replication.
     mutable VectorBuffer attrBuffer_;
 };
@@ -57,6 +57,8 @@ public:
     bool SetSize(unsigned bytes, unsigned structureSize);
     /// Sets the data if possible.
     bool SetData(void* data, unsigned dataSize, unsigned structureSize);
+    /// Sets a byte range of the data without resizing the buffer.
+    bool SetDataRange(const void* data, unsigned offset, unsigned dataSize);
     /// Gets the data from the GPU.
     bool GetData(void* writeInto, unsigned offset, unsigned lengthOfRead);
 
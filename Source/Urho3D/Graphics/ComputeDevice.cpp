@@ -93,6 +93,13 @@ bool ComputeDevice::SetWriteBuffer(ComputeBuffer* buffer, unsigned unit)
     return SetWritableBuffer(buffer, unit);
 }
 
+void ComputeDevice::ClearWriteBuffers()
+{
+    for (unsigned i = 0; i < MAX_COMPUTE_WRITE_TARGETS; ++i)
+        SetWritableBuffer(nullptr, i);
+    ApplyBindings();
+}
+
 }
 
 #endif
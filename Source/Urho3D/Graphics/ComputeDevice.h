@@ -87,6 +87,8 @@ public:
     void Dispatch(unsigned xDim, unsigned yDim, unsigned zDim);
     /// Dispatches the compute call by # of groups, will queue a barrier as needed.
     void DispatchByGroup(unsigned xDim, unsigned yDim, unsigned zDim);
+    /// Unbinds all write buffers immediately, so that a buffer written by compute can be bound for drawing.
+    void ClearWriteBuffers();
 
 private:
     /// Setup necessary initial member state.
@@ -24,6 +24,8 @@
 
 #include "../Core/Context.h"
 #include "../Core/Profiler.h"
+#include "../Core/Timer.h"
+#include "../Core/WorkQueue.h"
 #include "../Graphics/AnimatedModel.h"
 #include "../Graphics/Batch.h"
 #include "../Graphics/Camera.h"
@@ -33,6 +35,7 @@
 #include "../Graphics/IndexBuffer.h"
 #include "../Graphics/Material.h"
 #include "../Graphics/Tangent.h"
+#include "../Graphics/TriangleBVH.h"
 #include "../Graphics/VertexBuffer.h"
 #include "../IO/Log.h"
 #include "../IO/MemoryBuffer.h"
@@ -60,6 +63,232 @@ static const unsigned STATIC_ELEMENT_MASK = MASK_POSITION | MASK_NORMAL | MASK_T
 static const unsigned SKINNED_ELEMENT_MASK = MASK_POSITION | MASK_NORMAL | MASK_TEXCOORD1 | MASK_TANGENT | MASK_BLENDWEIGHTS |
                                              MASK_BLENDINDICES;
 
+/// Triangle source data of one target geometry.
+struct DecalSourceGeometry
+{
+    /// Fetch the triangle hierarchy of the geometry, building it if not built yet. The hierarchy holds vertex indices, which
+    /// are shared by all vertex buffers of the geometry.
+    void GetTriangleBVH()
+    {
+        bvh_ = geometry_->GetTriangleBVH();
+    }
+
+    /// Return vertex index triples of the triangles that may intersect a frustum.
+    void GetTriangles(PODVector<unsigned>& dest, const Frustum& frustum) const
+    {
+        dest.Clear();
+        if (bvh_)
+        {
+            bvh_->GetTriangles(dest, frustum);
+            return;
+        }
+
+        dest.Resize(count_ / 3 * 3);
+        for (unsigned i = 0; i < dest.Size(); i += 3)
+            GetTriangle(i, dest[i], dest[i + 1], dest[i + 2]);
+    }
+
+    /// Return vertex indices of a triangle by its first index or vertex.
+    void GetTriangle(unsigned i, unsigned& i0, unsigned& i1, unsigned& i2) const
+    {
+        if (!indexData_)
+        {
+            i0 = start_ + i;
+            i1 = i0 + 1;
+            i2 = i0 + 2;
+        }
+        else if (indexStride_ == sizeof(unsigned short))
+        {
+            const unsigned short* indices = ((const unsigned short*)indexData_) + start_ + i;
+            i0 = indices[0];
+            i1 = indices[1];
+            i2 = indices[2];
+        }
+        else
+        {
+            const unsigned* indices = ((const unsigned*)indexData_) + start_ + i;
+            i0 = indices[0];
+            i1 = indices[1];
+            i2 = indices[2];
+        }
+    }
+
+    /// Geometry, held to keep the vertex data alive.
+    SharedPtr<Geometry> geometry_;
+    /// Triangle hierarchy of the geometry, or null to test all triangles. Fetched by GetTriangleBVH.
+    SharedPtr<TriangleBVH> bvh_;
+    /// Position data.
+    const unsigned char* positionData_;
+    /// Normal data, or null to use face normals.
+    const unsigned char* normalData_;
+    /// Blend weight and index data, or null.
+    const unsigned char* skinningData_;
+    /// Index data, or null for non-indexed geometry.
+    const unsigned char* indexData_;
+    /// Position stride.
+    unsigned positionStride_;
+    /// Normal stride.
+    unsigned normalStride_;
+    /// Skinning stride.
+    unsigned skinningStride_;
+    /// Index size.
+    unsigned indexStride_;
+    /// First index, or first vertex for non-indexed geometry.
+    unsigned start_;
+    /// Number of indices or vertices.
+    unsigned count_;
+};
+
+/// Decal queued for projection in a worker thread.
+struct DecalJob : public RefCounted
+{
+    /// Decal set that queued the decal.
+    DecalSet* decalSet_;
+    /// Handle returned to the caller.
+    unsigned handle_;
+    /// Work item.
+    SharedPtr<WorkItem> item_;
+    /// Target geometries.
+    Vector<DecalSourceGeometry> sources_;
+    /// Decal frustum in target space.
+    Frustum frustum_;
+    /// Bounding box of the frustum for rejecting triangles.
+    BoundingBox frustumBox_;
+    /// Decal frustum transform in target space.
+    Matrix3x4 frustumTransform_;
+    /// Decal projection for calculating UVs.
+    Matrix4 projection_;
+    /// Transform from target space to the decal set's space.
+    Matrix3x4 decalTransform_;
+    /// Decal normal in target space.
+    Vector3 decalNormal_;
+    /// Top-left UV.
+    Vector2 topLeftUV_;
+    /// Bottom-right UV.
+    Vector2 bottomRightUV_;
+    /// Minimum dot product of face and decal normals.
+    float normalCutoff_;
+    /// Vertex limit of the decal set when queued.
+    unsigned maxVertices_;
+    /// Resulting decal.
+    Decal decal_;
+    /// Vertex limit exceeded flag.
+    bool overflow_;
+};
+
+static bool GetSourceGeometry(Geometry* geometry, DecalSourceGeometry& source)
+{
+    if (!geometry || geometry->GetPrimitiveType() != TRIANGLE_LIST)
+        return false;
+
+    source.geometry_ = geometry;
+    source.positionData_ = nullptr;
+    source.normalData_ = nullptr;
+    source.skinningData_ = nullptr;
+    source.indexData_ = nullptr;
+    source.positionStride_ = 0;
+    source.normalStride_ = 0;
+    source.skinningStride_ = 0;
+    source.indexStride_ = 0;
+
+    IndexBuffer* ib = geometry->GetIndexBuffer();
+    if (ib)
+    {
+        source.indexData_ = ib->GetShadowData();
+        source.indexStride_ = ib->GetIndexSize();
+    }
+
+    // For morphed models positions, normals and skinning may be in different buffers
+    for (unsigned i = 0; i < geometry->GetNumVertexBuffers(); ++i)
+    {
+        VertexBuffer* vb = geometry->GetVertexBuffer(i);
+        if (!vb)
+            continue;
+
+        unsigned elementMask = vb->GetElementMask();
+        unsigned char* data = vb->GetShadowData();
+        if (!data)
+            continue;
+
+        if (elementMask & MASK_POSITION)
+        {
+            source.positionData_ = data;
+            source.positionStride_ = vb->GetVertexSize();
+        }
+        if (elementMask & MASK_NORMAL)
+        {
+            source.normalData_ = data + vb->GetElementOffset(SEM_NORMAL);
+            source.normalStride_ = vb->GetVertexSize();
+        }
+        if (elementMask & MASK_BLENDWEIGHTS)
+        {
+            source.skinningData_ = data + vb->GetElementOffset(SEM_BLENDWEIGHTS);
+            source.skinningStride_ = vb->GetVertexSize();
+        }
+    }
+
+    // Positions and indices are needed
+    if (!source.positionData_)
+    {
+        // As a fallback, try to get the geometry's raw vertex/index data
+        const PODVector<VertexElement>* elements;
+        geometry->GetRawData(source.positionData_, source.positionStride_, source.indexData_, source.indexStride_, elements);
+        if (!source.positionData_)
+        {
+            URHO3D_LOGWARNING("Can not add decal, target drawable has no CPU-side geometry data");
+            return false;
+        }
+    }
+
+    if (source.indexData_)
+    {
+        source.start_ = geometry->GetIndexStart();
+        source.count_ = geometry->GetIndexCount();
+    }
+    else
+    {
+        source.start_ = geometry->GetVertexStart();
+        source.count_ = geometry->GetVertexCount();
+    }
+
+    return true;
+}
+
+static void WriteDecalVertex(float*& dest, const DecalVertex& vertex, bool skinned)
+{
+    *dest++ = vertex.position_.x_;
+    *dest++ = vertex.position_.y_;
+    *dest++ = vertex.position_.z_;
+    *dest++ = vertex.normal_.x_;
+    *dest++ = vertex.normal_.y_;
+    *dest++ = vertex.normal_.z_;
+    *dest++ = vertex.texCoord_.x_;
+    *dest++ = vertex.texCoord_.y_;
+    *dest++ = vertex.tangent_.x_;
+    *dest++ = vertex.tangent_.y_;
+    *dest++ = vertex.tangent_.z_;
+    *dest++ = vertex.tangent_.w_;
+    if (skinned)
+    {
+        *dest++ = vertex.blendWeights_[0];
+        *dest++ = vertex.blendWeights_[1];
+        *dest++ = vertex.blendWeights_[2];
+        *dest++ = vertex.blendWeights_[3];
+        *dest++ = *((float*)vertex.blendIndices_);
+    }
+}
+
+static bool RangesOverlap(unsigned start1, unsigned count1, unsigned start2, unsigned count2)
+{
+    return start1 != M_MAX_UNSIGNED && start1 < start2 + count2 && start2 < start1 + count1;
+}
+
+static void MergeDirtyRange(unsigned& dirtyStart, unsigned& dirtyEnd, unsigned start, unsigned count)
+{
+    dirtyStart = Min(dirtyStart, start);
+    dirtyEnd = Max(dirtyEnd, start + count);
+}
+
 static DecalVertex ClipEdge(const DecalVertex& v0, const DecalVertex& v1, float d0, float d1, bool skinned)
 {
     DecalVertex ret;
@@ -128,6 +357,108 @@ static void ClipPolygon(PODVector<DecalVertex>& dest, const PODVector<DecalVerte
         dest.Push(ClipEdge(src[last], src[0], lastDistance, distance, skinned));
 }
 
+void ProjectDecalWork(const WorkItem* item, unsigned threadIndex)
+{
+    auto* job = reinterpret_cast<DecalJob*>(item->aux_);
+    Decal& decal = job->decal_;
+    const Frustum& frustum = job->frustum_;
+
+    // Clip each face in two scratch buffers instead of allocating per face
+    PODVector<DecalVertex> face;
+    PODVector<DecalVertex> clipped;
+    PODVector<unsigned> triangles;
+    face.Reserve(3 + NUM_FRUSTUM_PLANES);
+    clipped.Reserve(3 + NUM_FRUSTUM_PLANES);
+
+    for (DecalSourceGeometry& source : job->sources_)
+    {
+        // A hierarchy that is not built yet is built here rather than on the main thread when the decal was queued
+        source.GetTriangleBVH();
+        source.GetTriangles(triangles, frustum);
+
+        for (unsigned i = 0; i + 2 < triangles.Size(); i += 3)
+        {
+            const unsigned i0 = triangles[i];
+            const unsigned i1 = triangles[i + 1];
+            const unsigned i2 = triangles[i + 2];
+
+            const Vector3& v0 = *((const Vector3*)(&source.positionData_[i0 * source.positionStride_]));
+            const Vector3& v1 = *((const Vector3*)(&source.positionData_[i1 * source.positionStride_]));
+            const Vector3& v2 = *((const Vector3*)(&source.positionData_[i2 * source.positionStride_]));
+
+            // Cheap rejection of triangles outside the frustum's bounding box before the plane tests
+            const Vector3 triMin(Min(Min(v0.x_, v1.x_), v2.x_), Min(Min(v0.y_, v1.y_), v2.y_), Min(Min(v0.z_, v1.z_), v2.z_));
+            const Vector3 triMax(Max(Max(v0.x_, v1.x_), v2.x_), Max(Max(v0.y_, v1.y_), v2.y_), Max(Max(v0.z_, v1.z_), v2.z_));
+            if (job->frustumBox_.IsInside(BoundingBox(triMin, triMax)) == OUTSIDE)
+                continue;
+
+            Vector3 n0, n1, n2;
+            if (source.normalData_)
+            {
+                n0 = *((const Vector3*)(&source.normalData_[i0 * source.normalStride_]));
+                n1 = *((const Vector3*)(&source.normalData_[i1 * source.normalStride_]));
+                n2 = *((const Vector3*)(&source.normalData_[i2 * source.normalStride_]));
+            }
+            else
+                n0 = n1 = n2 = (v1 - v0).CrossProduct(v2 - v0).Normalized();
+
+            // Check if face is too much away from the decal normal
+            if (job->decalNormal_.DotProduct((n0 + n1 + n2) / 3.0f) < job->normalCutoff_)
+                continue;
+
+            // Check if face is culled completely by any of the planes
+            bool culled = false;
+            for (unsigned j = PLANE_FAR; j < NUM_FRUSTUM_PLANES; --j)
+            {
+                const Plane& plane = frustum.planes_[j];
+                if (plane.Distance(v0) < 0.0f && plane.Distance(v1) < 0.0f && plane.Distance(v2) < 0.0f)
+                {
+                    culled = true;
+                    break;
+                }
+            }
+            if (culled)
+                continue;
+
+            face.Clear();
+            face.Push(DecalVertex(v0, n0));
+            face.Push(DecalVertex(v1, n1));
+            face.Push(DecalVertex(v2, n2));
+            for (const auto& plane : frustum.planes_)
+            {
+                ClipPolygon(clipped, face, plane, false);
+                Swap(face, clipped);
+                if (face.Empty())
+                    break;
+            }
+
+            for (unsigned j = 2; j < face.Size(); ++j)
+            {
+                decal.AddVertex(face[0]);
+                decal.AddVertex(face[j - 1]);
+                decal.AddVertex(face[j]);
+            }
+
+            // Stop before the 16-bit indices wrap; the decal will be rejected on commit
+            if (decal.vertices_.Size() > job->maxVertices_)
+            {
+                job->overflow_ = true;
+                return;
+            }
+        }
+    }
+
+    if (decal.vertices_.Empty())
+        return;
+
+    job->decalSet_->CalculateUVs(decal, job->frustumTransform_.Inverse(), job->projection_, job->topLeftUV_, job->bottomRightUV_);
+    job->decalSet_->TransformVertices(decal, job->decalTransform_);
+    GenerateTangents(&decal.vertices_[0], sizeof(DecalVertex), &decal.indices_[0], sizeof(unsigned short), 0,
+        decal.indices_.Size(), offsetof(DecalVertex, normal_), offsetof(DecalVertex, texCoord_), offsetof(DecalVertex,
+        tangent_));
+    decal.CalculateBoundingBox();
+}
+
 void Decal::AddVertex(const DecalVertex& vertex)
 {
     for (unsigned i = 0; i < vertices_.Size(); ++i)
@@ -166,7 +497,17 @@ DecalSet::DecalSet(Context* context) :
     boundingBoxDirty_(true),
     skinningDirty_(false),
     assignBonesPending_(false),
-    subscribed_(false)
+    subscribed_(false),
+    vertexHead_(0),
+    indexHead_(0),
+    dirtyVertexStart_(M_MAX_UNSIGNED),
+    dirtyVertexEnd_(0),
+    dirtyIndexStart_(M_MAX_UNSIGNED),
+    dirtyIndexEnd_(0),
+    uploadFrameNumber_(0),
+    frameBytesUploaded_(0),
+    totalBytesUploaded_(0),
+    nextDecalHandle_(1)
 {
     geometry_->SetIndexBuffer(indexBuffer_);
 
@@ -175,7 +516,10 @@ DecalSet::DecalSet(Context* context) :
     batches_[0].geometryType_ = GEOM_STATIC_NOINSTANCING;
 }
 
-DecalSet::~DecalSet() = default;
+DecalSet::~DecalSet()
+{
+    AbortPendingDecals();
+}
 
 void DecalSet::RegisterObject(Context* context)
 {
@@ -229,7 +573,18 @@ void DecalSet::UpdateBatches(const FrameInfo& frame)
 void DecalSet::UpdateGeometry(const FrameInfo& frame)
 {
     if (bufferDirty_ || vertexBuffer_->IsDataLost() || indexBuffer_->IsDataLost())
+    {
         UpdateBuffers();
+        AddBytesUploaded(frame, vertexBuffer_->GetVertexCount() * vertexBuffer_->GetVertexSize() +
+            indexBuffer_->GetIndexCount() * indexBuffer_->GetIndexSize());
+    }
+    else if (dirtyVertexEnd_ || dirtyIndexEnd_)
+    {
+        const unsigned bytes = (dirtyVertexEnd_ ? (dirtyVertexEnd_ - dirtyVertexStart_) * vertexBuffer_->GetVertexSize() : 0) +
+            (dirtyIndexEnd_ ? (dirtyIndexEnd_ - dirtyIndexStart_) * indexBuffer_->GetIndexSize() : 0);
+        UploadDirtyRanges();
+        AddBytesUploaded(frame, bytes);
+    }
 
     if (skinningDirty_)
         UpdateSkinning();
@@ -237,7 +592,7 @@ void DecalSet::UpdateGeometry(const FrameInfo& frame)
 
 UpdateGeometryType DecalSet::GetUpdateGeometryType()
 {
-    if (bufferDirty_ || vertexBuffer_->IsDataLost() || indexBuffer_->IsDataLost())
+    if (bufferDirty_ || vertexBuffer_->IsDataLost() || indexBuffer_->IsDataLost() || dirtyVertexEnd_ || dirtyIndexEnd_)
         return UPDATE_MAIN_THREAD;
     else if (skinningDirty_)
         return UPDATE_WORKER_THREAD;
@@ -323,64 +678,13 @@ bool DecalSet::AddDecal(Drawable* target, const Vector3& worldPosition, const Qu
         bufferDirty_ = true;
     }
 
-    // Center the decal frustum on the world position
-    Vector3 adjustedWorldPosition = worldPosition - 0.5f * depth * (worldRotation * Vector3::FORWARD);
-    /// \todo target transform is not right if adding a decal to StaticModelGroup
-    Matrix3x4 targetTransform = target->GetNode()->GetWorldTransform().Inverse();
-
-    // For an animated model, adjust the decal position back to the bind pose
-    // To do this, need to find the bone the decal is colliding with
-    if (animatedModel)
-    {
-        Skeleton& skeleton = animatedModel->GetSkeleton();
-        unsigned numBones = skeleton.GetNumBones();
-        Bone* bestBone = nullptr;
-        float bestSize = 0.0f;
-
-        for (unsigned i = 0; i < numBones; ++i)
-        {
-            Bone* bone = skeleton.GetBone(i);
-            if (!bone->node_ || !bone->collisionMask_)
-                continue;
-
-            // Represent the decal as a sphere, try to find the biggest colliding bone
-            Sphere decalSphere
-                (bone->node_->GetWorldTransform().Inverse() * worldPosition, 0.5f * size / bone->node_->GetWorldScale().Length());
-
-            if (bone->collisionMask_ & BONECOLLISION_BOX)
-            {
-                float size = bone->boundingBox_.HalfSize().Length();
-                if (bone->boundingBox_.IsInside(decalSphere) && size > bestSize)
-                {
-                    bestBone = bone;
-                    bestSize = size;
-                }
-            }
-            else if (bone->collisionMask_ & BONECOLLISION_SPHERE)
-            {
-                Sphere boneSphere(Vector3::ZERO, bone->radius_);
-                float size = bone->radius_;
-                if (boneSphere.IsInside(decalSphere) && size > bestSize)
-                {
-                    bestBone = bone;
-                    bestSize = size;
-                }
-            }
-        }
-
-        if (bestBone)
-            targetTransform = (bestBone->node_->GetWorldTransform() * bestBone->offsetMatrix_).Inverse();
-    }
-
     // Build the decal frustum
     Frustum decalFrustum;
-    Matrix3x4 frustumTransform = targetTransform * Matrix3x4(adjustedWorldPosition, worldRotation, 1.0f);
-    decalFrustum.DefineOrtho(size, aspectRatio, 1.0, 0.0f, depth, frustumTransform);
-
-    Vector3 decalNormal = (targetTransform * Vector4(worldRotation * Vector3::BACK, 0.0f)).Normalized();
+    Matrix3x4 frustumTransform;
+    Vector3 decalNormal;
+    GetDecalFrame(target, worldPosition, worldRotation, size, aspectRatio, depth, decalFrustum, frustumTransform, decalNormal);
 
-    decals_.Resize(decals_.Size() + 1);
-    Decal& newDecal = decals_.Back();
+    Decal newDecal;
     newDecal.timeToLive_ = timeToLive;
 
     Vector<PODVector<DecalVertex> > faces;
@@ -428,25 +732,10 @@ bool DecalSet::AddDecal(Drawable* target, const Vector3& worldPosition, const Qu
 
     // Check if resulted in no triangles
     if (newDecal.vertices_.Empty())
-    {
-        decals_.Pop();
         return true;
-    }
 
-    if (newDecal.vertices_.Size() > maxVertices_)
-    {
-        URHO3D_LOGWARNING("Can not add decal, vertex count " + String(newDecal.vertices_.Size()) + " exceeds maximum " +
-                   String(maxVertices_));
-        decals_.Pop();
-        return false;
-    }
-    if (newDecal.indices_.Size() > maxIndices_)
-    {
-        URHO3D_LOGWARNING("Can not add decal, index count " + String(newDecal.indices_.Size()) + " exceeds maximum " +
-                   String(maxIndices_));
-        decals_.Pop();
-        return false;
-    }
+    if (newDecal.vertices_.Size() > maxVertices_ || newDecal.indices_.Size() > maxIndices_)
+        return CommitDecal(newDecal);
 
     // Calculate UVs
     Matrix4 projection(Matrix4::ZERO);
@@ -465,23 +754,276 @@ bool DecalSet::AddDecal(Drawable* target, const Vector3& worldPosition, const Qu
         tangent_));
 
     newDecal.CalculateBoundingBox();
-    numVertices_ += newDecal.vertices_.Size();
-    numIndices_ += newDecal.indices_.Size();
+    if (!CommitDecal(newDecal))
+        return false;
+
+    URHO3D_LOGDEBUG("Added decal with " + String(newDecal.vertices_.Size()) + " vertices");
+    return true;
+}
+
+unsigned DecalSet::AddDecalAsync(Drawable* target, const Vector3& worldPosition, const Quaternion& worldRotation, float size,
+    float aspectRatio, float depth, const Vector2& topLeftUV, const Vector2& bottomRightUV, float timeToLive, float normalCutoff,
+    unsigned subGeometry)
+{
+    URHO3D_PROFILE(AddDecalAsync);
+
+    // Do not add decals in headless mode
+    if (!node_ || !GetSubsystem<Graphics>())
+        return 0;
+
+    if (!target || !target->GetNode())
+    {
+        URHO3D_LOGERROR("Null target drawable for decal");
+        return 0;
+    }
+
+    // Skinned decals remap bones into this decal set as they go, so project them here
+    if (dynamic_cast<AnimatedModel*>(target))
+    {
+        return AddDecal(target, worldPosition, worldRotation, size, aspectRatio, depth, topLeftUV, bottomRightUV, timeToLive,
+            normalCutoff, subGeometry) ? nextDecalHandle_++ : 0;
+    }
+
+    if (skinned_)
+    {
+        RemoveAllDecals();
+        skinned_ = false;
+        bufferDirty_ = true;
+    }
+
+    SharedPtr<DecalJob> job(new DecalJob());
+    job->decalSet_ = this;
+    job->handle_ = nextDecalHandle_++;
+    GetDecalFrame(target, worldPosition, worldRotation, size, aspectRatio, depth, job->frustum_, job->frustumTransform_,
+        job->decalNormal_);
+    job->frustumBox_.Define(job->frustum_);
+    job->projection_ = Matrix4::ZERO;
+    job->projection_.m11_ = (1.0f / (size * 0.5f));
+    job->projection_.m00_ = job->projection_.m11_ / aspectRatio;
+    job->projection_.m22_ = 1.0f / depth;
+    job->projection_.m33_ = 1.0f;
+    job->decalTransform_ = node_->GetWorldTransform().Inverse() * target->GetNode()->GetWorldTransform();
+    job->topLeftUV_ = topLeftUV;
+    job->bottomRightUV_ = bottomRightUV;
+    job->normalCutoff_ = normalCutoff;
+    job->maxVertices_ = maxVertices_;
+    job->decal_.timeToLive_ = timeToLive;
+    job->overflow_ = false;
+
+    // Resolve the geometries now, as LOD and batch data may change before the worker runs
+    unsigned numBatches = target->GetBatches().Size();
+    for (unsigned i = 0; i < numBatches; ++i)
+    {
+        if (subGeometry < numBatches && i != subGeometry)
+            continue;
+
+        DecalSourceGeometry source;
+        if (GetSourceGeometry(target->GetLodGeometry(i, 0), source))
+            job->sources_.Push(source);
+    }
+
+    // Use an unpooled item so that it is not recycled while the handle is pending
+    job->item_ = new WorkItem();
+    job->item_->workFunction_ = ProjectDecalWork;
+    job->item_->aux_ = job.Get();
+    job->item_->priority_ = 0;
+    GetSubsystem<WorkQueue>()->AddWorkItem(job->item_);
+
+    pendingDecals_.Push(job);
+    if (!subscribed_)
+        UpdateEventSubscription(false);
+
+    return job->handle_;
+}
+
+void DecalSet::CommitPendingDecals(bool wait)
+{
+    if (pendingDecals_.Empty())
+        return;
+
+    URHO3D_PROFILE(CommitPendingDecals);
+
+    if (wait)
+        GetSubsystem<WorkQueue>()->Complete(0);
+
+    // Commit in submission order so that the oldest decals are still removed first
+    unsigned numCommitted = 0;
+    while (numCommitted < pendingDecals_.Size() && pendingDecals_[numCommitted]->item_->completed_)
+    {
+        DecalJob& job = *pendingDecals_[numCommitted++];
+        if (job.overflow_)
+        {
+            URHO3D_LOGWARNING("Can not add decal, vertex count exceeds maximum " + String(maxVertices_));
+            continue;
+        }
+        if (!job.decal_.vertices_.Empty() && !skinned_)
+            CommitDecal(job.decal_);
+    }
+
+    if (numCommitted)
+        pendingDecals_.Erase(0, numCommitted);
+}
+
+bool DecalSet::IsDecalPending(unsigned handle) const
+{
+    for (unsigned i = 0; i < pendingDecals_.Size(); ++i)
+    {
+        if (pendingDecals_[i]->handle_ == handle)
+            return true;
+    }
+    return false;
+}
+
+void DecalSet::GetDecalFrame(Drawable* target, const Vector3& worldPosition, const Quaternion& worldRotation, float size,
+    float aspectRatio, float depth, Frustum& frustum, Matrix3x4& frustumTransform, Vector3& decalNormal)
+{
+    auto* animatedModel = dynamic_cast<AnimatedModel*>(target);
+
+    // Center the decal frustum on the world position
+    Vector3 adjustedWorldPosition = worldPosition - 0.5f * depth * (worldRotation * Vector3::FORWARD);
+    /// \todo target transform is not right if adding a decal to StaticModelGroup
+    Matrix3x4 targetTransform = target->GetNode()->GetWorldTransform().Inverse();
+
+    // For an animated model, adjust the decal position back to the bind pose
+    // To do this, need to find the bone the decal is colliding with
+    if (animatedModel)
+    {
+        Skeleton& skeleton = animatedModel->GetSkeleton();
+        unsigned numBones = skeleton.GetNumBones();
+        Bone* bestBone = nullptr;
+        float bestSize = 0.0f;
+
+        for (unsigned i = 0; i < numBones; ++i)
+        {
+            Bone* bone = skeleton.GetBone(i);
+            if (!bone->node_ || !bone->collisionMask_)
+                continue;
+
+            // Represent the decal as a sphere, try to find the biggest colliding bone
+            Sphere decalSphere
+                (bone->node_->GetWorldTransform().Inverse() * worldPosition, 0.5f * size / bone->node_->GetWorldScale().Length());
+
+            if (bone->collisionMask_ & BONECOLLISION_BOX)
+            {
+                float size = bone->boundingBox_.HalfSize().Length();
+                if (bone->boundingBox_.IsInside(decalSphere) && size > bestSize)
+                {
+                    bestBone = bone;
+                    bestSize = size;
+                }
+            }
+            else if (bone->collisionMask_ & BONECOLLISION_SPHERE)
+            {
+                Sphere boneSphere(Vector3::ZERO, bone->radius_);
+                float size = bone->radius_;
+                if (boneSphere.IsInside(decalSphere) && size > bestSize)
+                {
+                    bestBone = bone;
+                    bestSize = size;
+                }
+            }
+        }
+
+        if (bestBone)
+            targetTransform = (bestBone->node_->GetWorldTransform() * bestBone->offsetMatrix_).Inverse();
+    }
+
+    // Build the decal frustum
+    frustumTransform = targetTransform * Matrix3x4(adjustedWorldPosition, worldRotation, 1.0f);
+    frustum.DefineOrtho(size, aspectRatio, 1.0, 0.0f, depth, frustumTransform);
+
+    decalNormal = (targetTransform * Vector4(worldRotation * Vector3::BACK, 0.0f)).Normalized();
+}
+
+bool DecalSet::CommitDecal(const Decal& decal)
+{
+    if (decal.vertices_.Size() > maxVertices_)
+    {
+        URHO3D_LOGWARNING("Can not add decal, vertex count " + String(decal.vertices_.Size()) + " exceeds maximum " +
+                   String(maxVertices_));
+        return false;
+    }
+    if (decal.indices_.Size() > maxIndices_)
+    {
+        URHO3D_LOGWARNING("Can not add decal, index count " + String(decal.indices_.Size()) + " exceeds maximum " +
+                   String(maxIndices_));
+        return false;
+    }
+
+    decals_.Push(decal);
+    // Unless the buffers are going to be rewritten anyway, write only the new decal's slots
+    if (IsRingBuffer() && !bufferDirty_)
+        PlaceDecal(decals_.Back());
+    numVertices_ += decal.vertices_.Size();
+    numIndices_ += decal.indices_.Size();
 
     // Remove oldest decals if total vertices exceeded
     while (decals_.Size() && (numVertices_ > maxVertices_ || numIndices_ > maxIndices_))
         RemoveDecals(1);
 
-    URHO3D_LOGDEBUG("Added decal with " + String(newDecal.vertices_.Size()) + " vertices");
-
     // If new decal is time limited, subscribe to scene post-update
-    if (newDecal.timeToLive_ > 0.0f && !subscribed_)
+    if (decal.timeToLive_ > 0.0f && !subscribed_)
         UpdateEventSubscription(false);
 
-    MarkDecalsDirty();
+    MarkDecalsDirty(!IsRingBuffer());
     return true;
 }
 
+void DecalSet::PlaceDecal(Decal& decal)
+{
+    const unsigned numDecalVertices = decal.vertices_.Size();
+    const unsigned numDecalIndices = decal.indices_.Size();
+    if (vertexHead_ + numDecalVertices > maxVertices_)
+        vertexHead_ = 0;
+    if (indexHead_ + numDecalIndices > maxIndices_)
+        indexHead_ = 0;
+
+    // Decals are placed in age order, so the ones in the way are the oldest
+    for (List<Decal>::Iterator i = decals_.Begin(); i != decals_.End();)
+    {
+        if (&*i != &decal && (RangesOverlap(i->vertexStart_, i->vertices_.Size(), vertexHead_, numDecalVertices) ||
+            RangesOverlap(i->indexStart_, i->indices_.Size(), indexHead_, numDecalIndices)))
+            i = RemoveDecal(i);
+        else
+            ++i;
+    }
+
+    decal.vertexStart_ = vertexHead_;
+    decal.indexStart_ = indexHead_;
+
+    const unsigned vertexFloats = vertexBuffer_->GetVertexSize() / sizeof(float);
+    float* vertices = &vertexData_[vertexHead_ * vertexFloats];
+    for (unsigned i = 0; i < numDecalVertices; ++i)
+        WriteDecalVertex(vertices, decal.vertices_[i], skinned_);
+    for (unsigned i = 0; i < numDecalIndices; ++i)
+        indexData_[indexHead_ + i] = (unsigned short)(decal.indices_[i] + vertexHead_);
+
+    MergeDirtyRange(dirtyVertexStart_, dirtyVertexEnd_, vertexHead_, numDecalVertices);
+    MergeDirtyRange(dirtyIndexStart_, dirtyIndexEnd_, indexHead_, numDecalIndices);
+    vertexHead_ += numDecalVertices;
+    indexHead_ += numDecalIndices;
+}
+
+void DecalSet::AbortPendingDecals()
+{
+    if (pendingDecals_.Empty())
+        return;
+
+    // The work items point to the jobs, so wait for any that have already started
+    auto* queue = GetSubsystem<WorkQueue>();
+    for (unsigned i = 0; i < pendingDecals_.Size(); ++i)
+    {
+        WorkItem* item = pendingDecals_[i]->item_;
+        if (queue && !queue->RemoveWorkItem(pendingDecals_[i]->item_))
+        {
+            while (!item->completed_)
+                Time::Sleep(0);
+        }
+    }
+
+    pendingDecals_.Clear();
+}
+
 void DecalSet::RemoveDecals(unsigned num)
 {
     while (num-- && decals_.Size())
@@ -698,112 +1240,19 @@ void DecalSet::GetFaces(Vector<PODVector<DecalVertex> >& faces, Drawable* target
     const Vector3& decalNormal, float normalCutoff)
 {
     // Try to use the most accurate LOD level if possible
-    Geometry* geometry = target->GetLodGeometry(batchIndex, 0);
-    if (!geometry || geometry->GetPrimitiveType() != TRIANGLE_LIST)
+    DecalSourceGeometry source;
+    if (!GetSourceGeometry(target->GetLodGeometry(batchIndex, 0), source))
         return;
 
-    const unsigned char* positionData = nullptr;
-    const unsigned char* normalData = nullptr;
-    const unsigned char* skinningData = nullptr;
-    const unsigned char* indexData = nullptr;
-    unsigned positionStride = 0;
-    unsigned normalStride = 0;
-    unsigned skinningStride = 0;
-    unsigned indexStride = 0;
-
-    IndexBuffer* ib = geometry->GetIndexBuffer();
-    if (ib)
-    {
-        indexData = ib->GetShadowData();
-        indexStride = ib->GetIndexSize();
-    }
-
-    // For morphed models positions, normals and skinning may be in different buffers
-    for (unsigned i = 0; i < geometry->GetNumVertexBuffers(); ++i)
-    {
-        VertexBuffer* vb = geometry->GetVertexBuffer(i);
-        if (!vb)
-            continue;
-
-        unsigned elementMask = vb->GetElementMask();
-        unsigned char* data = vb->GetShadowData();
-        if (!data)
-            continue;
-
-        if (elementMask & MASK_POSITION)
-        {
-            positionData = data;
-            positionStride = vb->GetVertexSize();
-        }
-        if (elementMask & MASK_NORMAL)
-        {
-            normalData = data + vb->GetElementOffset(SEM_NORMAL);
-            normalStride = vb->GetVertexSize();
-        }
-        if (elementMask & MASK_BLENDWEIGHTS)
-        {
-            skinningData = data + vb->GetElementOffset(SEM_BLENDWEIGHTS);
-            skinningStride = vb->GetVertexSize();
-        }
-    }
-
-    // Positions and indices are needed
-    if (!positionData)
-    {
-        // As a fallback, try to get the geometry's raw vertex/index data
-        const PODVector<VertexElement>* elements;
-        geometry->GetRawData(positionData, positionStride, indexData, indexStride, elements);
-        if (!positionData)
-        {
-            URHO3D_LOGWARNING("Can not add decal, target drawable has no CPU-side geometry data");
-            return;
-        }
-    }
-
-    if (indexData)
-    {
-        unsigned indexStart = geometry->GetIndexStart();
-        unsigned indexCount = geometry->GetIndexCount();
-
-        // 16-bit indices
-        if (indexStride == sizeof(unsigned short))
-        {
-            const unsigned short* indices = ((const unsigned short*)indexData) + indexStart;
-            const unsigned short* indicesEnd = indices + indexCount;
-
-            while (indices < indicesEnd)
-            {
-                GetFace(faces, target, batchIndex, indices[0], indices[1], indices[2], positionData, normalData, skinningData,
-                    positionStride, normalStride, skinningStride, frustum, decalNormal, normalCutoff);
-                indices += 3;
-            }
-        }
-        else
-        // 32-bit indices
-        {
-            const unsigned* indices = ((const unsigned*)indexData) + indexStart;
-            const unsigned* indicesEnd = indices + indexCount;
+    source.GetTriangleBVH();
+    PODVector<unsigned> triangles;
+    source.GetTriangles(triangles, frustum);
 
-            while (indices < indicesEnd)
-            {
-                GetFace(faces, target, batchIndex, indices[0], indices[1], indices[2], positionData, normalData, skinningData,
-                    positionStride, normalStride, skinningStride, frustum, decalNormal, normalCutoff);
-                indices += 3;
-            }
-        }
-    }
-    else
+    for (unsigned i = 0; i + 2 < triangles.Size(); i += 3)
     {
-        // Non-indexed geometry
-        unsigned indices = geometry->GetVertexStart();
-        unsigned indicesEnd = indices + geometry->GetVertexCount();
-
-        while (indices + 2 < indicesEnd)
-        {
-            GetFace(faces, target, batchIndex, indices, indices + 1, indices + 2, positionData, normalData, skinningData,
-                positionStride, normalStride, skinningStride, frustum, decalNormal, normalCutoff);
-            indices += 3;
-        }
+        GetFace(faces, target, batchIndex, triangles[i], triangles[i + 1], triangles[i + 2], source.positionData_,
+            source.normalData_, source.skinningData_, source.positionStride_, source.normalStride_, source.skinningStride_,
+            frustum, decalNormal, normalCutoff);
     }
 }
 
@@ -985,18 +1434,30 @@ List<Decal>::Iterator DecalSet::RemoveDecal(List<Decal>::Iterator i)
 {
     numVertices_ -= i->vertices_.Size();
     numIndices_ -= i->indices_.Size();
-    MarkDecalsDirty();
+
+    if (IsRingBuffer() && !bufferDirty_ && i->indexStart_ != M_MAX_UNSIGNED)
+    {
+        // Turn the slot into degenerate triangles instead of rewriting the buffers
+        for (unsigned j = 0; j < i->indices_.Size(); ++j)
+            indexData_[i->indexStart_ + j] = 0;
+        MergeDirtyRange(dirtyIndexStart_, dirtyIndexEnd_, i->indexStart_, i->indices_.Size());
+        MarkDecalsDirty(false);
+    }
+    else
+        MarkDecalsDirty();
+
     return decals_.Erase(i);
 }
 
-void DecalSet::MarkDecalsDirty()
+void DecalSet::MarkDecalsDirty(bool rewriteBuffers)
 {
     if (!boundingBoxDirty_)
     {
         boundingBoxDirty_ = true;
         OnMarkedDirty(node_);
     }
-    bufferDirty_ = true;
+    if (rewriteBuffers)
+        bufferDirty_ = true;
 }
 
 void DecalSet::CalculateBoundingBox()
@@ -1019,56 +1480,85 @@ void DecalSet::UpdateBuffers()
     if (indexBuffer_->GetIndexCount() != newIBSize)
         indexBuffer_->SetSize(newIBSize, false);
     geometry_->SetVertexBuffer(0, vertexBuffer_);
-    geometry_->SetDrawRange(TRIANGLE_LIST, 0, numIndices_, 0, numVertices_);
+    // A ring buffer draws its whole capacity; free slots hold degenerate triangles
+    geometry_->SetDrawRange(TRIANGLE_LIST, 0, newIBSize, 0, newVBSize);
 
-    float* vertices = numVertices_ ? (float*)vertexBuffer_->Lock(0, numVertices_) : nullptr;
-    unsigned short* indices = numIndices_ ? (unsigned short*)indexBuffer_->Lock(0, numIndices_) : nullptr;
+    // Stage the whole buffers with the decals packed from the start
+    const unsigned vertexFloats = vertexBuffer_->GetVertexSize() / sizeof(float);
+    vertexData_.Resize(newVBSize * vertexFloats);
+    indexData_.Resize(newIBSize);
 
-    if (vertices && indices)
-    {
-        unsigned short indexStart = 0;
+    float* vertices = vertexData_.Buffer();
+    unsigned short* indices = indexData_.Buffer();
+    unsigned vertexStart = 0;
+    unsigned indexStart = 0;
 
-        for (List<Decal>::ConstIterator i = decals_.Begin(); i != decals_.End(); ++i)
-        {
-            for (unsigned j = 0; j < i->vertices_.Size(); ++j)
-            {
-                const DecalVertex& vertex = i->vertices_[j];
-                *vertices++ = vertex.position_.x_;
-                *vertices++ = vertex.position_.y_;
-                *vertices++ = vertex.position_.z_;
-                *vertices++ = vertex.normal_.x_;
-                *vertices++ = vertex.normal_.y_;
-                *vertices++ = vertex.normal_.z_;
-                *vertices++ = vertex.texCoord_.x_;
-                *vertices++ = vertex.texCoord_.y_;
-                *vertices++ = vertex.tangent_.x_;
-                *vertices++ = vertex.tangent_.y_;
-                *vertices++ = vertex.tangent_.z_;
-                *vertices++ = vertex.tangent_.w_;
-                if (skinned_)
-                {
-                    *vertices++ = vertex.blendWeights_[0];
-                    *vertices++ = vertex.blendWeights_[1];
-                    *vertices++ = vertex.blendWeights_[2];
-                    *vertices++ = vertex.blendWeights_[3];
-                    *vertices++ = *((float*)vertex.blendIndices_);
-                }
-            }
+    for (List<Decal>::Iterator i = decals_.Begin(); i != decals_.End(); ++i)
+    {
+        for (unsigned j = 0; j < i->vertices_.Size(); ++j)
+            WriteDecalVertex(vertices, i->vertices_[j], skinned_);
 
-            for (unsigned j = 0; j < i->indices_.Size(); ++j)
-                *indices++ = i->indices_[j] + indexStart;
+        for (unsigned j = 0; j < i->indices_.Size(); ++j)
+            *indices++ = (unsigned short)(i->indices_[j] + vertexStart);
 
-            indexStart += i->vertices_.Size();
-        }
+        i->vertexStart_ = vertexStart;
+        i->indexStart_ = indexStart;
+        vertexStart += i->vertices_.Size();
+        indexStart += i->indices_.Size();
     }
 
-    vertexBuffer_->Unlock();
+    if (vertexStart < newVBSize)
+        memset(&vertexData_[vertexStart * vertexFloats], 0, (newVBSize - vertexStart) * vertexFloats * sizeof(float));
+    if (indexStart < newIBSize)
+        memset(&indexData_[indexStart], 0, (newIBSize - indexStart) * sizeof(unsigned short));
+
+    if (newVBSize)
+        vertexBuffer_->SetData(vertexData_.Buffer());
+    if (newIBSize)
+        indexBuffer_->SetData(indexData_.Buffer());
+
     vertexBuffer_->ClearDataLost();
-    indexBuffer_->Unlock();
     indexBuffer_->ClearDataLost();
+    vertexHead_ = vertexStart;
+    indexHead_ = indexStart;
+    dirtyVertexStart_ = dirtyIndexStart_ = M_MAX_UNSIGNED;
+    dirtyVertexEnd_ = dirtyIndexEnd_ = 0;
     bufferDirty_ = false;
 }
 
+void DecalSet::UploadDirtyRanges()
+{
+    if (dirtyVertexEnd_)
+    {
+        const unsigned vertexFloats = vertexBuffer_->GetVertexSize() / sizeof(float);
+        vertexBuffer_->SetDataRange(&vertexData_[dirtyVertexStart_ * vertexFloats], dirtyVertexStart_,
+            dirtyVertexEnd_ - dirtyVertexStart_);
+    }
+    if (dirtyIndexEnd_)
+        indexBuffer_->SetDataRange(&indexData_[dirtyIndexStart_], dirtyIndexStart_, dirtyIndexEnd_ - dirtyIndexStart_);
+
+    dirtyVertexStart_ = dirtyIndexStart_ = M_MAX_UNSIGNED;
+    dirtyVertexEnd_ = dirtyIndexEnd_ = 0;
+}
+
+void DecalSet::AddBytesUploaded(const FrameInfo& frame, unsigned bytes)
+{
+    if (frame.frameNumber_ != uploadFrameNumber_)
+    {
+        uploadFrameNumber_ = frame.frameNumber_;
+        frameBytesUploaded_ = 0;
+    }
+
+    frameBytesUploaded_ += bytes;
+    totalBytesUploaded_ += bytes;
+}
+
+unsigned DecalSet::GetBytesUploaded() const
+{
+    auto* time = GetSubsystem<Time>();
+    return time && time->GetFrameNumber() == uploadFrameNumber_ ? frameBytesUploaded_ : 0;
+}
+
 void DecalSet::UpdateSkinning()
 {
     // Use model's world transform in case a bone is missing
@@ -1140,8 +1630,8 @@ void DecalSet::UpdateEventSubscription(bool checkAllDecals)
             }
         }
 
-        // If no time limited decals, no need to subscribe to scene update
-        enabled = hasTimeLimitedDecals;
+        // If no time limited or queued decals, no need to subscribe to scene update
+        enabled = hasTimeLimitedDecals || !pendingDecals_.Empty();
     }
 
     if (enabled && !subscribed_)
@@ -1162,6 +1652,8 @@ void DecalSet::HandleScenePostUpdate(StringHash eventType, VariantMap& eventData
 
     float timeStep = eventData[P_TIMESTEP].GetFloat();
 
+    CommitPendingDecals();
+
     for (List<Decal>::Iterator i = decals_.Begin(); i != decals_.End();)
     {
         i->timer_ += timeStep;
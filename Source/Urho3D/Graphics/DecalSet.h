@@ -32,6 +32,9 @@ namespace Urho3D
 
 class IndexBuffer;
 class VertexBuffer;
+struct DecalJob;
+struct DecalSourceGeometry;
+struct WorkItem;
 
 /// %Decal vertex.
 struct DecalVertex
@@ -78,7 +81,9 @@ struct Decal
     /// Construct with defaults.
     Decal() :
         timer_(0.0f),
-        timeToLive_(0.0f)
+        timeToLive_(0.0f),
+        vertexStart_(M_MAX_UNSIGNED),
+        indexStart_(M_MAX_UNSIGNED)
     {
     }
 
@@ -91,6 +96,10 @@ struct Decal
     float timer_;
     /// Maximum time to live in seconds (0 = infinite)
     float timeToLive_;
+    /// First vertex in the decal set's vertex buffer.
+    unsigned vertexStart_;
+    /// First index in the decal set's index buffer.
+    unsigned indexStart_;
     /// Local-space bounding box.
     BoundingBox boundingBox_;
     /// Decal vertices.
@@ -104,6 +113,8 @@ class URHO3D_API DecalSet : public Drawable
 {
     URHO3D_OBJECT(DecalSet, Drawable);
 
+    friend void ProjectDecalWork(const WorkItem* item, unsigned threadIndex);
+
 public:
     /// Construct.
     explicit DecalSet(Context* context);
@@ -131,12 +142,18 @@ public:
     void SetMaxVertices(unsigned num);
     /// Set maximum number of decal vertex indices.
     void SetMaxIndices(unsigned num);
-    /// Set whether to optimize GPU buffer sizes according to current amount of decals. Default false, which will size the buffers according to the maximum vertices/indices. When true, buffers will be reallocated whenever decals are added/removed, which can be worse for performance.
+    /// Set whether to optimize GPU buffer sizes according to current amount of decals. Default false, which will size the buffers according to the maximum vertices/indices and use them as a ring buffer: new decals overwrite the oldest in place and only the changed ranges are uploaded. When true, buffers will be reallocated and rewritten whenever decals are added/removed, which can be worse for performance.
     void SetOptimizeBufferSize(bool enable);
     /// Add a decal at world coordinates, using a target drawable's geometry for reference. If the decal needs to move with the target, the decal component should be created to the target's node. Return true if successful.
     bool AddDecal(Drawable* target, const Vector3& worldPosition, const Quaternion& worldRotation, float size, float aspectRatio,
         float depth, const Vector2& topLeftUV, const Vector2& bottomRightUV, float timeToLive = 0.0f, float normalCutoff = 0.1f,
         unsigned subGeometry = M_MAX_UNSIGNED);
+    /// Queue a decal to be projected in a worker thread and added on a later scene post-update. Parameters are the same as in AddDecal. Return a nonzero handle, or 0 if the decal could not be queued. Decals on skinned targets are added immediately. The target's CPU-side geometry data must not change while the decal is pending.
+    unsigned AddDecalAsync(Drawable* target, const Vector3& worldPosition, const Quaternion& worldRotation, float size,
+        float aspectRatio, float depth, const Vector2& topLeftUV, const Vector2& bottomRightUV, float timeToLive = 0.0f,
+        float normalCutoff = 0.1f, unsigned subGeometry = M_MAX_UNSIGNED);
+    /// Add the queued decals whose projection has finished. Optionally finish the remaining projections first. Called automatically on scene post-update.
+    void CommitPendingDecals(bool wait = false);
     /// Remove n oldest decals.
     void RemoveDecals(unsigned num);
     /// Remove all decals.
@@ -148,6 +165,12 @@ public:
     /// Return number of decals.
     unsigned GetNumDecals() const { return decals_.Size(); }
 
+    /// Return number of queued decals not yet added.
+    unsigned GetNumPendingDecals() const { return pendingDecals_.Size(); }
+
+    /// Return whether a queued decal is still being projected or waiting to be added.
+    bool IsDecalPending(unsigned handle) const;
+
     /// Retur number of vertices in the decals.
     unsigned GetNumVertices() const { return numVertices_; }
 
@@ -163,6 +186,12 @@ public:
     /// Return whether is optimizing GPU buffer sizes according to current amount of decals.
     bool GetOptimizeBufferSize() const { return optimizeBufferSize_; }
 
+    /// Return bytes uploaded to the GPU buffers during the current frame.
+    unsigned GetBytesUploaded() const;
+
+    /// Return bytes uploaded to the GPU buffers in total.
+    unsigned long long GetTotalBytesUploaded() const { return totalBytesUploaded_; }
+
     /// Set material attribute.
     void SetMaterialAttr(const ResourceRef& value);
     /// Set decals attribute.
@@ -179,6 +208,9 @@ protected:
     void OnMarkedDirty(Node* node) override;
 
 private:
+    /// Return the decal frustum and transforms for a target, and choose the bone for a skinned target.
+    void GetDecalFrame(Drawable* target, const Vector3& worldPosition, const Quaternion& worldRotation, float size,
+        float aspectRatio, float depth, Frustum& frustum, Matrix3x4& frustumTransform, Vector3& decalNormal);
     /// Get triangle faces from the target geometry.
     void GetFaces(Vector<PODVector<DecalVertex> >& faces, Drawable* target, unsigned batchIndex, const Frustum& frustum,
         const Vector3& decalNormal, float normalCutoff);
@@ -196,14 +228,26 @@ private:
         (Decal& decal, const Matrix3x4& view, const Matrix4& projection, const Vector2& topLeftUV, const Vector2& bottomRightUV);
     /// Transform decal's vertices from the target geometry to the decal set local space.
     void TransformVertices(Decal& decal, const Matrix3x4& transform);
+    /// Add a finished decal, removing the oldest decals if necessary. Return true if successful.
+    bool CommitDecal(const Decal& decal);
+    /// Write a decal to the next free ring buffer slots, evicting the decals that used them.
+    void PlaceDecal(Decal& decal);
+    /// Cancel or finish queued decal projections before destruction.
+    void AbortPendingDecals();
     /// Remove a decal by iterator and return iterator to the next decal.
     List<Decal>::Iterator RemoveDecal(List<Decal>::Iterator i);
-    /// Mark decals and the bounding box dirty.
-    void MarkDecalsDirty();
+    /// Mark decals and the bounding box dirty. Optionally skip rewriting the buffers when the changed ranges were already staged.
+    void MarkDecalsDirty(bool rewriteBuffers = true);
     /// Recalculate the local-space bounding box.
     void CalculateBoundingBox();
     /// Rewrite decal vertex and index buffers.
     void UpdateBuffers();
+    /// Upload the changed ranges of the staged vertex and index data.
+    void UploadDirtyRanges();
+    /// Add to the uploaded bytes counters.
+    void AddBytesUploaded(const FrameInfo& frame, unsigned bytes);
+    /// Return whether the buffers are used as a ring buffer.
+    bool IsRingBuffer() const { return !optimizeBufferSize_; }
     /// Recalculate skinning.
     void UpdateSkinning();
     /// Update the batch (geometry type, shader data.)
@@ -249,6 +293,32 @@ private:
     bool assignBonesPending_;
     /// Subscribed to scene post update event flag.
     bool subscribed_;
+    /// Staged vertex data of the whole vertex buffer.
+    PODVector<float> vertexData_;
+    /// Staged index data of the whole index buffer.
+    PODVector<unsigned short> indexData_;
+    /// Next vertex to write in ring buffer mode.
+    unsigned vertexHead_;
+    /// Next index to write in ring buffer mode.
+    unsigned indexHead_;
+    /// First changed vertex since the last upload.
+    unsigned dirtyVertexStart_;
+    /// End of changed vertices since the last upload.
+    unsigned dirtyVertexEnd_;
+    /// First changed index since the last upload.
+    unsigned dirtyIndexStart_;
+    /// End of changed indices since the last upload.
+    unsigned dirtyIndexEnd_;
+    /// Frame number of the last upload.
+    unsigned uploadFrameNumber_;
+    /// Bytes uploaded during the frame of the last upload.
+    unsigned frameBytesUploaded_;
+    /// Bytes uploaded in total.
+    unsigned long long totalBytesUploaded_;
+    /// Queued decals in submission order.
+    Vector<SharedPtr<DecalJob> > pendingDecals_;
+    /// Next queued decal handle.
+    unsigned nextDecalHandle_;
 };
 
 }
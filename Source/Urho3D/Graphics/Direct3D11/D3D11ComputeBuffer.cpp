@@ -132,6 +132,28 @@ bool ComputeBuffer::SetData(void* data, unsigned dataSize, unsigned structureSiz
     return true;
 }
 
+bool ComputeBuffer::SetDataRange(const void* data, unsigned offset, unsigned dataSize)
+{
+    if (!object_.ptr_ || offset + dataSize > size_)
+    {
+        URHO3D_LOGERROR("Illegal range for setting new ComputeBuffer data");
+        return false;
+    }
+
+    if (!dataSize)
+        return true;
+
+    D3D11_BOX box;
+    box.left = offset;
+    box.right = offset + dataSize;
+    box.top = 0;
+    box.bottom = 1;
+    box.front = 0;
+    box.back = 1;
+    graphics_->GetImpl()->GetDeviceContext()->UpdateSubresource((ID3D11Resource*)object_.ptr_, 0, &box, data, 0, 0);
+    return true;
+}
+
 bool ComputeBuffer::GetData(void* writeInto, unsigned offset, unsigned readLength)
 {
     if (!object_.ptr_)
@@ -221,7 +221,7 @@ bool ComputeDevice::SetWritableBuffer(Object* object, unsigned slot)
     // Null object is trivial
     if (object == nullptr)
     {
-        uavsDirty_ = uavs_[slot] != nullptr;
+        uavsDirty_ |= uavs_[slot] != nullptr;
         uavs_[slot] = nullptr;
         return true;
     }
@@ -258,7 +258,7 @@ bool ComputeDevice::SetWritableBuffer(Object* object, unsigned slot)
     {
         buffer = (ID3D11Buffer*)vbuffer->GetGPUObject();
         viewDesc.Format = DXGI_FORMAT_R32G32B32A32_FLOAT;
-        viewDesc.Buffer.NumElements = vbuffer->GetElements().Size() * vbuffer->GetVertexCount();
+        viewDesc.Buffer.NumElements = vbuffer->GetVertexSize() * vbuffer->GetVertexCount() / sizeof(Vector4);
     }
     else if (auto ibuffer = object->Cast<IndexBuffer>())
     {
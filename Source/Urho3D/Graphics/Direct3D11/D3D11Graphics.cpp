@@ -826,6 +826,57 @@ bool Graphics::ResolveToTexture(TextureCube* texture)
     return true;
 }
 
+bool Graphics::CopyTexture(Texture2D* source, Texture2D* destination)
+{
+    if (!source || !destination || !source->GetGPUObject() || !destination->GetGPUObject() || source == destination)
+        return false;
+    if (source->GetWidth() != destination->GetWidth() || source->GetHeight() != destination->GetHeight() ||
+        source->GetFormat() != destination->GetFormat() || source->GetMultiSample() != destination->GetMultiSample())
+        return false;
+
+    URHO3D_PROFILE(CopyTexture);
+
+    // The destination may still be bound as the current depth-stencil or rendertarget; unbind before the copy
+    impl_->deviceContext_->OMSetRenderTargets(0, nullptr, nullptr);
+    impl_->renderTargetsDirty_ = true;
+
+    impl_->deviceContext_->CopyResource((ID3D11Resource*)destination->GetGPUObject(), (ID3D11Resource*)source->GetGPUObject());
+    return true;
+}
+
+bool Graphics::CopyTextureRegion(Texture2D* source, Texture2D* destination, const IntRect& rect)
+{
+    if (!source || !destination || !source->GetGPUObject() || !destination->GetGPUObject() || source == destination)
+        return false;
+    if (rect.left_ < 0 || rect.top_ < 0 || rect.right_ > source->GetWidth() || rect.bottom_ > source->GetHeight() ||
+        rect.left_ >= rect.right_ || rect.top_ >= rect.bottom_)
+        return false;
+    if (rect == IntRect(0, 0, source->GetWidth(), source->GetHeight()))
+        return CopyTexture(source, destination);
+    // Depth-stencil and multisampled resources can only be copied whole
+    if (source->GetUsage() == TEXTURE_DEPTHSTENCIL || source->GetMultiSample() > 1)
+        return false;
+    if (source->GetWidth() != destination->GetWidth() || source->GetHeight() != destination->GetHeight() ||
+        source->GetFormat() != destination->GetFormat() || source->GetMultiSample() != destination->GetMultiSample())
+        return false;
+
+    URHO3D_PROFILE(CopyTextureRegion);
+
+    impl_->deviceContext_->OMSetRenderTargets(0, nullptr, nullptr);
+    impl_->renderTargetsDirty_ = true;
+
+    D3D11_BOX box;
+    box.left = (UINT)rect.left_;
+    box.top = (UINT)rect.top_;
+    box.right = (UINT)rect.right_;
+    box.bottom = (UINT)rect.bottom_;
+    box.front = 0;
+    box.back = 1;
+    impl_->deviceContext_->CopySubresourceRegion((ID3D11Resource*)destination->GetGPUObject(), 0, (UINT)rect.left_,
+        (UINT)rect.top_, 0, (ID3D11Resource*)source->GetGPUObject(), 0, &box);
+    return true;
+}
+
 bool Graphics_IsDrawingShadow = false;
 
 void Graphics::Draw(PrimitiveType type, unsigned vertexStart, unsigned vertexCount)
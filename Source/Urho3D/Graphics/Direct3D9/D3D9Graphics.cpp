@@ -939,6 +939,17 @@ bool Graphics::ResolveToTexture(TextureCube* texture)
     return true;
 }
 
+bool Graphics::CopyTexture(Texture2D* source, Texture2D* destination)
+{
+    // Depth textures can not be copied on Direct3D9
+    return false;
+}
+
+bool Graphics::CopyTextureRegion(Texture2D* source, Texture2D* destination, const IntRect& rect)
+{
+    return false;
+}
+
 void Graphics::Draw(PrimitiveType type, unsigned vertexStart, unsigned vertexCount)
 {
     if (!vertexCount)
@@ -38,6 +38,8 @@
 
 #include "../Graphics/StaticModel.h"
 
+#include <atomic>
+
 #include "../DebugNew.h"
 
 #ifdef _MSC_VER
@@ -49,6 +51,28 @@ namespace Urho3D
 
 const char* GEOMETRY_CATEGORY = "Geometry";
 
+/// Source of drawable transform versions. Shared by all drawables so that a version is never reused by a recreated drawable.
+static std::atomic<unsigned> transformVersionCounter(0);
+
+LodPolicy::LodPolicy() :
+    hysteresis_(0.0f),
+    budgetBias_(1.0f),
+    maxSwitches_(0),
+    numSwitches_(0)
+{
+}
+
+bool LodPolicy::AcquireSwitch()
+{
+    // Denied switches are not counted, so that the count stays meaningful as a statistic
+    if (numSwitches_.fetch_add(1) >= maxSwitches_ && maxSwitches_)
+    {
+        --numSwitches_;
+        return false;
+    }
+    return true;
+}
+
 SourceBatch::SourceBatch() :
     distance_(0.0f),
     geometry_(nullptr),
@@ -79,6 +103,7 @@ Drawable::Drawable(Context* context, unsigned char drawableFlags) :
     occludee_(true),
     updateQueued_(false),
     zoneDirty_(false),
+    transformVersion_(++transformVersionCounter),
     octant_(nullptr),
     zone_(nullptr),
     viewMask_(DEFAULT_VIEWMASK),
@@ -390,6 +415,7 @@ void Drawable::OnSceneSet(Scene* scene)
 void Drawable::OnMarkedDirty(Node* node)
 {
     worldBoundingBoxDirty_ = true;
+    transformVersion_ = ++transformVersionCounter;
     if (!updateQueued_ && octant_)
         octant_->GetSceneManager()->QueueUpdate(this);
 
@@ -26,6 +26,8 @@
 #include "../Math/BoundingBox.h"
 #include "../Scene/Component.h"
 
+#include <atomic>
+
 namespace Urho3D
 {
 
@@ -61,12 +63,36 @@ enum UpdateGeometryType
 {
     UPDATE_NONE = 0,
     UPDATE_MAIN_THREAD,
-    UPDATE_WORKER_THREAD
+    UPDATE_WORKER_THREAD,
+    /// Prepare into staging memory in a worker thread, then upload in CommitGeometry() on the main thread.
+    UPDATE_WORKER_THREAD_STAGED
+};
+
+/// Frame-wide LOD selection settings and state, maintained by the Renderer.
+struct URHO3D_API LodPolicy
+{
+    /// Construct with no hysteresis, switch limit or budget bias.
+    LodPolicy();
+
+    /// Take one of the frame's LOD switches. Return false if the switch limit has been reached. Thread-safe.
+    bool AcquireSwitch();
+
+    /// Fraction of a LOD switch distance that the LOD distance must move past before switching back and forth.
+    float hysteresis_;
+    /// LOD bias multiplier from the triangle budget, 1 when within budget.
+    float budgetBias_;
+    /// Maximum LOD switches per frame, 0 for unlimited.
+    unsigned maxSwitches_;
+    /// LOD switches made on the current frame.
+    std::atomic<unsigned> numSwitches_;
 };
 
 /// Rendering frame update parameters.
 struct FrameInfo
 {
+    /// Return a drawable's LOD bias combined with the frame's budget bias.
+    float GetLodBias(float bias) const { return lodPolicy_ ? bias * lodPolicy_->budgetBias_ : bias; }
+
     /// Frame number.
     unsigned frameNumber_;
     /// Time elapsed since last frame.
@@ -75,6 +101,8 @@ struct FrameInfo
     IntVector2 viewSize_;
     /// Camera being used.
     Camera* camera_;
+    /// LOD policy, or null for plain distance-based LOD selection.
+    LodPolicy* lodPolicy_;
 };
 
 /// Source data for a 3D geometry draw call.
@@ -134,6 +162,8 @@ public:
     virtual void UpdateBatches(const FrameInfo& frame);
     /// Prepare geometry for rendering.
     virtual void UpdateGeometry(const FrameInfo& frame) { }
+    /// Upload geometry prepared into staging memory by UpdateGeometry(). Called from the main thread after all worker thread updates.
+    virtual void CommitGeometry(const FrameInfo& frame) { }
 
     /// Return whether a geometry update is necessary, and if it can happen in a worker thread.
     virtual UpdateGeometryType GetUpdateGeometryType() { return UPDATE_NONE; }
@@ -224,6 +254,9 @@ public:
     /// Return draw call source data.
     const Vector<SourceBatch>& GetBatches() const { return batches_; }
 
+    /// Return transform version. Changes to a new, globally unique value whenever a transform affecting the drawable is dirtied.
+    unsigned GetTransformVersion() const { return transformVersion_; }
+
     /// Set new zone. Zone assignment may optionally be temporary, meaning it needs to be re-evaluated on the next frame.
     void SetZone(Zone* zone, bool temporary = false);
     /// Set sorting value.
@@ -346,6 +379,8 @@ protected:
     bool updateQueued_;
     /// Zone inconclusive or dirtied flag.
     bool zoneDirty_;
+    /// Transform version.
+    unsigned transformVersion_;
     /// Octree octant.
     SceneCell* octant_;
     /// Current zone.
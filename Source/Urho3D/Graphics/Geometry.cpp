@@ -22,9 +22,11 @@
 
 #include "../Precompiled.h"
 
+#include "../Core/Profiler.h"
 #include "../Graphics/Geometry.h"
 #include "../Graphics/Graphics.h"
 #include "../Graphics/IndexBuffer.h"
+#include "../Graphics/TriangleBVH.h"
 #include "../Graphics/VertexBuffer.h"
 #include "../IO/Log.h"
 #include "../Math/Ray.h"
@@ -34,6 +36,9 @@
 namespace Urho3D
 {
 
+/// Minimum number of triangles to build a triangle hierarchy for; smaller geometries are scanned directly.
+static const unsigned MIN_BVH_TRIANGLES = 64;
+
 Geometry::Geometry(Context* context) :
     Object(context),
     primitiveType_(TRIANGLE_LIST),
@@ -43,7 +48,9 @@ Geometry::Geometry(Context* context) :
     vertexCount_(0),
     rawVertexSize_(0),
     rawIndexSize_(0),
-    lodDistance_(0.0f)
+    lodDistance_(0.0f),
+    triangleBVHEnabled_(false),
+    triangleBVHChecked_(false)
 {
     SetNumVertexBuffers(1);
 }
@@ -73,12 +80,15 @@ bool Geometry::SetVertexBuffer(unsigned index, VertexBuffer* buffer)
     }
 
     vertexBuffers_[index] = buffer;
+    if (!index)
+        ResetTriangleBVH();
     return true;
 }
 
 void Geometry::SetIndexBuffer(IndexBuffer* buffer)
 {
     indexBuffer_ = buffer;
+    ResetTriangleBVH();
 }
 
 bool Geometry::SetDrawRange(PrimitiveType type, unsigned indexStart, unsigned indexCount, bool getUsedVertexRange)
@@ -114,6 +124,7 @@ bool Geometry::SetDrawRange(PrimitiveType type, unsigned indexStart, unsigned in
         vertexCount_ = 0;
     }
 
+    ResetTriangleBVH();
     return true;
 }
 
@@ -142,6 +153,7 @@ bool Geometry::SetDrawRange(PrimitiveType type, unsigned indexStart, unsigned in
     vertexStart_ = vertexStart;
     vertexCount_ = vertexCount;
 
+    ResetTriangleBVH();
     return true;
 }
 
@@ -158,6 +170,7 @@ void Geometry::SetRawVertexData(const SharedArrayPtr<unsigned char>& data, const
     rawVertexData_ = data;
     rawVertexSize_ = VertexBuffer::GetVertexSize(elements);
     rawElements_ = elements;
+    ResetTriangleBVH();
 }
 
 void Geometry::SetRawVertexData(const SharedArrayPtr<unsigned char>& data, unsigned elementMask)
@@ -165,12 +178,14 @@ void Geometry::SetRawVertexData(const SharedArrayPtr<unsigned char>& data, unsig
     rawVertexData_ = data;
     rawVertexSize_ = VertexBuffer::GetVertexSize(elementMask);
     rawElements_ = VertexBuffer::GetElements(elementMask);
+    ResetTriangleBVH();
 }
 
 void Geometry::SetRawIndexData(const SharedArrayPtr<unsigned char>& data, unsigned indexSize)
 {
     rawIndexData_ = data;
     rawIndexSize_ = indexSize;
+    ResetTriangleBVH();
 }
 
 void Geometry::Draw(Graphics* graphics, bool isVR)
@@ -328,6 +343,9 @@ float Geometry::GetHitDistance(const Ray& ray, Vector3* outNormal, Vector2* outU
         outUV = nullptr;
     }
 
+    if (SharedPtr<TriangleBVH> bvh = GetTriangleBVH())
+        return bvh->GetHitDistance(ray, vertexData, vertexSize, outNormal, outUV, uvOffset);
+
     return indexData ? ray.HitDistance(vertexData, vertexSize, indexData, indexSize, indexStart_, indexCount_, outNormal, outUV,
         uvOffset) : ray.HitDistance(vertexData, vertexSize, vertexStart_, vertexCount_, outNormal, outUV, uvOffset);
 }
@@ -346,4 +364,59 @@ bool Geometry::IsInside(const Ray& ray) const
                          ray.InsideGeometry(vertexData, vertexSize, vertexStart_, vertexCount_)) : false;
 }
 
+void Geometry::SetTriangleBVHEnabled(bool enable)
+{
+    if (enable == triangleBVHEnabled_)
+        return;
+
+    ResetTriangleBVH();
+    triangleBVHEnabled_ = enable;
+}
+
+SharedPtr<TriangleBVH> Geometry::GetTriangleBVH() const
+{
+    if (!triangleBVHEnabled_)
+        return SharedPtr<TriangleBVH>();
+
+    MutexLock lock(triangleBVHMutex_);
+
+    if (!triangleBVHChecked_)
+    {
+        triangleBVHChecked_ = true;
+
+        const unsigned char* vertexData;
+        const unsigned char* indexData;
+        unsigned vertexSize;
+        unsigned indexSize;
+        const PODVector<VertexElement>* elements;
+
+        GetRawData(vertexData, vertexSize, indexData, indexSize, elements);
+
+        if (primitiveType_ != TRIANGLE_LIST || !vertexData || !elements ||
+            VertexBuffer::GetElementOffset(*elements, TYPE_VECTOR3, SEM_POSITION) != 0)
+            return SharedPtr<TriangleBVH>();
+
+        const unsigned start = indexData ? indexStart_ : vertexStart_;
+        const unsigned count = indexData ? indexCount_ : vertexCount_;
+        if (count / 3 < MIN_BVH_TRIANGLES)
+            return SharedPtr<TriangleBVH>();
+
+        URHO3D_PROFILE(BuildTriangleBVH);
+
+        SharedPtr<TriangleBVH> bvh(new TriangleBVH());
+        if (bvh->Build(vertexData, vertexSize, indexData, indexSize, start, count))
+            triangleBVH_ = bvh;
+    }
+
+    return triangleBVH_;
+}
+
+void Geometry::ResetTriangleBVH()
+{
+    MutexLock lock(triangleBVHMutex_);
+
+    triangleBVH_.Reset();
+    triangleBVHChecked_ = false;
+}
+
 }
@@ -23,6 +23,7 @@
 #pragma once
 
 #include "../Container/ArrayPtr.h"
+#include "../Core/Mutex.h"
 #include "../Core/Object.h"
 #include "../Graphics/GraphicsDefs.h"
 
@@ -32,6 +33,7 @@ namespace Urho3D
 class IndexBuffer;
 class Ray;
 class Graphics;
+class TriangleBVH;
 class VertexBuffer;
 
 /// Defines one or more vertex buffers, an index buffer and a draw range.
@@ -108,6 +110,14 @@ public:
     float GetHitDistance(const Ray& ray, Vector3* outNormal = nullptr, Vector2* outUV = nullptr) const;
     /// Return whether or not the ray is inside geometry.
     bool IsInside(const Ray& ray) const;
+    /// Set whether ray queries use a triangle hierarchy over the raw data. A change to the data discards the hierarchy and the next query rebuilds it, so enable only for geometry that stays unchanged between queries. Default false.
+    void SetTriangleBVHEnabled(bool enable);
+    /// Return whether ray queries use a triangle hierarchy.
+    bool GetTriangleBVHEnabled() const { return triangleBVHEnabled_; }
+    /// Return the triangle hierarchy over the raw data, building it on first use. Return null if not enabled, or if the geometry is too small to benefit or has no raw triangle list data. Thread-safe.
+    SharedPtr<TriangleBVH> GetTriangleBVH() const;
+    /// Discard the triangle hierarchy. Call after modifying the raw data in place.
+    void ResetTriangleBVH();
 
     /// Return whether has empty draw range.
     bool IsEmpty() const { return indexCount_ == 0 && vertexCount_ == 0; }
@@ -139,6 +149,14 @@ private:
     unsigned rawVertexSize_;
     /// Raw index data override size.
     unsigned rawIndexSize_;
+    /// Triangle hierarchy for ray and volume queries.
+    mutable SharedPtr<TriangleBVH> triangleBVH_;
+    /// Triangle hierarchy enabled flag.
+    bool triangleBVHEnabled_;
+    /// Triangle hierarchy build attempted flag.
+    mutable bool triangleBVHChecked_;
+    /// Triangle hierarchy build mutex.
+    mutable Mutex triangleBVHMutex_;
 };
 
 }
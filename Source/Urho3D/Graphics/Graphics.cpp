@@ -30,8 +30,10 @@
 #include "../Graphics/CustomGeometry.h"
 #include "../Graphics/DebugRenderer.h"
 #include "../Graphics/DecalSet.h"
+#include "../Graphics/InstanceCluster.h"
 #include "../Graphics/LightProbe.h"
 #include "../Graphics/LightProbeManager.h"
+#include "../Graphics/LightProbeVolume.h"
 #include "../Graphics/Graphics.h"
 #include "../Graphics/GraphicsImpl.h"
 #include "../Graphics/Material.h"
@@ -43,6 +45,7 @@
 #include "../Graphics/ShaderPrecache.h"
 #include "../Graphics/Skybox.h"
 #include "../Graphics/StaticModelGroup.h"
+#include "../Graphics/StreamingTerrain.h"
 #include "../Graphics/Technique.h"
 #include "../Graphics/Terrain.h"
 #include "../Graphics/TerrainPatch.h"
@@ -428,8 +431,10 @@ void RegisterGraphicsLibrary(Context* context)
     Light::RegisterObject(context);
 	LightProbe::RegisterObject(context);
 	LightProbeManager::RegisterObject(context);
+	LightProbeVolume::RegisterObject(context);
     StaticModel::RegisterObject(context);
     StaticModelGroup::RegisterObject(context);
+    InstanceCluster::RegisterObject(context);
     Skybox::RegisterObject(context);
     AnimatedModel::RegisterObject(context);
     AnimationController::RegisterObject(context);
@@ -441,6 +446,7 @@ void RegisterGraphicsLibrary(Context* context)
     DecalSet::RegisterObject(context);
     Terrain::RegisterObject(context);
     TerrainPatch::RegisterObject(context);
+    StreamingTerrain::RegisterObject(context);
     DebugRenderer::RegisterObject(context);
     Octree::RegisterObject(context);
     Zone::RegisterObject(context);
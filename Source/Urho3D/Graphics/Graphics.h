@@ -135,6 +135,10 @@ public:
     bool ResolveToTexture(Texture2D* texture);
     /// Resolve a multisampled cube texture on itself.
     bool ResolveToTexture(TextureCube* texture);
+    /// Copy the full contents of a texture to another texture of the same size and format. Return true if successful. Not supported on Direct3D9 and OpenGL ES.
+    bool CopyTexture(Texture2D* source, Texture2D* destination);
+    /// Copy a rectangle of a texture to the same position in another texture of the same size and format. Return true if successful. Not supported on Direct3D9 and OpenGL ES. On Direct3D11 depth-stencil and multisampled textures can only be copied whole.
+    bool CopyTextureRegion(Texture2D* source, Texture2D* destination, const IntRect& rect);
     /// Draw non-indexed geometry.
     void Draw(PrimitiveType type, unsigned vertexStart, unsigned vertexCount);
     /// Draw indexed geometry.
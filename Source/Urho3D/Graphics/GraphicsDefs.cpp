@@ -77,6 +77,7 @@ extern URHO3D_API const StringHash PSP_MATSPECCOLOR("MatSpecColor");
 extern URHO3D_API const StringHash PSP_NEARCLIP("NearClipPS");
 extern URHO3D_API const StringHash PSP_FARCLIP("FarClipPS");
 extern URHO3D_API const StringHash PSP_SHADOWCUBEADJUST("ShadowCubeAdjust");
+extern URHO3D_API const StringHash PSP_SHADOWCUBEUVSCALE("ShadowCubeUVScale");
 extern URHO3D_API const StringHash PSP_SHADOWDEPTHFADE("ShadowDepthFade");
 extern URHO3D_API const StringHash PSP_SHADOWINTENSITY("ShadowIntensity");
 extern URHO3D_API const StringHash PSP_SHADOWMAPINVSIZE("ShadowMapInvSize");
@@ -0,0 +1,732 @@
+//
+// Copyright (c) 2017-2020 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#include "../Precompiled.h"
+
+#include "../Container/Sort.h"
+#include "../Core/Context.h"
+#include "../Core/Profiler.h"
+#include "../Core/WorkQueue.h"
+#include "../Graphics/Batch.h"
+#include "../Graphics/Camera.h"
+#include "../Graphics/Geometry.h"
+#include "../Graphics/GraphicsEvents.h"
+#include "../Graphics/InstanceCluster.h"
+#include "../Graphics/OctreeQuery.h"
+#include "../Graphics/View.h"
+#include "../IO/Log.h"
+#include "../IO/MemoryBuffer.h"
+#include "../IO/VectorBuffer.h"
+#include "../Scene/Scene.h"
+
+#include "../DebugNew.h"
+
+namespace Urho3D
+{
+
+extern const char* GEOMETRY_CATEGORY;
+
+static const unsigned CELL_SIZE = 64;
+static const unsigned HIERARCHY_CHILDREN = 8;
+static const unsigned CELL_INSIDE_FLAG = 0x80000000;
+static const unsigned DEFAULT_PARALLEL_THRESHOLD = 4096;
+static const float QUANTIZE_RANGE = 65535.0f;
+static const float ROTATION_SCALE = 32767.0f;
+
+/// Spread the low 10 bits of a value to every third bit.
+static unsigned SpreadMortonBits(unsigned value)
+{
+    value = (value * 0x00010001u) & 0xff0000ffu;
+    value = (value * 0x00000101u) & 0x0f00f00fu;
+    value = (value * 0x00000011u) & 0xc30c30c3u;
+    value = (value * 0x00000005u) & 0x49249249u;
+    return value;
+}
+
+static unsigned short QuantizeUnsigned(float value, float minValue, float step)
+{
+    return step > 0.0f ? (unsigned short)Clamp(RoundToInt((value - minValue) / step), 0, 65535) : (unsigned short)0;
+}
+
+void CullInstanceClusterWork(const WorkItem* item, unsigned threadIndex)
+{
+    auto* cluster = reinterpret_cast<InstanceCluster*>(item->aux_);
+    auto* task = reinterpret_cast<InstanceClusterCullTask*>(item->start_);
+    cluster->CullCells(*task, (unsigned)(task - cluster->tasks_.Buffer()));
+}
+
+void CompactInstanceClusterWork(const WorkItem* item, unsigned threadIndex)
+{
+    auto* cluster = reinterpret_cast<InstanceCluster*>(item->aux_);
+    auto* task = reinterpret_cast<InstanceClusterCullTask*>(item->start_);
+    cluster->CompactCells(*task, (unsigned)(task - cluster->tasks_.Buffer()));
+}
+
+InstanceCluster::InstanceCluster(Context* context) :
+    StaticModel(context),
+    cullCamera_(nullptr),
+    cullLodBias_(1.0f),
+    cullView_(nullptr),
+    parallelThreshold_(DEFAULT_PARALLEL_THRESHOLD),
+    numVisibleInstances_(0)
+{
+    UpdateCullBuffers();
+}
+
+InstanceCluster::~InstanceCluster() = default;
+
+void InstanceCluster::RegisterObject(Context* context)
+{
+    context->RegisterFactory<InstanceCluster>(GEOMETRY_CATEGORY);
+
+    URHO3D_COPY_BASE_ATTRIBUTES(StaticModel);
+    URHO3D_ACCESSOR_ATTRIBUTE("Parallel Threshold", GetParallelThreshold, SetParallelThreshold, unsigned,
+        DEFAULT_PARALLEL_THRESHOLD, AM_DEFAULT);
+    URHO3D_MIXED_ACCESSOR_ATTRIBUTE("Instance Data", GetInstanceDataAttr, SetInstanceDataAttr, PODVector<unsigned char>,
+        Variant::emptyBuffer, AM_FILE | AM_NOEDIT);
+}
+
+void InstanceCluster::ProcessRayQuery(const RayOctreeQuery& query, PODVector<RayQueryResult>& results)
+{
+    RayQueryLevel level = query.level_;
+    if (level < RAY_AABB)
+    {
+        Drawable::ProcessRayQuery(query, results);
+        return;
+    }
+
+    // Check ray hit distance to AABB before proceeding with more accurate tests
+    if (query.ray_.HitDistance(GetWorldBoundingBox()) >= query.maxDistance_)
+        return;
+
+    // Reject whole cells in local space. The local distances are only compared against a miss
+    const Matrix3x4& worldTransform = node_->GetWorldTransform();
+    Ray clusterRay = query.ray_.Transformed(worldTransform.Inverse());
+
+    for (unsigned i = 0; i < cells_.Size(); ++i)
+    {
+        const InstanceClusterCell& cell = cells_[i];
+        if (clusterRay.HitDistance(cell.box_) == M_INFINITY)
+            continue;
+
+        for (unsigned j = 0; j < cell.count_; ++j)
+        {
+            Matrix3x4 instanceTransform = worldTransform * GetLocalTransform(cell, instances_[cell.first_ + j]);
+
+            // Initial test using AABB
+            float distance = query.ray_.HitDistance(boundingBox_.Transformed(instanceTransform));
+            Vector3 normal = -query.ray_.direction_;
+            Vector2 uv = Vector2::ZERO;
+
+            // Then proceed to OBB and triangle-level tests if necessary
+            if (level >= RAY_OBB && distance < query.maxDistance_)
+            {
+                Ray localRay = query.ray_.Transformed(instanceTransform.Inverse());
+                distance = localRay.HitDistance(boundingBox_);
+
+                if (level >= RAY_TRIANGLE && distance < query.maxDistance_)
+                {
+                    distance = M_INFINITY;
+
+                    for (unsigned k = 0; k < geometries_.Size(); ++k)
+                    {
+                        Geometry* geometry = geometries_[k].Size() ? geometries_[k][0].Get() : nullptr;
+                        if (geometry)
+                        {
+                            Vector3 geometryNormal;
+                            Vector2 geometryUV;
+                            float geometryDistance = level == RAY_TRIANGLE ? geometry->GetHitDistance(localRay, &geometryNormal) :
+                                geometry->GetHitDistance(localRay, &geometryNormal, &geometryUV);
+                            if (geometryDistance < query.maxDistance_ && geometryDistance < distance)
+                            {
+                                distance = geometryDistance;
+                                normal = (instanceTransform * Vector4(geometryNormal, 0.0f)).Normalized();
+                                uv = geometryUV;
+                            }
+                        }
+                    }
+                }
+            }
+
+            if (distance < query.maxDistance_)
+            {
+                RayQueryResult result;
+                result.position_ = query.ray_.origin_ + distance * query.ray_.direction_;
+                result.normal_ = normal;
+                result.textureUV_ = uv;
+                result.distance_ = distance;
+                result.drawable_ = this;
+                result.node_ = node_;
+                result.subObject_ = cell.first_ + j;
+                results.Push(result);
+            }
+        }
+    }
+}
+
+void InstanceCluster::UpdateBatches(const FrameInfo& frame)
+{
+    const BoundingBox& worldBoundingBox = GetWorldBoundingBox();
+    distance_ = frame.camera_->GetDistance(worldBoundingBox.Center());
+
+    for (unsigned i = 0; i < batches_.Size(); ++i)
+        batches_[i].distance_ = distance_;
+
+    // Large clusters have normally been culled in parallel when the view update began. Otherwise cull here; the lock also
+    // serializes the light threads updating a shadow caster
+    bool culled;
+    StaticModelInstanceView& view = instanceViews_.Lock(frame, 0, batches_.Size(), culled);
+    if (!culled)
+        CullInstances(frame, view, false);
+    SetInstanceBatches(view);
+    instanceViews_.Unlock();
+}
+
+void InstanceCluster::SetModel(Model* model)
+{
+    StaticModel::SetModel(model);
+    UpdateLodBatches();
+    UpdateBoxes();
+    UpdateCullBuffers();
+}
+
+void InstanceCluster::AddInstance(const Vector3& position, const Quaternion& rotation, float scale)
+{
+    InstanceClusterTransform instance;
+    instance.position_ = position;
+    instance.rotation_ = rotation;
+    instance.scale_ = scale;
+    pendingInstances_.Push(instance);
+}
+
+void InstanceCluster::AddInstances(const PODVector<InstanceClusterTransform>& instances)
+{
+    pendingInstances_.Push(instances);
+}
+
+void InstanceCluster::RemoveAllInstances()
+{
+    pendingInstances_.Clear();
+    instances_.Clear();
+    cells_.Clear();
+    UpdateBoxes();
+    UpdateCullBuffers();
+    MarkNetworkUpdate();
+}
+
+void InstanceCluster::Commit()
+{
+    URHO3D_PROFILE(CommitInstanceCluster);
+
+    // Requantize the committed instances along with the new ones, as the cells change
+    PODVector<InstanceClusterTransform> transforms;
+    transforms.Reserve(instances_.Size() + pendingInstances_.Size());
+    for (unsigned i = 0; i < instances_.Size(); ++i)
+        transforms.Push(GetInstance(i));
+    transforms.Push(pendingInstances_);
+    pendingInstances_.Clear();
+
+    BoundingBox positionBox;
+    for (unsigned i = 0; i < transforms.Size(); ++i)
+        positionBox.Merge(transforms[i].position_);
+
+    // Sort along a Morton curve so that each run of instances is spatially compact
+    unsigned numInstances = transforms.Size();
+    PODVector<unsigned long long> keys(numInstances);
+    if (numInstances)
+    {
+        Vector3 size = positionBox.Size();
+        Vector3 keyScale(size.x_ > M_EPSILON ? 1023.0f / size.x_ : 0.0f, size.y_ > M_EPSILON ? 1023.0f / size.y_ : 0.0f,
+            size.z_ > M_EPSILON ? 1023.0f / size.z_ : 0.0f);
+
+        for (unsigned i = 0; i < numInstances; ++i)
+        {
+            Vector3 keyPosition = (transforms[i].position_ - positionBox.min_) * keyScale;
+            unsigned code = SpreadMortonBits((unsigned)keyPosition.x_) | (SpreadMortonBits((unsigned)keyPosition.y_) << 1u) |
+                (SpreadMortonBits((unsigned)keyPosition.z_) << 2u);
+            keys[i] = ((unsigned long long)code << 32u) | i;
+        }
+
+        Sort(keys.Begin(), keys.End());
+    }
+
+    // Quantize each run relative to its own position and scale range
+    instances_.Resize(numInstances);
+    cells_.Resize((numInstances + CELL_SIZE - 1) / CELL_SIZE);
+    for (unsigned i = 0; i < cells_.Size(); ++i)
+    {
+        InstanceClusterCell& cell = cells_[i];
+        cell.first_ = i * CELL_SIZE;
+        cell.count_ = Min(CELL_SIZE, numInstances - cell.first_);
+
+        BoundingBox cellPositions;
+        float minScale = M_INFINITY;
+        float maxScale = -M_INFINITY;
+        for (unsigned j = cell.first_; j < cell.first_ + cell.count_; ++j)
+        {
+            const InstanceClusterTransform& transform = transforms[(unsigned)keys[j]];
+            cellPositions.Merge(transform.position_);
+            minScale = Min(minScale, transform.scale_);
+            maxScale = Max(maxScale, transform.scale_);
+        }
+
+        cell.positionMin_ = cellPositions.min_;
+        cell.positionStep_ = cellPositions.Size() / QUANTIZE_RANGE;
+        cell.scaleMin_ = minScale;
+        cell.scaleStep_ = (maxScale - minScale) / QUANTIZE_RANGE;
+
+        for (unsigned j = cell.first_; j < cell.first_ + cell.count_; ++j)
+        {
+            const InstanceClusterTransform& transform = transforms[(unsigned)keys[j]];
+            InstanceClusterInstance& instance = instances_[j];
+            instance.position_[0] = QuantizeUnsigned(transform.position_.x_, cell.positionMin_.x_, cell.positionStep_.x_);
+            instance.position_[1] = QuantizeUnsigned(transform.position_.y_, cell.positionMin_.y_, cell.positionStep_.y_);
+            instance.position_[2] = QuantizeUnsigned(transform.position_.z_, cell.positionMin_.z_, cell.positionStep_.z_);
+            instance.scale_ = QuantizeUnsigned(transform.scale_, cell.scaleMin_, cell.scaleStep_);
+
+            Quaternion rotation = transform.rotation_.Normalized();
+            instance.rotation_[0] = (short)RoundToInt(rotation.w_ * ROTATION_SCALE);
+            instance.rotation_[1] = (short)RoundToInt(rotation.x_ * ROTATION_SCALE);
+            instance.rotation_[2] = (short)RoundToInt(rotation.y_ * ROTATION_SCALE);
+            instance.rotation_[3] = (short)RoundToInt(rotation.z_ * ROTATION_SCALE);
+        }
+    }
+
+    UpdateBoxes();
+    UpdateCullBuffers();
+    MarkNetworkUpdate();
+}
+
+void InstanceCluster::SetParallelThreshold(unsigned count)
+{
+    parallelThreshold_ = count;
+    MarkNetworkUpdate();
+}
+
+InstanceClusterTransform InstanceCluster::GetInstance(unsigned index) const
+{
+    InstanceClusterTransform ret;
+    if (index >= instances_.Size())
+    {
+        ret.rotation_ = Quaternion::IDENTITY;
+        ret.scale_ = 1.0f;
+        return ret;
+    }
+
+    const InstanceClusterCell& cell = cells_[index / CELL_SIZE];
+    const InstanceClusterInstance& instance = instances_[index];
+    ret.position_ = Vector3(cell.positionMin_.x_ + instance.position_[0] * cell.positionStep_.x_,
+        cell.positionMin_.y_ + instance.position_[1] * cell.positionStep_.y_,
+        cell.positionMin_.z_ + instance.position_[2] * cell.positionStep_.z_);
+    ret.rotation_ = Quaternion(instance.rotation_[0] / ROTATION_SCALE, instance.rotation_[1] / ROTATION_SCALE,
+        instance.rotation_[2] / ROTATION_SCALE, instance.rotation_[3] / ROTATION_SCALE).Normalized();
+    ret.scale_ = cell.scaleMin_ + instance.scale_ * cell.scaleStep_;
+    return ret;
+}
+
+unsigned InstanceCluster::GetMemoryUse() const
+{
+    unsigned ret = instances_.Size() * sizeof(InstanceClusterInstance) + cells_.Size() * sizeof(InstanceClusterCell) +
+        pendingInstances_.Size() * sizeof(InstanceClusterTransform);
+    for (unsigned i = 0; i < levelBoxes_.Size(); ++i)
+        ret += levelBoxes_[i].Size() * sizeof(BoundingBox);
+    return ret;
+}
+
+void InstanceCluster::SetInstanceDataAttr(const PODVector<unsigned char>& value)
+{
+    instances_.Clear();
+    cells_.Clear();
+
+    if (!value.Empty())
+    {
+        MemoryBuffer buffer(value);
+        cells_.Resize(buffer.ReadVLE());
+
+        // Every cell but the last is full, which GetInstance() and the culling rely on
+        bool valid = true;
+        unsigned first = 0;
+        for (unsigned i = 0; i < cells_.Size(); ++i)
+        {
+            InstanceClusterCell& cell = cells_[i];
+            cell.positionMin_ = buffer.ReadVector3();
+            cell.positionStep_ = buffer.ReadVector3();
+            cell.scaleMin_ = buffer.ReadFloat();
+            cell.scaleStep_ = buffer.ReadFloat();
+            cell.first_ = first;
+            cell.count_ = buffer.ReadVLE();
+            if (!cell.count_ || cell.count_ > CELL_SIZE || (cell.count_ < CELL_SIZE && i + 1 < cells_.Size()))
+                valid = false;
+            first += cell.count_;
+        }
+
+        unsigned numInstances = buffer.ReadVLE();
+        unsigned dataSize = numInstances * sizeof(InstanceClusterInstance);
+        if (!valid || numInstances != first || buffer.GetSize() - buffer.GetPosition() < dataSize)
+        {
+            URHO3D_LOGERROR("Invalid instance cluster data");
+            cells_.Clear();
+        }
+        else
+        {
+            instances_.Resize(numInstances);
+            buffer.Read(instances_.Buffer(), dataSize);
+        }
+    }
+
+    UpdateBoxes();
+    UpdateCullBuffers();
+}
+
+PODVector<unsigned char> InstanceCluster::GetInstanceDataAttr() const
+{
+    VectorBuffer ret;
+
+    ret.WriteVLE(cells_.Size());
+    for (unsigned i = 0; i < cells_.Size(); ++i)
+    {
+        const InstanceClusterCell& cell = cells_[i];
+        ret.WriteVector3(cell.positionMin_);
+        ret.WriteVector3(cell.positionStep_);
+        ret.WriteFloat(cell.scaleMin_);
+        ret.WriteFloat(cell.scaleStep_);
+        ret.WriteVLE(cell.count_);
+    }
+
+    ret.WriteVLE(instances_.Size());
+    ret.Write(instances_.Buffer(), instances_.Size() * sizeof(InstanceClusterInstance));
+
+    return ret.GetBuffer();
+}
+
+void InstanceCluster::OnSceneSet(Scene* scene)
+{
+    StaticModel::OnSceneSet(scene);
+
+    if (scene)
+        SubscribeToEvent(E_BEGINVIEWUPDATE, URHO3D_HANDLER(InstanceCluster, HandleBeginViewUpdate));
+    else
+        UnsubscribeFromEvent(E_BEGINVIEWUPDATE);
+}
+
+void InstanceCluster::OnWorldBoundingBoxUpdate()
+{
+    if (clusterBox_.Defined())
+        worldBoundingBox_ = clusterBox_.Transformed(node_->GetWorldTransform());
+    else
+    {
+        Vector3 worldPosition = node_->GetWorldPosition();
+        worldBoundingBox_.Define(worldPosition, worldPosition);
+    }
+}
+
+void InstanceCluster::HandleBeginViewUpdate(StringHash eventType, VariantMap& eventData)
+{
+    using namespace BeginViewUpdate;
+
+    if (instances_.Size() < parallelThreshold_ || batches_.Empty() || !IsEnabledEffective() ||
+        eventData[P_SCENE].GetPtr() != GetScene())
+        return;
+
+    auto* view = static_cast<View*>(eventData[P_VIEW].GetPtr());
+    const FrameInfo& frame = view->GetFrameInfo();
+    Camera* camera = frame.camera_;
+    if (!camera || !(camera->GetViewMask() & viewMask_) || camera->GetFrustum().IsInsideFast(GetWorldBoundingBox()) == OUTSIDE)
+        return;
+
+    URHO3D_PROFILE(CullInstanceCluster);
+
+    // The view's own batch update then reuses the result
+    bool culled;
+    StaticModelInstanceView& instanceView = instanceViews_.Lock(frame, 0, batches_.Size(), culled);
+    if (!culled)
+        CullInstances(frame, instanceView, true);
+    instanceViews_.Unlock();
+}
+
+void InstanceCluster::CullInstances(const FrameInfo& frame, StaticModelInstanceView& view, bool parallel)
+{
+    cullCamera_ = frame.camera_;
+    cullTransform_ = node_->GetWorldTransform();
+    cullLodBias_ = frame.GetLodBias(lodBias_);
+    cullFrustum_ = cullCamera_->GetFrustum().Transformed(cullTransform_.Inverse());
+    cullView_ = &view;
+
+    // The shadow batches reuse these lists, so a shadow caster keeps the cells and instances outside the view frustum and only
+    // chooses their LOD, as StaticModelGroup does
+    visibleCells_.Clear();
+    if (!cells_.Empty())
+        GatherCells(levelBoxes_.Size(), 0, castShadows_);
+
+    // Split the visible cells into tasks of roughly equal instance counts
+    auto* queue = parallel ? GetSubsystem<WorkQueue>() : nullptr;
+    unsigned numTasks = queue ? queue->GetNumThreads() + 1 : 1;
+    unsigned numCandidates = 0;
+    for (unsigned i = 0; i < visibleCells_.Size(); ++i)
+        numCandidates += cells_[visibleCells_[i] & ~CELL_INSIDE_FLAG].count_;
+
+    tasks_.Clear();
+    unsigned instancesPerTask = (numCandidates + numTasks - 1) / numTasks;
+    InstanceClusterCullTask task;
+    task.start_ = 0;
+    task.visibleStart_ = 0;
+    task.numVisible_ = 0;
+    unsigned taskInstances = 0;
+    for (unsigned i = 0; i < visibleCells_.Size(); ++i)
+    {
+        taskInstances += cells_[visibleCells_[i] & ~CELL_INSIDE_FLAG].count_;
+        if (taskInstances >= instancesPerTask || i + 1 == visibleCells_.Size())
+        {
+            task.end_ = i + 1;
+            tasks_.Push(task);
+            task.start_ = i + 1;
+            task.visibleStart_ += taskInstances;
+            taskInstances = 0;
+        }
+    }
+
+    // Cull the instances and count the transforms of each batch per task
+    if (tasks_.Size() > 1)
+    {
+        for (unsigned i = 0; i < tasks_.Size(); ++i)
+        {
+            SharedPtr<WorkItem> item = queue->GetFreeItem();
+            item->priority_ = M_MAX_UNSIGNED;
+            item->workFunction_ = CullInstanceClusterWork;
+            item->aux_ = this;
+            item->start_ = &tasks_[i];
+            queue->AddWorkItem(item);
+        }
+        queue->Complete(M_MAX_UNSIGNED);
+    }
+    else if (tasks_.Size())
+        CullCells(tasks_[0], 0);
+
+    // Turn the counts into write offsets. The transforms are stored in batch order, and within a batch in task order
+    unsigned numBatches = batches_.Size();
+    unsigned offset = 0;
+    numVisibleInstances_ = 0;
+    for (unsigned i = 0; i < numBatches; ++i)
+    {
+        view.batchCounts_[i] = 0;
+        for (unsigned j = 0; j < tasks_.Size(); ++j)
+        {
+            unsigned& count = taskBatchCounts_[j * numBatches + i];
+            view.batchCounts_[i] += count;
+            unsigned taskOffset = offset;
+            offset += count;
+            count = taskOffset;
+        }
+    }
+    for (unsigned i = 0; i < tasks_.Size(); ++i)
+        numVisibleInstances_ += tasks_[i].numVisible_;
+
+    view.Reserve(offset);
+
+    // Decode the visible transforms into their batches
+    if (tasks_.Size() > 1)
+    {
+        for (unsigned i = 0; i < tasks_.Size(); ++i)
+        {
+            SharedPtr<WorkItem> item = queue->GetFreeItem();
+            item->priority_ = M_MAX_UNSIGNED;
+            item->workFunction_ = CompactInstanceClusterWork;
+            item->aux_ = this;
+            item->start_ = &tasks_[i];
+            queue->AddWorkItem(item);
+        }
+        queue->Complete(M_MAX_UNSIGNED);
+    }
+    else if (tasks_.Size())
+        CompactCells(tasks_[0], 0);
+}
+
+void InstanceCluster::GatherCells(unsigned level, unsigned index, bool inside)
+{
+    if (!inside)
+    {
+        Intersection result = cullFrustum_.IsInside(level ? levelBoxes_[level - 1][index] : cells_[index].box_);
+        if (result == OUTSIDE)
+            return;
+        inside = result == INSIDE;
+    }
+
+    if (!level)
+    {
+        visibleCells_.Push(inside ? index | CELL_INSIDE_FLAG : index);
+        return;
+    }
+
+    unsigned childStart = index * HIERARCHY_CHILDREN;
+    unsigned childEnd = Min(childStart + HIERARCHY_CHILDREN, level > 1 ? levelBoxes_[level - 2].Size() : cells_.Size());
+    for (unsigned i = childStart; i < childEnd; ++i)
+        GatherCells(level - 1, i, inside);
+}
+
+void InstanceCluster::CullCells(InstanceClusterCullTask& task, unsigned taskIndex)
+{
+    unsigned numGeometries = geometries_.Size();
+    unsigned numBatches = batches_.Size();
+    unsigned* counts = &taskBatchCounts_[taskIndex * numBatches];
+    for (unsigned i = 0; i < numBatches; ++i)
+        counts[i] = 0;
+
+    unsigned* destInstances = &visibleInstances_[task.visibleStart_];
+    float* destLodDistances = &visibleLodDistances_[task.visibleStart_];
+    float modelScale = boundingBox_.Size().DotProduct(DOT_SCALE) * cullTransform_.Scale().DotProduct(DOT_SCALE);
+    unsigned numVisible = 0;
+
+    for (unsigned i = task.start_; i < task.end_; ++i)
+    {
+        const InstanceClusterCell& cell = cells_[visibleCells_[i] & ~CELL_INSIDE_FLAG];
+        bool inside = (visibleCells_[i] & CELL_INSIDE_FLAG) != 0;
+
+        // When the nearest and farthest instance resolve to the same LOD levels, the whole cell shares one LOD distance
+        BoundingBox worldBox = cell.box_.Transformed(cullTransform_);
+        float centerDistance = cullCamera_->GetDistance(worldBox.Center());
+        float radius = worldBox.HalfSize().Length();
+        float nearLodDistance = cullCamera_->GetLodDistance(Max(centerDistance - radius, 0.0f),
+            modelScale * (cell.scaleMin_ + cell.scaleStep_ * QUANTIZE_RANGE), cullLodBias_);
+        float farLodDistance = cullCamera_->GetLodDistance(centerDistance + radius, modelScale * cell.scaleMin_, cullLodBias_);
+        bool uniformLod = true;
+        for (unsigned j = 0; j < numGeometries; ++j)
+        {
+            if (GetLodLevel(j, nearLodDistance) != GetLodLevel(j, farLodDistance))
+            {
+                uniformLod = false;
+                break;
+            }
+        }
+
+        for (unsigned j = cell.first_; j < cell.first_ + cell.count_; ++j)
+        {
+            const InstanceClusterInstance& instance = instances_[j];
+            float lodDistance = nearLodDistance;
+
+            if (!inside || !uniformLod)
+            {
+                Matrix3x4 localTransform = GetLocalTransform(cell, instance);
+                if (!inside && cullFrustum_.IsInsideFast(boundingBox_.Transformed(localTransform)) == OUTSIDE)
+                    continue;
+                if (!uniformLod)
+                {
+                    float scale = cell.scaleMin_ + instance.scale_ * cell.scaleStep_;
+                    lodDistance = cullCamera_->GetLodDistance(cullCamera_->GetDistance(cullTransform_ *
+                        localTransform.Translation()), modelScale * scale, cullLodBias_);
+                }
+            }
+
+            destInstances[numVisible] = j;
+            destLodDistances[numVisible] = lodDistance;
+            ++numVisible;
+
+            for (unsigned k = 0; k < numGeometries; ++k)
+                ++counts[GetLodBatchIndex(k, GetLodLevel(k, lodDistance))];
+        }
+    }
+
+    task.numVisible_ = numVisible;
+}
+
+void InstanceCluster::CompactCells(const InstanceClusterCullTask& task, unsigned taskIndex)
+{
+    unsigned numGeometries = geometries_.Size();
+    unsigned* offsets = &taskBatchCounts_[taskIndex * batches_.Size()];
+    Matrix3x4* dest = cullView_->transforms_.Get();
+    const unsigned* visibleInstances = &visibleInstances_[task.visibleStart_];
+    const float* visibleLodDistances = &visibleLodDistances_[task.visibleStart_];
+
+    for (unsigned i = 0; i < task.numVisible_; ++i)
+    {
+        unsigned index = visibleInstances[i];
+        Matrix3x4 worldTransform = cullTransform_ * GetLocalTransform(cells_[index / CELL_SIZE], instances_[index]);
+
+        for (unsigned j = 0; j < numGeometries; ++j)
+            dest[offsets[GetLodBatchIndex(j, GetLodLevel(j, visibleLodDistances[i]))]++] = worldTransform;
+    }
+}
+
+Matrix3x4 InstanceCluster::GetLocalTransform(const InstanceClusterCell& cell, const InstanceClusterInstance& instance) const
+{
+    Vector3 position(cell.positionMin_.x_ + instance.position_[0] * cell.positionStep_.x_,
+        cell.positionMin_.y_ + instance.position_[1] * cell.positionStep_.y_,
+        cell.positionMin_.z_ + instance.position_[2] * cell.positionStep_.z_);
+    Quaternion rotation(instance.rotation_[0] / ROTATION_SCALE, instance.rotation_[1] / ROTATION_SCALE,
+        instance.rotation_[2] / ROTATION_SCALE, instance.rotation_[3] / ROTATION_SCALE);
+    float scale = cell.scaleMin_ + instance.scale_ * cell.scaleStep_;
+
+    return Matrix3x4(position, rotation.Normalized(), scale);
+}
+
+void InstanceCluster::UpdateBoxes()
+{
+    // Without a model the instances are points
+    bool hasModel = boundingBox_.Defined();
+
+    clusterBox_.Clear();
+    for (unsigned i = 0; i < cells_.Size(); ++i)
+    {
+        InstanceClusterCell& cell = cells_[i];
+        cell.box_.Clear();
+        for (unsigned j = cell.first_; j < cell.first_ + cell.count_; ++j)
+        {
+            Matrix3x4 localTransform = GetLocalTransform(cell, instances_[j]);
+            if (hasModel)
+                cell.box_.Merge(boundingBox_.Transformed(localTransform));
+            else
+                cell.box_.Merge(localTransform.Translation());
+        }
+        clusterBox_.Merge(cell.box_);
+    }
+
+    // Build the levels bottom-up until a single root box remains
+    levelBoxes_.Clear();
+    unsigned numChildren = cells_.Size();
+    while (numChildren > 1)
+    {
+        PODVector<BoundingBox> boxes((numChildren + HIERARCHY_CHILDREN - 1) / HIERARCHY_CHILDREN);
+        for (unsigned i = 0; i < boxes.Size(); ++i)
+        {
+            unsigned childEnd = Min((i + 1) * HIERARCHY_CHILDREN, numChildren);
+            for (unsigned j = i * HIERARCHY_CHILDREN; j < childEnd; ++j)
+                boxes[i].Merge(levelBoxes_.Empty() ? cells_[j].box_ : levelBoxes_.Back()[j]);
+        }
+        levelBoxes_.Push(boxes);
+        numChildren = boxes.Size();
+    }
+
+    OnMarkedDirty(node_);
+}
+
+void InstanceCluster::UpdateCullBuffers()
+{
+    auto* queue = GetSubsystem<WorkQueue>();
+    unsigned maxTasks = queue ? queue->GetNumThreads() + 1 : 1;
+
+    tasks_.Reserve(maxTasks);
+    taskBatchCounts_.Resize(maxTasks * batches_.Size());
+    visibleCells_.Reserve(cells_.Size());
+    visibleInstances_.Resize(instances_.Size());
+    visibleLodDistances_.Resize(instances_.Size());
+}
+
+}
@@ -0,0 +1,212 @@
+//
+// Copyright (c) 2017-2020 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+
+#pragma once
+
+#include "../Graphics/StaticModel.h"
+#include "../Math/Frustum.h"
+#include "../Math/Quaternion.h"
+
+namespace Urho3D
+{
+
+struct WorkItem;
+
+/// Unquantized transform of an instance cluster instance, relative to the scene node.
+struct InstanceClusterTransform
+{
+    /// Position.
+    Vector3 position_;
+    /// Rotation.
+    Quaternion rotation_;
+    /// Uniform scale.
+    float scale_;
+};
+
+/// Instance of an instance cluster, with its transform quantized relative to its cell.
+struct InstanceClusterInstance
+{
+    /// Position within the cell's position range, 16 bits per axis.
+    unsigned short position_[3];
+    /// Uniform scale within the cell's scale range.
+    unsigned short scale_;
+    /// Rotation quaternion in w, x, y, z order, scaled to the signed 16-bit range.
+    short rotation_[4];
+};
+
+/// Leaf of the instance hierarchy: a run of spatially close instances.
+struct InstanceClusterCell
+{
+    /// Local-space bounding box of the instance models.
+    BoundingBox box_;
+    /// Minimum instance position.
+    Vector3 positionMin_;
+    /// Position per quantization step.
+    Vector3 positionStep_;
+    /// Minimum instance scale.
+    float scaleMin_;
+    /// Scale per quantization step.
+    float scaleStep_;
+    /// Index of the first instance.
+    unsigned first_;
+    /// Number of instances.
+    unsigned count_;
+};
+
+/// Part of the visible cells culled by one work item.
+struct InstanceClusterCullTask
+{
+    /// Start index in the visible cells.
+    unsigned start_;
+    /// End index in the visible cells.
+    unsigned end_;
+    /// Start of the task's output in the visible instance buffers.
+    unsigned visibleStart_;
+    /// Number of instances that passed culling.
+    unsigned numVisible_;
+};
+
+/// Draws a large number of static instances of one model without scene nodes. The instances are sorted into cells of nearby
+/// instances with quantized transforms, and the cells into a bounding box hierarchy. Culling and LOD selection happen per cell
+/// and then per instance, in parallel for large clusters, and the visible instances are drawn as instanced batches per LOD
+/// level. Shadow casting clusters skip the frustum test and only choose the LOD level, so that instances outside the view
+/// frustum keep their shadows.
+class URHO3D_API InstanceCluster : public StaticModel
+{
+    URHO3D_OBJECT(InstanceCluster, StaticModel);
+
+    friend void CullInstanceClusterWork(const WorkItem* item, unsigned threadIndex);
+    friend void CompactInstanceClusterWork(const WorkItem* item, unsigned threadIndex);
+
+public:
+    /// Construct.
+    explicit InstanceCluster(Context* context);
+    /// Destruct.
+    ~InstanceCluster() override;
+    /// Register object factory. StaticModel must be registered first.
+    static void RegisterObject(Context* context);
+
+    /// Process octree raycast. May be called from a worker thread.
+    void ProcessRayQuery(const RayOctreeQuery& query, PODVector<RayQueryResult>& results) override;
+    /// Calculate distance and prepare batches for rendering. May be called from worker thread(s), possibly re-entrantly.
+    void UpdateBatches(const FrameInfo& frame) override;
+    /// Return number of occlusion geometry triangles. Instance clusters are not occluders.
+    unsigned GetNumOccluderTriangles() override { return 0; }
+    /// Draw to occlusion buffer. Instance clusters are not occluders.
+    bool DrawOcclusion(OcclusionBuffer* buffer) override { return true; }
+    /// Set model.
+    void SetModel(Model* model) override;
+
+    /// Add an instance relative to the scene node. Takes effect on Commit().
+    void AddInstance(const Vector3& position, const Quaternion& rotation = Quaternion::IDENTITY, float scale = 1.0f);
+    /// Add instances relative to the scene node. Take effect on Commit().
+    void AddInstances(const PODVector<InstanceClusterTransform>& instances);
+    /// Remove all instances.
+    void RemoveAllInstances();
+    /// Sort the added instances into the hierarchy along with the existing ones, which are requantized. Must be called from the
+    /// main thread.
+    void Commit();
+    /// Set the number of instances from which culling is split into work items for the worker threads.
+    void SetParallelThreshold(unsigned count);
+
+    /// Return number of committed instances.
+    unsigned GetNumInstances() const { return instances_.Size(); }
+    /// Return number of cells.
+    unsigned GetNumCells() const { return cells_.Size(); }
+    /// Return the transform of a committed instance after quantization. The instance order changes on Commit().
+    InstanceClusterTransform GetInstance(unsigned index) const;
+    /// Return the number of instances from which culling runs in parallel.
+    unsigned GetParallelThreshold() const { return parallelThreshold_; }
+    /// Return number of instances that passed culling in the last batch update.
+    unsigned GetNumVisibleInstances() const { return numVisibleInstances_; }
+    /// Return memory used by the committed instances and the hierarchy in bytes.
+    unsigned GetMemoryUse() const;
+
+    /// Set instance data attribute.
+    void SetInstanceDataAttr(const PODVector<unsigned char>& value);
+    /// Return instance data attribute.
+    PODVector<unsigned char> GetInstanceDataAttr() const;
+
+protected:
+    /// Handle scene being assigned.
+    void OnSceneSet(Scene* scene) override;
+    /// Recalculate the world-space bounding box.
+    void OnWorldBoundingBoxUpdate() override;
+
+private:
+    /// Handle the beginning of a view update. Culls large clusters in parallel before the view's own culling.
+    void HandleBeginViewUpdate(StringHash eventType, VariantMap& eventData);
+    /// Cull the instances for a frame's camera into a view's storage, with work items if parallel is true.
+    void CullInstances(const FrameInfo& frame, StaticModelInstanceView& view, bool parallel);
+    /// Collect the cells of a hierarchy node that intersect the culling frustum. Level 0 is the cells themselves.
+    void GatherCells(unsigned level, unsigned index, bool inside);
+    /// Cull the instances of one task's cells and find their LOD distances.
+    void CullCells(InstanceClusterCullTask& task, unsigned taskIndex);
+    /// Write the transforms of one task's visible instances into the view's storage.
+    void CompactCells(const InstanceClusterCullTask& task, unsigned taskIndex);
+    /// Return the local transform of an instance.
+    Matrix3x4 GetLocalTransform(const InstanceClusterCell& cell, const InstanceClusterInstance& instance) const;
+    /// Recalculate the cell and hierarchy bounding boxes from the model bounding box.
+    void UpdateBoxes();
+    /// Size the culling buffers. Must be called from the main thread.
+    void UpdateCullBuffers();
+
+    /// Instances added since the last commit.
+    PODVector<InstanceClusterTransform> pendingInstances_;
+    /// Committed instances in cell order.
+    PODVector<InstanceClusterInstance> instances_;
+    /// Cells in spatial order.
+    PODVector<InstanceClusterCell> cells_;
+    /// Bounding boxes of the hierarchy levels above the cells. Each box encloses the next CHILDREN boxes of the level below.
+    Vector<PODVector<BoundingBox> > levelBoxes_;
+    /// Local-space bounding box of all instances.
+    BoundingBox clusterBox_;
+    /// Culling tasks of the current update.
+    PODVector<InstanceClusterCullTask> tasks_;
+    /// Visible cells of the current update, flagged when completely inside the frustum.
+    PODVector<unsigned> visibleCells_;
+    /// Instances that passed culling in the current update.
+    PODVector<unsigned> visibleInstances_;
+    /// LOD distances of the instances that passed culling.
+    PODVector<float> visibleLodDistances_;
+    /// Transform counts per task and batch, later turned into write offsets.
+    PODVector<unsigned> taskBatchCounts_;
+    /// Camera of the current update.
+    Camera* cullCamera_;
+    /// Frustum of the current update in local space.
+    Frustum cullFrustum_;
+    /// Node world transform of the current update.
+    Matrix3x4 cullTransform_;
+    /// LOD bias of the current update, including the frame's budget bias.
+    float cullLodBias_;
+    /// Storage of the current update.
+    StaticModelInstanceView* cullView_;
+    /// Culled instance transforms per view, compacted per geometry and LOD level.
+    StaticModelInstanceViews instanceViews_;
+    /// Instance count from which culling runs in parallel.
+    unsigned parallelThreshold_;
+    /// Number of instances that passed culling.
+    unsigned numVisibleInstances_;
+};
+
+}
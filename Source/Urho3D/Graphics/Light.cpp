@@ -29,6 +29,7 @@
 #include "../Graphics/Graphics.h"
 #include "../Graphics/Light.h"
 #include "../Graphics/OctreeQuery.h"
+#include "../Graphics/ShadowMapCache.h"
 #include "../Graphics/Texture2D.h"
 #include "../Graphics/TextureCube.h"
 #include "../IO/Log.h"
@@ -161,6 +162,7 @@ void Light::RegisterObject(Context* context)
     URHO3D_ATTRIBUTE_EX("Normal Offset", float, shadowBias_.normalOffset_, ValidateShadowBias, DEFAULT_NORMALOFFSET, AM_DEFAULT);
     URHO3D_ATTRIBUTE("Near/Farclip Ratio", float, shadowNearFarRatio_, DEFAULT_SHADOWNEARFARRATIO, AM_DEFAULT);
     URHO3D_ACCESSOR_ATTRIBUTE("Max Extrusion", GetShadowMaxExtrusion, SetShadowMaxExtrusion, float, DEFAULT_SHADOWMAXEXTRUSION, AM_DEFAULT);
+    URHO3D_ACCESSOR_ATTRIBUTE("Cache Static Shadows", GetCacheStaticShadows, SetCacheStaticShadows, bool, false, AM_DEFAULT);
     URHO3D_ATTRIBUTE("View Mask", int, viewMask_, DEFAULT_VIEWMASK, AM_DEFAULT);
     URHO3D_ATTRIBUTE("Light Mask", int, lightMask_, DEFAULT_LIGHTMASK, AM_DEFAULT);
 }
@@ -357,6 +359,18 @@ void Light::SetShadowMaxExtrusion(float extrusion)
     MarkNetworkUpdate();
 }
 
+void Light::SetCacheStaticShadows(bool enable)
+{
+    if (enable == shadowCache_.NotNull())
+        return;
+
+    if (enable)
+        shadowCache_ = new ShadowMapCache(context_);
+    else
+        shadowCache_.Reset();
+    MarkNetworkUpdate();
+}
+
 void Light::SetFadeDistance(float distance)
 {
     fadeDistance_ = Max(distance, 0.0f);
@@ -31,6 +31,7 @@ namespace Urho3D
 {
 
 class Camera;
+class ShadowMapCache;
 struct LightBatchQueue;
 
 /// %Light types.
@@ -206,6 +207,8 @@ public:
     void SetShadowNearFarRatio(float nearFarRatio);
     /// Set maximum shadow extrusion for directional lights. The actual extrusion will be the smaller of this and camera far clip. Default 1000.
     void SetShadowMaxExtrusion(float extrusion);
+    /// Set whether to cache the depth of static shadow casters between frames. Has effect only on spot and point lights with depth texture shadow maps.
+    void SetCacheStaticShadows(bool enable);
     /// Set range attenuation texture.
     void SetRampTexture(Texture* texture);
     /// Set spotlight attenuation texture.
@@ -283,6 +286,12 @@ public:
     /// Return maximum shadow extrusion distance for directional lights.
     float GetShadowMaxExtrusion() const { return shadowMaxExtrusion_; }
 
+    /// Return whether static shadow casters are cached.
+    bool GetCacheStaticShadows() const { return shadowCache_.NotNull(); }
+
+    /// Return static shadow caster cache, or null if not enabled.
+    ShadowMapCache* GetShadowMapCache() const { return shadowCache_; }
+
     /// Return range attenuation texture.
     Texture* GetRampTexture() const { return rampTexture_; }
 
@@ -367,6 +376,8 @@ private:
     SharedPtr<Texture> shapeTexture_;
     /// Light queue.
     LightBatchQueue* lightQueue_;
+    /// Static shadow caster cache.
+    SharedPtr<ShadowMapCache> shadowCache_;
     /// Specular intensity.
     float specularIntensity_;
     /// Brightness multiplier.
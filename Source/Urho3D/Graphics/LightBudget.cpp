@@ -0,0 +1,78 @@
+//
+// Copyright (c) 2017-2020 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+
+#include "../Precompiled.h"
+
+#include "../Container/Sort.h"
+#include "../Graphics/Camera.h"
+#include "../Graphics/Light.h"
+#include "../Graphics/LightBudget.h"
+#include "../Scene/Node.h"
+
+#include "../DebugNew.h"
+
+namespace Urho3D
+{
+
+static bool CompareLightImportance(const LightImportance& lhs, const LightImportance& rhs)
+{
+    return lhs.importance_ > rhs.importance_;
+}
+
+float GetLightImportance(Light* light, Camera* camera)
+{
+    const float intensity = Abs(light->GetEffectiveColor().SumRGB());
+    if (light->GetLightType() == LIGHT_DIRECTIONAL)
+        return intensity;
+
+    const BoundingBox& box = light->GetWorldBoundingBox();
+    const float radius = box.HalfSize().Length();
+    const float distance = camera->GetDistance(box.Center());
+    if (distance <= radius)
+        return intensity;
+
+    // Projected radius of the bounding sphere relative to the half height of the view
+    float projectedRadius;
+    if (camera->IsOrthographic())
+        projectedRadius = 2.0f * radius * camera->GetZoom() / camera->GetOrthoSize();
+    else
+        projectedRadius = radius * camera->GetZoom() / (distance * tanf(camera->GetFov() * M_DEGTORAD * 0.5f));
+
+    return Min(projectedRadius * projectedRadius, 1.0f) * intensity;
+}
+
+void SortLightsByImportance(PODVector<LightImportance>& lights, const HashSet<Light*>& previousLights, float hysteresis)
+{
+    if (!previousLights.Empty())
+    {
+        for (PODVector<LightImportance>::Iterator i = lights.Begin(); i != lights.End(); ++i)
+        {
+            if (previousLights.Contains(i->light_))
+                i->importance_ *= hysteresis;
+        }
+    }
+
+    Sort(lights.Begin(), lights.End(), CompareLightImportance);
+}
+
+}
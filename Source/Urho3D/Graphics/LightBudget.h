@@ -0,0 +1,48 @@
+//
+// Copyright (c) 2017-2020 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+
+#pragma once
+
+#include "../Container/HashSet.h"
+
+namespace Urho3D
+{
+
+class Camera;
+class Light;
+
+/// Importance of a per-pixel light within a view's light budget.
+struct LightImportance
+{
+    /// Light.
+    Light* light_;
+    /// Approximate screen coverage of the light volume times light intensity.
+    float importance_;
+};
+
+/// Return the importance of a light as seen from a camera: the approximate fraction of the view covered by the light's bounding sphere times the light's intensity. Directional lights cover the whole view.
+URHO3D_API float GetLightImportance(Light* light, Camera* camera);
+/// Sort lights by importance, most important first. Lights that were within the budget on the previous frame have their importance multiplied by the hysteresis factor first, so that lights of nearly equal importance do not trade places every frame.
+URHO3D_API void SortLightsByImportance(PODVector<LightImportance>& lights, const HashSet<Light*>& previousLights, float hysteresis);
+
+}
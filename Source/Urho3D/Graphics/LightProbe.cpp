@@ -21,7 +21,8 @@ LightProbe::LightProbe(Context* context) : Drawable(context, DRAWABLE_PROBE),
 
 LightProbe::~LightProbe()
 {
-
+	if (manager_)
+		manager_->RemoveProbe(this);
 }
 
 extern const char* SCENE_CATEGORY;
@@ -54,10 +55,28 @@ void LightProbe::DrawDebugGeometry(DebugRenderer* debug, bool depthTest)
 	debug->AddBoundingBox(GetWorldBoundingBox(), color_);
 }
 
+void LightProbe::OnSetEnabled()
+{
+	Drawable::OnSetEnabled();
+
+	if (manager_)
+		manager_->MarkProbesDirty();
+}
+
 void LightProbe::OnSceneSet(Scene* scene)
 {
 	if (scene)
-		scene->GetOrCreateComponent<LightProbeManager>();
+		scene->GetOrCreateComponent<LightProbeManager>()->AddProbe(this);
+	else if (manager_)
+		manager_->RemoveProbe(this);
+}
+
+void LightProbe::OnMarkedDirty(Node* node)
+{
+	Drawable::OnMarkedDirty(node);
+
+	if (manager_)
+		manager_->MarkProbesDirty();
 }
 
 void LightProbe::OnWorldBoundingBoxUpdate()
@@ -7,10 +7,12 @@ namespace Urho3D
 {
 
 class Context;
+class LightProbeManager;
 
 class URHO3D_API LightProbe : public Drawable
 {
 	URHO3D_OBJECT(LightProbe, Drawable);
+	friend class LightProbeManager;
 public:
 	/// Construct.
 	explicit LightProbe(Context* context);
@@ -26,16 +28,25 @@ public:
 	void SetColor(const Color& value);
 
 	void DrawDebugGeometry(DebugRenderer* debug, bool depthTest) override;
+	/// Handle enabled/disabled state change.
+	void OnSetEnabled() override;
+
+	/// Return the probe manager the probe is registered with.
+	LightProbeManager* GetProbeManager() const { return manager_; }
 
 protected:
-	/// Ensure there's a probe manager if we're in a scene.
+	/// Ensure there's a probe manager if we're in a scene, and register with it.
 	virtual void OnSceneSet(Scene* scene) override;
+	/// Handle node transform being dirtied.
+	void OnMarkedDirty(Node* node) override;
 	/// Recalculate the world-space bounding box.
 	void OnWorldBoundingBoxUpdate() override;
 
 private:
 	Color color_;
 	float radius_;
+	/// Probe manager the probe is registered with.
+	WeakPtr<LightProbeManager> manager_;
 };
 
 }
\ No newline at end of file
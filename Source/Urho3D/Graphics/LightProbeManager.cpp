@@ -2,9 +2,12 @@
 #include "LightProbeManager.h"
 
 #include <Urho3D/Core/Context.h>
+#include <Urho3D/Core/Profiler.h>
+#include <Urho3D/Core/WorkQueue.h>
 #include <Urho3D/Graphics/DebugRenderer.h>
 #include <Urho3D/Graphics/GraphicsEvents.h>
 #include <Urho3D/Graphics/LightProbe.h>
+#include <Urho3D/Graphics/LightProbeVolume.h>
 #include <Urho3D/Graphics/Octree.h>
 #include <Urho3D/Scene/Scene.h>
 
@@ -15,6 +18,22 @@
 namespace Urho3D
 {
 
+/// Range of positions to look up in a work item.
+struct NearestProbesJob
+{
+	const Vector3* positions_;
+	ProbeWeights* results_;
+	unsigned numPositions_;
+	unsigned count_;
+};
+
+void NearestProbesWork(const WorkItem* item, unsigned threadIndex)
+{
+	auto* manager = reinterpret_cast<LightProbeManager*>(item->aux_);
+	auto* job = reinterpret_cast<NearestProbesJob*>(item->start_);
+	manager->FindNearestProbes(job->positions_, job->results_, job->numPositions_, job->count_);
+}
+
 struct LPPointCloud
 {
 	PODVector<Pair<Vector3, LightProbe*> > points;
@@ -48,13 +67,20 @@ struct LightProbeManager::OpaqueData
 	}
 };
 
-LightProbeManager::LightProbeManager(Context* context) : Component(context)
+LightProbeManager::LightProbeManager(Context* context) : Component(context),
+	probesDirty_(false),
+	numRebuilds_(0)
 {
 	cloud_ = new OpaqueData();
 }
 
 LightProbeManager::~LightProbeManager()
 {
+	for (auto probe : probes_)
+		probe->manager_ = nullptr;
+	for (auto volume : volumes_)
+		volume->manager_ = nullptr;
+
 	if (cloud_)
 		delete cloud_;
 	cloud_ = nullptr;
@@ -66,8 +92,83 @@ void LightProbeManager::RegisterObject(Context* context)
 	context->RegisterFactory<LightProbeManager>(SCENE_CATEGORY);
 }
 
+void LightProbeManager::AddProbe(LightProbe* probe)
+{
+	if (!probe || probe->manager_ == this)
+		return;
+
+	if (probe->manager_)
+		probe->manager_->RemoveProbe(probe);
+
+	probe->manager_ = this;
+	probes_.Push(probe);
+	probesDirty_ = true;
+}
+
+void LightProbeManager::RemoveProbe(LightProbe* probe)
+{
+	if (!probe || probe->manager_ != this)
+		return;
+
+	probes_.RemoveSwap(probe);
+	probe->manager_ = nullptr;
+	// The tree still points to the probe, but every query rebuilds a dirty tree before reading it
+	probesDirty_ = true;
+}
+
+void LightProbeManager::AddVolume(LightProbeVolume* volume)
+{
+	if (!volume || volume->manager_ == this)
+		return;
+
+	if (volume->manager_)
+		volume->manager_->RemoveVolume(volume);
+
+	volume->manager_ = this;
+	volumes_.Push(volume);
+}
+
+void LightProbeManager::RemoveVolume(LightProbeVolume* volume)
+{
+	if (!volume || volume->manager_ != this)
+		return;
+
+	volumes_.RemoveSwap(volume);
+	volume->manager_ = nullptr;
+}
+
+void LightProbeManager::BakeVolumes()
+{
+	for (auto volume : volumes_)
+		volume->Bake();
+}
+
+Color LightProbeManager::GetIrradiance(const Vector3& position, const Vector3& normal)
+{
+	if (LightProbeVolume* volume = GetVolume(position))
+		return volume->GetIrradiance(position, normal);
+
+	if (LightProbe* probe = GetNearestProbe(position))
+		return probe->GetColor();
+
+	return Color::BLACK;
+}
+
+LightProbeVolume* LightProbeManager::GetVolume(const Vector3& position) const
+{
+	for (auto volume : volumes_)
+	{
+		if (volume->IsEnabledEffective() && volume->IsBaked() && volume->GetWorldBoundingBox().IsInside(position) != OUTSIDE)
+			return volume;
+	}
+	return nullptr;
+}
+
 LightProbe* LightProbeManager::GetNearestProbe(const Vector3& position)
 {
+	if (probesDirty_)
+		RebuildTree();
+
 	if (cloud_ && cloud_->table_)
 	{
 		size_t foundIdx = 0;
@@ -79,8 +180,91 @@ LightProbe* LightProbeManager::GetNearestProbe(const Vector3& position)
 	return nullptr;
 }
 
+void LightProbeManager::GetNearestProbes(const PODVector<Vector3>& positions, unsigned count, PODVector<ProbeWeights>& results)
+{
+	URHO3D_PROFILE(GetNearestProbes);
+
+	// Volume bakes may run before the first rendered frame
+	if (probesDirty_)
+		RebuildTree();
+
+	results.Resize(positions.Size());
+	count = Min(count, MAX_PROBE_NEIGHBORS);
+	if (positions.Empty())
+		return;
+
+	auto* queue = GetSubsystem<WorkQueue>();
+	const unsigned numWorkItems = queue->GetNumThreads() + 1; // Worker threads + main thread
+	const unsigned positionsPerItem = Max(positions.Size() / numWorkItems, 1U);
+
+	PODVector<NearestProbesJob> jobs(numWorkItems);
+	unsigned start = 0;
+	for (unsigned i = 0; i < numWorkItems && start < positions.Size(); ++i)
+	{
+		const unsigned end = (i < numWorkItems - 1) ? Min(start + positionsPerItem, positions.Size()) : positions.Size();
+
+		NearestProbesJob& job = jobs[i];
+		job.positions_ = &positions[start];
+		job.results_ = &results[start];
+		job.numPositions_ = end - start;
+		job.count_ = count;
+
+		SharedPtr<WorkItem> item = queue->GetFreeItem();
+		item->priority_ = M_MAX_UNSIGNED;
+		item->workFunction_ = NearestProbesWork;
+		item->aux_ = this;
+		item->start_ = &job;
+		queue->AddWorkItem(item);
+
+		start = end;
+	}
+
+	queue->Complete(M_MAX_UNSIGNED);
+}
+
+void LightProbeManager::GetNearestProbes(const PODVector<Drawable*>& drawables, unsigned count, PODVector<ProbeWeights>& results)
+{
+	// Bounding boxes update lazily, so read them in the main thread
+	drawablePositions_.Resize(drawables.Size());
+	for (unsigned i = 0; i < drawables.Size(); ++i)
+		drawablePositions_[i] = drawables[i]->GetWorldBoundingBox().Center();
+
+	GetNearestProbes(drawablePositions_, count, results);
+}
+
+void LightProbeManager::FindNearestProbes(const Vector3* positions, ProbeWeights* results, unsigned numPositions, unsigned count) const
+{
+	size_t indices[MAX_PROBE_NEIGHBORS];
+	float distancesSquared[MAX_PROBE_NEIGHBORS];
+
+	for (unsigned i = 0; i < numPositions; ++i)
+	{
+		ProbeWeights& result = results[i];
+		result.count_ = 0;
+		if (!cloud_->table_ || !count)
+			continue;
+
+		const unsigned found = (unsigned)cloud_->table_->knnSearch(positions[i].Data(), count, indices, distancesSquared);
+
+		// Inverse distance weights. A probe at the position takes all the weight
+		float totalWeight = 0.0f;
+		for (unsigned j = 0; j < found; ++j)
+		{
+			result.probes_[j] = cloud_->pointList_.points[indices[j]].second_;
+			result.weights_[j] = 1.0f / Max(sqrtf(distancesSquared[j]), M_EPSILON);
+			totalWeight += result.weights_[j];
+		}
+		for (unsigned j = 0; j < found; ++j)
+			result.weights_[j] /= totalWeight;
+		result.count_ = found;
+	}
+}
+
 void LightProbeManager::DrawDebugGeometry(DebugRenderer* debug, bool depthTest)
 {
+	if (probesDirty_)
+		RebuildTree();
+
 	if (cloud_)
 	{
 		for (auto pt : cloud_->pointList_.points)
@@ -97,38 +281,69 @@ void LightProbeManager::OnSceneSet(Scene* scene)
 {
 	if (scene)
 	{
+		// Pick up the probes already in the scene once; later ones register themselves
+		PODVector<LightProbe*> probes;
+		scene->GetComponents<LightProbe>(probes, true);
+		for (auto probe : probes)
+			AddProbe(probe);
+		PODVector<LightProbeVolume*> volumes;
+		scene->GetComponents<LightProbeVolume>(volumes, true);
+		for (auto volume : volumes)
+			AddVolume(volume);
+
 		using namespace BeginRendering;
 		SubscribeToEvent(E_BEGINRENDERING, URHO3D_HANDLER(LightProbeManager, HandleBeginRendering));
 	}
 	else
+	{
+		// Detach everything in bulk instead of removing one by one
+		for (auto probe : probes_)
+			probe->manager_ = nullptr;
+		probes_.Clear();
+		for (auto volume : volumes_)
+			volume->manager_ = nullptr;
+		volumes_.Clear();
+
+		cloud_->pointList_.points.Clear();
+		delete cloud_->table_;
+		cloud_->table_ = nullptr;
+		probesDirty_ = false;
+
 		UnsubscribeFromAllEvents();
+	}
 }
 
 
 void LightProbeManager::HandleBeginRendering(StringHash eventType, VariantMap& eventData)
 {
-	if (auto scene = GetScene())
+	if (probesDirty_)
+		RebuildTree();
+}
+
+void LightProbeManager::RebuildTree()
+{
+	URHO3D_PROFILE(RebuildLightProbeTree);
+
+	cloud_->pointList_.points.Clear();
+	for (auto probe : probes_)
 	{
-		PODVector<LightProbe*> probes;
-		scene->GetComponents<LightProbe>(probes, true);
-		cloud_->pointList_.points.Clear();
-		for (auto probe : probes)
-		{
-			if (probe->IsEnabledEffective())
-				cloud_->pointList_.points.Push(Pair<Vector3, LightProbe*>(probe->GetNode()->GetWorldPosition(), probe));
-		}
+		if (probe->IsEnabledEffective())
+			cloud_->pointList_.points.Push(Pair<Vector3, LightProbe*>(probe->GetNode()->GetWorldPosition(), probe));
+	}
 
-		if (cloud_->table_)
-			delete cloud_->table_;
+	if (cloud_->table_)
+		delete cloud_->table_;
 
-		if (probes.Empty())
-			cloud_->table_ = nullptr;
-		else
-		{
-			cloud_->table_ = new LP_KDTreeTable(3, cloud_->pointList_, nanoflann::KDTreeSingleIndexAdaptorParams(10));
-			cloud_->table_->buildIndex();
-		}
+	if (cloud_->pointList_.points.Empty())
+		cloud_->table_ = nullptr;
+	else
+	{
+		cloud_->table_ = new LP_KDTreeTable(3, cloud_->pointList_, nanoflann::KDTreeSingleIndexAdaptorParams(10));
+		cloud_->table_->buildIndex();
 	}
+
+	probesDirty_ = false;
+	++numRebuilds_;
 }
 
 }
\ No newline at end of file
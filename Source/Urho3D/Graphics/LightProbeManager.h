@@ -5,8 +5,25 @@
 namespace Urho3D
 {
 
+	class Drawable;
 	class LightProbe;
+	class LightProbeVolume;
 
+	/// Maximum number of probes returned for a position by the batched nearest probe lookup.
+	static const unsigned MAX_PROBE_NEIGHBORS = 4;
+
+	/// Nearest probes of a position and their interpolation weights, which sum to 1.
+	struct ProbeWeights
+	{
+		/// Probes, nearest first.
+		LightProbe* probes_[MAX_PROBE_NEIGHBORS];
+		/// Inverse distance weights of the probes.
+		float weights_[MAX_PROBE_NEIGHBORS];
+		/// Number of probes found.
+		unsigned count_;
+	};
+
+	/// Keeps the probes of a scene in a KD-tree for nearest probe lookups. Probes register themselves, and the tree is rebuilt before rendering only if a probe was added, removed, moved or toggled. Baked probe volumes, when present, answer irradiance lookups without searching the tree.
 	class URHO3D_API LightProbeManager : public Component
 	{
 		URHO3D_OBJECT(LightProbeManager, Component);
@@ -18,7 +35,37 @@ namespace Urho3D
 		/// Register object factory.
 		static void RegisterObject(Context* context);
 
+		/// Add a probe. Called by LightProbe when it enters the scene.
+		void AddProbe(LightProbe* probe);
+		/// Remove a probe. Called by LightProbe when it leaves the scene. The KD-tree is rebuilt on the next query.
+		void RemoveProbe(LightProbe* probe);
+		/// Mark the KD-tree for rebuild. Called by LightProbe when it moves or is enabled or disabled.
+		void MarkProbesDirty() { probesDirty_ = true; }
+		/// Add a probe volume. Called by LightProbeVolume when it enters the scene.
+		void AddVolume(LightProbeVolume* volume);
+		/// Remove a probe volume. Called by LightProbeVolume when it leaves the scene.
+		void RemoveVolume(LightProbeVolume* volume);
+		/// Resample the probes into all probe volumes.
+		void BakeVolumes();
+
+		/// Return the nearest probe of a position.
 		LightProbe* GetNearestProbe(const Vector3& position);
+		/// Find up to count (max. MAX_PROBE_NEIGHBORS) nearest probes and interpolation weights for many positions, split over the work queue threads.
+		void GetNearestProbes(const PODVector<Vector3>& positions, unsigned count, PODVector<ProbeWeights>& results);
+		/// Find up to count nearest probes and interpolation weights for the world bounding box centers of drawables, split over the work queue threads.
+		void GetNearestProbes(const PODVector<Drawable*>& drawables, unsigned count, PODVector<ProbeWeights>& results);
+		/// Find nearest probes for a range of positions in the calling thread. Called from worker threads by GetNearestProbes.
+		void FindNearestProbes(const Vector3* positions, ProbeWeights* results, unsigned numPositions, unsigned count) const;
+
+		/// Return irradiance at a position for a surface normal. Samples the first enabled baked volume containing the position, or falls back to the color of the nearest probe.
+		Color GetIrradiance(const Vector3& position, const Vector3& normal);
+		/// Return the first enabled baked probe volume containing a position, or null.
+		LightProbeVolume* GetVolume(const Vector3& position) const;
+
+		/// Return number of registered probes.
+		unsigned GetNumProbes() const { return probes_.Size(); }
+		/// Return number of KD-tree rebuilds so far.
+		unsigned GetNumRebuilds() const { return numRebuilds_; }
 
 		void DrawDebugGeometry(DebugRenderer* debug, bool depthTest) override;
 
@@ -29,9 +76,21 @@ namespace Urho3D
 	private:
 		/// Handle the scene subsystem update event.
 		void HandleBeginRendering(StringHash eventType, VariantMap& eventData);
+		/// Refill the point cloud from the enabled probes and rebuild the KD-tree.
+		void RebuildTree();
 
 		struct OpaqueData;
 		OpaqueData* cloud_;
+		/// Registered probes, enabled or not.
+		PODVector<LightProbe*> probes_;
+		/// Registered probe volumes.
+		PODVector<LightProbeVolume*> volumes_;
+		/// Scratch positions for drawable lookups.
+		PODVector<Vector3> drawablePositions_;
+		/// Whether the KD-tree needs to be rebuilt.
+		bool probesDirty_;
+		/// Number of KD-tree rebuilds.
+		unsigned numRebuilds_;
 	};
 
 }
\ No newline at end of file
@@ -0,0 +1,375 @@
+#include "../Precompiled.h"
+#include "LightProbeVolume.h"
+
+#include <Urho3D/Core/Context.h>
+#include <Urho3D/Core/Profiler.h>
+#include <Urho3D/Graphics/Graphics.h>
+#include <Urho3D/Graphics/LightProbe.h>
+#include <Urho3D/Graphics/LightProbeManager.h>
+#include <Urho3D/Graphics/Texture3D.h>
+#if defined(URHO3D_COMPUTE)
+#include <Urho3D/Graphics/ComputeBuffer.h>
+#endif
+#include <Urho3D/IO/Log.h>
+#include <Urho3D/IO/MemoryBuffer.h>
+#include <Urho3D/IO/VectorBuffer.h>
+#include <Urho3D/Scene/Node.h>
+#include <Urho3D/Scene/Scene.h>
+
+#include <Urho3D/DebugNew.h>
+
+namespace Urho3D
+{
+
+extern const char* SCENE_CATEGORY;
+
+static const Vector3 DEFAULT_VOLUME_SIZE(32.0f, 16.0f, 32.0f);
+static const IntVector3 DEFAULT_VOLUME_RESOLUTION(8, 4, 8);
+static const unsigned MAX_VOLUME_CELLS = 256 * 256 * 256;
+
+/// Cosine lobe convolution of the L0 and L1 bands folded with the basis constants.
+static const float SH_IRRADIANCE_L0 = 0.886227f;
+static const float SH_IRRADIANCE_L1 = 1.023327f;
+
+static unsigned short FloatToHalf(float value)
+{
+	unsigned bits;
+	memcpy(&bits, &value, sizeof bits);
+
+	const unsigned sign = (bits >> 16u) & 0x8000u;
+	const int exponent = (int)((bits >> 23u) & 0xffu) - 127 + 15;
+	unsigned mantissa = bits & 0x7fffffu;
+
+	if (exponent <= 0)
+		return (unsigned short)sign;
+	if (exponent >= 31)
+		return (unsigned short)(sign | 0x7c00u);
+
+	// Round to nearest; a carry out of the mantissa correctly bumps the exponent
+	mantissa += 0x1000u;
+	return (unsigned short)(sign + (((unsigned)exponent << 10u) + (mantissa >> 13u)));
+}
+
+static float HalfToFloat(unsigned short value)
+{
+	const unsigned sign = (value & 0x8000u) << 16u;
+	const unsigned exponent = (value >> 10u) & 0x1fu;
+	const unsigned mantissa = value & 0x3ffu;
+
+	unsigned bits;
+	if (exponent == 0)
+		bits = sign;
+	else if (exponent == 31)
+		bits = sign | 0x7f800000u | (mantissa << 13u);
+	else
+		bits = sign | ((exponent - 15 + 127) << 23u) | (mantissa << 13u);
+
+	float result;
+	memcpy(&result, &bits, sizeof result);
+	return result;
+}
+
+Color ProbeSH::GetIrradiance(const Vector3& normal) const
+{
+	Color result = coefficients_[0] * SH_IRRADIANCE_L0 +
+		(coefficients_[1] * normal.x_ + coefficients_[2] * normal.y_ + coefficients_[3] * normal.z_) * SH_IRRADIANCE_L1;
+	return Color(Max(result.r_, 0.0f), Max(result.g_, 0.0f), Max(result.b_, 0.0f), 1.0f);
+}
+
+LightProbeVolume::LightProbeVolume(Context* context) : Component(context),
+	size_(DEFAULT_VOLUME_SIZE),
+	resolution_(DEFAULT_VOLUME_RESOLUTION),
+	textureDirty_(false),
+	bufferDirty_(false)
+{
+
+}
+
+LightProbeVolume::~LightProbeVolume()
+{
+	if (manager_)
+		manager_->RemoveVolume(this);
+}
+
+void LightProbeVolume::RegisterObject(Context* context)
+{
+	context->RegisterFactory<LightProbeVolume>(SCENE_CATEGORY);
+
+	URHO3D_ACCESSOR_ATTRIBUTE("Is Enabled", IsEnabled, SetEnabled, bool, true, AM_DEFAULT);
+	URHO3D_ACCESSOR_ATTRIBUTE("Size", GetSize, SetSize, Vector3, DEFAULT_VOLUME_SIZE, AM_DEFAULT);
+	URHO3D_ACCESSOR_ATTRIBUTE("Resolution", GetResolution, SetResolution, IntVector3, DEFAULT_VOLUME_RESOLUTION, AM_DEFAULT);
+	URHO3D_MIXED_ACCESSOR_ATTRIBUTE("Probe Data", GetProbeDataAttr, SetProbeDataAttr, PODVector<unsigned char>, Variant::emptyBuffer,
+		AM_FILE | AM_NOEDIT);
+}
+
+void LightProbeVolume::SetSize(const Vector3& size)
+{
+	size_ = Vector3(Max(size.x_, M_EPSILON), Max(size.y_, M_EPSILON), Max(size.z_, M_EPSILON));
+	MarkNetworkUpdate();
+}
+
+void LightProbeVolume::SetResolution(const IntVector3& resolution)
+{
+	IntVector3 newResolution(Max(resolution.x_, 1), Max(resolution.y_, 1), Max(resolution.z_, 1));
+	if ((unsigned)newResolution.x_ * newResolution.y_ * newResolution.z_ > MAX_VOLUME_CELLS)
+	{
+		URHO3D_LOGERROR("Light probe volume resolution too large");
+		return;
+	}
+
+	if (newResolution != resolution_)
+	{
+		resolution_ = newResolution;
+		Clear();
+	}
+	MarkNetworkUpdate();
+}
+
+void LightProbeVolume::Bake()
+{
+	URHO3D_PROFILE(BakeLightProbeVolume);
+
+	if (!manager_ || !manager_->GetNumProbes())
+	{
+		URHO3D_LOGWARNING("No light probes to bake light probe volume from");
+		return;
+	}
+
+	const unsigned numCells = (unsigned)(resolution_.x_ * resolution_.y_ * resolution_.z_);
+	PODVector<Vector3> positions(numCells);
+	for (int z = 0, i = 0; z < resolution_.z_; ++z)
+	{
+		for (int y = 0; y < resolution_.y_; ++y)
+		{
+			for (int x = 0; x < resolution_.x_; ++x, ++i)
+				positions[i] = GetCellPosition(x, y, z);
+		}
+	}
+
+	PODVector<ProbeWeights> weights;
+	manager_->GetNearestProbes(positions, MAX_PROBE_NEIGHBORS, weights);
+
+	data_.Resize(numCells * NUM_PROBE_SH_COEFFICIENTS * 4);
+	for (unsigned i = 0; i < numCells; ++i)
+	{
+		const ProbeWeights& cell = weights[i];
+
+		// The constant term reproduces the interpolated probe color. The gradient terms tilt it towards
+		// the brighter neighbours, so that a surface facing a bright probe receives more of its color
+		Color average(0.0f, 0.0f, 0.0f, 0.0f);
+		for (unsigned j = 0; j < cell.count_; ++j)
+			average += cell.probes_[j]->GetColor() * cell.weights_[j];
+
+		ProbeSH sh;
+		sh.coefficients_[0] = average * (1.0f / SH_IRRADIANCE_L0);
+		for (unsigned k = 1; k < NUM_PROBE_SH_COEFFICIENTS; ++k)
+			sh.coefficients_[k] = Color(0.0f, 0.0f, 0.0f, 0.0f);
+
+		for (unsigned j = 0; j < cell.count_; ++j)
+		{
+			Vector3 direction = cell.probes_[j]->GetNode()->GetWorldPosition() - positions[i];
+			const float distance = direction.Length();
+			if (distance < M_EPSILON)
+				continue;
+			direction /= distance;
+
+			const Color delta = (cell.probes_[j]->GetColor() - average) * (cell.weights_[j] / SH_IRRADIANCE_L1);
+			sh.coefficients_[1] += delta * direction.x_;
+			sh.coefficients_[2] += delta * direction.y_;
+			sh.coefficients_[3] += delta * direction.z_;
+		}
+
+		for (unsigned k = 0; k < NUM_PROBE_SH_COEFFICIENTS; ++k)
+		{
+			unsigned short* dest = &data_[(k * numCells + i) * 4];
+			dest[0] = FloatToHalf(sh.coefficients_[k].r_);
+			dest[1] = FloatToHalf(sh.coefficients_[k].g_);
+			dest[2] = FloatToHalf(sh.coefficients_[k].b_);
+			dest[3] = FloatToHalf(k == 0 ? 1.0f : 0.0f);
+		}
+	}
+
+	textureDirty_ = true;
+	bufferDirty_ = true;
+}
+
+void LightProbeVolume::Clear()
+{
+	data_.Clear();
+	texture_.Reset();
+#if defined(URHO3D_COMPUTE)
+	buffer_.Reset();
+#endif
+	textureDirty_ = false;
+	bufferDirty_ = false;
+}
+
+BoundingBox LightProbeVolume::GetWorldBoundingBox() const
+{
+	const Vector3 center = node_ ? node_->GetWorldPosition() : Vector3::ZERO;
+	return BoundingBox(center - size_ * 0.5f, center + size_ * 0.5f);
+}
+
+ProbeSH LightProbeVolume::Sample(const Vector3& position) const
+{
+	ProbeSH result;
+	if (data_.Empty())
+	{
+		for (unsigned k = 0; k < NUM_PROBE_SH_COEFFICIENTS; ++k)
+			result.coefficients_[k] = Color(0.0f, 0.0f, 0.0f, 0.0f);
+		return result;
+	}
+
+	// Continuous cell coordinates with cell centers at integers
+	const BoundingBox box = GetWorldBoundingBox();
+	const Vector3 local = (position - box.min_) / size_;
+	const Vector3 cellPos(
+		Clamp(local.x_ * resolution_.x_ - 0.5f, 0.0f, (float)(resolution_.x_ - 1)),
+		Clamp(local.y_ * resolution_.y_ - 0.5f, 0.0f, (float)(resolution_.y_ - 1)),
+		Clamp(local.z_ * resolution_.z_ - 0.5f, 0.0f, (float)(resolution_.z_ - 1)));
+
+	const int x0 = (int)cellPos.x_;
+	const int y0 = (int)cellPos.y_;
+	const int z0 = (int)cellPos.z_;
+	const int x1 = Min(x0 + 1, resolution_.x_ - 1);
+	const int y1 = Min(y0 + 1, resolution_.y_ - 1);
+	const int z1 = Min(z0 + 1, resolution_.z_ - 1);
+	const float fx = cellPos.x_ - x0;
+	const float fy = cellPos.y_ - y0;
+	const float fz = cellPos.z_ - z0;
+
+	for (unsigned k = 0; k < NUM_PROBE_SH_COEFFICIENTS; ++k)
+	{
+		const Color c00 = GetCoefficient(k, x0, y0, z0).Lerp(GetCoefficient(k, x1, y0, z0), fx);
+		const Color c10 = GetCoefficient(k, x0, y1, z0).Lerp(GetCoefficient(k, x1, y1, z0), fx);
+		const Color c01 = GetCoefficient(k, x0, y0, z1).Lerp(GetCoefficient(k, x1, y0, z1), fx);
+		const Color c11 = GetCoefficient(k, x0, y1, z1).Lerp(GetCoefficient(k, x1, y1, z1), fx);
+		result.coefficients_[k] = c00.Lerp(c10, fy).Lerp(c01.Lerp(c11, fy), fz);
+	}
+
+	return result;
+}
+
+Texture3D* LightProbeVolume::GetTexture()
+{
+	if (data_.Empty())
+		return nullptr;
+
+	if (!texture_ || textureDirty_)
+	{
+		if (!texture_)
+		{
+			texture_ = new Texture3D(context_);
+			texture_->SetFilterMode(FILTER_BILINEAR);
+			texture_->SetAddressMode(COORD_U, ADDRESS_CLAMP);
+			texture_->SetAddressMode(COORD_V, ADDRESS_CLAMP);
+			texture_->SetAddressMode(COORD_W, ADDRESS_CLAMP);
+		}
+
+		// Filtering along the depth axis would blend the border slices of neighbouring coefficient slabs, so pad each slab with
+		// a copy of its first and last slice
+		const int slabDepth = resolution_.z_ + 2;
+		const int depth = slabDepth * NUM_PROBE_SH_COEFFICIENTS;
+		const unsigned sliceSize = resolution_.x_ * resolution_.y_ * 4;
+		PODVector<unsigned short> textureData(sliceSize * depth);
+		for (unsigned k = 0; k < NUM_PROBE_SH_COEFFICIENTS; ++k)
+		{
+			for (int z = 0; z < slabDepth; ++z)
+			{
+				const int sourceZ = Clamp(z - 1, 0, resolution_.z_ - 1);
+				memcpy(&textureData[(k * slabDepth + z) * sliceSize], &data_[(k * resolution_.z_ + sourceZ) * sliceSize],
+					sliceSize * sizeof(unsigned short));
+			}
+		}
+
+		texture_->SetSize(resolution_.x_, resolution_.y_, depth, Graphics::GetRGBAFloat16Format());
+		texture_->SetData(0, 0, 0, 0, resolution_.x_, resolution_.y_, depth, textureData.Buffer());
+		textureDirty_ = false;
+	}
+
+	return texture_;
+}
+
+#if defined(URHO3D_COMPUTE)
+ComputeBuffer* LightProbeVolume::GetBuffer()
+{
+	if (data_.Empty())
+		return nullptr;
+
+	if (!buffer_ || bufferDirty_)
+	{
+		if (!buffer_)
+			buffer_ = new ComputeBuffer(context_);
+
+		// One half float RGBA value per element, read as uint2 in the shader
+		buffer_->SetData(data_.Buffer(), GetDataSize(), sizeof(unsigned short) * 4);
+		bufferDirty_ = false;
+	}
+
+	return buffer_;
+}
+#endif
+
+void LightProbeVolume::SetProbeDataAttr(const PODVector<unsigned char>& value)
+{
+	if (value.Empty())
+	{
+		Clear();
+		return;
+	}
+
+	MemoryBuffer buffer(value);
+	IntVector3 resolution;
+	resolution.x_ = buffer.ReadInt();
+	resolution.y_ = buffer.ReadInt();
+	resolution.z_ = buffer.ReadInt();
+
+	const unsigned numValues = (unsigned)(resolution.x_ * resolution.y_ * resolution.z_) * NUM_PROBE_SH_COEFFICIENTS * 4;
+	if (resolution != resolution_ || buffer.GetSize() - buffer.GetPosition() != numValues * sizeof(unsigned short))
+	{
+		URHO3D_LOGERROR("Light probe volume data does not match its resolution");
+		return;
+	}
+
+	data_.Resize(numValues);
+	buffer.Read(data_.Buffer(), numValues * sizeof(unsigned short));
+	textureDirty_ = true;
+	bufferDirty_ = true;
+}
+
+PODVector<unsigned char> LightProbeVolume::GetProbeDataAttr() const
+{
+	VectorBuffer ret;
+	if (data_.Empty())
+		return ret.GetBuffer();
+
+	ret.WriteInt(resolution_.x_);
+	ret.WriteInt(resolution_.y_);
+	ret.WriteInt(resolution_.z_);
+	ret.Write(data_.Buffer(), GetDataSize());
+	return ret.GetBuffer();
+}
+
+void LightProbeVolume::OnSceneSet(Scene* scene)
+{
+	if (scene)
+		scene->GetOrCreateComponent<LightProbeManager>()->AddVolume(this);
+	else if (manager_)
+		manager_->RemoveVolume(this);
+}
+
+Vector3 LightProbeVolume::GetCellPosition(int x, int y, int z) const
+{
+	const BoundingBox box = GetWorldBoundingBox();
+	return box.min_ + size_ * Vector3((x + 0.5f) / resolution_.x_, (y + 0.5f) / resolution_.y_, (z + 0.5f) / resolution_.z_);
+}
+
+Color LightProbeVolume::GetCoefficient(unsigned coefficient, int x, int y, int z) const
+{
+	const unsigned numCells = (unsigned)(resolution_.x_ * resolution_.y_ * resolution_.z_);
+	const unsigned cell = (unsigned)(x + (y + z * resolution_.y_) * resolution_.x_);
+	const unsigned short* src = &data_[(coefficient * numCells + cell) * 4];
+	return Color(HalfToFloat(src[0]), HalfToFloat(src[1]), HalfToFloat(src[2]), HalfToFloat(src[3]));
+}
+
+}
@@ -0,0 +1,108 @@
+#pragma once
+
+#include "../Math/BoundingBox.h"
+#include "../Math/Color.h"
+#include "../Scene/Component.h"
+
+namespace Urho3D
+{
+
+class LightProbeManager;
+class Texture3D;
+#if defined(URHO3D_COMPUTE)
+class ComputeBuffer;
+#endif
+
+/// Number of L1 spherical harmonics coefficients per probe volume cell: the constant term and the x, y and z gradients.
+static const unsigned NUM_PROBE_SH_COEFFICIENTS = 4;
+
+/// L1 spherical harmonics radiance of a point, in full precision.
+struct ProbeSH
+{
+	/// Evaluate irradiance for a surface normal.
+	Color GetIrradiance(const Vector3& normal) const;
+
+	/// Coefficients in L0, L1x, L1y, L1z order.
+	Color coefficients_[NUM_PROBE_SH_COEFFICIENTS];
+};
+
+/// Regular world-aligned grid of L1 spherical harmonics baked from the LightProbe components of the scene. Looks up lighting with trilinear interpolation instead of searching the probes. Place one per zone or per streamed tile; the grid is centered on the node and ignores its rotation.
+class URHO3D_API LightProbeVolume : public Component
+{
+	URHO3D_OBJECT(LightProbeVolume, Component);
+	friend class LightProbeManager;
+public:
+	/// Construct.
+	explicit LightProbeVolume(Context* context);
+	/// Destruct.
+	~LightProbeVolume() override;
+	/// Register object factory.
+	static void RegisterObject(Context* context);
+
+	/// Set the world size of the grid.
+	void SetSize(const Vector3& size);
+	/// Set the number of cells on each axis. Clears baked data.
+	void SetResolution(const IntVector3& resolution);
+	/// Resample the scene's probes into the grid.
+	void Bake();
+	/// Clear baked data.
+	void Clear();
+
+	/// Return the world size of the grid.
+	const Vector3& GetSize() const { return size_; }
+	/// Return the number of cells on each axis.
+	const IntVector3& GetResolution() const { return resolution_; }
+	/// Return whether the grid has baked data.
+	bool IsBaked() const { return !data_.Empty(); }
+	/// Return the world bounding box of the grid.
+	BoundingBox GetWorldBoundingBox() const;
+	/// Return interpolated spherical harmonics at a world position. Positions outside the grid clamp to its border.
+	ProbeSH Sample(const Vector3& position) const;
+	/// Return interpolated irradiance at a world position for a surface normal.
+	Color GetIrradiance(const Vector3& position, const Vector3& normal) const { return Sample(position).GetIrradiance(normal); }
+	/// Return baked data size in bytes.
+	unsigned GetDataSize() const { return data_.Size() * sizeof(unsigned short); }
+
+	/// Return the baked data as a bilinearly filtered half float RGBA 3D texture. The coefficients are stacked along the depth axis in slabs of resolution z + 2 slices, the first and last being copies of their neighbours, so that filtering never mixes coefficients. Sample coefficient k at w = (k * (resolution z + 2) + 1 + local z * resolution z) / depth. Created on first call after a bake.
+	Texture3D* GetTexture();
+#if defined(URHO3D_COMPUTE)
+	/// Return the baked data as a structured buffer of half float RGBA values laid out as [coefficient][z][y][x], without the texture's padding slices. Created on first call after a bake.
+	ComputeBuffer* GetBuffer();
+#endif
+
+	/// Set baked data attribute.
+	void SetProbeDataAttr(const PODVector<unsigned char>& value);
+	/// Return baked data attribute.
+	PODVector<unsigned char> GetProbeDataAttr() const;
+
+protected:
+	/// Register with the scene's probe manager.
+	void OnSceneSet(Scene* scene) override;
+
+private:
+	/// Return the world position of the center of a cell.
+	Vector3 GetCellPosition(int x, int y, int z) const;
+	/// Read a coefficient of a cell to full precision.
+	Color GetCoefficient(unsigned coefficient, int x, int y, int z) const;
+
+	/// World size of the grid.
+	Vector3 size_;
+	/// Number of cells on each axis.
+	IntVector3 resolution_;
+	/// Half float RGBA coefficients laid out as [coefficient][z][y][x].
+	PODVector<unsigned short> data_;
+	/// Texture of the baked data.
+	SharedPtr<Texture3D> texture_;
+#if defined(URHO3D_COMPUTE)
+	/// Structured buffer of the baked data.
+	SharedPtr<ComputeBuffer> buffer_;
+#endif
+	/// Whether the texture needs to be refreshed.
+	bool textureDirty_;
+	/// Whether the structured buffer needs to be refreshed.
+	bool bufferDirty_;
+	/// Probe manager the volume is registered with.
+	WeakPtr<LightProbeManager> manager_;
+};
+
+}
@@ -1,9 +1,11 @@
 #include "LightTiler.h"
 #include "../Scene/Node.h"
 #include "../Core/Context.h"
+#include "../Core/Profiler.h"
+#include "../Core/WorkQueue.h"
 #include "../Graphics/Camera.h"
 #include "../Graphics/Light.h"
-#include <MathGeoLib.h>
+#include "../IO/Log.h"
 
 namespace Urho3D
 {
@@ -20,16 +22,19 @@ namespace Urho3D
 //              XYZ: clustered
 //
 //              Because the light recording is done on the CPU here the tests
-//              are crude AABB tests that will cause a lot of false positives.
+//              are bounding sphere vs. cell cone tests, which are conservative.
 //
 //****************************************************************************
 struct ClusterInfo {
     Vector3 minVec;
-    float pad0;
+    float nearDist;
     Vector3 maxVec;
-    float pad1;
+    float farDist;
     IntVector3 tiles;
-    int pad2;
+    unsigned itemsPerCell;
+    Vector4 headPosition; // xyz = world position of the head camera, w unused
+    Vector4 angles;       // x = first azimuth, y = first inclination, z = azimuth per cell, w = inclination per cell
+    Vector4 headRows[3];  // rows of the world to head space transform
 };
 
 struct uint4 {
@@ -39,17 +44,39 @@ struct uint4 {
     unsigned w_;
 };
 
-struct LightData
+/// Upload the records that differ from the previous upload as one range. Return the number of bytes uploaded.
+template <class T> unsigned UploadChangedRecords(ComputeBuffer* buffer, const PODVector<T>& records, PODVector<T>& uploaded)
 {
-    Vector3 position_;
-    float radius_;
-    Vector4 color_;
-};
+    unsigned first = records.Size();
+    unsigned last = 0;
+    for (unsigned i = 0; i < records.Size(); ++i)
+    {
+        if (i >= uploaded.Size() || memcmp(&records[i], &uploaded[i], sizeof(T)) != 0)
+        {
+            first = Min(first, i);
+            last = i + 1;
+        }
+    }
+
+    if (first >= last || !buffer->SetDataRange(&records[first], first * sizeof(T), (last - first) * sizeof(T)))
+        return 0;
+
+    // Mirror only what reached the buffer, so that a failed upload is retried on the next frame. Records past the end of a
+    // shorter list remain in the buffer and are kept as well
+    if (uploaded.Size() < last)
+        uploaded.Resize(last);
+    memcpy(&uploaded[first], &records[first], (last - first) * sizeof(T));
+    return (last - first) * sizeof(T);
+}
 
 LightTiler::LightTiler(Context* context, IntVector3 cells, uint32_t lightsPerCell) :
     Object(context),
     lightsPerCell_(lightsPerCell),
-    tileDim_(cells)
+    tileDim_(cells),
+    nearDist_(0.0f),
+    farDist_(0.0f),
+    numLights_(0),
+    numUploadedBytes_(0)
 {
     maxLights_ = 300;
 
@@ -59,7 +86,7 @@ LightTiler::LightTiler(Context* context, IntVector3 cells, uint32_t lightsPerCel
     cellsUBO_->SetSize(sizeof(uint4) * CellCount(), sizeof(uint4));
 
     lightsUBO_ = new ComputeBuffer(context);
-    lightsUBO_->SetSize(sizeof(LightData) * maxLights_, sizeof(LightData));
+    lightsUBO_->SetSize(sizeof(ClusteredLightData) * maxLights_, sizeof(ClusteredLightData));
 
     lightIndexesUBO_ = new ComputeBuffer(context);
     lightIndexesUBO_->SetSize(sizeof(unsigned) * lightsPerCell_ * CellCount(), sizeof(unsigned));
@@ -86,19 +113,152 @@ Vector3 Vector3_ToSphericalCoordinates(Vector3 self)
     return Vector3(azimuth, inclination, len);
 }
 
-Vector3 AABB_CornerPoint(const BoundingBox& bnds, int index)
+Vector3 Vector3_FromSphericalCoordinates(float azimuth, float inclination)
+{
+    float cosInclination = cosf(inclination);
+    return Vector3(cosInclination * sinf(azimuth), -sinf(inclination), cosInclination * cosf(azimuth));
+}
+
+void BinLightsWork(const WorkItem* item, unsigned threadIndex)
+{
+    auto* tiler = reinterpret_cast<LightTiler*>(item->aux_);
+    auto* job = reinterpret_cast<LightTiler::BinJob*>(item->start_);
+    tiler->BinLights(job->begin_, job->end_, job->hits_);
+}
+
+void LightTiler::UpdateColumnCones()
 {
-    switch (index)
+    const unsigned numColumns = tileDim_.x_ * tileDim_.y_;
+    const Vector2 cellAngles((maxAngles_.x_ - minAngles_.x_) / tileDim_.x_, (maxAngles_.y_ - minAngles_.y_) / tileDim_.y_);
+
+    columnDirX_.Resize(numColumns);
+    columnDirY_.Resize(numColumns);
+    columnDirZ_.Resize(numColumns);
+    columnCos_.Resize(numColumns);
+    columnSin_.Resize(numColumns);
+
+    for (int y = 0; y < tileDim_.y_; ++y)
     {
-    default: // For release builds where assume() is disabled, return always the first option if out-of-bounds.
-    case 0: return bnds.min_;
-    case 1: return Vector3(bnds.min_.x_, bnds.min_.y_, bnds.max_.z_);
-    case 2: return Vector3(bnds.min_.x_, bnds.max_.y_, bnds.min_.z_);
-    case 3: return Vector3(bnds.min_.x_, bnds.max_.y_, bnds.max_.z_);
-    case 4: return Vector3(bnds.max_.x_, bnds.min_.y_, bnds.min_.z_);
-    case 5: return Vector3(bnds.max_.x_, bnds.min_.y_, bnds.max_.z_);
-    case 6: return Vector3(bnds.max_.x_, bnds.max_.y_, bnds.min_.z_);
-    case 7: return bnds.max_;
+        for (int x = 0; x < tileDim_.x_; ++x)
+        {
+            const unsigned column = x + y * tileDim_.x_;
+            const float azimuth = minAngles_.x_ + (x + 0.5f) * cellAngles.x_;
+            const float inclination = minAngles_.y_ + (y + 0.5f) * cellAngles.y_;
+            const Vector3 center = Vector3_FromSphericalCoordinates(azimuth, inclination);
+
+            // The farthest point of the cell from its center is on its edges: check the corners and edge midpoints
+            float minCos = 1.0f;
+            for (int i = -1; i <= 1; ++i)
+            {
+                for (int j = -1; j <= 1; ++j)
+                {
+                    Vector3 edge = Vector3_FromSphericalCoordinates(azimuth + i * 0.5f * cellAngles.x_,
+                        inclination + j * 0.5f * cellAngles.y_);
+                    minCos = Min(minCos, center.DotProduct(edge));
+                }
+            }
+
+            columnDirX_[column] = center.x_;
+            columnDirY_[column] = center.y_;
+            columnDirZ_[column] = center.z_;
+            columnCos_[column] = minCos;
+            columnSin_[column] = sqrtf(Max(1.0f - minCos * minCos, 0.0f));
+        }
+    }
+
+    coneMinAngles_ = minAngles_;
+    coneMaxAngles_ = maxAngles_;
+}
+
+void LightTiler::BinLights(unsigned begin, unsigned end, PODVector<unsigned>& hits) const
+{
+    hits.Clear();
+
+    for (unsigned lightIndex = begin; lightIndex < end; ++lightIndex)
+        BinSphere(lightSpheres_[lightIndex], lightIndex, hits);
+}
+
+void LightTiler::BinSphere(const Vector4& sphere, unsigned lightIndex, PODVector<unsigned>& hits) const
+{
+    const Vector2 cellAngles((maxAngles_.x_ - minAngles_.x_) / tileDim_.x_, (maxAngles_.y_ - minAngles_.y_) / tileDim_.y_);
+
+    const float radius = sphere.w_;
+    if (radius < 0.0f)
+        return;
+
+    // Depth slices covered by the radial extent of the sphere
+    const Vector3 center(sphere.x_, sphere.y_, sphere.z_);
+    const float distance = center.Length();
+    if (distance - radius > farDist_ || distance + radius < nearDist_)
+        return;
+
+    const int zStart = Clamp<int>(toSliceZ(Max(distance - radius, nearDist_), nearDist_, farDist_), 0, tileDim_.z_ - 1);
+    const int zEnd = Clamp<int>(toSliceZ(Min(distance + radius, farDist_), nearDist_, farDist_), 0, tileDim_.z_ - 1);
+
+    int xStart = 0, xEnd = tileDim_.x_ - 1;
+    int yStart = 0, yEnd = tileDim_.y_ - 1;
+    Vector3 direction = Vector3::FORWARD;
+    float sinRadius = 1.0f;
+    float cosRadius = 0.0f;
+    const bool containsHead = distance <= radius;
+
+    if (!containsHead)
+    {
+        // Angular radius of the sphere as seen from the head, and the azimuth and inclination windows it covers
+        direction = center / distance;
+        sinRadius = radius / distance;
+        cosRadius = sqrtf(1.0f - sinRadius * sinRadius);
+
+        const float azimuth = atan2f(direction.x_, direction.z_);
+        const float inclination = asinf(-direction.y_);
+        const float angularRadius = asinf(sinRadius);
+        const float cosInclination = cosf(inclination);
+
+        const float yA = (inclination - angularRadius - minAngles_.y_) / cellAngles.y_;
+        const float yB = (inclination + angularRadius - minAngles_.y_) / cellAngles.y_;
+        yStart = (int)Floor(Min(yA, yB));
+        yEnd = (int)Floor(Max(yA, yB));
+
+        // Near the poles the sphere can cover all azimuths
+        if (cosInclination > sinRadius)
+        {
+            const float azimuthRadius = asinf(sinRadius / cosInclination);
+            const float xA = (azimuth - azimuthRadius - minAngles_.x_) / cellAngles.x_;
+            const float xB = (azimuth + azimuthRadius - minAngles_.x_) / cellAngles.x_;
+            xStart = (int)Floor(Min(xA, xB));
+            xEnd = (int)Floor(Max(xA, xB));
+        }
+
+        if (xEnd < 0 || xStart >= tileDim_.x_ || yEnd < 0 || yStart >= tileDim_.y_)
+            return;
+
+        xStart = Max(xStart, 0);
+        xEnd = Min(xEnd, tileDim_.x_ - 1);
+        yStart = Max(yStart, 0);
+        yEnd = Min(yEnd, tileDim_.y_ - 1);
+    }
+
+    for (int y = yStart; y <= yEnd; ++y)
+    {
+        for (int x = xStart; x <= xEnd; ++x)
+        {
+            const unsigned column = x + y * tileDim_.x_;
+            // The sphere touches the column if the angle between their centers is at most the sum of their angular radii.
+            // Both radii are below 90 degrees, so compare cosines: cos(between) >= cos(a + b)
+            if (!containsHead)
+            {
+                const float cosBetween = direction.x_ * columnDirX_[column] + direction.y_ * columnDirY_[column] +
+                    direction.z_ * columnDirZ_[column];
+                if (cosBetween < cosRadius * columnCos_[column] - sinRadius * columnSin_[column])
+                    continue;
+            }
+
+            for (int z = zStart; z <= zEnd; ++z)
+            {
+                hits.Push(toIndex(x, y, z));
+                hits.Push(lightIndex);
+            }
+        }
     }
 }
 
@@ -114,34 +274,9 @@ Vector3 AABB_CornerPoint(const BoundingBox& bnds, int index)
 //              doesn't currently work in a CAVE setting.
 //
 //****************************************************************************
-#pragma optimize("", off)
 uint32_t LightTiler::BuildLightTables_Radial(Camera** cameras, int camCt, const Vector< SharedPtr<Light> >& lights)
 {
-    const float zStep = 1.0f / tileDim_.z_;
-    const float yStep = 1.0f / tileDim_.y_;
-    const float xStep = 1.0f / tileDim_.x_;
-
-    Vector<uint4> lightCounts(CellCount(), { 0, 0, 0, 0 });
-    Vector<uint32_t> lightIndices(CellCount() * lightsPerCell_);
-    Vector<LightData> lightRawData;
-
-    uint32_t hitCt = 0;
-
-    for (auto& l : lights)
-    {
-        LightData d;
-        //d.lightMat = l->GetShadowMatrix(0);
-        //d.lightPos = float4(l->GetPosition(), l->GetKind());
-        //d.lightDir = float4(l->GetDirection(), l->GetRadius());
-        //d.color = l->GetColor();
-        //d.shadowMapCoords[0] = l->GetShadowDomain(0);
-        //d.shadowMapCoords[1] = l->GetShadowDomain(1);
-        //d.fov = l->GetFOV();
-        //d.castShadows = l->IsShadowCasting() ? 1.0f : 0.0f;
-        //d.goboIndex = 0.0f;
-        //d.rampIndex = 0.0f;
-        lightRawData.Push(d);
-    }
+    URHO3D_PROFILE(BuildLightTables);
 
     Camera* headCam = cameras[0], *leftEye = nullptr, *rightEye = nullptr;
     if (camCt > 1)
@@ -153,92 +288,223 @@ uint32_t LightTiler::BuildLightTables_Radial(Camera** cameras, int camCt, const
     leftEye = leftEye == nullptr ? headCam : leftEye;
     rightEye = rightEye == nullptr ? headCam : rightEye;
 
-    const auto frus = headCam->GetFrustum();
-    const auto nearDist = leftEye->GetNearClip();
-    const auto farDist = leftEye->GetFarClip();
+    nearDist_ = leftEye->GetNearClip();
+    farDist_ = leftEye->GetFarClip();
+
+    // Work in head space: forward is +Z whatever the head orientation, so the grid matches the eye frustums under pitch and
+    // roll, and its azimuth range stays centered away from the seam at +-pi
+    const Vector3 headCamPos = headCam->GetNode()->GetWorldPosition();
+    transform_ = Matrix3x4(headCamPos, headCam->GetNode()->GetWorldRotation(), 1.0f).Inverse();
 
-    // bottom left
-    const Vector3 minVec = (leftEye->GetFrustum().vertices_[6] - leftEye->GetFrustum().vertices_[2]).Normalized();
-    // top right
-    const Vector3 maxVec = (rightEye->GetFrustum().vertices_[4] - rightEye->GetFrustum().vertices_[0]).Normalized();
+    // The grid must cover the eye frustums. The corners bound the azimuth, but the inclination peaks where the top and bottom
+    // edges cross the view axis, so sample the far plane edges at their ends, midpoints and crossings of the vertical plane
+    viewEdgeDirections_.Clear();
+    Camera* eyes[] = { leftEye, rightEye };
+    for (unsigned i = 0; i < (leftEye != rightEye ? 2 : 1); ++i)
+    {
+        const Frustum& frustum = eyes[i]->GetFrustum();
+        for (unsigned j = 0; j < 4; ++j)
+        {
+            const Vector3 a = transform_ * frustum.vertices_[4 + j];
+            const Vector3 b = transform_ * frustum.vertices_[4 + (j + 1) % 4];
+            viewEdgeDirections_.Push(a.Normalized());
+            viewEdgeDirections_.Push(((a + b) * 0.5f).Normalized());
+            if ((a.x_ < 0.0f) != (b.x_ < 0.0f))
+                viewEdgeDirections_.Push(a.Lerp(b, a.x_ / (a.x_ - b.x_)).Normalized());
+        }
+    }
+
+    // The cells divide the azimuth and inclination range of the samples evenly. The column cones only change with the field of
+    // view, so are recomputed only when the range moves
+    minAngles_ = Vector2(M_INFINITY, M_INFINITY);
+    maxAngles_ = Vector2(-M_INFINITY, -M_INFINITY);
+    for (unsigned i = 0; i < viewEdgeDirections_.Size(); ++i)
+    {
+        const Vector3 spherical = Vector3_ToSphericalCoordinates(viewEdgeDirections_[i]);
+        minAngles_.x_ = Min(minAngles_.x_, spherical.x_);
+        minAngles_.y_ = Min(minAngles_.y_, spherical.y_);
+        maxAngles_.x_ = Max(maxAngles_.x_, spherical.x_);
+        maxAngles_.y_ = Max(maxAngles_.y_, spherical.y_);
+    }
+    const Vector3 minVec = Vector3_FromSphericalCoordinates(minAngles_.x_, minAngles_.y_);
+    const Vector3 maxVec = Vector3_FromSphericalCoordinates(maxAngles_.x_, maxAngles_.y_);
+    if (minAngles_ != coneMinAngles_ || maxAngles_ != coneMaxAngles_ || columnCos_.Size() != (unsigned)(tileDim_.x_ * tileDim_.y_))
+        UpdateColumnCones();
 
+    // Shaders find the cell of a position the same way the lights are binned
     ClusterInfo info;
     info.minVec = minVec;
+    info.nearDist = nearDist_;
     info.maxVec = maxVec;
+    info.farDist = farDist_;
     info.tiles = tileDim_;
+    info.itemsPerCell = lightsPerCell_;
+    info.headPosition = Vector4(headCamPos, 0.0f);
+    info.angles = Vector4(minAngles_.x_, minAngles_.y_, (maxAngles_.x_ - minAngles_.x_) / tileDim_.x_,
+        (maxAngles_.y_ - minAngles_.y_) / tileDim_.y_);
+    info.headRows[0] = Vector4(transform_.m00_, transform_.m01_, transform_.m02_, transform_.m03_);
+    info.headRows[1] = Vector4(transform_.m10_, transform_.m11_, transform_.m12_, transform_.m13_);
+    info.headRows[2] = Vector4(transform_.m20_, transform_.m21_, transform_.m22_, transform_.m23_);
     clusterInfo_->SetData(&info, sizeof(info), sizeof(ClusterInfo));
 
-    Matrix3 sphereSpaceTransform = Quaternion(Vector3(0.0f, 0.0f, 1.0f), minVec).RotationMatrix();
+    // Fill the records and the bounding spheres in head space. Directional lights get a record but are not clustered
+    numLights_ = Min(lights.Size(), maxLights_);
+    lightSpheres_.Resize(numLights_);
+    lightRecords_.Resize(numLights_);
+
+    for (unsigned i = 0; i < numLights_; ++i)
+    {
+        Sphere sphere = TiledRendering::RecordLight(lightRecords_[i], lights[i]);
+        lightSpheres_[i] = Vector4(transform_ * sphere.center_, sphere.radius_);
+    }
 
-    const auto headCamPos = headCam->GetNode()->GetWorldPosition();
-    const auto totalAngle = Vector3_ToSphericalCoordinates(maxVec) - Vector3_ToSphericalCoordinates(minVec);
-    for (unsigned lightIndex = 0; lightIndex < lights.Size() && lightIndex < maxLights_; ++lightIndex)
+    // Bin lights in worker threads, each into its own list of cell and light index pairs
     {
-        auto& l = lights[lightIndex];
-        auto aabb = l->GetWorldBoundingBox();
+        URHO3D_PROFILE(BinLights);
 
-        Vector3 pts[8];
-        for (int i = 0; i < 8; ++i)
-            pts[i] = Vector3_ToSphericalCoordinates(AABB_CornerPoint(aabb, i) - headCamPos);
+        auto* queue = GetSubsystem<WorkQueue>();
+        const unsigned numWorkItems = queue->GetNumThreads() + 1; // Worker threads + main thread
+        const unsigned lightsPerItem = Max(numLights_ / numWorkItems, 1U);
 
-        auto minPt = pts[0];
-        auto maxPt = pts[0];
-        for (int i = 1; i < 8; ++i)
+        binJobs_.Resize(numWorkItems);
+        unsigned start = 0;
+        for (unsigned i = 0; i < numWorkItems; ++i)
         {
-            minPt = VectorMin(minPt, pts[i]);
-            maxPt = VectorMax(maxPt, pts[i]);
+            BinJob& job = binJobs_[i];
+            job.begin_ = start;
+            job.end_ = (i < numWorkItems - 1) ? Min(start + lightsPerItem, numLights_) : numLights_;
+            start = job.end_;
+            if (job.begin_ == job.end_)
+            {
+                job.hits_.Clear();
+                continue;
+            }
+
+            SharedPtr<WorkItem> item = queue->GetFreeItem();
+            item->priority_ = M_MAX_UNSIGNED;
+            item->workFunction_ = BinLightsWork;
+            item->aux_ = this;
+            item->start_ = &job;
+            queue->AddWorkItem(item);
         }
 
-        int zStartIndex = toSliceZ(minPt.z_, nearDist, farDist);
-        int zEndIndex = toSliceZ(maxPt.z_, nearDist, farDist);
+        queue->Complete(M_MAX_UNSIGNED);
+    }
 
-        int yStartIndex = (int)Floor(math::InvLerp(minVec.y_, maxVec.y_, minPt.x_) * tileDim_.x_);
-        int yEndIndex = (int)Ceil(math::InvLerp(minVec.y_, maxVec.y_, maxPt.x_) * tileDim_.x_);
+    // Compact the per-job lists into the cell tables in light order
+    uint32_t hitCt = 0;
+    cellCounts_.Resize(CellCount() * 4);
+    memset(cellCounts_.Buffer(), 0, cellCounts_.Size() * sizeof(unsigned));
+    cellLightIndices_.Resize(CellCount() * lightsPerCell_);
+    for (unsigned i = 0; i < binJobs_.Size(); ++i)
+    {
+        const PODVector<unsigned>& hits = binJobs_[i].hits_;
+        for (unsigned j = 0; j < hits.Size(); j += 2)
+        {
+            const unsigned clusterID = hits[j];
+            unsigned& count = cellCounts_[clusterID * 4];
+            if (count < lightsPerCell_)
+                cellLightIndices_[clusterID * lightsPerCell_ + count++] = hits[j + 1];
+            ++hitCt;
+        }
+    }
 
-        int xStartIndex = (int)Floor(math::InvLerp(minVec.x_, maxVec.x_, minPt.x_) * tileDim_.x_);
-        int xEndIndex = (int)Ceil(math::InvLerp(minVec.x_, maxVec.x_, maxPt.x_) * tileDim_.x_);
+    cellsUBO_->SetData(cellCounts_.Buffer(), sizeof(unsigned) * cellCounts_.Size(), sizeof(uint4));
+    lightIndexesUBO_->SetData(cellLightIndices_.Buffer(), sizeof(uint32_t) * cellLightIndices_.Size(), sizeof(uint32_t));
 
-        // Now cull the light, casts aren't optional
-        if ((zStartIndex < 0 && zEndIndex < 0) || (zStartIndex >= (int)tileDim_.z_ && zEndIndex >= (int)tileDim_.z_))
-            continue;
+    // The record buffer keeps its capacity, so only the changed range is uploaded
+    numUploadedBytes_ = UploadChangedRecords(lightsUBO_, lightRecords_, uploadedLightRecords_);
 
-        if ((yStartIndex < 0 && yEndIndex < 0) || (yStartIndex >= (int)tileDim_.y_ && yEndIndex >= (int)tileDim_.y_))
-            continue;
+    return hitCt;
+}
 
-        if ((xStartIndex < 0 && xEndIndex < 0) || (xStartIndex >= (int)tileDim_.x_ && xEndIndex >= (int)tileDim_.x_))
-            continue;
+unsigned LightTiler::ValidateViewCoverage() const
+{
+    // Test lights halfway through the depth slices, small enough to touch only the cells on their direction
+    const float distance = sqrtf(nearDist_ * farDist_);
+    PODVector<unsigned> hits;
+    unsigned numMissing = 0;
 
-        zStartIndex = Clamp<int>(zStartIndex, 0, tileDim_.z_ - 1);
-        zEndIndex = Clamp<int>(zEndIndex, 0, tileDim_.z_ - 1);
+    for (unsigned i = 0; i < viewEdgeDirections_.Size(); ++i)
+    {
+        hits.Clear();
+        BinSphere(Vector4(viewEdgeDirections_[i] * distance, distance * 0.001f), 0, hits);
+        if (hits.Empty())
+            ++numMissing;
+    }
 
-        yStartIndex = Clamp<int>(yStartIndex, 0, tileDim_.y_ - 1);
-        yEndIndex = Clamp<int>(yEndIndex, 0, tileDim_.y_ - 1);
+    return numMissing;
+}
+
+unsigned LightTiler::ValidateLightTables() const
+{
+    if (cellCounts_.Size() != CellCount() * 4 || lightSpheres_.Size() != numLights_)
+        return 0;
 
-        xStartIndex = Clamp<int>(xStartIndex, 0, tileDim_.x_ - 1);
-        xEndIndex = Clamp<int>(xEndIndex, 0, tileDim_.x_ - 1);
+    const Vector2 cellAngles((maxAngles_.x_ - minAngles_.x_) / tileDim_.x_, (maxAngles_.y_ - minAngles_.y_) / tileDim_.y_);
+    const unsigned samplesPerAxis = 3;
+    unsigned numMissing = 0;
 
-        for (auto z = zStartIndex; z <= zEndIndex; ++z)
+    for (int z = 0; z < tileDim_.z_; ++z)
+    {
+        // Slice boundaries are spaced logarithmically between the near and far distance
+        const float zNear = nearDist_ * powf(farDist_ / nearDist_, (float)z / tileDim_.z_);
+        const float zFar = nearDist_ * powf(farDist_ / nearDist_, (float)(z + 1) / tileDim_.z_);
+
+        for (int y = 0; y < tileDim_.y_; ++y)
         {
-            for (auto y = yStartIndex; y <= yEndIndex; ++y)
+            for (int x = 0; x < tileDim_.x_; ++x)
             {
-                for (auto x = xStartIndex; x <= xEndIndex; ++x)
+                const unsigned clusterID = toIndex(x, y, z);
+
+                // Reference: any sample point of the cell inside the light's sphere means the light must be listed
+                Vector3 samples[samplesPerAxis * samplesPerAxis * samplesPerAxis];
+                unsigned numSamples = 0;
+                for (unsigned i = 0; i < samplesPerAxis; ++i)
                 {
-                    auto clusterID = x + y * tileDim_.x_ + z * tileDim_.x_ * tileDim_.y_;
-                    lightIndices[clusterID * lightsPerCell_ + lightCounts[clusterID].x_ % lightsPerCell_] = lightIndex;
-                    lightCounts[clusterID].x_ += 1;
-                    ++hitCt;
+                    for (unsigned j = 0; j < samplesPerAxis; ++j)
+                    {
+                        const float fraction = 1.0f / (samplesPerAxis - 1);
+                        const Vector3 direction = Vector3_FromSphericalCoordinates(minAngles_.x_ + (x + i * fraction) * cellAngles.x_,
+                            minAngles_.y_ + (y + j * fraction) * cellAngles.y_);
+                        for (unsigned k = 0; k < samplesPerAxis; ++k)
+                            samples[numSamples++] = direction * Lerp(zNear, zFar, k * fraction);
+                    }
+                }
+
+                for (unsigned lightIndex = 0; lightIndex < lightSpheres_.Size(); ++lightIndex)
+                {
+                    const Vector4& sphere = lightSpheres_[lightIndex];
+                    if (sphere.w_ < 0.0f)
+                        continue;
+
+                    const Vector3 center(sphere.x_, sphere.y_, sphere.z_);
+                    bool touches = false;
+                    for (unsigned i = 0; i < numSamples && !touches; ++i)
+                        touches = (samples[i] - center).LengthSquared() <= sphere.w_ * sphere.w_;
+                    if (!touches)
+                        continue;
+
+                    const unsigned count = cellCounts_[clusterID * 4];
+                    if (count >= lightsPerCell_)
+                        continue;
+
+                    bool found = false;
+                    for (unsigned i = 0; i < count && !found; ++i)
+                        found = cellLightIndices_[clusterID * lightsPerCell_ + i] == lightIndex;
+                    if (!found)
+                    {
+                        if (!numMissing)
+                            URHO3D_LOGWARNING("Clustered light " + String(lightIndex) + " missing from cell " + String(x) + "," +
+                                String(y) + "," + String(z));
+                        ++numMissing;
+                    }
                 }
             }
         }
     }
 
-    cellsUBO_->SetData(lightCounts.Buffer(), sizeof(uint4)* lightCounts.Size(), sizeof(uint4));
-    lightsUBO_->SetData(lightRawData.Buffer(), sizeof(LightData)* lightRawData.Size(), sizeof(LightData));
-    lightIndexesUBO_->SetData(lightIndices.Buffer(), sizeof(uint32_t)* lightIndices.Size(), sizeof(uint32_t));
-    transform_ = sphereSpaceTransform;
-
-    return hitCt;
+    return numMissing;
 }
-#pragma optimize("", on)
 
 }
@@ -1,9 +1,11 @@
 #pragma once
 
 #include "../Math/BoundingBox.h"
+#include "../Math/Matrix3x4.h"
 
 #include "../Graphics/ComputeBuffer.h"
 #include "../Graphics/ComputeDevice.h"
+#include "../Graphics/TiledRendering.h"
 
 namespace Urho3D
 {
@@ -21,27 +23,37 @@ public:
     LightTiler(Context* device, IntVector3 cells, uint32_t lightsPerCell);
     virtual ~LightTiler();
 
-    /// In spherical coordinates instead of vanilla froxels. Based on Min-To-Max range walk.
+    /// In spherical coordinates instead of vanilla froxels. Lights are bounded by spheres, tested against the cone of each cell column and binned in worker threads.
     uint32_t BuildLightTables_Radial(Camera** cameras, int cameraCt, const Vector< SharedPtr<Light> >& lights);
+    /// Bin the lights [begin, end) into cells, output as pairs of cell and light index. Called from worker threads.
+    void BinLights(unsigned begin, unsigned end, PODVector<unsigned>& hits) const;
+    /// Check the last built tables against a brute-force test of every light against sample points of every cell. Slow, for debugging. Return the number of entries missing from cells that are not full.
+    unsigned ValidateLightTables() const;
+    /// Bin a small test light on each sampled edge direction of the eye frustums of the last build, including directly above and below the view axis. Return the number of test lights that fall in no cell. Slow, for debugging.
+    unsigned ValidateViewCoverage() const;
 
-    /// Stores the counts
+    /// Return number of record bytes uploaded by the last build. Unchanged records, such as those of static lights, are not uploaded.
+    unsigned GetNumUploadedBytes() const { return numUploadedBytes_; }
+
+    /// Stores the counts of lights in each cell.
     SharedPtr<ComputeBuffer> cellsUBO_;
 
-    /// Stores the LightData structs.
+    /// Stores the ClusteredLightData structs.
     SharedPtr<ComputeBuffer> lightsUBO_;
-    /// Stores the indexes for each cell that map a light to a LightData struct.
+    /// Stores the indexes for each cell that map a light to a ClusteredLightData struct.
     SharedPtr<ComputeBuffer> lightIndexesUBO_;
     SharedPtr<ComputeBuffer> clusterInfo_;
 
-    SharedPtr<ComputeBuffer> iblCubesUBO_;
-    SharedPtr<ComputeBuffer> iblCubeIndexesUBO_;
-
-    SharedPtr<ComputeBuffer> decalsUBO_;
-    SharedPtr<ComputeBuffer> decalIndexesUBO_;
-
     SharedPtr<Texture> lightsTex_;
 
-    Matrix4 transform_; // left-multiply
+    /// Light count of each cell in the first of 4 components, uploaded to cellsUBO_. Kept between builds.
+    PODVector<unsigned> cellCounts_;
+    /// Light indices of each cell in lightsPerCell_ slots, uploaded to lightIndexesUBO_. Kept between builds.
+    PODVector<uint32_t> cellLightIndices_;
+
+    /// World to head space transform of the last build: the head camera's inverse position and rotation, without scale. The
+    /// cell grid is laid out in head space, so that it follows the view and its azimuth range never crosses the seam behind it.
+    Matrix3x4 transform_;
     IntVector3 tileDim_; // uze Z > 1 for clustered.
     uint32_t lightsPerCell_;
     uint32_t maxLights_;
@@ -52,6 +64,51 @@ public:
         float logFrac = log(farDist / nearDist);
         return Floor((log(z) * (tileDim_.z_ / logFrac)) - ((tileDim_.z_ * log(nearDist)) / logFrac));
     }
+
+    /// Range of lights to bin in a work item and its output.
+    struct BinJob
+    {
+        unsigned begin_;
+        unsigned end_;
+        PODVector<unsigned> hits_;
+    };
+
+private:
+    /// Recompute the cone of each cell column after the angular range of the grid has changed.
+    void UpdateColumnCones();
+    /// Bin one head space bounding sphere, radius in W, output as pairs of cell and light index.
+    void BinSphere(const Vector4& sphere, unsigned lightIndex, PODVector<unsigned>& hits) const;
+
+    /// Bounding spheres of the lights in head space, radius in W. Negative radius for lights that are not binned.
+    PODVector<Vector4> lightSpheres_;
+    /// Records of the last build.
+    PODVector<ClusteredLightData> lightRecords_;
+    /// Records as last uploaded, to find the changed ones.
+    PODVector<ClusteredLightData> uploadedLightRecords_;
+    /// Light count of the last build.
+    unsigned numLights_;
+    /// Record bytes uploaded by the last build.
+    unsigned numUploadedBytes_;
+    /// Unit direction of each cell column's center, structure of arrays.
+    PODVector<float> columnDirX_;
+    PODVector<float> columnDirY_;
+    PODVector<float> columnDirZ_;
+    /// Cosine and sine of the angle from each cell column's center to its farthest edge.
+    PODVector<float> columnCos_;
+    PODVector<float> columnSin_;
+    /// Head space directions sampled along the far plane edges of the eye frustums in the last build.
+    PODVector<Vector3> viewEdgeDirections_;
+    /// Azimuth and inclination of the grid's first and last cell corners.
+    Vector2 minAngles_;
+    Vector2 maxAngles_;
+    /// Angular range the column cones were computed for.
+    Vector2 coneMinAngles_;
+    Vector2 coneMaxAngles_;
+    /// Near and far distance of the depth slices.
+    float nearDist_;
+    float farDist_;
+    /// Work item ranges and outputs, kept between builds.
+    Vector<BinJob> binJobs_;
 };
 
 }
@@ -60,6 +60,91 @@ unsigned LookupIndexBuffer(IndexBuffer* buffer, const Vector<SharedPtr<IndexBuff
     return 0;
 }
 
+static void DecodeMorphDeltas(VertexBufferMorph& morph)
+{
+    // Without packed data the morph is already decoded
+    if (!morph.morphData_)
+        return;
+
+    unsigned vertexCount = morph.vertexCount_;
+    morph.indices_.Reset();
+    morph.positionDeltas_.Reset();
+    morph.normalDeltas_.Reset();
+    morph.tangentDeltas_.Reset();
+    if (!vertexCount)
+    {
+        morph.morphData_.Reset();
+        return;
+    }
+
+    morph.indices_ = new unsigned[vertexCount];
+    if (morph.elementMask_ & MASK_POSITION)
+        morph.positionDeltas_ = new float[vertexCount * 3];
+    if (morph.elementMask_ & MASK_NORMAL)
+        morph.normalDeltas_ = new float[vertexCount * 3];
+    if (morph.elementMask_ & MASK_TANGENT)
+        morph.tangentDeltas_ = new float[vertexCount * 3];
+
+    // Split the packed <index, data> records into separate streams, so that accumulation can run one element at a time
+    // over contiguous memory
+    const unsigned char* src = morph.morphData_.Get();
+    for (unsigned i = 0; i < vertexCount; ++i)
+    {
+        morph.indices_[i] = *((const unsigned*)src);
+        src += sizeof(unsigned);
+
+        if (morph.positionDeltas_)
+        {
+            memcpy(&morph.positionDeltas_[i * 3], src, 3 * sizeof(float));
+            src += 3 * sizeof(float);
+        }
+        if (morph.normalDeltas_)
+        {
+            memcpy(&morph.normalDeltas_[i * 3], src, 3 * sizeof(float));
+            src += 3 * sizeof(float);
+        }
+        if (morph.tangentDeltas_)
+        {
+            memcpy(&morph.tangentDeltas_[i * 3], src, 3 * sizeof(float));
+            src += 3 * sizeof(float);
+        }
+    }
+
+    // The streams hold everything the packed data did, so keep only one copy
+    morph.morphData_.Reset();
+}
+
+static void WriteMorphDeltas(Serializer& dest, const VertexBufferMorph& morph)
+{
+    if (morph.morphData_)
+    {
+        dest.Write(morph.morphData_.Get(), morph.dataSize_);
+        return;
+    }
+
+    // Interleave the streams back into <index, data> records
+    for (unsigned i = 0; i < morph.vertexCount_; ++i)
+    {
+        dest.WriteUInt(morph.indices_[i]);
+        if (morph.positionDeltas_)
+            dest.Write(&morph.positionDeltas_[i * 3], 3 * sizeof(float));
+        if (morph.normalDeltas_)
+            dest.Write(&morph.normalDeltas_[i * 3], 3 * sizeof(float));
+        if (morph.tangentDeltas_)
+            dest.Write(&morph.tangentDeltas_[i * 3], 3 * sizeof(float));
+    }
+}
+
+template <class T> static SharedArrayPtr<T> CloneArray(const SharedArrayPtr<T>& src, unsigned count)
+{
+    if (!src)
+        return SharedArrayPtr<T>();
+
+    SharedArrayPtr<T> ret(new T[count]);
+    memcpy(ret.Get(), src.Get(), count * sizeof(T));
+    return ret;
+}
+
 Model::Model(Context* context) :
     ResourceWithMetadata(context)
 {
@@ -284,8 +369,10 @@ bool Model::BeginLoad(Deserializer& source)
             newBuffer.morphData_ = new unsigned char[newBuffer.dataSize_];
 
             source.Read(&newBuffer.morphData_[0], newBuffer.vertexCount_ * vertexSize);
+            DecodeMorphDeltas(newBuffer);
 
             newMorph.buffers_[bufferIndex] = newBuffer;
+            // The decoded deltas take the same space as the packed data, which is released after decoding
             memoryUse += sizeof(VertexBufferMorph) + newBuffer.vertexCount_ * vertexSize;
         }
 
@@ -356,6 +443,8 @@ bool Model::EndLoad()
             geometry->SetVertexBuffer(0, vertexBuffers_[desc.vbRef_]);
             geometry->SetIndexBuffer(indexBuffers_[desc.ibRef_]);
             geometry->SetDrawRange(desc.type_, desc.indexStart_, desc.indexCount_);
+            // Loaded geometry is static, so ray queries can keep a triangle hierarchy
+            geometry->SetTriangleBVHEnabled(true);
         }
     }
 
@@ -436,18 +525,7 @@ bool Model::Save(Serializer& dest) const
             dest.WriteUInt(j->first_);
             dest.WriteUInt(j->second_.elementMask_);
             dest.WriteUInt(j->second_.vertexCount_);
-
-            // Base size: size of each vertex index
-            unsigned vertexSize = sizeof(unsigned);
-            // Add size of individual elements
-            if (j->second_.elementMask_ & MASK_POSITION)
-                vertexSize += sizeof(Vector3);
-            if (j->second_.elementMask_ & MASK_NORMAL)
-                vertexSize += sizeof(Vector3);
-            if (j->second_.elementMask_ & MASK_TANGENT)
-                vertexSize += sizeof(Vector3);
-
-            dest.Write(j->second_.morphData_.Get(), vertexSize * j->second_.vertexCount_);
+            WriteMorphDeltas(dest, j->second_);
         }
     }
 
@@ -612,6 +690,16 @@ void Model::SetGeometryBoneMappings(const Vector<PODVector<unsigned> >& geometry
 void Model::SetMorphs(const Vector<ModelMorph>& morphs)
 {
     morphs_ = morphs;
+    UpdateMorphDeltas();
+}
+
+void Model::UpdateMorphDeltas()
+{
+    for (Vector<ModelMorph>::Iterator i = morphs_.Begin(); i != morphs_.End(); ++i)
+    {
+        for (HashMap<unsigned, VertexBufferMorph>::Iterator j = i->buffers_.Begin(); j != i->buffers_.End(); ++j)
+            DecodeMorphDeltas(j->second_);
+    }
 }
 
 SharedPtr<Model> Model::Clone(const String& cloneName) const
@@ -705,6 +793,7 @@ SharedPtr<Model> Model::Clone(const String& cloneName) const
                 cloneGeometry->SetDrawRange(origGeometry->GetPrimitiveType(), origGeometry->GetIndexStart(),
                     origGeometry->GetIndexCount(), origGeometry->GetVertexStart(), origGeometry->GetVertexCount(), false);
                 cloneGeometry->SetLodDistance(origGeometry->GetLodDistance());
+                cloneGeometry->SetTriangleBVHEnabled(origGeometry->GetTriangleBVHEnabled());
             }
 
             ret->geometries_[i][j] = cloneGeometry;
@@ -719,12 +808,11 @@ SharedPtr<Model> Model::Clone(const String& cloneName) const
         for (HashMap<unsigned, VertexBufferMorph>::Iterator j = morph.buffers_.Begin(); j != morph.buffers_.End(); ++j)
         {
             VertexBufferMorph& vbMorph = j->second_;
-            if (vbMorph.dataSize_)
-            {
-                SharedArrayPtr<unsigned char> cloneData(new unsigned char[vbMorph.dataSize_]);
-                memcpy(cloneData.Get(), vbMorph.morphData_.Get(), vbMorph.dataSize_);
-                vbMorph.morphData_ = cloneData;
-            }
+            vbMorph.morphData_ = CloneArray(vbMorph.morphData_, vbMorph.dataSize_);
+            vbMorph.indices_ = CloneArray(vbMorph.indices_, vbMorph.vertexCount_);
+            vbMorph.positionDeltas_ = CloneArray(vbMorph.positionDeltas_, vbMorph.vertexCount_ * 3);
+            vbMorph.normalDeltas_ = CloneArray(vbMorph.normalDeltas_, vbMorph.vertexCount_ * 3);
+            vbMorph.tangentDeltas_ = CloneArray(vbMorph.tangentDeltas_, vbMorph.vertexCount_ * 3);
         }
     }
 
@@ -46,8 +46,16 @@ struct VertexBufferMorph
     unsigned vertexCount_;
     /// Morphed vertices data size as bytes.
     unsigned dataSize_;
-    /// Morphed vertices. Stored packed as <index, data> pairs.
+    /// Morphed vertices packed as <index, data> pairs, as loaded or assigned manually. Released once decoded into the arrays below, which then hold the only copy.
     SharedArrayPtr<unsigned char> morphData_;
+    /// Morphed vertex indices decoded from the packed data for sparse accumulation.
+    SharedArrayPtr<unsigned> indices_;
+    /// Position deltas decoded from the packed data as contiguous xyz triplets. Null if the morph has no positions.
+    SharedArrayPtr<float> positionDeltas_;
+    /// Normal deltas decoded from the packed data as contiguous xyz triplets. Null if the morph has no normals.
+    SharedArrayPtr<float> normalDeltas_;
+    /// Tangent deltas decoded from the packed data as contiguous xyz triplets. Null if the morph has no tangents.
+    SharedArrayPtr<float> tangentDeltas_;
 };
 
 /// Definition of a model's vertex morph.
@@ -145,6 +153,8 @@ public:
     void SetGeometryBoneMappings(const Vector<PODVector<unsigned> >& geometryBoneMappings);
     /// Set vertex morphs.
     void SetMorphs(const Vector<ModelMorph>& morphs);
+    /// Decode the packed morph data of vertex morphs into sparse delta arrays and release it. Morphs without packed data are left as they are. Call after assigning packed morph data manually.
+    void UpdateMorphDeltas();
     /// Clone the model. The geometry data is deep-copied and can be modified in the clone without affecting the original.
     SharedPtr<Model> Clone(const String& cloneName = String::EMPTY) const;
 
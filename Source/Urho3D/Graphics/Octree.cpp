@@ -180,6 +180,7 @@ void Octree::HandleRenderUpdate(StringHash eventType, VariantMap& eventData)
     frame.frameNumber_ = GetSubsystem<Time>()->GetFrameNumber();
     frame.timeStep_ = eventData[P_TIMESTEP].GetFloat();
     frame.camera_ = nullptr;
+    frame.lodPolicy_ = nullptr;
 
     Update(frame);
 }
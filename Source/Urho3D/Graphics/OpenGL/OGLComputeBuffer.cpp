@@ -98,6 +98,28 @@ bool ComputeBuffer::SetData(void* data, unsigned dataSize, unsigned structureSiz
     return true;
 }
 
+bool ComputeBuffer::SetDataRange(const void* data, unsigned offset, unsigned dataSize)
+{
+    if (object_.name_ == 0)
+        return false;
+
+    if (graphics_->IsDeviceLost())
+    {
+        URHO3D_LOGERROR("ComputeBuffer::SetDataRange, attempted to call while device is lost");
+        return false;
+    }
+
+    if (offset + dataSize > size_)
+    {
+        URHO3D_LOGERROR("Illegal range for setting new ComputeBuffer data");
+        return false;
+    }
+
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, object_.name_);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, offset, dataSize, data);
+    return true;
+}
+
 bool ComputeBuffer::GetData(void* writeInto, unsigned offset, unsigned readLength)
 {
     if (object_.name_ == 0)
@@ -929,6 +929,61 @@ bool Graphics::ResolveToTexture(TextureCube* texture)
 #endif
 }
 
+bool Graphics::CopyTexture(Texture2D* source, Texture2D* destination)
+{
+    return source && CopyTextureRegion(source, destination, IntRect(0, 0, source->GetWidth(), source->GetHeight()));
+}
+
+bool Graphics::CopyTextureRegion(Texture2D* source, Texture2D* destination, const IntRect& rect)
+{
+#ifndef GL_ES_VERSION_2_0
+    if (!gl3Support || !source || !destination || !source->GetGPUObjectName() || !destination->GetGPUObjectName() ||
+        source == destination)
+        return false;
+    if (source->GetWidth() != destination->GetWidth() || source->GetHeight() != destination->GetHeight() ||
+        source->GetFormat() != destination->GetFormat() || source->GetUsage() != destination->GetUsage())
+        return false;
+    if (rect.left_ < 0 || rect.top_ < 0 || rect.right_ > source->GetWidth() || rect.bottom_ > source->GetHeight() ||
+        rect.left_ >= rect.right_ || rect.top_ >= rect.bottom_)
+        return false;
+
+    URHO3D_PROFILE(CopyTexture);
+
+    // Use the resolve FBOs to not disturb the currently set rendertarget(s)
+    if (!impl_->resolveSrcFBO_)
+        impl_->resolveSrcFBO_ = CreateFramebuffer();
+    if (!impl_->resolveDestFBO_)
+        impl_->resolveDestFBO_ = CreateFramebuffer();
+
+    bool depth = source->GetUsage() == TEXTURE_DEPTHSTENCIL;
+    GLenum attachment = depth ? GL_DEPTH_ATTACHMENT : GL_COLOR_ATTACHMENT0;
+    // Flip the rectangle to match the viewport convention of SetViewport()
+    int height = source->GetHeight();
+    int bottom = height - rect.bottom_;
+    int top = height - rect.top_;
+
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, impl_->resolveSrcFBO_);
+    glFramebufferTexture2D(GL_READ_FRAMEBUFFER, attachment, GL_TEXTURE_2D, source->GetGPUObjectName(), 0);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, impl_->resolveDestFBO_);
+    glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, attachment, GL_TEXTURE_2D, destination->GetGPUObjectName(), 0);
+    glBlitFramebuffer(rect.left_, bottom, rect.right_, top, rect.left_, bottom, rect.right_, top,
+        depth ? GL_DEPTH_BUFFER_BIT : GL_COLOR_BUFFER_BIT, GL_NEAREST);
+
+    // Detach again so that the resolve FBOs do not keep references to the textures
+    glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, attachment, GL_TEXTURE_2D, 0, 0);
+    glFramebufferTexture2D(GL_READ_FRAMEBUFFER, attachment, GL_TEXTURE_2D, 0, 0);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+
+    // Restore previously bound FBO
+    BindFramebuffer(impl_->boundFBO_);
+    return true;
+#else
+    // Not supported on GLES
+    return false;
+#endif
+}
+
 void Graphics::Draw(PrimitiveType type, unsigned vertexStart, unsigned vertexCount)
 {
     if (!vertexCount)
@@ -62,6 +62,7 @@ ParticleEffect::ParticleEffect(Context* context) :
     sorted_(false),
     spawnOnSpline_(false),
     fixedScreenSize_(false),
+    gpuSimulated_(false),
     animationLodBias_(0.0f),
     emitterType_(EMITTER_SPHERE),
     emitterSize_(Vector3::ZERO),
@@ -140,6 +141,7 @@ bool ParticleEffect::Load(const XMLElement& source)
     sorted_ = false;
     spawnOnSpline_ = false;
     fixedScreenSize_ = false;
+    gpuSimulated_ = false;
     animationLodBias_ = 0.0f;
     emitterType_ = EMITTER_SPHERE;
     emitterSize_ = Vector3::ZERO;
@@ -204,6 +206,9 @@ bool ParticleEffect::Load(const XMLElement& source)
     if (source.HasChild("fixedscreensize"))
         fixedScreenSize_ = source.GetChild("fixedscreensize").GetBool("enable");
 
+    if (source.HasChild("gpusimulated"))
+        gpuSimulated_ = source.GetChild("gpusimulated").GetBool("enable");
+
     if (source.HasChild("animlodbias"))
         SetAnimationLodBias(source.GetChild("animlodbias").GetFloat("value"));
 
@@ -406,6 +411,12 @@ bool ParticleEffect::Save(XMLElement& dest) const
     childElem = dest.CreateChild("fixedscreensize");
     childElem.SetBool("enable", fixedScreenSize_);
 
+    if (gpuSimulated_)
+    {
+        childElem = dest.CreateChild("gpusimulated");
+        childElem.SetBool("enable", gpuSimulated_);
+    }
+
     childElem = dest.CreateChild("animlodbias");
     childElem.SetFloat("value", animationLodBias_);
 
@@ -566,6 +577,11 @@ void ParticleEffect::SetFixedScreenSize(bool enable)
     fixedScreenSize_ = enable;
 }
 
+void ParticleEffect::SetGPUSimulated(bool enable)
+{
+    gpuSimulated_ = enable;
+}
+
 void ParticleEffect::SetAnimationLodBias(float lodBias)
 {
     animationLodBias_ = lodBias;
@@ -839,6 +855,7 @@ SharedPtr<ParticleEffect> ParticleEffect::Clone(const String& cloneName) const
     ret->scaled_ = scaled_;
     ret->sorted_ = sorted_;
     ret->fixedScreenSize_ = fixedScreenSize_;
+    ret->gpuSimulated_ = gpuSimulated_;
     ret->animationLodBias_ = animationLodBias_;
     ret->emitterType_ = emitterType_;
     ret->emitterSize_ = emitterSize_;
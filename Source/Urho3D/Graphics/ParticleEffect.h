@@ -139,6 +139,10 @@ public:
     void SetSorted(bool enable);
     /// Set whether billboards have fixed size on screen (measured in pixels) regardless of distance to camera.
     void SetFixedScreenSize(bool enable);
+    /// Set whether particles are emitted, simulated and expanded to billboards in compute shaders when supported. Splines,
+    /// spawn points, vortex force, sorting and direction-facing billboards are not supported by the GPU path and fall back to
+    /// the CPU simulation.
+    void SetGPUSimulated(bool enable);
     /// Set animation LOD bias.
     void SetAnimationLodBias(float lodBias);
     /// Set emitter type.
@@ -241,6 +245,9 @@ public:
     /// Return whether billboards are fixed screen size.
     bool IsFixedScreenSize() const { return fixedScreenSize_; }
 
+    /// Return whether particles are simulated on the GPU when supported.
+    bool IsGPUSimulated() const { return gpuSimulated_; }
+
     /// Return animation Lod bias.
     float GetAnimationLodBias() const { return animationLodBias_; }
 
@@ -386,6 +393,8 @@ private:
     bool sorted_;
     /// Billboards fixed screen size flag.
     bool fixedScreenSize_;
+    /// GPU simulation flag.
+    bool gpuSimulated_;
     /// Spawn somewhere along the spline.
     bool spawnOnSpline_;
     /// Animation LOD bias.
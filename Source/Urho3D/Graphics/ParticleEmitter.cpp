@@ -27,6 +27,13 @@
 #include "../Graphics/DrawableEvents.h"
 #include "../Graphics/ParticleEffect.h"
 #include "../Graphics/ParticleEmitter.h"
+#ifdef URHO3D_COMPUTE
+    #include "../Graphics/ComputeBuffer.h"
+    #include "../Graphics/ComputeDevice.h"
+    #include "../Graphics/ConstantBuffer.h"
+    #include "../Graphics/Graphics.h"
+    #include "../Graphics/VertexBuffer.h"
+#endif
 #include "../Resource/ResourceCache.h"
 #include "../Resource/ResourceEvents.h"
 #include "../Scene/Scene.h"
@@ -44,6 +51,19 @@ static const unsigned MAX_PARTICLES_IN_FRAME = 100;
 
 extern const char* autoRemoveModeNames[];
 
+void ParticleStreams::Resize(unsigned num)
+{
+    velocity_.Resize(num);
+    size_.Resize(num);
+    timer_.Resize(num);
+    timeToLive_.Resize(num);
+    scale_.Resize(num);
+    rotationSpeed_.Resize(num);
+    colorIndex_.Resize(num);
+    texIndex_.Resize(num);
+    identifier_.Resize(num);
+}
+
 ParticleEmitter::ParticleEmitter(Context* context) :
     BillboardSet(context),
     periodTimer_(0.0f),
@@ -57,7 +77,14 @@ ParticleEmitter::ParticleEmitter(Context* context) :
     autoRemove_(REMOVE_DISABLED),
     previousPosition_(FLT_MIN, FLT_MIN, FLT_MIN),
 	nextParticleID_(0),
-    warmStart_(false)
+    warmStart_(false),
+    gpuSupported_(false),
+    gpuEmitCount_(0),
+    gpuEmitIndex_(0),
+    gpuTimeStep_(0.0f),
+    gpuActiveTime_(0.0f),
+    gpuFrameNumber_(M_MAX_UNSIGNED),
+    gpuPreviousPosition_(Vector3::ZERO)
 {
     SetNumParticles(DEFAULT_NUM_PARTICLES);
 }
@@ -113,6 +140,14 @@ void ParticleEmitter::Update(const FrameInfo& frame)
     if (!needUpdate_)
         return;
 
+    // On the GPU only the emission is decided here, the particles are simulated when the geometry is updated
+    if (IsGPUSimulated())
+    {
+        UpdateGPUEmission();
+        needUpdate_ = false;
+        return;
+    }
+
     if (previousPosition_ == Vector3(FLT_MIN, FLT_MIN, FLT_MIN))
         previousPosition_ = node_->GetWorldPosition();
     currentPosition_ = node_->GetWorldDirection();
@@ -133,29 +168,7 @@ void ParticleEmitter::Update(const FrameInfo& frame)
 
     do {
         // Check active/inactive period switching
-        periodTimer_ += lastTimeStep_;
-        if (emitting_)
-        {
-            float activeTime = effect_->GetActiveTime();
-            if (activeTime && periodTimer_ >= activeTime)
-            {
-                emitting_ = false;
-                periodTimer_ -= activeTime;
-            }
-        }
-        else
-        {
-            float inactiveTime = effect_->GetInactiveTime();
-            if (inactiveTime && periodTimer_ >= inactiveTime)
-            {
-                emitting_ = true;
-                sendFinishedEvent_ = true;
-                periodTimer_ -= inactiveTime;
-            }
-            // If emitter has an indefinite stop interval, keep period timer reset to allow restarting emission in the editor
-            if (inactiveTime == 0.0f)
-                periodTimer_ = 0.0f;
-        }
+        UpdatePeriodTimer();
 
         // Check for emitting new particles
         if (emitting_)
@@ -198,124 +211,200 @@ void ParticleEmitter::Update(const FrameInfo& frame)
             }
         }
 
-        // Update existing particles
-        Vector3 relativeConstantForce = node_->GetWorldRotation().Inverse() * effect_->GetConstantForce();
+        // Cull expired particles and gather the live ones, so that the passes below need no per-particle enabled checks
+        unsigned numParticles = particles_.Size();
+        aliveParticles_.Clear();
+        for (unsigned i = 0; i < numParticles; ++i)
+        {
+            Billboard& billboard = billboards_[i];
+            if (!billboard.enabled_)
+                continue;
+
+            needCommit = true;
+            if (particles_.timer_[i] >= particles_.timeToLive_[i])
+            {
+                billboard.enabled_ = false;
+                doWarmStart = false;
+            }
+            else
+                aliveParticles_.Push(i);
+        }
+
+        unsigned numAlive = aliveParticles_.Size();
+        if (numAlive)
+            UpdateParticles(numAlive);
+    } while (emitting_ && doWarmStart);
+
+    if (needCommit)
+        Commit();
+
+    previousPosition_ = currentPosition_;
+    needUpdate_ = false;
+}
+
+void ParticleEmitter::UpdateGeometry(const FrameInfo& frame)
+{
+    if (IsGPUSimulated())
+        DispatchGPUParticles(frame);
+    else
+        BillboardSet::UpdateGeometry(frame);
+}
+
+UpdateGeometryType ParticleEmitter::GetUpdateGeometryType()
+{
+    // Dispatching the compute kernels needs the main thread
+    if (IsGPUSimulated())
+        return UPDATE_MAIN_THREAD;
+    else
+        return BillboardSet::GetUpdateGeometryType();
+}
+
+void ParticleEmitter::UpdateParticles(unsigned numAlive)
+{
+    const unsigned* alive = &aliveParticles_[0];
+    const float timeStep = lastTimeStep_;
+    Vector3* velocities = &particles_.velocity_[0];
+    float* timers = &particles_.timer_[0];
+
+    // Timers
+    for (unsigned k = 0; k < numAlive; ++k)
+        timers[alive[k]] += timeStep;
+
+    // Forces. Each effect parameter is checked once per pass instead of once per particle
+    const Vector3& constantForce = effect_->GetConstantForce();
+    if (constantForce != Vector3::ZERO)
+    {
+        Vector3 deltaVelocity = timeStep * (relative_ ? node_->GetWorldRotation().Inverse() * constantForce : constantForce);
+        for (unsigned k = 0; k < numAlive; ++k)
+            velocities[alive[k]] += deltaVelocity;
+    }
+
+    const Vector2& vortexForce = effect_->GetVortexForce();
+    if (vortexForce != Vector2::ZERO)
+    {
+        Vector3 vortexAxis = node_->GetWorldRotation() * effect_->GetVortexAxis();
+        for (unsigned k = 0; k < numAlive; ++k)
+        {
+            Vector3& velocity = velocities[alive[k]];
+            velocity = Quaternion(Random(vortexForce.x_, vortexForce.y_) * timeStep, vortexAxis) * velocity;
+        }
+    }
+
+    float dampingForce = effect_->GetDampingForce();
+    if (dampingForce != 0.0f)
+    {
+        float damping = 1.0f - timeStep * dampingForce;
+        for (unsigned k = 0; k < numAlive; ++k)
+            velocities[alive[k]] *= damping;
+    }
+
+    // Positions
+    const Vector<Spline>& effectSplines = effect_->GetSplines();
+    if (effectSplines.Empty())
+    {
         // If billboards are not relative, apply scaling to the position update
         Vector3 scaleVector = Vector3::ONE;
         if (scaled_ && !relative_)
             scaleVector = node_->GetWorldScale();
+        Vector3 positionScale = timeStep * scaleVector;
 
-        auto vortexAxis = node_->GetWorldRotation() * effect_->GetVortexAxis();
-        const auto& effectSplines = effect_->GetSplines();
-        bool isSpline = effect_->GetSplines().Size() > 0;
-        const Matrix3x4 nodeWorldTransform = node_->GetWorldTransform();
-        const Quaternion& nodeWorldRotation = node_->GetWorldRotation();
-        for (unsigned i = 0; i < particles_.Size(); ++i)
+        for (unsigned k = 0; k < numAlive; ++k)
         {
-            Particle& particle = particles_[i];
+            unsigned i = alive[k];
             Billboard& billboard = billboards_[i];
+            billboard.position_ += velocities[i] * positionScale;
+            billboard.direction_ = velocities[i].Normalized();
+        }
+    }
+    else
+    {
+        const Matrix3x4& nodeWorldTransform = node_->GetWorldTransform();
+        const Quaternion& nodeWorldRotation = node_->GetWorldRotation();
+        const float* timeToLive = &particles_.timeToLive_[0];
+        const unsigned* identifiers = &particles_.identifier_[0];
 
-            if (billboard.enabled_)
-            {
-                needCommit = true;
-
-                // Time to live
-                if (particle.timer_ >= particle.timeToLive_)
-                {
-                    billboard.enabled_ = false;
-                    doWarmStart = false;
-                    continue;
-                }
-                const float prevTime = particle.timer_;
-                particle.timer_ += lastTimeStep_;
-
-                // Velocity & position
-                const Vector3& constantForce = effect_->GetConstantForce();
-                if (constantForce != Vector3::ZERO)
-                {
-                    if (relative_)
-                        particle.velocity_ += lastTimeStep_ * relativeConstantForce;
-                    else
-                        particle.velocity_ += lastTimeStep_ * constantForce;
-                }
+        for (unsigned k = 0; k < numAlive; ++k)
+        {
+            unsigned i = alive[k];
+            Billboard& billboard = billboards_[i];
+            const Spline& spline = effectSplines[SeededRand(identifiers[i] * GetID()) % effectSplines.Size()];
+            Vector3 oldPos = spline.GetPoint((timers[i] - timeStep) / timeToLive[i]).GetVector3();
+            Vector3 newPos = spline.GetPoint(timers[i] / timeToLive[i]).GetVector3();
+            billboard.position_ = nodeWorldTransform * newPos;
+            billboard.direction_ = nodeWorldRotation * (billboard.position_ - oldPos).Normalized();
+        }
+    }
 
-                const Vector2& vortexForce = effect_->GetVortexForce();
-                if (vortexForce != Vector2::ZERO)
-                    particle.velocity_ = Quaternion(Random(vortexForce.x_, vortexForce.y_) * lastTimeStep_, vortexAxis) * particle.velocity_;
+    // Rotation
+    const float* rotationSpeeds = &particles_.rotationSpeed_[0];
+    for (unsigned k = 0; k < numAlive; ++k)
+    {
+        unsigned i = alive[k];
+        billboards_[i].rotation_ += timeStep * rotationSpeeds[i];
+    }
 
-                float dampingForce = effect_->GetDampingForce();
-                if (dampingForce != 0.0f)
-                {
-                    Vector3 force = -dampingForce * particle.velocity_;
-                    particle.velocity_ += lastTimeStep_ * force;
-                }
+    // Scaling
+    float sizeAdd = effect_->GetSizeAdd();
+    float sizeMul = effect_->GetSizeMul();
+    if (sizeAdd != 0.0f || sizeMul != 1.0f)
+    {
+        float scaleAdd = timeStep * sizeAdd;
+        float scaleMul = (timeStep * (sizeMul - 1.0f)) + 1.0f;
+        float* scales = &particles_.scale_[0];
+        const Vector2* sizes = &particles_.size_[0];
 
-                if (!isSpline)
-                {
-                    billboard.position_ += lastTimeStep_ * particle.velocity_ * scaleVector;
-                    billboard.direction_ = particle.velocity_.Normalized();
-                }
-                else
-                {
-                    unsigned idx = SeededRand(particle.identifier_ * GetID());
-                    Vector3 oldPos = effectSplines[idx % effectSplines.Size()].GetPoint(prevTime / particle.timeToLive_).GetVector3();
-                    Vector3 newPos = effectSplines[idx % effectSplines.Size()].GetPoint(particle.timer_ / particle.timeToLive_).GetVector3();
-                    billboard.position_ = nodeWorldTransform * newPos;
-                    billboard.direction_ = nodeWorldRotation * (billboard.position_ - oldPos).Normalized();
-                }
+        for (unsigned k = 0; k < numAlive; ++k)
+        {
+            unsigned i = alive[k];
+            float scale = Max(scales[i] + scaleAdd, 0.0f);
+            if (sizeMul != 1.0f)
+                scale *= scaleMul;
+            scales[i] = scale;
+            billboards_[i].size_ = sizes[i] * scale;
+        }
+    }
 
-                // Rotation
-                billboard.rotation_ += lastTimeStep_ * particle.rotationSpeed_;
+    // Color interpolation
+    const Vector<ColorFrame>& colorFrames = effect_->GetColorFrames();
+    if (colorFrames.Size())
+    {
+        unsigned lastFrame = colorFrames.Size() - 1;
+        unsigned* colorIndices = &particles_.colorIndex_[0];
 
-                // Scaling
-                float sizeAdd = effect_->GetSizeAdd();
-                float sizeMul = effect_->GetSizeMul();
-                if (sizeAdd != 0.0f || sizeMul != 1.0f)
-                {
-                    particle.scale_ += lastTimeStep_ * sizeAdd;
-                    if (particle.scale_ < 0.0f)
-                        particle.scale_ = 0.0f;
-                    if (sizeMul != 1.0f)
-                        particle.scale_ *= (lastTimeStep_ * (sizeMul - 1.0f)) + 1.0f;
-                    billboard.size_ = particle.size_ * particle.scale_;
-                }
+        for (unsigned k = 0; k < numAlive; ++k)
+        {
+            unsigned i = alive[k];
+            unsigned& index = colorIndices[i];
+            if (index >= colorFrames.Size())
+                continue;
+
+            if (index < lastFrame && timers[i] >= colorFrames[index + 1].time_)
+                ++index;
+            if (index < lastFrame)
+                billboards_[i].color_ = colorFrames[index].Interpolate(colorFrames[index + 1], timers[i]);
+            else
+                billboards_[i].color_ = colorFrames[index].color_;
+        }
+    }
 
-                // Color interpolation
-                unsigned& index = particle.colorIndex_;
-                const Vector<ColorFrame>& colorFrames_ = effect_->GetColorFrames();
-                if (index < colorFrames_.Size())
-                {
-                    if (index < colorFrames_.Size() - 1)
-                    {
-                        if (particle.timer_ >= colorFrames_[index + 1].time_)
-                            ++index;
-                    }
-                    if (index < colorFrames_.Size() - 1)
-                        billboard.color_ = colorFrames_[index].Interpolate(colorFrames_[index + 1], particle.timer_);
-                    else
-                        billboard.color_ = colorFrames_[index].color_;
-                }
+    // Texture animation
+    const Vector<TextureFrame>& textureFrames = effect_->GetTextureFrames();
+    if (textureFrames.Size() > 1)
+    {
+        unsigned lastFrame = textureFrames.Size() - 1;
+        unsigned* texIndices = &particles_.texIndex_[0];
 
-                // Texture animation
-                unsigned& texIndex = particle.texIndex_;
-                const Vector<TextureFrame>& textureFrames_ = effect_->GetTextureFrames();
-                if (textureFrames_.Size() && texIndex < textureFrames_.Size() - 1)
-                {
-                    if (particle.timer_ >= textureFrames_[texIndex + 1].time_)
-                    {
-                        billboard.uv_ = textureFrames_[texIndex + 1].uv_;
-                        ++texIndex;
-                    }
-                }
+        for (unsigned k = 0; k < numAlive; ++k)
+        {
+            unsigned i = alive[k];
+            unsigned& texIndex = texIndices[i];
+            if (texIndex < lastFrame && timers[i] >= textureFrames[texIndex + 1].time_)
+            {
+                billboards_[i].uv_ = textureFrames[texIndex + 1].uv_;
+                ++texIndex;
             }
         }
-    } while (emitting_ && doWarmStart);
-
-    if (needCommit)
-        Commit();
-
-    previousPosition_ = currentPosition_;
-    needUpdate_ = false;
+    }
 }
 
 void ParticleEmitter::SetEffect(ParticleEffect* effect)
@@ -383,6 +472,13 @@ void ParticleEmitter::RemoveAllParticles()
     for (PODVector<Billboard>::Iterator i = billboards_.Begin(); i != billboards_.End(); ++i)
         i->enabled_ = false;
 
+    // Recreate the GPU particle state on the next dispatch
+#ifdef URHO3D_COMPUTE
+    gpuParticles_.Reset();
+#endif
+    gpuEmitCount_ = 0;
+    gpuActiveTime_ = 0.0f;
+
     Commit();
 }
 
@@ -395,6 +491,7 @@ void ParticleEmitter::Reset()
 
 void ParticleEmitter::ApplyEffect()
 {
+    gpuSupported_ = false;
     if (!effect_)
         return;
 
@@ -406,6 +503,78 @@ void ParticleEmitter::ApplyEffect()
     SetFixedScreenSize(effect_->IsFixedScreenSize());
     SetAnimationLodBias(effect_->GetAnimationLodBias());
     SetFaceCameraMode(effect_->GetFaceCameraMode());
+
+#ifdef URHO3D_COMPUTE
+    if (effect_->IsGPUSimulated())
+    {
+        auto* computeDevice = GetSubsystem<ComputeDevice>();
+        gpuSupported_ = computeDevice && computeDevice->IsSupported() && effect_->GetSplines().Empty() &&
+            effect_->GetSpawnPoints().Empty() && effect_->GetVortexForce() == Vector2::ZERO;
+    }
+#endif
+}
+
+bool ParticleEmitter::IsGPUSimulated() const
+{
+    return gpuSupported_ && !sorted_ && !fixedScreenSize_ && !IsGeneratePoints() && faceCameraMode_ != FC_DIRECTION;
+}
+
+void ParticleEmitter::GetGPUParticleParams(GPUParticleParams& params) const
+{
+    params = GPUParticleParams();
+    if (!effect_ || !node_)
+        return;
+
+    // Relative particles live in the emitter's space, others are emitted directly into world space
+    const Quaternion& worldRotation = node_->GetWorldRotation();
+    Quaternion emitRotation = relative_ ? Quaternion::IDENTITY : worldRotation;
+    Vector3 worldScale = node_->GetWorldScale();
+
+    params.emitTransform_ = relative_ ? Matrix3x4::IDENTITY : node_->GetWorldTransform();
+    params.emitRotation_ = Vector4(emitRotation.x_, emitRotation.y_, emitRotation.z_, emitRotation.w_);
+    params.positionScale_ = scaled_ && !relative_ ? worldScale : Vector3::ONE;
+    params.timeStep_ = gpuTimeStep_;
+    params.constantForce_ = relative_ ? worldRotation.Inverse() * effect_->GetConstantForce() : effect_->GetConstantForce();
+    params.dampingForce_ = effect_->GetDampingForce();
+    params.emitterSize_ = effect_->GetEmitterSize();
+    params.emitterType_ = effect_->GetEmitterType();
+    params.directionMin_ = effect_->GetMinDirection();
+    params.emitIndex_ = gpuEmitIndex_;
+    params.directionMax_ = effect_->GetMaxDirection();
+    params.emitCount_ = gpuEmitCount_;
+    params.travelDelta_ = relative_ ? Vector3::ZERO : gpuPreviousPosition_ - node_->GetWorldPosition();
+    params.seed_ = GPUParticleHash(GetID()) ^ GPUParticleHash(gpuFrameNumber_);
+    params.sizeMin_ = effect_->GetMinParticleSize();
+    params.sizeMax_ = effect_->GetMaxParticleSize();
+    params.velocityMin_ = effect_->GetMinVelocity();
+    params.velocityMax_ = effect_->GetMaxVelocity();
+    params.timeToLiveMin_ = effect_->GetMinTimeToLive();
+    params.timeToLiveMax_ = effect_->GetMaxTimeToLive();
+    params.rotationMin_ = effect_->GetMinRotation();
+    params.rotationMax_ = effect_->GetMaxRotation();
+    params.rotationSpeedMin_ = effect_->GetMinRotationSpeed();
+    params.rotationSpeedMax_ = effect_->GetMaxRotationSpeed();
+    params.sizeAdd_ = effect_->GetSizeAdd();
+    params.sizeMul_ = effect_->GetSizeMul();
+    params.billboardScale_ = scaled_ ? Vector2(worldScale.x_, worldScale.y_) : Vector2::ONE;
+    params.numParticles_ = particles_.Size();
+
+    const Vector<ColorFrame>& colorFrames = effect_->GetColorFrames();
+    params.numColorFrames_ = Min(colorFrames.Size(), MAX_GPU_PARTICLE_FRAMES);
+    for (unsigned i = 0; i < params.numColorFrames_; ++i)
+    {
+        params.colors_[i] = colorFrames[i].color_;
+        params.frameTimes_[i].x_ = colorFrames[i].time_;
+    }
+
+    const Vector<TextureFrame>& textureFrames = effect_->GetTextureFrames();
+    params.numTextureFrames_ = Min(textureFrames.Size(), MAX_GPU_PARTICLE_FRAMES);
+    for (unsigned i = 0; i < params.numTextureFrames_; ++i)
+    {
+        const Rect& uv = textureFrames[i].uv_;
+        params.textureUVs_[i] = Vector4(uv.min_.x_, uv.min_.y_, uv.max_.x_, uv.max_.y_);
+        params.frameTimes_[i].y_ = textureFrames[i].time_;
+    }
 }
 
 ParticleEffect* ParticleEmitter::GetEffect() const
@@ -429,16 +598,16 @@ void ParticleEmitter::SetParticlesAttr(const VariantVector& value)
     unsigned index = 0;
     SetNumParticles(index < value.Size() ? value[index++].GetUInt() : 0);
 
-    for (PODVector<Particle>::Iterator i = particles_.Begin(); i != particles_.End() && index < value.Size(); ++i)
+    for (unsigned i = 0; i < particles_.Size() && index < value.Size(); ++i)
     {
-        i->velocity_ = value[index++].GetVector3();
-        i->size_ = value[index++].GetVector2();
-        i->timer_ = value[index++].GetFloat();
-        i->timeToLive_ = value[index++].GetFloat();
-        i->scale_ = value[index++].GetFloat();
-        i->rotationSpeed_ = value[index++].GetFloat();
-        i->colorIndex_ = (unsigned)value[index++].GetInt();
-        i->texIndex_ = (unsigned)value[index++].GetInt();
+        particles_.velocity_[i] = value[index++].GetVector3();
+        particles_.size_[i] = value[index++].GetVector2();
+        particles_.timer_[i] = value[index++].GetFloat();
+        particles_.timeToLive_[i] = value[index++].GetFloat();
+        particles_.scale_[i] = value[index++].GetFloat();
+        particles_.rotationSpeed_[i] = value[index++].GetFloat();
+        particles_.colorIndex_[i] = (unsigned)value[index++].GetInt();
+        particles_.texIndex_[i] = (unsigned)value[index++].GetInt();
     }
 }
 
@@ -453,16 +622,16 @@ VariantVector ParticleEmitter::GetParticlesAttr() const
 
     ret.Reserve(particles_.Size() * 8 + 1);
     ret.Push(particles_.Size());
-    for (PODVector<Particle>::ConstIterator i = particles_.Begin(); i != particles_.End(); ++i)
+    for (unsigned i = 0; i < particles_.Size(); ++i)
     {
-        ret.Push(i->velocity_);
-        ret.Push(i->size_);
-        ret.Push(i->timer_);
-        ret.Push(i->timeToLive_);
-        ret.Push(i->scale_);
-        ret.Push(i->rotationSpeed_);
-        ret.Push(i->colorIndex_);
-        ret.Push(i->texIndex_);
+        ret.Push(particles_.velocity_[i]);
+        ret.Push(particles_.size_[i]);
+        ret.Push(particles_.timer_[i]);
+        ret.Push(particles_.timeToLive_[i]);
+        ret.Push(particles_.scale_[i]);
+        ret.Push(particles_.rotationSpeed_[i]);
+        ret.Push(particles_.colorIndex_[i]);
+        ret.Push(particles_.texIndex_[i]);
     }
     return ret;
 }
@@ -509,7 +678,6 @@ bool ParticleEmitter::EmitNewParticle(float interpDelta)
     if (index == M_MAX_UNSIGNED)
         return false;
     assert(index < particles_.Size());
-    Particle& particle = particles_[index];
     Billboard& billboard = billboards_[index];
 
     Vector3 startDir;
@@ -531,7 +699,7 @@ bool ParticleEmitter::EmitNewParticle(float interpDelta)
 		unsigned splineIdx = SeededRand(GetID() * (nextParticleID_ + 1));
 		Vector3 p = splines[splineIdx % splines.Size()].GetPoint(0).GetVector3();
 		startPos = p;
-		particle.velocity_ = splines[splineIdx % splines.Size()].GetPoint(0.001f).GetVector3();
+		particles_.velocity_[index] = splines[splineIdx % splines.Size()].GetPoint(0.001f).GetVector3();
 	}
     else
     {
@@ -555,7 +723,7 @@ bool ParticleEmitter::EmitNewParticle(float interpDelta)
             Vector3 dir = Quaternion(angle, Vector3::UP) * Vector3::FORWARD;
             dir.Normalize();
             startPos = dir * Max(effect_->GetEmitterSize().z_, 0.2f) * 0.5f;
-            particle.velocity_ = dir * Abs(effect_->GetRandomVelocity());
+            particles_.velocity_[index] = dir * Abs(effect_->GetRandomVelocity());
         }
         break;
 
@@ -585,17 +753,17 @@ bool ParticleEmitter::EmitNewParticle(float interpDelta)
     auto travelDelta = previousPosition_ - currentPosition_;
 
     startPos += travelDelta * interpDelta;
-    particle.size_ = effect_->GetRandomSize();
-    particle.timer_ = 0.0f;
-    particle.timeToLive_ = effect_->GetRandomTimeToLive();
-    particle.scale_ = 1.0f;
-    particle.rotationSpeed_ = effect_->GetRandomRotationSpeed();
-    particle.colorIndex_ = 0;
-    particle.texIndex_ = 0;
+    particles_.size_[index] = effect_->GetRandomSize();
+    particles_.timer_[index] = 0.0f;
+    particles_.timeToLive_[index] = effect_->GetRandomTimeToLive();
+    particles_.scale_[index] = 1.0f;
+    particles_.rotationSpeed_[index] = effect_->GetRandomRotationSpeed();
+    particles_.colorIndex_[index] = 0;
+    particles_.texIndex_[index] = 0;
 
     if (faceCameraMode_ == FC_DIRECTION)
     {
-        startPos += startDir * particle.size_.y_;
+        startPos += startDir * particles_.size_[index].y_;
     }
 
     if (!relative_)
@@ -605,12 +773,12 @@ bool ParticleEmitter::EmitNewParticle(float interpDelta)
     };
 
     if (effect_->GetEmitterType() != EMITTER_RING && effect_->GetSplines().Size() == 0)
-        particle.velocity_ = effect_->GetRandomVelocity() * startDir;
+        particles_.velocity_[index] = effect_->GetRandomVelocity() * startDir;
 
-	particle.identifier_ = ++nextParticleID_;
+	particles_.identifier_[index] = ++nextParticleID_;
 
     billboard.position_ = startPos;
-    billboard.size_ = particles_[index].size_;
+    billboard.size_ = particles_.size_[index];
     const Vector<TextureFrame>& textureFrames_ = effect_->GetTextureFrames();
     billboard.uv_ = textureFrames_.Size() ? textureFrames_[0].uv_ : Rect::POSITIVE;
     billboard.rotation_ = effect_->GetRandomRotation();
@@ -622,6 +790,174 @@ bool ParticleEmitter::EmitNewParticle(float interpDelta)
     return true;
 }
 
+void ParticleEmitter::OnWorldBoundingBoxUpdate()
+{
+    if (!IsGPUSimulated())
+    {
+        BillboardSet::OnWorldBoundingBoxUpdate();
+        return;
+    }
+
+    // The particles are not known on the CPU, so bound the farthest they can get from the emitter during their lifetime
+    float maxTime = effect_->GetMaxTimeToLive();
+    float maxSpeed = Max(Abs(effect_->GetMinVelocity()), Abs(effect_->GetMaxVelocity()));
+    float maxScale = Max(1.0f + effect_->GetSizeAdd() * maxTime, 1.0f) * expf(Max(effect_->GetSizeMul() - 1.0f, 0.0f) * maxTime);
+    float reach = effect_->GetEmitterSize().Length() * 0.5f + maxSpeed * maxTime +
+        0.5f * effect_->GetConstantForce().Length() * maxTime * maxTime + effect_->GetMaxParticleSize().Length() * maxScale;
+
+    Vector3 worldScale = node_->GetWorldScale();
+    reach *= Max(Max(Abs(worldScale.x_), Abs(worldScale.y_)), Abs(worldScale.z_));
+
+    Vector3 center = node_->GetWorldPosition();
+    worldBoundingBox_.Define(center - Vector3(reach, reach, reach), center + Vector3(reach, reach, reach));
+}
+
+void ParticleEmitter::UpdatePeriodTimer()
+{
+    periodTimer_ += lastTimeStep_;
+    if (emitting_)
+    {
+        float activeTime = effect_->GetActiveTime();
+        if (activeTime && periodTimer_ >= activeTime)
+        {
+            emitting_ = false;
+            periodTimer_ -= activeTime;
+        }
+    }
+    else
+    {
+        float inactiveTime = effect_->GetInactiveTime();
+        if (inactiveTime && periodTimer_ >= inactiveTime)
+        {
+            emitting_ = true;
+            sendFinishedEvent_ = true;
+            periodTimer_ -= inactiveTime;
+        }
+        // If emitter has an indefinite stop interval, keep period timer reset to allow restarting emission in the editor
+        if (inactiveTime == 0.0f)
+            periodTimer_ = 0.0f;
+    }
+}
+
+void ParticleEmitter::UpdateGPUEmission()
+{
+    UpdatePeriodTimer();
+
+    gpuTimeStep_ += lastTimeStep_;
+    gpuActiveTime_ = Max(gpuActiveTime_ - lastTimeStep_, 0.0f);
+
+    if (!emitting_)
+        return;
+
+    emissionTimer_ += lastTimeStep_;
+
+    float intervalMin = 1.0f / effect_->GetMaxEmissionRate();
+    float intervalMax = 1.0f / effect_->GetMinEmissionRate();
+
+    // If emission timer has a longer delay than max. interval, clamp it
+    if (emissionTimer_ < -intervalMax)
+        emissionTimer_ = -intervalMax;
+
+    // Count the whole frame's particles with one interval, so that the cost does not grow with the emission rate. Particles
+    // that do not fit stay in the timer for the next frame
+    if (emissionTimer_ > 0.0f)
+    {
+        float interval = Lerp(intervalMin, intervalMax, Random(1.0f));
+        unsigned room = particles_.Size() - Min(gpuEmitCount_, particles_.Size());
+        unsigned count = (unsigned)Min(ceilf(emissionTimer_ / interval), (float)room);
+        emissionTimer_ -= count * interval;
+        gpuEmitCount_ += count;
+        if (count)
+            gpuActiveTime_ = effect_->GetMaxTimeToLive();
+    }
+}
+
+void ParticleEmitter::DispatchGPUParticles(const FrameInfo& frame)
+{
+#ifdef URHO3D_COMPUTE
+    // Simulate once per frame even if rendered from several views
+    if (frame.frameNumber_ == gpuFrameNumber_)
+        return;
+    gpuFrameNumber_ = frame.frameNumber_;
+
+    unsigned numParticles = particles_.Size();
+    if (!numParticles)
+        return;
+
+    URHO3D_PROFILE(DispatchGPUParticles);
+
+    auto* graphics = GetSubsystem<Graphics>();
+    auto* computeDevice = GetSubsystem<ComputeDevice>();
+
+    // (Re)create the particle state with all particles expired
+    if (!gpuParticles_ || gpuParticles_->GetNumElements() != numParticles)
+    {
+        if (!gpuParticles_)
+        {
+            gpuParticles_ = new ComputeBuffer(context_);
+            gpuAliveList_ = new ComputeBuffer(context_);
+            gpuAliveCount_ = new ComputeBuffer(context_);
+            gpuDeadList_ = new ComputeBuffer(context_);
+            gpuDeadCount_ = new ComputeBuffer(context_);
+            gpuParams_ = new ConstantBuffer(context_);
+            gpuParams_->SetSize(sizeof(GPUParticleParams));
+        }
+
+        PODVector<GPUParticle> initialParticles(numParticles);
+        memset(&initialParticles[0], 0, numParticles * sizeof(GPUParticle));
+        gpuParticles_->SetData(&initialParticles[0], numParticles * sizeof(GPUParticle), sizeof(GPUParticle));
+        gpuAliveList_->SetSize(numParticles * sizeof(unsigned), sizeof(unsigned));
+        gpuAliveCount_->SetSize(sizeof(unsigned), sizeof(unsigned));
+
+        // All slots start free. The dead count persists across dispatches, unlike the alive count
+        PODVector<unsigned> initialDeadList(numParticles);
+        for (unsigned i = 0; i < numParticles; ++i)
+            initialDeadList[i] = i;
+        int deadCount = (int)numParticles;
+        gpuDeadList_->SetData(&initialDeadList[0], numParticles * sizeof(unsigned), sizeof(unsigned));
+        gpuDeadCount_->SetData(&deadCount, sizeof(int), sizeof(int));
+        gpuEmitIndex_ = 0;
+        gpuPreviousPosition_ = node_->GetWorldPosition();
+    }
+
+    VertexBuffer* vertexBuffer = PrepareGPUVertexBuffer();
+
+    GPUParticleParams params;
+    GetGPUParticleParams(params);
+    gpuParams_->SetParameter(0, sizeof(GPUParticleParams), &params);
+    gpuParams_->Apply();
+
+    unsigned aliveCount = 0;
+    gpuAliveCount_->SetData(&aliveCount, sizeof(unsigned), sizeof(unsigned));
+
+    computeDevice->SetConstantBuffer(gpuParams_.Get(), 0);
+    computeDevice->SetWriteBuffer(gpuParticles_.Get(), 0);
+    computeDevice->SetWriteBuffer(gpuAliveList_.Get(), 1);
+    computeDevice->SetWriteBuffer(gpuAliveCount_.Get(), 2);
+    computeDevice->SetWriteBuffer(vertexBuffer, 3);
+    computeDevice->SetWriteBuffer(gpuDeadList_.Get(), 4);
+    computeDevice->SetWriteBuffer(gpuDeadCount_.Get(), 5);
+
+    if (params.emitCount_)
+    {
+        computeDevice->SetProgram(graphics->GetShader(CS, "CS_Particles", "EMIT"));
+        computeDevice->Dispatch(params.emitCount_, 1, 1);
+    }
+    computeDevice->SetProgram(graphics->GetShader(CS, "CS_Particles", "SIMULATE"));
+    computeDevice->Dispatch(numParticles, 1, 1);
+    computeDevice->SetProgram(graphics->GetShader(CS, "CS_Particles", "EXPAND"));
+    computeDevice->Dispatch(numParticles, 1, 1);
+
+    // The vertex buffer can not be drawn from while bound for writing
+    computeDevice->ClearWriteBuffers();
+
+    gpuEmitIndex_ += gpuEmitCount_;
+    gpuEmitCount_ = 0;
+    gpuTimeStep_ = 0.0f;
+    gpuPreviousPosition_ = node_->GetWorldPosition();
+#endif
+}
+
 unsigned ParticleEmitter::GetFreeParticle() const
 {
     for (unsigned i = 0; i < billboards_.Size(); ++i)
@@ -635,6 +971,9 @@ unsigned ParticleEmitter::GetFreeParticle() const
 
 bool ParticleEmitter::CheckActiveParticles() const
 {
+    if (IsGPUSimulated())
+        return gpuActiveTime_ > 0.0f;
+
     for (unsigned i = 0; i < billboards_.Size(); ++i)
     {
         if (billboards_[i].enabled_)
@@ -23,33 +23,45 @@
 #pragma once
 
 #include "../Graphics/BillboardSet.h"
+#include "../Graphics/ParticleKernels.h"
 
 namespace Urho3D
 {
 
+class ComputeBuffer;
+class ConstantBuffer;
 class ParticleEffect;
 
-/// One particle in the particle system.
-struct Particle
+/// Simulation state of a particle emitter's particles, stored as one array per attribute so that each update pass loads only
+/// the attributes it uses. Particles live in fixed slots, so the passes gather them through the list of live indices rather
+/// than reading the arrays in order. The billboard with the same index holds the rendered state, from which BillboardSet
+/// writes the vertices.
+struct URHO3D_API ParticleStreams
 {
-    /// Velocity.
-    Vector3 velocity_;
-    /// Original billboard size.
-    Vector2 size_;
-    /// Time elapsed from creation.
-    float timer_;
-    /// Lifetime.
-    float timeToLive_;
-    /// Size scaling value.
-    float scale_;
-    /// Rotation speed.
-    float rotationSpeed_;
-    /// Current color animation index.
-    unsigned colorIndex_;
-    /// Current texture animation index.
-    unsigned texIndex_;
-	/// Particle identifier. TODO: split into ushort: EffectID, ushort: ParticleID.
-	unsigned identifier_;
+    /// Resize all streams.
+    void Resize(unsigned num);
+
+    /// Return number of particles.
+    unsigned Size() const { return timer_.Size(); }
+
+    /// Velocities.
+    PODVector<Vector3> velocity_;
+    /// Original billboard sizes.
+    PODVector<Vector2> size_;
+    /// Times elapsed from creation.
+    PODVector<float> timer_;
+    /// Lifetimes.
+    PODVector<float> timeToLive_;
+    /// Size scaling values.
+    PODVector<float> scale_;
+    /// Rotation speeds.
+    PODVector<float> rotationSpeed_;
+    /// Current color animation indices.
+    PODVector<unsigned> colorIndex_;
+    /// Current texture animation indices.
+    PODVector<unsigned> texIndex_;
+    /// Particle identifiers. TODO: split into ushort: EffectID, ushort: ParticleID.
+    PODVector<unsigned> identifier_;
 };
 
 /// %Particle emitter component.
@@ -69,6 +81,10 @@ public:
     void OnSetEnabled() override;
     /// Update before octree reinsertion. Is called from a worker thread.
     void Update(const FrameInfo& frame) override;
+    /// Prepare geometry for rendering. Dispatches the compute kernels when simulated on the GPU.
+    void UpdateGeometry(const FrameInfo& frame) override;
+    /// Return whether a geometry update is necessary, and if it can happen in a worker thread.
+    UpdateGeometryType GetUpdateGeometryType() override;
 
     /// Set particle effect.
     void SetEffect(ParticleEffect* effect);
@@ -98,6 +114,11 @@ public:
 
     /// Return whether is currently emitting.
     bool IsEmitting() const { return emitting_; }
+    /// Return whether particles are simulated on the GPU. Requires the effect to enable it, compute support and billboard
+    /// settings the GPU path supports.
+    bool IsGPUSimulated() const;
+    /// Return the kernel parameters for the next GPU dispatch. Can be used to run the CPU reference kernels.
+    void GetGPUParticleParams(GPUParticleParams& params) const;
 
     /// Return whether particles are to be serialized.
     bool GetSerializeParticles() const { return serializeParticles_; }
@@ -122,11 +143,21 @@ public:
 protected:
     /// Handle scene being assigned.
     void OnSceneSet(Scene* scene) override;
+    /// Recalculate the world-space bounding box.
+    void OnWorldBoundingBoxUpdate() override;
 
     /// Create a new particle. Return true if there was room.
     bool EmitNewParticle(float interpDelta);
+    /// Advance the live particles gathered into aliveParticles_ by the last timestep, one attribute at a time. The passes are plain scalar loops.
+    void UpdateParticles(unsigned numAlive);
     /// Return a free particle index.
     unsigned GetFreeParticle() const;
+    /// Advance the active/inactive period timer.
+    void UpdatePeriodTimer();
+    /// Count the particles to emit on the next GPU dispatch.
+    void UpdateGPUEmission();
+    /// Run the emit, simulate and expand kernels once per frame.
+    void DispatchGPUParticles(const FrameInfo& frame);
     /// Return whether has active particles.
     bool CheckActiveParticles() const;
 
@@ -139,7 +170,9 @@ private:
     /// Particle effect.
     SharedPtr<ParticleEffect> effect_;
     /// Particles.
-    PODVector<Particle> particles_;
+    ParticleStreams particles_;
+    /// Indices of the particles alive during the current update.
+    PODVector<unsigned> aliveParticles_;
     /// Previous position of the emitter's node
     Vector3 previousPosition_;
     /// Cache of the emitter's node position (to avoid redundant queries)
@@ -165,6 +198,34 @@ private:
     AutoRemoveMode autoRemove_;
 	/// Particle ID for the next emitted particle.
 	unsigned nextParticleID_;
+#ifdef URHO3D_COMPUTE
+    /// Particle state of the GPU simulation.
+    SharedPtr<ComputeBuffer> gpuParticles_;
+    /// Indices of the particles alive after the GPU simulation step.
+    SharedPtr<ComputeBuffer> gpuAliveList_;
+    /// Number of particles alive after the GPU simulation step.
+    SharedPtr<ComputeBuffer> gpuAliveCount_;
+    /// Indices of the free particle slots, popped by the GPU emit step and pushed by the simulation step.
+    SharedPtr<ComputeBuffer> gpuDeadList_;
+    /// Number of free particle slots.
+    SharedPtr<ComputeBuffer> gpuDeadCount_;
+    /// GPU kernel parameters.
+    SharedPtr<ConstantBuffer> gpuParams_;
+#endif
+    /// Effect and compute support allow the GPU simulation.
+    bool gpuSupported_;
+    /// Number of particles to emit on the next GPU dispatch.
+    unsigned gpuEmitCount_;
+    /// Number of particles emitted by earlier GPU dispatches.
+    unsigned gpuEmitIndex_;
+    /// Time accumulated for the next GPU dispatch.
+    float gpuTimeStep_;
+    /// Time until all GPU simulated particles have expired.
+    float gpuActiveTime_;
+    /// Frame number of the last GPU dispatch.
+    unsigned gpuFrameNumber_;
+    /// Emitter world position at the last GPU dispatch.
+    Vector3 gpuPreviousPosition_;
 };
 
 }
@@ -0,0 +1,245 @@
+//
+// Copyright (c) 2017-2020 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+
+#include "../Precompiled.h"
+
+#include "../Graphics/ParticleEffect.h"
+#include "../Graphics/ParticleKernels.h"
+
+#include "../DebugNew.h"
+
+// The functions below are the reference for CS_Particles.hlsl and must be kept in sync with it, operation for operation, so
+// that GPU results can be validated against them without a GPU.
+
+namespace Urho3D
+{
+
+unsigned GPUParticleHash(unsigned value)
+{
+    unsigned state = value * 747796405u + 2891336453u;
+    unsigned word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+    return (word >> 22u) ^ word;
+}
+
+/// Return a random value in the range [0, 1) and advance the generator state.
+static float NextRandom(unsigned& state)
+{
+    state = GPUParticleHash(state);
+    return (float)(state >> 8u) * (1.0f / 16777216.0f);
+}
+
+/// Normalize a vector, leaving a zero vector as is.
+static Vector3 SafeNormalize(const Vector3& v)
+{
+    float length = v.Length();
+    return length > 0.0f ? v / length : v;
+}
+
+/// Rotate a vector by a quaternion stored as XYZW.
+static Vector3 RotateVector(const Vector4& q, const Vector3& v)
+{
+    Vector3 axis(q.x_, q.y_, q.z_);
+    return v + 2.0f * axis.CrossProduct(axis.CrossProduct(v) + q.w_ * v);
+}
+
+void ParticleEmitKernel(const GPUParticleParams& params, GPUParticle* particles, unsigned* deadList, int& deadCount,
+    unsigned thread)
+{
+    if (thread >= params.emitCount_)
+        return;
+
+    // Take a free slot from the dead list. When all slots are alive the particle is dropped
+    if (deadCount <= 0)
+        return;
+    GPUParticle& particle = particles[deadList[--deadCount]];
+
+    unsigned rng = GPUParticleHash(params.seed_ ^ GPUParticleHash(params.emitIndex_ + thread));
+
+    Vector3 direction(
+        Lerp(params.directionMin_.x_, params.directionMax_.x_, NextRandom(rng)),
+        Lerp(params.directionMin_.y_, params.directionMax_.y_, NextRandom(rng)),
+        Lerp(params.directionMin_.z_, params.directionMax_.z_, NextRandom(rng))
+    );
+    direction = SafeNormalize(direction);
+    float speed = Lerp(params.velocityMin_, params.velocityMax_, NextRandom(rng));
+
+    Vector3 position;
+    Vector3 velocity = direction * speed;
+    if (params.emitterType_ == EMITTER_BOX)
+    {
+        position = Vector3(NextRandom(rng) - 0.5f, NextRandom(rng) - 0.5f, NextRandom(rng) - 0.5f) * params.emitterSize_;
+    }
+    else if (params.emitterType_ == EMITTER_RING)
+    {
+        float angle = Lerp(params.emitterSize_.x_, params.emitterSize_.y_, NextRandom(rng)) * M_DEGTORAD;
+        Vector3 ringDirection(sinf(angle), 0.0f, cosf(angle));
+        position = ringDirection * Max(params.emitterSize_.z_, 0.2f) * 0.5f;
+        velocity = ringDirection * Abs(speed);
+    }
+    else
+    {
+        Vector3 sphereDirection(NextRandom(rng) * 2.0f - 1.0f, NextRandom(rng) * 2.0f - 1.0f, NextRandom(rng) * 2.0f - 1.0f);
+        position = params.emitterSize_ * SafeNormalize(sphereDirection) * 0.5f;
+    }
+
+    // Spread the new particles along the emitter's movement since the previous dispatch
+    float interpDelta = params.emitCount_ > 1 ? (float)thread / (float)(params.emitCount_ - 1) : 0.0f;
+
+    particle.position_ = params.emitTransform_ * position + params.travelDelta_ * interpDelta;
+    particle.timer_ = 0.0f;
+    particle.velocity_ = RotateVector(params.emitRotation_, velocity);
+    particle.timeToLive_ = Lerp(params.timeToLiveMin_, params.timeToLiveMax_, NextRandom(rng));
+    particle.size_ = params.sizeMin_.Lerp(params.sizeMax_, NextRandom(rng));
+    particle.rotation_ = Lerp(params.rotationMin_, params.rotationMax_, NextRandom(rng));
+    particle.rotationSpeed_ = Lerp(params.rotationSpeedMin_, params.rotationSpeedMax_, NextRandom(rng));
+    particle.scale_ = 1.0f;
+}
+
+void ParticleSimulateKernel(const GPUParticleParams& params, GPUParticle* particles, unsigned* aliveList, unsigned& aliveCount,
+    unsigned* deadList, int& deadCount, unsigned thread)
+{
+    if (thread >= params.numParticles_)
+        return;
+
+    GPUParticle& particle = particles[thread];
+    if (particle.timer_ >= particle.timeToLive_)
+        return;
+
+    float timeStep = params.timeStep_;
+    particle.timer_ += timeStep;
+    if (particle.timer_ >= particle.timeToLive_)
+    {
+        // Return the expired slot to the dead list
+        deadList[deadCount++] = thread;
+        return;
+    }
+
+    particle.velocity_ += params.constantForce_ * timeStep;
+    particle.velocity_ *= 1.0f - timeStep * params.dampingForce_;
+    particle.position_ += particle.velocity_ * params.positionScale_ * timeStep;
+    particle.rotation_ += particle.rotationSpeed_ * timeStep;
+    particle.scale_ = Max(particle.scale_ + params.sizeAdd_ * timeStep, 0.0f) * ((params.sizeMul_ - 1.0f) * timeStep + 1.0f);
+
+    aliveList[aliveCount++] = thread;
+}
+
+void ParticleExpandKernel(const GPUParticleParams& params, const GPUParticle* particles, const unsigned* aliveList,
+    unsigned aliveCount, float* vertices, unsigned thread)
+{
+    if (thread >= params.numParticles_)
+        return;
+
+    float* dest = vertices + thread * GPU_PARTICLE_VERTEX_FLOATS;
+    if (thread >= aliveCount)
+    {
+        for (unsigned i = 0; i < GPU_PARTICLE_VERTEX_FLOATS; ++i)
+            dest[i] = 0.0f;
+        return;
+    }
+
+    const GPUParticle& particle = particles[aliveList[thread]];
+
+    Color color;
+    if (params.numColorFrames_)
+    {
+        unsigned index = 0;
+        while (index + 1 < params.numColorFrames_ && particle.timer_ >= params.frameTimes_[index + 1].x_)
+            ++index;
+        color = params.colors_[index];
+        if (index + 1 < params.numColorFrames_)
+        {
+            float interval = params.frameTimes_[index + 1].x_ - params.frameTimes_[index].x_;
+            if (interval > 0.0f)
+                color = color.Lerp(params.colors_[index + 1], (particle.timer_ - params.frameTimes_[index].x_) / interval);
+        }
+    }
+
+    Vector4 uv(0.0f, 0.0f, 1.0f, 1.0f);
+    if (params.numTextureFrames_)
+    {
+        unsigned index = 0;
+        while (index + 1 < params.numTextureFrames_ && particle.timer_ >= params.frameTimes_[index + 1].y_)
+            ++index;
+        uv = params.textureUVs_[index];
+    }
+
+    Vector2 size = particle.size_ * particle.scale_ * params.billboardScale_;
+    float angle = particle.rotation_ * M_DEGTORAD;
+    float s = sinf(angle);
+    float c = cosf(angle);
+    unsigned packedColor = color.ToUInt();
+
+    const float corners[4][4] = {
+        { uv.x_, uv.y_, -size.x_ * c + size.y_ * s, size.x_ * s + size.y_ * c },
+        { uv.z_, uv.y_, size.x_ * c + size.y_ * s, -size.x_ * s + size.y_ * c },
+        { uv.z_, uv.w_, size.x_ * c - size.y_ * s, -size.x_ * s - size.y_ * c },
+        { uv.x_, uv.w_, -size.x_ * c - size.y_ * s, size.x_ * s - size.y_ * c }
+    };
+
+    for (unsigned i = 0; i < 4; ++i)
+    {
+        dest[0] = particle.position_.x_;
+        dest[1] = particle.position_.y_;
+        dest[2] = particle.position_.z_;
+        ((unsigned&)dest[3]) = packedColor;
+        dest[4] = corners[i][0];
+        dest[5] = corners[i][1];
+        dest[6] = corners[i][2];
+        dest[7] = corners[i][3];
+        dest += 8;
+    }
+}
+
+unsigned RunParticleKernels(const GPUParticleParams& params, PODVector<GPUParticle>& particles, PODVector<unsigned>& aliveList,
+    PODVector<unsigned>& deadList, int& deadCount, PODVector<float>& vertices)
+{
+    unsigned numParticles = params.numParticles_;
+    if (!numParticles)
+        return 0;
+
+    particles.Resize(numParticles);
+    aliveList.Resize(numParticles);
+    vertices.Resize(numParticles * GPU_PARTICLE_VERTEX_FLOATS);
+
+    if (deadList.Size() != numParticles)
+    {
+        deadList.Resize(numParticles);
+        for (unsigned i = 0; i < numParticles; ++i)
+            deadList[i] = i;
+        deadCount = numParticles;
+    }
+
+    for (unsigned i = 0; i < params.emitCount_; ++i)
+        ParticleEmitKernel(params, &particles[0], &deadList[0], deadCount, i);
+
+    unsigned aliveCount = 0;
+    for (unsigned i = 0; i < numParticles; ++i)
+        ParticleSimulateKernel(params, &particles[0], &aliveList[0], aliveCount, &deadList[0], deadCount, i);
+
+    for (unsigned i = 0; i < numParticles; ++i)
+        ParticleExpandKernel(params, &particles[0], &aliveList[0], aliveCount, &vertices[0], i);
+
+    return aliveCount;
+}
+
+}
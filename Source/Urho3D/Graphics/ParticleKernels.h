@@ -0,0 +1,159 @@
+//
+// Copyright (c) 2017-2020 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+
+#pragma once
+
+#include "../Container/Vector.h"
+#include "../Math/Color.h"
+#include "../Math/Matrix3x4.h"
+#include "../Math/Vector4.h"
+
+namespace Urho3D
+{
+
+/// Maximum number of color and texture frames evaluated by the GPU particle kernels. Further frames are ignored.
+static const unsigned MAX_GPU_PARTICLE_FRAMES = 8;
+/// Thread group size of the GPU particle kernels. Must match CS_Particles.hlsl.
+static const unsigned GPU_PARTICLE_GROUP_SIZE = 64;
+/// Number of floats written per particle by the expand kernel: four quad vertices of position, color, UV and rotated size.
+static const unsigned GPU_PARTICLE_VERTEX_FLOATS = 32;
+
+/// Particle state used by the GPU particle kernels. Laid out in float4 rows to match the structured buffer in CS_Particles.hlsl.
+struct GPUParticle
+{
+    /// Position.
+    Vector3 position_;
+    /// Time elapsed from creation.
+    float timer_;
+    /// Velocity.
+    Vector3 velocity_;
+    /// Lifetime. A particle whose timer has reached its lifetime is free.
+    float timeToLive_;
+    /// Original size.
+    Vector2 size_;
+    /// Rotation in degrees.
+    float rotation_;
+    /// Rotation speed in degrees per second.
+    float rotationSpeed_;
+    /// Size scaling value.
+    float scale_;
+    /// Padding to a float4 row.
+    float padding_[3];
+};
+
+/// Per-dispatch parameters of the GPU particle kernels. Laid out in float4 rows to match the constant buffer in CS_Particles.hlsl.
+struct GPUParticleParams
+{
+    /// Transform applied to emitted positions. Identity for relative particles.
+    Matrix3x4 emitTransform_;
+    /// Rotation applied to emitted directions as XYZW.
+    Vector4 emitRotation_;
+    /// Scale applied to velocity when integrating positions.
+    Vector3 positionScale_;
+    /// Timestep.
+    float timeStep_;
+    /// Constant force in particle space.
+    Vector3 constantForce_;
+    /// Damping force.
+    float dampingForce_;
+    /// Emitter size.
+    Vector3 emitterSize_;
+    /// Emitter shape, see EmitterType.
+    unsigned emitterType_;
+    /// Minimum emission direction.
+    Vector3 directionMin_;
+    /// Number of particles emitted by earlier dispatches. Offsets the random sequence of the emit kernel.
+    unsigned emitIndex_;
+    /// Maximum emission direction.
+    Vector3 directionMax_;
+    /// Number of particles to emit.
+    unsigned emitCount_;
+    /// Emitter movement since the previous dispatch, over which new particles are spread.
+    Vector3 travelDelta_;
+    /// Random seed of this dispatch.
+    unsigned seed_;
+    /// Minimum particle size.
+    Vector2 sizeMin_;
+    /// Maximum particle size.
+    Vector2 sizeMax_;
+    /// Minimum velocity.
+    float velocityMin_;
+    /// Maximum velocity.
+    float velocityMax_;
+    /// Minimum lifetime.
+    float timeToLiveMin_;
+    /// Maximum lifetime.
+    float timeToLiveMax_;
+    /// Minimum rotation.
+    float rotationMin_;
+    /// Maximum rotation.
+    float rotationMax_;
+    /// Minimum rotation speed.
+    float rotationSpeedMin_;
+    /// Maximum rotation speed.
+    float rotationSpeedMax_;
+    /// Size additive parameter.
+    float sizeAdd_;
+    /// Size multiplicative parameter.
+    float sizeMul_;
+    /// Scale applied to billboard size when expanding.
+    Vector2 billboardScale_;
+    /// Number of particle slots.
+    unsigned numParticles_;
+    /// Number of color frames.
+    unsigned numColorFrames_;
+    /// Number of texture frames.
+    unsigned numTextureFrames_;
+    /// Padding to a float4 row.
+    unsigned padding_;
+    /// Color frame colors.
+    Color colors_[MAX_GPU_PARTICLE_FRAMES];
+    /// Texture frame UV rectangles as min XY, max XY.
+    Vector4 textureUVs_[MAX_GPU_PARTICLE_FRAMES];
+    /// Frame times. X is the color frame time and Y the texture frame time.
+    Vector4 frameTimes_[MAX_GPU_PARTICLE_FRAMES];
+};
+
+/// Hash function used as the random number generator of the particle kernels.
+URHO3D_API unsigned GPUParticleHash(unsigned value);
+
+/// CPU reference of the emit kernel. Initializes one new particle per thread below emitCount_ into a slot popped from the
+/// dead list. The particle is dropped if the dead list is empty.
+URHO3D_API void ParticleEmitKernel(const GPUParticleParams& params, GPUParticle* particles, unsigned* deadList, int& deadCount,
+    unsigned thread);
+/// CPU reference of the simulate kernel. Advances one particle per thread and appends it to the alive list if it survives, or
+/// pushes its slot to the dead list if it expires. On the GPU the appends are atomic, so the list orders are unspecified and
+/// results should be compared as sets.
+URHO3D_API void ParticleSimulateKernel(const GPUParticleParams& params, GPUParticle* particles, unsigned* aliveList,
+    unsigned& aliveCount, unsigned* deadList, int& deadCount, unsigned thread);
+/// CPU reference of the expand kernel. Writes the billboard vertices of the alive particle at the thread's index in the
+/// compacted alive list, or a degenerate quad past the alive count.
+URHO3D_API void ParticleExpandKernel(const GPUParticleParams& params, const GPUParticle* particles, const unsigned* aliveList,
+    unsigned aliveCount, float* vertices, unsigned thread);
+/// Run the emit, simulate and expand kernels over all threads in dispatch order on the CPU. The dead list carries the free
+/// slots between runs and is reset to all slots free when its size does not match the particle count. Return the number of
+/// alive particles.
+URHO3D_API unsigned RunParticleKernels(const GPUParticleParams& params, PODVector<GPUParticle>& particles,
+    PODVector<unsigned>& aliveList, PODVector<unsigned>& deadList, int& deadCount, PODVector<float>& vertices);
+
+}
@@ -162,6 +162,14 @@ void RenderPathCommand::Load(const XMLElement& element)
             isVR_ = element.GetBool("vr");
         break;
 
+    case CMD_CLUSTEREDLIGHTS:
+        pass_ = element.GetAttribute("pass");
+        sortMode_ =
+            (RenderCommandSortMode)GetStringListIndex(element.GetAttributeLower("sort").CString(), sortModeNames, SORT_FRONTTOBACK);
+        if (element.HasAttribute("vr"))
+            isVR_ = element.GetBool("vr");
+        break;
+
     case CMD_FORWARDLIGHTS:
         pass_ = element.GetAttribute("pass");
         if (element.HasAttribute("uselitbase"))
@@ -234,6 +242,9 @@ void RenderPathCommand::Load(const XMLElement& element)
     domainShaderDefines_ = element.GetAttribute("dsdefines");
     geometryShaderDefines_ = element.GetAttribute("gsdefines");
     pixelShaderDefines_ = element.GetAttribute("psdefines");
+    // The clustered lights pass always uses the shader variations that read the light tables
+    if (type_ == CMD_CLUSTEREDLIGHTS)
+        pixelShaderDefines_ = (pixelShaderDefines_ + " CLUSTERED").Trimmed();
     XMLElement parameterElem = element.GetChild("parameter");
     while (parameterElem)
     {
@@ -178,6 +178,8 @@ struct URHO3D_API RenderPathCommand
 
     /// Return depth-stencil output name.
     const String& GetDepthStencilName() const { return depthStencilName_; }
+    /// Return whether draws a scene pass batch queue. The clustered lights command is a scene pass that also shades all clustered lights.
+    bool IsScenePass() const { return type_ == CMD_SCENEPASS || type_ == CMD_CLUSTEREDLIGHTS; }
 
     /// Tag name.
     String tag_;
@@ -185,7 +187,7 @@ struct URHO3D_API RenderPathCommand
     RenderCommandType type_;
     /// Sorting mode.
     RenderCommandSortMode sortMode_;
-    /// Scene pass name.
+    /// Scene pass name. For the clustered lights command, the opaque base pass to draw, "base" if empty.
     String pass_;
     /// Scene pass index. Filled by View.
     unsigned passIndex_;
@@ -264,6 +264,11 @@ static const unsigned MAX_BUFFER_AGE = 1000;
 
 static const int MAX_EXTRA_INSTANCING_BUFFER_ELEMENTS = 4;
 
+static const float DEFAULT_LOD_HYSTERESIS = 0.1f;
+static const float MIN_LOD_BUDGET_BIAS = 0.1f;
+/// Fraction of the way the budget bias moves toward its target per frame.
+static const float LOD_BUDGET_RESPONSE = 0.25f;
+
 PODVector<VertexElement> CreateInstancingBufferElements(unsigned numExtraElements, bool forVR)
 {
     static const unsigned NUM_INSTANCEMATRIX_ELEMENTS = 3;
@@ -291,9 +296,14 @@ Renderer::Renderer(Context* context) :
     vsmShadowParams_(0.0000001f, 0.9f),
     vsmMultiSample_(1),
     maxShadowMaps_(1),
+    shadowAtlasSize_(0),
+    numShadowAtlasAllocations_(0),
     minInstances_(2),
     maxSortedInstances_(1000),
     maxOccluderTriangles_(5000),
+    lightBudget_(0),
+    lightBudgetHysteresis_(1.25f),
+    triangleBudget_(0),
     occlusionBufferSize_(256),
     occluderSizeThreshold_(0.025f),
     mobileShadowBiasMul_(1.0f),
@@ -301,6 +311,7 @@ Renderer::Renderer(Context* context) :
     mobileNormalOffsetMul_(1.0f),
     numOcclusionBuffers_(0),
     numShadowCameras_(0),
+    numPrimitives_(0),
     shadersChangedFrameNumber_(M_MAX_UNSIGNED),
     hdrRendering_(false),
     specularLighting_(true),
@@ -313,6 +324,8 @@ Renderer::Renderer(Context* context) :
     initialized_(false),
     resetViews_(false)
 {
+    lodPolicy_.hysteresis_ = DEFAULT_LOD_HYSTERESIS;
+
     SubscribeToEvent(E_SCREENMODE, URHO3D_HANDLER(Renderer, HandleScreenMode));
 
     // Try to initialize right now, but skip if screen mode is not yet set
@@ -512,6 +525,23 @@ void Renderer::SetMaxShadowMaps(int shadowMaps)
     }
 }
 
+void Renderer::SetShadowAtlasSize(int size)
+{
+    if (!graphics_)
+        return;
+
+    if (size > 0)
+        size = NextPowerOfTwo((unsigned)Max(size, SHADOW_MIN_PIXELS));
+    else
+        size = 0;
+
+    if (size != shadowAtlasSize_)
+    {
+        shadowAtlasSize_ = size;
+        ResetShadowMaps();
+    }
+}
+
 void Renderer::SetDynamicInstancing(bool enable)
 {
     if (!instancingBuffer_)
@@ -544,6 +574,33 @@ void Renderer::SetMaxOccluderTriangles(int triangles)
     maxOccluderTriangles_ = Max(triangles, 0);
 }
 
+void Renderer::SetLightBudget(int lights)
+{
+    lightBudget_ = Max(lights, 0);
+}
+
+void Renderer::SetLightBudgetHysteresis(float hysteresis)
+{
+    lightBudgetHysteresis_ = Max(hysteresis, 1.0f);
+}
+
+void Renderer::SetLodHysteresis(float hysteresis)
+{
+    lodPolicy_.hysteresis_ = Max(hysteresis, 0.0f);
+}
+
+void Renderer::SetMaxLodSwitches(int switches)
+{
+    lodPolicy_.maxSwitches_ = (unsigned)Max(switches, 0);
+}
+
+void Renderer::SetTriangleBudget(int triangles)
+{
+    triangleBudget_ = Max(triangles, 0);
+    if (!triangleBudget_)
+        lodPolicy_.budgetBias_ = 1.0f;
+}
+
 void Renderer::SetOcclusionBufferSize(int size)
 {
     occlusionBufferSize_ = Max(size, 1);
@@ -700,6 +757,91 @@ unsigned Renderer::GetNumOccluders(bool allViews) const
     return numOccluders;
 }
 
+unsigned Renderer::GetNumLitBatches(bool allViews) const
+{
+    unsigned numLitBatches = 0;
+    unsigned lastView = allViews ? views_.Size() : 1;
+
+    for (unsigned i = 0; i < lastView; ++i)
+    {
+        View* view = GetActualView(views_[i]);
+        if (!view)
+            continue;
+
+        numLitBatches += view->GetNumLitBatches();
+    }
+
+    return numLitBatches;
+}
+
+unsigned Renderer::GetNumClusteredLights(bool allViews) const
+{
+    unsigned numClusteredLights = 0;
+    unsigned lastView = allViews ? views_.Size() : 1;
+
+    for (unsigned i = 0; i < lastView; ++i)
+    {
+        View* view = GetActualView(views_[i]);
+        if (!view)
+            continue;
+
+        numClusteredLights += view->GetNumClusteredLights();
+    }
+
+    return numClusteredLights;
+}
+
+unsigned Renderer::GetNumDemotedLights(bool allViews) const
+{
+    unsigned numDemotedLights = 0;
+    unsigned lastView = allViews ? views_.Size() : 1;
+
+    for (unsigned i = 0; i < lastView; ++i)
+    {
+        View* view = GetActualView(views_[i]);
+        if (!view)
+            continue;
+
+        numDemotedLights += view->GetNumDemotedLights();
+    }
+
+    return numDemotedLights;
+}
+
+unsigned Renderer::GetNumLightQueries(bool allViews) const
+{
+    unsigned numLightQueries = 0;
+    unsigned lastView = allViews ? views_.Size() : 1;
+
+    for (unsigned i = 0; i < lastView; ++i)
+    {
+        View* view = GetActualView(views_[i]);
+        if (!view)
+            continue;
+
+        numLightQueries += view->GetNumLightQueries();
+    }
+
+    return numLightQueries;
+}
+
+unsigned Renderer::GetNumCachedLightQueries(bool allViews) const
+{
+    unsigned numCachedLightQueries = 0;
+    unsigned lastView = allViews ? views_.Size() : 1;
+
+    for (unsigned i = 0; i < lastView; ++i)
+    {
+        View* view = GetActualView(views_[i]);
+        if (!view)
+            continue;
+
+        numCachedLightQueries += view->GetNumCachedLightQueries();
+    }
+
+    return numCachedLightQueries;
+}
+
 void Renderer::Update(float timeStep)
 {
     URHO3D_PROFILE(UpdateViews);
@@ -716,10 +858,31 @@ void Renderer::Update(float timeStep)
     frame_.frameNumber_ = GetSubsystem<Time>()->GetFrameNumber();
     frame_.timeStep_ = timeStep;
     frame_.camera_ = nullptr;
+    frame_.lodPolicy_ = &lodPolicy_;
     numShadowCameras_ = 0;
     numOcclusionBuffers_ = 0;
+    numShadowAtlasAllocations_ = 0;
     updatedOctrees_.Clear();
 
+    // Forget the influences of lights that were not processed on the previous frame; they may have been destroyed
+    for (HashMap<Light*, LightInfluence>::Iterator i = lightInfluences_.Begin(); i != lightInfluences_.End();)
+    {
+        if (i->second_.frameNumber_ + 1 < frame_.frameNumber_)
+            i = lightInfluences_.Erase(i);
+        else
+            ++i;
+    }
+
+    // Steer the LOD bias toward the triangle budget by the primitives of the previous frame. The bias only ever lowers
+    // detail, and moves gradually so that the LOD hysteresis absorbs the small changes
+    lodPolicy_.numSwitches_ = 0;
+    if (triangleBudget_ && numPrimitives_)
+    {
+        float targetBias = Clamp(lodPolicy_.budgetBias_ * (float)triangleBudget_ / (float)numPrimitives_, MIN_LOD_BUDGET_BIAS,
+            1.0f);
+        lodPolicy_.budgetBias_ += (targetBias - lodPolicy_.budgetBias_) * LOD_BUDGET_RESPONSE;
+    }
+
     // Reload shaders now if needed
     if (shadersDirty_)
         LoadShaders();
@@ -946,6 +1109,10 @@ Texture2D* Renderer::GetShadowMap(Light* light, Camera* camera, unsigned viewWid
         height *= 3;
     }
 
+    // All depth shadow maps come from the atlas when it is enabled
+    if (IsShadowAtlasEnabled())
+        return AllocateShadowAtlasRegion(light, width, height);
+
     int searchKey = (width << 16) | height;
     if (shadowMaps_.Contains(searchKey))
     {
@@ -1054,6 +1221,162 @@ Texture2D* Renderer::GetShadowMap(Light* light, Camera* camera, unsigned viewWid
     return newShadowMap;
 }
 
+bool Renderer::GetShadowAtlasRegion(Light* light, IntRect& rect, unsigned& id) const
+{
+    HashMap<Light*, ShadowAtlasRegion>::ConstIterator i = shadowAtlasRegions_.Find(light);
+    if (i == shadowAtlasRegions_.End())
+        return false;
+
+    rect = i->second_.rect_;
+    id = i->second_.id_;
+    return true;
+}
+
+LightInfluence* Renderer::GetLightInfluence(Light* light)
+{
+    HashMap<Light*, LightInfluence>::Iterator i = lightInfluences_.Find(light);
+    if (i == lightInfluences_.End())
+    {
+        LightInfluence newInfluence;
+        newInfluence.frameNumber_ = 0;
+        i = lightInfluences_.Insert(MakePair(light, newInfluence));
+    }
+
+    return &i->second_;
+}
+
+Texture2D* Renderer::GetStaticShadowAtlas()
+{
+    if (!shadowAtlasTexture_)
+        return nullptr;
+
+    if (!staticShadowAtlasTexture_)
+        staticShadowAtlasTexture_ = CreateShadowAtlasTexture();
+    return staticShadowAtlasTexture_;
+}
+
+Texture2D* Renderer::AllocateShadowAtlasRegion(Light* light, int width, int height)
+{
+    if (!shadowAtlasTexture_)
+    {
+        shadowAtlasTexture_ = CreateShadowAtlasTexture();
+        if (!shadowAtlasTexture_)
+            return nullptr;
+        shadowAtlas_.Reset(shadowAtlasTexture_->GetWidth(), SHADOW_MIN_PIXELS);
+    }
+
+    HashMap<Light*, ShadowAtlasRegion>::Iterator i = shadowAtlasRegions_.Find(light);
+    if (i != shadowAtlasRegions_.End())
+    {
+        ShadowAtlasRegion& region = i->second_;
+        // Keep the region when the size is unchanged, so that its layout and contents persist, and also when another view
+        // already used it on this frame
+        if (region.lastFrame_ == frame_.frameNumber_ || (region.rect_.Width() == width && region.rect_.Height() == height))
+        {
+            region.lastFrame_ = frame_.frameNumber_;
+            return shadowAtlasTexture_;
+        }
+
+        // Resize if there is space. A larger size that does not fit keeps the old region
+        IntRect rect;
+        unsigned id = shadowAtlas_.Allocate(width, height, rect);
+        if (!id && region.rect_.Width() < width)
+        {
+            region.lastFrame_ = frame_.frameNumber_;
+            return shadowAtlasTexture_;
+        }
+
+        shadowAtlas_.Free(region.id_);
+        if (id)
+        {
+            region.rect_ = rect;
+            region.id_ = id;
+            region.lastFrame_ = frame_.frameNumber_;
+            ++numShadowAtlasAllocations_;
+            return shadowAtlasTexture_;
+        }
+        shadowAtlasRegions_.Erase(i);
+    }
+
+    // Allocate a new region. If the atlas is full, evict regions of lights not used on this frame, then reduce the size
+    ShadowAtlasRegion region;
+    for (;;)
+    {
+        region.id_ = shadowAtlas_.Allocate(width, height, region.rect_);
+        if (region.id_)
+            break;
+        if (EvictShadowAtlasRegion())
+            continue;
+        if (Min(width, height) <= SHADOW_MIN_PIXELS)
+            return nullptr;
+        width >>= 1;
+        height >>= 1;
+    }
+
+    region.lastFrame_ = frame_.frameNumber_;
+    shadowAtlasRegions_[light] = region;
+    ++numShadowAtlasAllocations_;
+    return shadowAtlasTexture_;
+}
+
+bool Renderer::EvictShadowAtlasRegion()
+{
+    HashMap<Light*, ShadowAtlasRegion>::Iterator oldest = shadowAtlasRegions_.End();
+    for (HashMap<Light*, ShadowAtlasRegion>::Iterator i = shadowAtlasRegions_.Begin(); i != shadowAtlasRegions_.End(); ++i)
+    {
+        if (i->second_.lastFrame_ != frame_.frameNumber_ &&
+            (oldest == shadowAtlasRegions_.End() || i->second_.lastFrame_ < oldest->second_.lastFrame_))
+            oldest = i;
+    }
+
+    if (oldest == shadowAtlasRegions_.End())
+        return false;
+
+    shadowAtlas_.Free(oldest->second_.id_);
+    shadowAtlasRegions_.Erase(oldest);
+    return true;
+}
+
+SharedPtr<Texture2D> Renderer::CreateShadowAtlasTexture()
+{
+    unsigned format = (shadowQuality_ == SHADOWQUALITY_SIMPLE_24BIT || shadowQuality_ == SHADOWQUALITY_PCF_24BIT) ?
+        graphics_->GetHiresShadowMapFormat() : graphics_->GetShadowMapFormat();
+    if (!format)
+        return SharedPtr<Texture2D>();
+
+    SharedPtr<Texture2D> atlas(new Texture2D(context_));
+    atlas->SetNumLevels(1);
+    if (!atlas->SetSize(shadowAtlasSize_, shadowAtlasSize_, format, TEXTURE_DEPTHSTENCIL))
+    {
+        URHO3D_LOGERROR("Failed to create shadow atlas of size " + String(shadowAtlasSize_));
+        return SharedPtr<Texture2D>();
+    }
+
+#ifndef GL_ES_VERSION_2_0
+    atlas->SetFilterMode(FILTER_BILINEAR);
+    atlas->SetShadowCompare(true);
+#endif
+#ifndef URHO3D_OPENGL
+    atlas->SetFilterMode(graphics_->GetHardwareShadowSupport() ? FILTER_BILINEAR : FILTER_NEAREST);
+#endif
+
+    // Link the dummy color rendertarget if necessary, shared with shadow maps of the same size
+    unsigned dummyColorFormat = graphics_->GetDummyColorFormat();
+    if (dummyColorFormat)
+    {
+        int searchKey = (shadowAtlasSize_ << 16) | shadowAtlasSize_;
+        if (!colorShadowMaps_.Contains(searchKey))
+        {
+            colorShadowMaps_[searchKey] = new Texture2D(context_);
+            colorShadowMaps_[searchKey]->SetNumLevels(1);
+            colorShadowMaps_[searchKey]->SetSize(shadowAtlasSize_, shadowAtlasSize_, dummyColorFormat, TEXTURE_RENDERTARGET);
+        }
+        atlas->GetRenderSurface()->SetLinkedRenderTarget(colorShadowMaps_[searchKey]->GetRenderSurface());
+    }
+
+    return atlas;
+}
+
 Texture* Renderer::GetScreenBuffer(int width, int height, unsigned format, int multiSample, bool autoResolve, bool cubemap, bool filtered, bool srgb,
     unsigned persistentKey)
 {
@@ -2127,6 +2450,10 @@ void Renderer::ResetShadowMaps()
     shadowMapAllocations_.Clear();
     colorShadowMaps_.Clear();
     shadowMapArray_.Reset();
+    shadowAtlasTexture_.Reset();
+    staticShadowAtlasTexture_.Reset();
+    shadowAtlasRegions_.Clear();
+    shadowAtlas_.Reset(0, SHADOW_MIN_PIXELS);
 }
 
 void Renderer::ResetBuffers()
@@ -26,6 +26,7 @@
 #include "../Core/Mutex.h"
 #include "../Graphics/Batch.h"
 #include "../Graphics/Drawable.h"
+#include "../Graphics/ShadowAtlas.h"
 #include "../Graphics/Viewport.h"
 #include "../Math/Color.h"
 
@@ -58,6 +59,26 @@ struct BatchQueue;
 static const int SHADOW_MIN_PIXELS = 64;
 static const int INSTANCING_BUFFER_DEFAULT_SIZE = 1024;
 
+/// Shadow atlas region assigned to a light.
+struct ShadowAtlasRegion
+{
+    /// Region rectangle.
+    IntRect rect_;
+    /// Allocation id. Unique for each allocation, so a reallocated region can be told apart even if it has the same rectangle.
+    unsigned id_;
+    /// Frame number on which the region was last used.
+    unsigned lastFrame_;
+};
+
+/// Geometries within the volume of a spot or point light. Queried once per frame and shared by all views that process the light.
+struct LightInfluence
+{
+    /// Geometries in the light volume, regardless of view mask or visibility.
+    PODVector<Drawable*> geometries_;
+    /// Frame number of the query. The geometries are stale if it is not the current frame.
+    unsigned frameNumber_;
+};
+
 /// Light vertex shader variations.
 enum LightVSVariation
 {
@@ -225,6 +246,8 @@ public:
     void SetReuseShadowMaps(bool enable);
     /// Set maximum number of shadow maps created for one resolution. Only has effect if reuse of shadow maps is disabled.
     void SetMaxShadowMaps(int shadowMaps);
+    /// Set shadow atlas size. When nonzero, the shadow maps of all lights are allocated as persistent regions of one atlas texture and rendered before the view. Only used with depth (non-VSM) shadow qualities. Default 0 (disabled.)
+    void SetShadowAtlasSize(int size);
     /// Set dynamic instancing on/off. When on (default), drawables using the same static-type geometry and material will be automatically combined to an instanced draw call.
     void SetDynamicInstancing(bool enable);
     /// Set number of extra instancing buffer elements. Default is 0. Extra 4-vectors are available through TEXCOORD7 and further.
@@ -235,6 +258,16 @@ public:
     void SetMaxSortedInstances(int instances);
     /// Set maximum number of occluder triangles.
     void SetMaxOccluderTriangles(int triangles);
+    /// Set maximum number of per-pixel lights in a view. The most important lights by screen coverage times intensity are kept, and the rest are demoted to vertex lighting in that view. Default 0 (unlimited.)
+    void SetLightBudget(int lights);
+    /// Set importance multiplier for lights that were within the light budget on the previous frame, to prevent lights of similar importance from popping. Default 1.25.
+    void SetLightBudgetHysteresis(float hysteresis);
+    /// Set the fraction of a LOD switch distance that a model must move past before it switches LOD back, so that models near a switch distance do not alternate between levels. Default 0.1.
+    void SetLodHysteresis(float hysteresis);
+    /// Set maximum number of model LOD switches per frame. Switches over the limit are deferred to later frames. Default 0 (unlimited.)
+    void SetMaxLodSwitches(int switches);
+    /// Set target number of 3D primitives per frame. While exceeded, the LOD bias of models is lowered gradually, and restored when back within budget. Default 0 (no budget.)
+    void SetTriangleBudget(int triangles);
     /// Set occluder buffer width.
     void SetOcclusionBufferSize(int size);
     /// Set required screen size (1.0 = full screen) for occluders.
@@ -310,6 +343,24 @@ public:
     /// Return maximum number of shadow maps per resolution.
     int GetMaxShadowMaps() const { return maxShadowMaps_; }
 
+    /// Return shadow atlas size.
+    int GetShadowAtlasSize() const { return shadowAtlasSize_; }
+
+    /// Return whether shadow maps are allocated from the atlas.
+    bool IsShadowAtlasEnabled() const { return shadowAtlasSize_ > 0 && shadowQuality_ <= SHADOWQUALITY_PCF_24BIT; }
+
+    /// Return shadow atlas texture, or null if not created.
+    Texture2D* GetShadowAtlas() const { return shadowAtlasTexture_; }
+
+    /// Return the fraction of the shadow atlas allocated to lights.
+    float GetShadowAtlasOccupancy() const { return shadowAtlas_.GetOccupancy(); }
+
+    /// Return number of lights holding a shadow atlas region.
+    unsigned GetNumShadowAtlasRegions() const { return shadowAtlasRegions_.Size(); }
+
+    /// Return number of shadow atlas regions allocated on this frame.
+    unsigned GetNumShadowAtlasAllocations() const { return numShadowAtlasAllocations_; }
+
     /// Return whether dynamic instancing is in use.
     bool GetDynamicInstancing() const { return dynamicInstancing_; }
 
@@ -325,6 +376,24 @@ public:
     /// Return maximum number of occluder triangles.
     int GetMaxOccluderTriangles() const { return maxOccluderTriangles_; }
 
+    /// Return maximum number of per-pixel lights in a view.
+    int GetLightBudget() const { return lightBudget_; }
+
+    /// Return importance multiplier for lights that were within the light budget on the previous frame.
+    float GetLightBudgetHysteresis() const { return lightBudgetHysteresis_; }
+
+    /// Return LOD switch hysteresis fraction.
+    float GetLodHysteresis() const { return lodPolicy_.hysteresis_; }
+
+    /// Return maximum number of model LOD switches per frame.
+    int GetMaxLodSwitches() const { return (int)lodPolicy_.maxSwitches_; }
+
+    /// Return target number of 3D primitives per frame.
+    int GetTriangleBudget() const { return triangleBudget_; }
+
+    /// Return the LOD bias multiplier currently applied by the triangle budget.
+    float GetLodBudgetBias() const { return lodPolicy_.budgetBias_; }
+
     /// Return occlusion buffer width.
     int GetOcclusionBufferSize() const { return occlusionBufferSize_; }
 
@@ -352,6 +421,8 @@ public:
     /// Return number of batches rendered.
     unsigned GetNumBatches() const { return numBatches_; }
     unsigned GetNumShadowBatches() const { return numShadowBatches_; }
+    /// Return number of model LOD switches made on the current frame.
+    unsigned GetNumLodSwitches() const { return lodPolicy_.numSwitches_; }
 
     /// Return number of geometries rendered.
     unsigned GetNumGeometries(bool allViews = false) const;
@@ -359,6 +430,16 @@ public:
     unsigned GetNumLights(bool allViews = false) const;
     /// Return number of shadow maps rendered.
     unsigned GetNumShadowMaps(bool allViews = false) const;
+    /// Return number of batches built for per-pixel light queues. Compare with the clustered lights pass, which builds none.
+    unsigned GetNumLitBatches(bool allViews = false) const;
+    /// Return number of lights shaded by the clustered lights pass.
+    unsigned GetNumClusteredLights(bool allViews = false) const;
+    /// Return number of lights demoted from per-pixel to vertex lighting by the light budget.
+    unsigned GetNumDemotedLights(bool allViews = false) const;
+    /// Return number of spot and point light octree queries performed.
+    unsigned GetNumLightQueries(bool allViews = false) const;
+    /// Return number of spot and point light octree queries served from the per-frame light influence cache.
+    unsigned GetNumCachedLightQueries(bool allViews = false) const;
     /// Return number of occluders rendered.
     unsigned GetNumOccluders(bool allViews = false) const;
 
@@ -401,8 +482,14 @@ public:
     Geometry* GetLightGeometry(Light* light);
     /// Return quad geometry used in postprocessing.
     Geometry* GetQuadGeometry();
-    /// Allocate a shadow map. If shadow map reuse is disabled, a different map is returned each time.
+    /// Allocate a shadow map. If shadow map reuse is disabled, a different map is returned each time. If the atlas is enabled, returns the atlas and assigns a region of it to the light.
     Texture2D* GetShadowMap(Light* light, Camera* camera, unsigned viewWidth, unsigned viewHeight);
+    /// Return the shadow atlas region of a light. Return false if the light has no region.
+    bool GetShadowAtlasRegion(Light* light, IntRect& rect, unsigned& id) const;
+    /// Return the static shadow caster layer of the atlas, used by lights that cache static shadows. Created on demand.
+    Texture2D* GetStaticShadowAtlas();
+    /// Return the per-frame influence cache entry of a light, creating it if necessary. Call from the main thread only; the entry can then be filled in a worker thread.
+    LightInfluence* GetLightInfluence(Light* light);
     /// Allocate a rendertarget or depth-stencil texture for deferred rendering or postprocessing. Should only be called during actual rendering, not before.
     Texture* GetScreenBuffer
         (int width, int height, unsigned format, int multiSample, bool autoResolve, bool cubemap, bool filtered, bool srgb, unsigned persistentKey = 0);
@@ -460,6 +547,12 @@ private:
     void RemoveUnusedBuffers();
     /// Reset shadow map allocation counts.
     void ResetShadowMapAllocations();
+    /// Assign a shadow atlas region for a light and return the atlas, or null if it could not be allocated.
+    Texture2D* AllocateShadowAtlasRegion(Light* light, int width, int height);
+    /// Free the region of the least recently used light that was not used on this frame. Return false if none.
+    bool EvictShadowAtlasRegion();
+    /// Create a depth texture of the shadow atlas size.
+    SharedPtr<Texture2D> CreateShadowAtlasTexture();
     /// Reset screem buffer allocation counts.
     void ResetScreenBufferAllocations();
     /// Remove all shadow maps. Called when global shadow map resolution or format is changed.
@@ -515,6 +608,16 @@ private:
     HashMap<int, SharedPtr<Texture2D> > colorShadowMaps_;
     /// Shadow map allocations by resolution.
     HashMap<int, PODVector<Light*> > shadowMapAllocations_;
+    /// Shadow atlas texture.
+    SharedPtr<Texture2D> shadowAtlasTexture_;
+    /// Static shadow caster layer of the shadow atlas.
+    SharedPtr<Texture2D> staticShadowAtlasTexture_;
+    /// Shadow atlas region allocator.
+    ShadowAtlas shadowAtlas_;
+    /// Shadow atlas regions by light.
+    HashMap<Light*, ShadowAtlasRegion> shadowAtlasRegions_;
+    /// Per-frame light influence cache by light.
+    HashMap<Light*, LightInfluence> lightInfluences_;
     /// Instance of shadow map filter
     Object* shadowMapFilterInstance_;
     /// Function pointer of shadow map filter
@@ -545,6 +648,8 @@ private:
     Vector<String> deferredLightPSVariations_;
     /// Frame info for rendering.
     FrameInfo frame_;
+    /// LOD selection policy passed to the drawables through the frame info.
+    LodPolicy lodPolicy_;
     /// Texture anisotropy level.
     int textureAnisotropy_;
     /// Texture filtering mode.
@@ -567,12 +672,22 @@ private:
     int vsmMultiSample_;
     /// Maximum number of shadow maps per resolution.
     int maxShadowMaps_;
+    /// Shadow atlas size.
+    int shadowAtlasSize_;
+    /// Number of shadow atlas regions allocated on this frame.
+    unsigned numShadowAtlasAllocations_;
     /// Minimum number of instances required in a batch group to render as instanced.
     int minInstances_;
     /// Maximum sorted instances per batch group.
     int maxSortedInstances_;
     /// Maximum occluder triangles.
     int maxOccluderTriangles_;
+    /// Maximum per-pixel lights in a view.
+    int lightBudget_;
+    /// Importance multiplier for lights within the light budget on the previous frame.
+    float lightBudgetHysteresis_;
+    /// Target 3D primitives per frame.
+    int triangleBudget_;
     /// Occlusion buffer width.
     int occlusionBufferSize_;
     /// Occluder screen size threshold.
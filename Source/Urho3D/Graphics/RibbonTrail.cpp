@@ -23,6 +23,7 @@
 #include "../Precompiled.h"
 
 #include "../Core/Context.h"
+#include "../Core/Thread.h"
 #include "../Graphics/RibbonTrail.h"
 #include "../Graphics/VertexBuffer.h"
 #include "../Graphics/IndexBuffer.h"
@@ -69,6 +70,10 @@ RibbonTrail::RibbonTrail(Context* context) :
     transforms_(Matrix3x4::IDENTITY),
     bufferSizeDirty_(false),
     bufferDirty_(true),
+    vertexUploadPending_(false),
+    stagedVertexCount_(0),
+    stagedIndexCount_(0),
+    pointCapacity_(0),
     previousPosition_(Vector3::ZERO),
     numPoints_(0),
     lifetime_(1.0f),
@@ -308,9 +313,18 @@ void RibbonTrail::UpdateTail()
         }
     }
 
-    // Update buffer size if size of points different with tail number
+    // Update buffer size if size of points different with tail number. Resize only when the points no longer fit, otherwise
+    // rewriting the vertices is enough
     if (points_.Size() != numPoints_)
-        bufferSizeDirty_ = true;
+    {
+        if (points_.Size() > pointCapacity_)
+            bufferSizeDirty_ = true;
+        else
+        {
+            numPoints_ = points_.Size();
+            bufferDirty_ = true;
+        }
+    }
 }
 
 void RibbonTrail::SetEndScale(float endScale)
@@ -392,12 +406,26 @@ void RibbonTrail::UpdateGeometry(const FrameInfo& frame)
 
     if (bufferDirty_ || vertexBuffer_->IsDataLost())
         UpdateVertexBuffer(frame);
+
+    // If updating in the main thread, there will be no separate commit
+    if (vertexUploadPending_ && Thread::IsMainThread())
+        CommitVertexBuffer();
+}
+
+void RibbonTrail::CommitGeometry(const FrameInfo& frame)
+{
+    if (vertexUploadPending_)
+        CommitVertexBuffer();
 }
 
 UpdateGeometryType RibbonTrail::GetUpdateGeometryType()
 {
-    if (bufferDirty_ || bufferSizeDirty_ || vertexBuffer_->IsDataLost() || indexBuffer_->IsDataLost())
+    // Resizing the buffers and rewriting the indices need the main thread. Vertex data can be written in a worker thread and
+    // uploaded afterward
+    if (bufferSizeDirty_ || indexBuffer_->IsDataLost())
         return UPDATE_MAIN_THREAD;
+    else if (bufferDirty_ || vertexBuffer_->IsDataLost() || vertexUploadPending_)
+        return UPDATE_WORKER_THREAD_STAGED;
     else
         return UPDATE_NONE;
 }
@@ -460,21 +488,24 @@ void RibbonTrail::UpdateBufferSize()
     {
         indexBuffer_->SetSize(0, false);
         vertexBuffer_->SetSize(0, mask, true);
+        pointCapacity_ = 0;
         return;
     }
-    else
-    {
-        indexBuffer_->SetSize(((numPoints_ - 1) * indexPerSegment), false);
-        vertexBuffer_->SetSize(numPoints_ * vertexPerSegment, mask, true);
-    }
+
+    // Leave room to grow, so that adding points does not resize the buffers every time. The indices of a shorter trail are a
+    // prefix of those of a longer one, so the draw range alone handles fewer points
+    unsigned maxPoints = 65536 / vertexPerSegment;
+    pointCapacity_ = Max(numPoints_, Min(NextPowerOfTwo(numPoints_), maxPoints));
+    indexBuffer_->SetSize(((pointCapacity_ - 1) * indexPerSegment), false);
+    vertexBuffer_->SetSize(pointCapacity_ * vertexPerSegment, mask, true);
 
     // Indices do not change for a given tail generator capacity
-    auto* dest = (unsigned short*)indexBuffer_->Lock(0, ((numPoints_ - 1) * indexPerSegment), true);
+    auto* dest = (unsigned short*)indexBuffer_->Lock(0, ((pointCapacity_ - 1) * indexPerSegment), true);
     if (!dest)
         return;
 
     unsigned vertexIndex = 0;
-    unsigned stripsLen = numPoints_ - 1;
+    unsigned stripsLen = pointCapacity_ - 1;
 
     while (stripsLen--)
     {
@@ -530,7 +561,9 @@ void RibbonTrail::UpdateVertexBuffer(const FrameInfo& frame)
     // if tail path is short and nothing to draw, exit
     if (numPoints_ < 2)
     {
-        batches_[0].geometry_->SetDrawRange(TRIANGLE_LIST, 0, 0, false);
+        stagedVertexCount_ = 0;
+        stagedIndexCount_ = 0;
+        vertexUploadPending_ = true;
         return;
     }
 
@@ -562,13 +595,15 @@ void RibbonTrail::UpdateVertexBuffer(const FrameInfo& frame)
             points_[i].next_ = &points_[i+1];
     }
 
-    batches_[0].geometry_->SetDrawRange(TRIANGLE_LIST, 0, (numPoints_ - 1) * indexPerSegment, false);
     bufferDirty_ = false;
     forceUpdate_ = false;
 
-    auto* dest = (float*)vertexBuffer_->Lock(0, (numPoints_ - 1) * vertexPerSegment, true);
-    if (!dest)
-        return;
+    // The draw range is applied with the upload, as the geometry may only be changed in the main thread
+    stagedVertexCount_ = (numPoints_ - 1) * vertexPerSegment;
+    stagedIndexCount_ = (numPoints_ - 1) * indexPerSegment;
+    vertexStaging_.Resize(stagedVertexCount_ * vertexBuffer_->GetVertexSize() / sizeof(float));
+    vertexUploadPending_ = true;
+    float* dest = &vertexStaging_[0];
 
     // Generate trail mesh
     if (trailType_ == TT_FACE_CAMERA)
@@ -795,9 +830,20 @@ void RibbonTrail::UpdateVertexBuffer(const FrameInfo& frame)
             dest += 26;
         }
     }
+}
+
+void RibbonTrail::CommitVertexBuffer()
+{
+    if (!stagedVertexCount_)
+        batches_[0].geometry_->SetDrawRange(TRIANGLE_LIST, 0, 0, false);
+    else if (vertexBuffer_->SetDataRange(&vertexStaging_[0], 0, stagedVertexCount_, true))
+    {
+        vertexBuffer_->ClearDataLost();
+        // Keep drawing the previous range if the upload failed, as it matches the data still in the buffer
+        batches_[0].geometry_->SetDrawRange(TRIANGLE_LIST, 0, stagedIndexCount_, false);
+    }
 
-    vertexBuffer_->Unlock();
-    vertexBuffer_->ClearDataLost();
+    vertexUploadPending_ = false;
 }
 
 void RibbonTrail::SetLifetime(float time)
@@ -81,6 +81,8 @@ public:
     void UpdateBatches(const FrameInfo& frame) override;
     /// Prepare geometry for rendering. Called from a worker thread if possible (no GPU update.)
     void UpdateGeometry(const FrameInfo& frame) override;
+    /// Upload the vertex data prepared by UpdateGeometry(). Called from the main thread.
+    void CommitGeometry(const FrameInfo& frame) override;
     /// Return whether a geometry update is necessary, and if it can happen in a worker thread.
     UpdateGeometryType GetUpdateGeometryType() override;
 
@@ -186,8 +188,10 @@ private:
 
     /// Resize RibbonTrail vertex and index buffers.
     void UpdateBufferSize();
-    /// Rewrite RibbonTrail vertex buffer.
+    /// Rewrite RibbonTrail vertex data into the staging buffer.
     void UpdateVertexBuffer(const FrameInfo& frame);
+    /// Upload the staging buffer to the vertex buffer and apply the staged draw range. Must be called from the main thread.
+    void CommitVertexBuffer();
     /// Update/Rebuild tail mesh only if position changed (called by UpdateBatches())
     void UpdateTail();
     /// Geometry.
@@ -202,6 +206,16 @@ private:
     bool bufferSizeDirty_;
     /// Vertex buffer needs rewrite flag.
     bool bufferDirty_;
+    /// Staging buffer waiting for upload flag.
+    bool vertexUploadPending_;
+    /// Vertex data written in UpdateGeometry() and uploaded in the main thread.
+    PODVector<float> vertexStaging_;
+    /// Number of vertices in the staging buffer.
+    unsigned stagedVertexCount_;
+    /// Number of indices to draw once the staging buffer is uploaded.
+    unsigned stagedIndexCount_;
+    /// Number of points the vertex and index buffers have room for.
+    unsigned pointCapacity_;
     /// Previous position of tail
     Vector3 previousPosition_;
     /// Distance between points. Basically is tail length.
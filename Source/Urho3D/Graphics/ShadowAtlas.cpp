@@ -0,0 +1,227 @@
+//
+// Copyright (c) 2017-2020 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+
+#include "../Precompiled.h"
+
+#include "../Graphics/ShadowAtlas.h"
+
+#include "../DebugNew.h"
+
+namespace Urho3D
+{
+
+ShadowAtlas::ShadowAtlas() :
+    size_(0),
+    minTileSize_(1),
+    nextId_(1),
+    allocatedArea_(0)
+{
+}
+
+void ShadowAtlas::Reset(int size, int minTileSize)
+{
+    size_ = size;
+    minTileSize_ = Max(minTileSize, 1);
+    allocatedArea_ = 0;
+    nodes_.Clear();
+    freeNodes_.Clear();
+    allocations_.Clear();
+
+    if (size_ > 0)
+    {
+        Node root;
+        root.position_ = IntVector2::ZERO;
+        root.size_ = size_;
+        root.parent_ = -1;
+        root.children_ = -1;
+        root.owner_ = 0;
+        nodes_.Push(root);
+    }
+}
+
+unsigned ShadowAtlas::Allocate(int width, int height, IntRect& region)
+{
+    if (nodes_.Empty() || width <= 0 || height <= 0)
+        return 0;
+
+    // Round up to whole tiles
+    width = (width + minTileSize_ - 1) / minTileSize_ * minTileSize_;
+    height = (height + minTileSize_ - 1) / minTileSize_ * minTileSize_;
+    int nodeSize = Max((int)NextPowerOfTwo((unsigned)Max(width, height)), minTileSize_);
+    if (nodeSize > size_)
+        return 0;
+
+    int index = FindFreeNode(0, nodeSize);
+    if (index < 0)
+        return 0;
+
+    unsigned id = nextId_++;
+    if (!nextId_)
+        nextId_ = 1;
+
+    Cover(index, width, height, id);
+
+    const IntVector2& position = nodes_[index].position_;
+    region = IntRect(position.x_, position.y_, position.x_ + width, position.y_ + height);
+
+    Allocation& allocation = allocations_[id];
+    allocation.region_ = region;
+    allocation.node_ = index;
+    allocatedArea_ += (unsigned long long)width * height;
+    return id;
+}
+
+void ShadowAtlas::Free(unsigned id)
+{
+    HashMap<unsigned, Allocation>::Iterator i = allocations_.Find(id);
+    if (i == allocations_.End())
+        return;
+
+    const IntRect& region = i->second_.region_;
+    allocatedArea_ -= (unsigned long long)region.Width() * region.Height();
+
+    // Clear the allocation, then merge parents whose children all became free
+    int index = i->second_.node_;
+    allocations_.Erase(i);
+    if (!Uncover(index, id))
+        return;
+
+    for (int parent = nodes_[index].parent_; parent >= 0; parent = nodes_[parent].parent_)
+    {
+        Node& node = nodes_[parent];
+        int first = node.children_;
+        if (!IsFreeLeaf(first) || !IsFreeLeaf(first + 1) || !IsFreeLeaf(first + 2) || !IsFreeLeaf(first + 3))
+            break;
+        freeNodes_.Push(first);
+        node.children_ = -1;
+    }
+}
+
+float ShadowAtlas::GetOccupancy() const
+{
+    return size_ > 0 ? (float)((double)allocatedArea_ / ((double)size_ * size_)) : 0.0f;
+}
+
+int ShadowAtlas::FindFreeNode(int index, int size)
+{
+    if (nodes_[index].size_ < size)
+        return -1;
+
+    if (nodes_[index].children_ < 0)
+    {
+        if (nodes_[index].owner_)
+            return -1;
+        if (nodes_[index].size_ == size)
+            return index;
+        // Larger free leaf: split and use the first child, leaving the siblings for later allocations
+        return FindFreeNode(Split(index), size);
+    }
+
+    // Search partially used nodes first. This keeps large free nodes intact for large regions
+    int first = nodes_[index].children_;
+    for (int i = 0; i < 4; ++i)
+    {
+        int found = FindFreeNode(first + i, size);
+        if (found >= 0)
+            return found;
+    }
+
+    return -1;
+}
+
+int ShadowAtlas::Split(int index)
+{
+    int first;
+    if (!freeNodes_.Empty())
+    {
+        first = freeNodes_.Back();
+        freeNodes_.Pop();
+    }
+    else
+    {
+        first = nodes_.Size();
+        nodes_.Resize(nodes_.Size() + 4);
+    }
+
+    Node& node = nodes_[index];
+    int half = node.size_ / 2;
+    for (int i = 0; i < 4; ++i)
+    {
+        Node& child = nodes_[first + i];
+        child.position_ = node.position_ + IntVector2((i & 1) * half, (i >> 1) * half);
+        child.size_ = half;
+        child.parent_ = index;
+        child.children_ = -1;
+        child.owner_ = 0;
+    }
+
+    node.children_ = first;
+    return first;
+}
+
+void ShadowAtlas::Cover(int index, int width, int height, unsigned owner)
+{
+    int size = nodes_[index].size_;
+    if ((width >= size && height >= size) || size <= minTileSize_)
+    {
+        nodes_[index].owner_ = owner;
+        return;
+    }
+
+    int half = size / 2;
+    int first = Split(index);
+    Cover(first, Min(width, half), Min(height, half), owner);
+    if (width > half)
+        Cover(first + 1, width - half, Min(height, half), owner);
+    if (height > half)
+        Cover(first + 2, Min(width, half), height - half, owner);
+    if (width > half && height > half)
+        Cover(first + 3, width - half, height - half, owner);
+}
+
+bool ShadowAtlas::Uncover(int index, unsigned owner)
+{
+    if (nodes_[index].children_ < 0)
+    {
+        if (nodes_[index].owner_ == owner)
+            nodes_[index].owner_ = 0;
+        return !nodes_[index].owner_;
+    }
+
+    int first = nodes_[index].children_;
+    bool free = true;
+    for (int i = 0; i < 4; ++i)
+    {
+        if (!Uncover(first + i, owner))
+            free = false;
+    }
+
+    if (free)
+    {
+        freeNodes_.Push(first);
+        nodes_[index].children_ = -1;
+    }
+    return free;
+}
+
+}
@@ -0,0 +1,107 @@
+//
+// Copyright (c) 2017-2020 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+
+#pragma once
+
+#include "../Container/HashMap.h"
+#include "../Math/Rect.h"
+
+namespace Urho3D
+{
+
+/// Quadtree allocator for the regions of a square shadow map atlas. A region is placed in the top-left corner of the smallest free power-of-two node that fits it, and the rest of the node stays available for smaller regions.
+class URHO3D_API ShadowAtlas
+{
+public:
+    /// Construct empty.
+    ShadowAtlas();
+
+    /// Reset to an empty atlas of the given power-of-two size. Region sizes are rounded up to multiples of the minimum tile size.
+    void Reset(int size, int minTileSize);
+    /// Allocate a region. Return a nonzero allocation id, or zero if there is no space.
+    unsigned Allocate(int width, int height, IntRect& region);
+    /// Free an allocation.
+    void Free(unsigned id);
+
+    /// Return atlas size.
+    int GetSize() const { return size_; }
+    /// Return number of allocations.
+    unsigned GetNumAllocations() const { return allocations_.Size(); }
+    /// Return allocated area in pixels.
+    unsigned long long GetAllocatedArea() const { return allocatedArea_; }
+    /// Return the fraction of the atlas covered by allocations.
+    float GetOccupancy() const;
+
+private:
+    /// Quadtree node.
+    struct Node
+    {
+        /// Top-left corner.
+        IntVector2 position_;
+        /// Side length.
+        int size_;
+        /// Index of the parent node, or -1 for the root.
+        int parent_;
+        /// Index of the first of four consecutive children, or -1 for a leaf.
+        int children_;
+        /// Allocation covering the leaf, or zero if free.
+        unsigned owner_;
+    };
+
+    /// Allocation.
+    struct Allocation
+    {
+        /// Region.
+        IntRect region_;
+        /// Node the region was placed in.
+        int node_;
+    };
+
+    /// Find a free node of the given size below a node, splitting free leaves as needed. Return -1 if not found.
+    int FindFreeNode(int index, int size);
+    /// Split a free leaf into four children. Return the index of the first child.
+    int Split(int index);
+    /// Mark the top-left area of a free node as owned by an allocation.
+    void Cover(int index, int width, int height, unsigned owner);
+    /// Clear an allocation from a subtree, merging children that became free. Return true if the node is free afterward.
+    bool Uncover(int index, unsigned owner);
+    /// Return whether a node is a free leaf.
+    bool IsFreeLeaf(int index) const { return nodes_[index].children_ < 0 && !nodes_[index].owner_; }
+
+    /// Nodes. Children are stored as four consecutive entries.
+    PODVector<Node> nodes_;
+    /// Indices of unused groups of four nodes.
+    PODVector<int> freeNodes_;
+    /// Allocations by id.
+    HashMap<unsigned, Allocation> allocations_;
+    /// Atlas size.
+    int size_;
+    /// Minimum tile size.
+    int minTileSize_;
+    /// Next allocation id.
+    unsigned nextId_;
+    /// Allocated area in pixels.
+    unsigned long long allocatedArea_;
+};
+
+}
@@ -0,0 +1,245 @@
+//
+// Copyright (c) 2017-2020 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+
+#include "../Precompiled.h"
+
+#include "../Graphics/Camera.h"
+#include "../Graphics/Drawable.h"
+#include "../Graphics/Light.h"
+#include "../Graphics/ShadowMapCache.h"
+#include "../Graphics/Texture2D.h"
+
+#include <cstring>
+
+#include "../DebugNew.h"
+
+namespace Urho3D
+{
+
+/// Number of frames after which the record of a caster that has not been seen is removed.
+static const unsigned SHADOW_CACHE_RECORD_FRAMES = 60;
+
+static inline unsigned long long MixHash(unsigned long long hash, unsigned long long value)
+{
+    unsigned long long x = hash ^ (value + 0x9e3779b97f4a7c15ULL + (hash << 6) + (hash >> 2));
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+static unsigned long long MixFloats(unsigned long long hash, const float* data, unsigned count)
+{
+    for (unsigned i = 0; i < count; ++i)
+    {
+        unsigned bits;
+        memcpy(&bits, &data[i], sizeof bits);
+        hash = MixHash(hash, bits);
+    }
+    return hash;
+}
+
+/// Return a hash of the draw calls of a drawable. Changes when e.g. the LOD level or the material is switched.
+static unsigned long long GetBatchesHash(Drawable* drawable)
+{
+    const Vector<SourceBatch>& batches = drawable->GetBatches();
+    unsigned long long hash = batches.Size();
+    for (unsigned i = 0; i < batches.Size(); ++i)
+    {
+        const SourceBatch& batch = batches[i];
+        hash = MixHash(hash, (unsigned long long)(size_t)batch.geometry_);
+        hash = MixHash(hash, (unsigned long long)(size_t)batch.material_.Get());
+        hash = MixHash(hash, ((unsigned long long)batch.numWorldTransforms_ << 8) | batch.geometryType_);
+    }
+    return hash;
+}
+
+ShadowMapCache::ShadowMapCache(Context* context) :
+    context_(context),
+    view_(nullptr),
+    frameNumber_(0),
+    signature_(0),
+    casterSignature_(0),
+    renderedSignature_(0),
+    numRebuilds_(0),
+    rebuildPending_(false),
+    rendered_(false),
+    disabled_(false)
+{
+}
+
+ShadowMapCache::~ShadowMapCache() = default;
+
+bool ShadowMapCache::BeginView(View* view, unsigned frameNumber, Texture2D* shadowMap, const BiasParameters& bias,
+    Texture2D* staticAtlas, unsigned regionId)
+{
+    if (disabled_ || !shadowMap || shadowMap->GetUsage() != TEXTURE_DEPTHSTENCIL)
+        return false;
+    // Another view has already collected its casters this frame. Sharing the cache would make the views invalidate each other
+    if (frameNumber == frameNumber_ && view != view_)
+        return false;
+
+    if (frameNumber != frameNumber_)
+    {
+        // Forget casters that have not been seen for a while, so that the records of destroyed drawables do not accumulate
+        for (HashMap<Drawable*, CasterRecord>::Iterator i = casters_.Begin(); i != casters_.End();)
+        {
+            if (frameNumber - i->second_.lastFrame_ > SHADOW_CACHE_RECORD_FRAMES)
+                i = casters_.Erase(i);
+            else
+                ++i;
+        }
+    }
+
+    view_ = view;
+    frameNumber_ = frameNumber;
+    rebuildPending_ = false;
+
+    if (staticAtlas)
+    {
+        if (texture_ != staticAtlas)
+        {
+            texture_ = staticAtlas;
+            rendered_ = false;
+        }
+    }
+    else if (!texture_ || texture_->GetWidth() != shadowMap->GetWidth() || texture_->GetHeight() != shadowMap->GetHeight() ||
+        texture_->GetFormat() != shadowMap->GetFormat() || texture_->GetMultiSample() != shadowMap->GetMultiSample())
+    {
+        texture_ = new Texture2D(context_);
+        texture_->SetNumLevels(1);
+        rendered_ = false;
+        if (!texture_->SetSize(shadowMap->GetWidth(), shadowMap->GetHeight(), shadowMap->GetFormat(), TEXTURE_DEPTHSTENCIL,
+            shadowMap->GetMultiSample()))
+        {
+            texture_.Reset();
+            return false;
+        }
+    }
+
+    signature_ = MixHash(((unsigned long long)texture_->GetWidth() << 32) | (unsigned)texture_->GetHeight(),
+        texture_->GetFormat());
+    signature_ = MixFloats(signature_, &bias.constantBias_, 1);
+    signature_ = MixFloats(signature_, &bias.slopeScaledBias_, 1);
+    // A reallocated atlas region may have been overwritten by another light even if its rectangle is the same
+    signature_ = MixHash(signature_, regionId);
+    casterSignature_ = 0;
+    for (unsigned i = 0; i < staticCasters_.Size(); ++i)
+        staticCasters_[i].Clear();
+    return true;
+}
+
+void ShadowMapCache::AddSplit(Camera* shadowCamera, const IntRect& viewport)
+{
+    signature_ = MixFloats(signature_, shadowCamera->GetView().Data(), 12);
+    signature_ = MixFloats(signature_, shadowCamera->GetProjection().Data(), 16);
+    signature_ = MixHash(signature_, ((unsigned long long)(unsigned)viewport.left_ << 32) | (unsigned)viewport.top_);
+    signature_ = MixHash(signature_, ((unsigned long long)(unsigned)viewport.right_ << 32) | (unsigned)viewport.bottom_);
+}
+
+bool ShadowMapCache::IsStaticCaster(Drawable* drawable)
+{
+    HashMap<Drawable*, CasterRecord>::Iterator i = casters_.Find(drawable);
+    if (i == casters_.End())
+    {
+        CasterRecord& record = casters_[drawable];
+        record.transformVersion_ = drawable->GetTransformVersion();
+        record.geometryHash_ = GetBatchesHash(drawable);
+        record.changedFrame_ = frameNumber_;
+        record.lastFrame_ = frameNumber_;
+        record.static_ = false;
+        return false;
+    }
+
+    CasterRecord& record = i->second_;
+    if (record.lastFrame_ == frameNumber_)
+        return record.static_;
+
+    unsigned long long geometryHash = GetBatchesHash(drawable);
+    if (record.transformVersion_ != drawable->GetTransformVersion() || record.geometryHash_ != geometryHash)
+    {
+        record.transformVersion_ = drawable->GetTransformVersion();
+        record.geometryHash_ = geometryHash;
+        record.changedFrame_ = frameNumber_;
+    }
+
+    record.lastFrame_ = frameNumber_;
+    // Drawables that update their geometry (skinning, billboards etc.) are always dynamic
+    record.static_ = frameNumber_ - record.changedFrame_ >= SHADOW_CACHE_STATIC_FRAMES &&
+        drawable->GetUpdateGeometryType() == UPDATE_NONE;
+    return record.static_;
+}
+
+void ShadowMapCache::AddStaticCaster(Drawable* drawable, unsigned split)
+{
+    const CasterRecord& record = casters_[drawable];
+    if (staticCasters_.Size() <= split)
+        staticCasters_.Resize(split + 1);
+    staticCasters_[split].Push(drawable);
+
+    // Combine casters order-independently, as the caster query order is not stable
+    unsigned long long hash = MixHash((unsigned long long)(size_t)drawable, split);
+    hash = MixHash(hash, record.transformVersion_);
+    casterSignature_ += MixHash(hash, record.geometryHash_);
+}
+
+bool ShadowMapCache::EndView()
+{
+    signature_ = MixHash(signature_, casterSignature_);
+    rebuildPending_ = !rendered_ || signature_ != renderedSignature_;
+    return rebuildPending_;
+}
+
+const PODVector<Drawable*>& ShadowMapCache::GetStaticCasters(unsigned split) const
+{
+    static const PODVector<Drawable*> noCasters;
+    return split < staticCasters_.Size() ? staticCasters_[split] : noCasters;
+}
+
+void ShadowMapCache::MarkRendered()
+{
+    if (!rebuildPending_)
+        return;
+
+    renderedSignature_ = signature_;
+    rendered_ = true;
+    rebuildPending_ = false;
+    ++numRebuilds_;
+}
+
+void ShadowMapCache::Disable()
+{
+    Release();
+    disabled_ = true;
+}
+
+void ShadowMapCache::Release()
+{
+    texture_.Reset();
+    casters_.Clear();
+    staticCasters_.Clear();
+    view_ = nullptr;
+    rebuildPending_ = false;
+    rendered_ = false;
+}
+
+}
@@ -0,0 +1,125 @@
+//
+// Copyright (c) 2017-2020 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+
+#pragma once
+
+#include "../Container/HashMap.h"
+#include "../Container/Ptr.h"
+#include "../Math/Rect.h"
+
+namespace Urho3D
+{
+
+class Camera;
+class Context;
+class Drawable;
+class Texture2D;
+class View;
+struct BiasParameters;
+
+/// Number of frames a shadow caster's transform and geometry must stay unchanged before it moves to the cached static layer.
+static const unsigned SHADOW_CACHE_STATIC_FRAMES = 8;
+
+/// Persistent depth of the static shadow casters of a spot or point light. The static layer is rendered only when its casters, the shadow cameras or the shadow map size change; each frame it is copied into the shadow map before the dynamic casters are drawn on top.
+class URHO3D_API ShadowMapCache : public RefCounted
+{
+public:
+    /// Construct.
+    explicit ShadowMapCache(Context* context);
+    /// Destruct.
+    ~ShadowMapCache() override;
+
+    /// Begin collecting the shadow casters of a view for the given shadow map. Only one view per frame can use the cache. When the shadow map is an atlas, the static layer is kept in the same region of the static atlas texture instead of a texture of its own. Return false if the cache can not be used, in which case all casters should be rendered normally.
+    bool BeginView(View* view, unsigned frameNumber, Texture2D* shadowMap, const BiasParameters& bias,
+        Texture2D* staticAtlas = nullptr, unsigned regionId = 0);
+    /// Add a shadow split's camera and viewport.
+    void AddSplit(Camera* shadowCamera, const IntRect& viewport);
+    /// Return whether a shadow caster is static, ie. its transform and geometry have not been updated for several frames. Updates the caster's record once per frame.
+    bool IsStaticCaster(Drawable* drawable);
+    /// Add a static shadow caster rendered into a split.
+    void AddStaticCaster(Drawable* drawable, unsigned split);
+    /// Finish collecting. Return true if the static layer must be rendered into the cache texture this frame.
+    bool EndView();
+    /// Mark the static layer as rendered into the cache texture.
+    void MarkRendered();
+    /// Disable the cache, for example when the texture copy is not supported by the rendering API.
+    void Disable();
+    /// Release the cache texture and caster records.
+    void Release();
+
+    /// Return the cache texture.
+    Texture2D* GetTexture() const { return texture_; }
+    /// Return whether the static layer must be rendered this frame.
+    bool IsRebuildPending() const { return rebuildPending_; }
+    /// Return the static shadow casters of a split collected this frame.
+    const PODVector<Drawable*>& GetStaticCasters(unsigned split) const;
+    /// Return whether has been disabled.
+    bool IsDisabled() const { return disabled_; }
+    /// Return number of times the static layer has been rendered.
+    unsigned GetNumRebuilds() const { return numRebuilds_; }
+
+private:
+    /// Per-caster record.
+    struct CasterRecord
+    {
+        /// Transform version when last seen.
+        unsigned transformVersion_;
+        /// Geometry signature when last seen.
+        unsigned long long geometryHash_;
+        /// Frame when the transform or geometry last changed.
+        unsigned changedFrame_;
+        /// Frame when last seen.
+        unsigned lastFrame_;
+        /// Static flag for the last seen frame.
+        bool static_;
+    };
+
+    /// Context.
+    Context* context_;
+    /// Cache texture holding the static layer. Shared with other lights when using the static atlas.
+    SharedPtr<Texture2D> texture_;
+    /// Caster records.
+    HashMap<Drawable*, CasterRecord> casters_;
+    /// Static casters of each split collected this frame.
+    Vector<PODVector<Drawable*> > staticCasters_;
+    /// View using the cache on the current frame.
+    View* view_;
+    /// Current frame number.
+    unsigned frameNumber_;
+    /// Signature of the shadow map and split setup being collected.
+    unsigned long long signature_;
+    /// Order-independent signature of the static casters being collected.
+    unsigned long long casterSignature_;
+    /// Signature of the static layer in the cache texture.
+    unsigned long long renderedSignature_;
+    /// Number of static layer rebuilds.
+    unsigned numRebuilds_;
+    /// Rebuild pending flag.
+    bool rebuildPending_;
+    /// Rendered signature valid flag.
+    bool rendered_;
+    /// Disabled flag.
+    bool disabled_;
+};
+
+}
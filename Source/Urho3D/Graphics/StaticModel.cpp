@@ -47,7 +47,10 @@ extern const char* GEOMETRY_CATEGORY;
 StaticModel::StaticModel(Context* context) :
     Drawable(context, DRAWABLE_GEOMETRY),
     occlusionLodLevel_(M_MAX_UNSIGNED),
-    materialsAttr_(Material::GetTypeStatic())
+    numLodLevels_(1),
+    materialsAttr_(Material::GetTypeStatic()),
+    lodLevelsReset_(true),
+    lodSwitchPending_(false)
 {
 }
 
@@ -146,12 +149,12 @@ void StaticModel::UpdateBatches(const FrameInfo& frame)
     }
 
     float scale = worldBoundingBox.Size().DotProduct(DOT_SCALE);
-    float newLodDistance = frame.camera_->GetLodDistance(distance_, scale, lodBias_);
+    float newLodDistance = frame.camera_->GetLodDistance(distance_, scale, frame.GetLodBias(lodBias_));
 
-    if (newLodDistance != lodDistance_)
+    if (newLodDistance != lodDistance_ || lodSwitchPending_)
     {
         lodDistance_ = newLodDistance;
-        CalculateLodLevels();
+        CalculateLodLevels(frame.lodPolicy_);
     }
 }
 
@@ -284,13 +287,15 @@ void StaticModel::SetMaterial(Material* material)
 
 bool StaticModel::SetMaterial(unsigned index, Material* material)
 {
-    if (index >= batches_.Size())
+    if (index >= geometries_.Size())
     {
         URHO3D_LOGERROR("Material index out of bounds");
         return false;
     }
 
-    batches_[index].material_ = material;
+    for (unsigned i = 0; i < numLodLevels_; ++i)
+        batches_[GetLodBatchIndex(index, i)].material_ = material;
+
     MarkNetworkUpdate();
     return true;
 }
@@ -313,7 +318,7 @@ void StaticModel::ApplyMaterialList(const String& fileName)
         return;
 
     unsigned index = 0;
-    while (!file->IsEof() && index < batches_.Size())
+    while (!file->IsEof() && index < geometries_.Size())
     {
         auto* material = cache->GetResource<Material>(file->ReadLine());
         if (material)
@@ -325,7 +330,7 @@ void StaticModel::ApplyMaterialList(const String& fileName)
 
 Material* StaticModel::GetMaterial(unsigned index) const
 {
-    return index < batches_.Size() ? batches_[index].material_ : nullptr;
+    return index < geometries_.Size() ? batches_[index].material_ : nullptr;
 }
 
 bool StaticModel::IsInside(const Vector3& point) const
@@ -366,6 +371,7 @@ void StaticModel::SetBoundingBox(const BoundingBox& box)
 
 void StaticModel::SetNumGeometries(unsigned num)
 {
+    numLodLevels_ = 1;
     batches_.Resize(num);
     geometries_.Resize(num);
     geometryData_.Resize(num);
@@ -392,8 +398,8 @@ ResourceRef StaticModel::GetModelAttr() const
 
 const ResourceRefList& StaticModel::GetMaterialsAttr() const
 {
-    materialsAttr_.names_.Resize(batches_.Size());
-    for (unsigned i = 0; i < batches_.Size(); ++i)
+    materialsAttr_.names_.Resize(geometries_.Size());
+    for (unsigned i = 0; i < geometries_.Size(); ++i)
         materialsAttr_.names_[i] = GetResourceName(GetMaterial(i));
 
     return materialsAttr_;
@@ -407,7 +413,7 @@ void StaticModel::OnWorldBoundingBoxUpdate()
 void StaticModel::ResetLodLevels()
 {
     // Ensure that each subgeometry has at least one LOD level, and reset the current LOD level
-    for (unsigned i = 0; i < batches_.Size(); ++i)
+    for (unsigned i = 0; i < geometries_.Size(); ++i)
     {
         if (!geometries_[i].Size())
             geometries_[i].Resize(1);
@@ -417,32 +423,146 @@ void StaticModel::ResetLodLevels()
 
     // Find out the real LOD levels on next geometry update
     lodDistance_ = M_INFINITY;
+    lodLevelsReset_ = true;
 }
 
-void StaticModel::CalculateLodLevels()
+void StaticModel::CalculateLodLevels(LodPolicy* policy)
 {
-    for (unsigned i = 0; i < batches_.Size(); ++i)
+    // The first choice after a reset is free, as the levels have not been shown yet
+    if (lodLevelsReset_)
+        policy = nullptr;
+    lodLevelsReset_ = false;
+    lodSwitchPending_ = false;
+
+    float hysteresis = policy ? policy->hysteresis_ : 0.0f;
+    bool switchAcquired = false;
+
+    for (unsigned i = 0; i < geometries_.Size(); ++i)
     {
         const Vector<SharedPtr<Geometry> >& batchGeometries = geometries_[i];
         // If only one LOD geometry, no reason to go through the LOD calculation
         if (batchGeometries.Size() <= 1)
             continue;
 
-        unsigned j;
+        unsigned newLodLevel = GetLodLevel(i, lodDistance_, geometryData_[i].lodLevel_, hysteresis);
+        if (geometryData_[i].lodLevel_ != newLodLevel)
+        {
+            // The geometries of a drawable switch together as one of the frame's switches. Retry on the next update if
+            // the limit has been reached
+            if (policy && !switchAcquired)
+            {
+                if (!policy->AcquireSwitch())
+                {
+                    lodSwitchPending_ = true;
+                    return;
+                }
+                switchAcquired = true;
+            }
+
+            geometryData_[i].lodLevel_ = newLodLevel;
+            batches_[i].geometry_ = batchGeometries[newLodLevel];
+        }
+    }
+}
+
+unsigned StaticModel::GetLodLevel(unsigned geometryIndex, float lodDistance) const
+{
+    const Vector<SharedPtr<Geometry> >& batchGeometries = geometries_[geometryIndex];
+    unsigned j;
+
+    for (j = 1; j < batchGeometries.Size(); ++j)
+    {
+        if (batchGeometries[j] && lodDistance <= batchGeometries[j]->GetLodDistance())
+            break;
+    }
+
+    return j - 1;
+}
+
+unsigned StaticModel::GetLodLevel(unsigned geometryIndex, float lodDistance, unsigned currentLevel, float hysteresis) const
+{
+    unsigned level = GetLodLevel(geometryIndex, lodDistance);
+    if (level > currentLevel)
+        level = Max(currentLevel, GetLodLevel(geometryIndex, lodDistance / (1.0f + hysteresis)));
+    else if (level < currentLevel)
+        level = Min(currentLevel, GetLodLevel(geometryIndex, lodDistance * (1.0f + hysteresis)));
+
+    return level;
+}
 
-        for (j = 1; j < batchGeometries.Size(); ++j)
+void StaticModel::UpdateLodBatches()
+{
+    unsigned numGeometries = geometries_.Size();
+    numLodLevels_ = 1;
+    for (unsigned i = 0; i < numGeometries; ++i)
+        numLodLevels_ = Max(numLodLevels_, geometries_[i].Size());
+
+    // Geometries with fewer LOD levels leave their extra batches empty
+    batches_.Resize(numGeometries * numLodLevels_);
+    for (unsigned i = 0; i < numGeometries; ++i)
+    {
+        for (unsigned j = 1; j < numLodLevels_; ++j)
         {
-            if (batchGeometries[j] && lodDistance_ <= batchGeometries[j]->GetLodDistance())
-                break;
+            SourceBatch& batch = batches_[GetLodBatchIndex(i, j)];
+            batch.geometry_ = j < geometries_[i].Size() ? geometries_[i][j].Get() : nullptr;
+            batch.material_ = batches_[i].material_;
+            batch.worldTransform_ = &Matrix3x4::IDENTITY;
+            batch.numWorldTransforms_ = 0;
         }
+    }
+}
 
-        unsigned newLodLevel = j - 1;
-        if (geometryData_[i].lodLevel_ != newLodLevel)
+void StaticModel::SetInstanceBatches(const StaticModelInstanceView& view)
+{
+    Matrix3x4* transforms = view.transforms_.Get();
+    for (unsigned i = 0; i < batches_.Size(); ++i)
+    {
+        unsigned count = view.batchCounts_[i];
+        batches_[i].worldTransform_ = count ? transforms : &Matrix3x4::IDENTITY;
+        batches_[i].numWorldTransforms_ = count;
+        transforms += count;
+    }
+}
+
+StaticModelInstanceViews::StaticModelInstanceViews() :
+    numViews_(0),
+    frameNumber_(0)
+{
+}
+
+StaticModelInstanceView& StaticModelInstanceViews::Lock(const FrameInfo& frame, unsigned numTransforms, unsigned numBatches,
+    bool& culled)
+{
+    mutex_.Acquire();
+
+    if (frame.frameNumber_ != frameNumber_)
+    {
+        frameNumber_ = frame.frameNumber_;
+        numViews_ = 0;
+    }
+
+    for (unsigned i = 0; i < numViews_; ++i)
+    {
+        if (views_[i].camera_ == frame.camera_)
         {
-            geometryData_[i].lodLevel_ = newLodLevel;
-            batches_[i].geometry_ = batchGeometries[newLodLevel];
+            culled = true;
+            return views_[i];
         }
     }
+
+    if (numViews_ == views_.Size())
+    {
+        views_.Resize(numViews_ + 1);
+        views_[numViews_].capacity_ = 0;
+    }
+
+    StaticModelInstanceView& view = views_[numViews_++];
+    view.camera_ = frame.camera_;
+    view.Reserve(numTransforms);
+    view.batchCounts_.Resize(numBatches);
+
+    culled = false;
+    return view;
 }
 
 void StaticModel::HandleModelReloadFinished(StringHash eventType, VariantMap& eventData)
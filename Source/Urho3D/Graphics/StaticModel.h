@@ -22,7 +22,10 @@
 
 #pragma once
 
+#include "../Container/ArrayPtr.h"
+#include "../Core/Mutex.h"
 #include "../Graphics/Drawable.h"
+#include "../Math/Matrix3x4.h"
 
 namespace Urho3D
 {
@@ -38,6 +41,55 @@ struct StaticModelGeometryData
     unsigned lodLevel_;
 };
 
+/// Instance transforms that passed culling for one view, compacted per batch.
+struct StaticModelInstanceView
+{
+    /// Ensure room for a number of transforms. Reallocates instead of resizing, as the contents need not be kept.
+    void Reserve(unsigned numTransforms)
+    {
+        if (capacity_ < numTransforms)
+        {
+            transforms_ = new Matrix3x4[numTransforms];
+            capacity_ = numTransforms;
+        }
+    }
+
+    /// Camera the instances were culled for.
+    Camera* camera_;
+    /// Transforms of all batches, one after another.
+    SharedArrayPtr<Matrix3x4> transforms_;
+    /// Capacity of the transform buffer.
+    unsigned capacity_;
+    /// Number of transforms per batch.
+    PODVector<unsigned> batchCounts_;
+};
+
+/// Per-view storage of culled instance transforms. All views are updated before any is rendered, so the batches of each view
+/// must refer to their own copy.
+class URHO3D_API StaticModelInstanceViews
+{
+public:
+    /// Construct.
+    StaticModelInstanceViews();
+
+    /// Lock and return the storage for the frame's camera, with room for the given numbers of transforms and batches. Culled is
+    /// set true if the instances were already culled for the camera during this frame, in which case the storage must be only
+    /// read. Call Unlock() when done. May be called from worker threads.
+    StaticModelInstanceView& Lock(const FrameInfo& frame, unsigned numTransforms, unsigned numBatches, bool& culled);
+    /// Unlock after Lock().
+    void Unlock() { mutex_.Release(); }
+
+private:
+    /// Storage, reused in order across frames.
+    Vector<StaticModelInstanceView> views_;
+    /// Number of views used during the current frame.
+    unsigned numViews_;
+    /// Current frame number.
+    unsigned frameNumber_;
+    /// Mutex for concurrent updates of a shadow caster from the light threads.
+    Mutex mutex_;
+};
+
 /// Static model component.
 class URHO3D_API StaticModel : public Drawable
 {
@@ -112,8 +164,23 @@ protected:
     void SetNumGeometries(unsigned num);
     /// Reset LOD levels.
     void ResetLodLevels();
-    /// Choose LOD levels based on distance.
-    void CalculateLodLevels();
+    /// Choose LOD levels based on distance. With a policy, applies its hysteresis and switch limit.
+    void CalculateLodLevels(LodPolicy* policy = nullptr);
+    /// Return the LOD level of a geometry for a LOD distance.
+    unsigned GetLodLevel(unsigned geometryIndex, float lodDistance) const;
+    /// Return the LOD level of a geometry for a LOD distance, leaving the current level only once the LOD distance is past the
+    /// switch distance by a hysteresis fraction.
+    unsigned GetLodLevel(unsigned geometryIndex, float lodDistance, unsigned currentLevel, float hysteresis) const;
+    /// Create a batch for each LOD level above zero of each geometry, after the per-geometry batches, so that instances can
+    /// be drawn at different LOD levels. Copies the geometry materials. Must be called from the main thread.
+    void UpdateLodBatches();
+    /// Return the batch index for a geometry's LOD level.
+    unsigned GetLodBatchIndex(unsigned geometryIndex, unsigned level) const
+    {
+        return level ? geometries_.Size() + geometryIndex * (numLodLevels_ - 1) + level - 1 : geometryIndex;
+    }
+    /// Point the batches at the instance transforms of a view.
+    void SetInstanceBatches(const StaticModelInstanceView& view);
 
     /// Extra per-geometry data.
     PODVector<StaticModelGeometryData> geometryData_;
@@ -123,8 +190,14 @@ protected:
     SharedPtr<Model> model_;
     /// Occlusion LOD level.
     unsigned occlusionLodLevel_;
+    /// Number of batches per geometry. Above one when UpdateLodBatches() has created batches for the LOD levels.
+    unsigned numLodLevels_;
     /// Material list attribute.
     mutable ResourceRefList materialsAttr_;
+    /// LOD levels reset flag. The next choice ignores the LOD policy.
+    bool lodLevelsReset_;
+    /// LOD switch deferred by the switch limit flag.
+    bool lodSwitchPending_;
 
 private:
     /// Handle model reload finished.
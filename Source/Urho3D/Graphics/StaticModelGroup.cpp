@@ -48,6 +48,9 @@ static const StringVector instanceNodesStructureElementNames =
 
 StaticModelGroup::StaticModelGroup(Context* context) :
     StaticModel(context),
+    numWorldTransforms_(0),
+    numVisibleInstances_(0),
+    instanceCulling_(true),
     nodesDirty_(false),
     nodeIDsDirty_(false)
 {
@@ -65,6 +68,7 @@ void StaticModelGroup::RegisterObject(Context* context)
     URHO3D_ACCESSOR_ATTRIBUTE("Instance Nodes", GetNodeIDsAttr, SetNodeIDsAttr,
         VariantVector, Variant::emptyVariantVector, AM_DEFAULT | AM_NODEIDVECTOR)
         .SetMetadata(AttributeMetadata::P_VECTOR_STRUCT_ELEMENTS, instanceNodesStructureElementNames);
+    URHO3D_ACCESSOR_ATTRIBUTE("Instance Culling", GetInstanceCulling, SetInstanceCulling, bool, true, AM_DEFAULT);
 }
 
 void StaticModelGroup::ApplyAttributes()
@@ -98,7 +102,7 @@ void StaticModelGroup::ApplyAttributes()
         }
     }
 
-    worldTransforms_.Resize(instanceNodes_.Size());
+    UpdateInstanceBuffers();
     numWorldTransforms_ = 0; // Correct amount will be found during world bounding box update
     nodesDirty_ = false;
 
@@ -137,7 +141,7 @@ void StaticModelGroup::ProcessRayQuery(const RayOctreeQuery& query, PODVector<Ra
             {
                 distance = M_INFINITY;
 
-                for (unsigned j = 0; j < batches_.Size(); ++j)
+                for (unsigned j = 0; j < geometries_.Size(); ++j)
                 {
                     Geometry* geometry = batches_[j].geometry_;
                     if (geometry)
@@ -175,30 +179,105 @@ void StaticModelGroup::UpdateBatches(const FrameInfo& frame)
     const Matrix3x4& worldTransform = node_->GetWorldTransform();
     distance_ = frame.camera_->GetDistance(worldBoundingBox.Center());
 
-    if (batches_.Size() > 1)
+    unsigned numGeometries = geometries_.Size();
+    for (unsigned i = 0; i < numGeometries; ++i)
     {
-        for (unsigned i = 0; i < batches_.Size(); ++i)
+        float batchDistance = numGeometries > 1 ? frame.camera_->GetDistance(worldTransform * geometryData_[i].center_) :
+            distance_;
+        for (unsigned j = 0; j < numLodLevels_; ++j)
+            batches_[GetLodBatchIndex(i, j)].distance_ = batchDistance;
+    }
+
+    if (!instanceCulling_)
+    {
+        for (unsigned i = 0; i < numGeometries; ++i)
         {
-            batches_[i].distance_ = frame.camera_->GetDistance(worldTransform * geometryData_[i].center_);
             batches_[i].worldTransform_ = numWorldTransforms_ ? &worldTransforms_[0] : &Matrix3x4::IDENTITY;
             batches_[i].numWorldTransforms_ = numWorldTransforms_;
+            for (unsigned j = 1; j < numLodLevels_; ++j)
+                batches_[GetLodBatchIndex(i, j)].numWorldTransforms_ = 0;
+        }
+        numVisibleInstances_ = numWorldTransforms_;
+
+        float scale = worldBoundingBox.Size().DotProduct(DOT_SCALE);
+        float newLodDistance = frame.camera_->GetLodDistance(distance_, scale, frame.GetLodBias(lodBias_));
+
+        if (newLodDistance != lodDistance_ || lodSwitchPending_)
+        {
+            lodDistance_ = newLodDistance;
+            CalculateLodLevels(frame.lodPolicy_);
         }
+        return;
+    }
+
+    // The light threads may update a shadow caster concurrently. The lock serializes them, and only the first culls
+    bool culled;
+    StaticModelInstanceView& view = instanceViews_.Lock(frame, numWorldTransforms_ * numGeometries, batches_.Size(), culled);
+    if (culled)
+    {
+        SetInstanceBatches(view);
+        instanceViews_.Unlock();
+        return;
+    }
+
+    // Cull the instances and find their LOD distances. The shadow batches reuse these lists, so a shadow caster keeps the
+    // instances outside the view frustum and only chooses their LOD
+    const Frustum& frustum = frame.camera_->GetFrustum();
+    const bool frustumCull = !castShadows_;
+    float lodBias = frame.GetLodBias(lodBias_);
+    unsigned numVisible = 0;
+    for (unsigned i = 0; i < numWorldTransforms_; ++i)
+    {
+        const BoundingBox& box = instanceBoxes_[i];
+        if (frustumCull && frustum.IsInsideFast(box) == OUTSIDE)
+            continue;
+
+        float instanceDistance = frame.camera_->GetDistance(box.Center());
+        float scale = box.Size().DotProduct(DOT_SCALE);
+        visibleInstances_[numVisible] = i;
+        visibleLodDistances_[numVisible] = frame.camera_->GetLodDistance(instanceDistance, scale, lodBias);
+        ++numVisible;
     }
-    else if (batches_.Size() == 1)
+    numVisibleInstances_ = numVisible;
+
+    // Compact the surviving transforms per geometry and LOD level so that each level draws as one instanced batch. The
+    // transforms are stored in batch order
+    for (unsigned i = 0; i < batches_.Size(); ++i)
+        view.batchCounts_[i] = 0;
+
+    for (unsigned i = 0; i < numGeometries; ++i)
     {
-        batches_[0].distance_ = distance_;
-        batches_[0].worldTransform_ = numWorldTransforms_ ? &worldTransforms_[0] : &Matrix3x4::IDENTITY;
-        batches_[0].numWorldTransforms_ = numWorldTransforms_;
+        for (unsigned j = 0; j < numVisible; ++j)
+            ++view.batchCounts_[GetLodBatchIndex(i, GetLodLevel(i, visibleLodDistances_[j]))];
     }
 
-    float scale = worldBoundingBox.Size().DotProduct(DOT_SCALE);
-    float newLodDistance = frame.camera_->GetLodDistance(distance_, scale, lodBias_);
+    unsigned offset = 0;
+    for (unsigned i = 0; i < batches_.Size(); ++i)
+    {
+        batchOffsets_[i] = offset;
+        offset += view.batchCounts_[i];
+    }
 
-    if (newLodDistance != lodDistance_)
+    Matrix3x4* dest = view.transforms_.Get();
+    for (unsigned i = 0; i < numGeometries; ++i)
     {
-        lodDistance_ = newLodDistance;
-        CalculateLodLevels();
+        for (unsigned j = 0; j < numVisible; ++j)
+        {
+            unsigned batchIndex = GetLodBatchIndex(i, GetLodLevel(i, visibleLodDistances_[j]));
+            dest[batchOffsets_[batchIndex]++] = worldTransforms_[visibleInstances_[j]];
+        }
     }
+
+    SetInstanceBatches(view);
+    instanceViews_.Unlock();
+}
+
+void StaticModelGroup::SetModel(Model* model)
+{
+    StaticModel::SetModel(model);
+    UpdateLodBatches();
+    batchOffsets_.Resize(batches_.Size());
+    UpdateInstanceBuffers();
 }
 
 unsigned StaticModelGroup::GetNumOccluderTriangles()
@@ -315,6 +394,35 @@ void StaticModelGroup::RemoveAllInstanceNodes()
     UpdateNumTransforms();
 }
 
+void StaticModelGroup::SetInstanceCulling(bool enable)
+{
+    if (enable == instanceCulling_)
+        return;
+
+    instanceCulling_ = enable;
+
+    // Return to the LOD levels chosen for the whole group on the next update
+    if (!instanceCulling_)
+    {
+        ResetLodLevels();
+        for (unsigned i = 0; i < geometries_.Size(); ++i)
+        {
+            for (unsigned j = 1; j < numLodLevels_; ++j)
+                batches_[GetLodBatchIndex(i, j)].numWorldTransforms_ = 0;
+        }
+    }
+    else
+    {
+        for (unsigned i = 0; i < geometries_.Size(); ++i)
+        {
+            batches_[i].geometry_ = geometries_[i][0];
+            geometryData_[i].lodLevel_ = 0;
+        }
+    }
+
+    MarkNetworkUpdate();
+}
+
 Node* StaticModelGroup::GetInstanceNode(unsigned index) const
 {
     return index < instanceNodes_.Size() ? instanceNodes_[index] : nullptr;
@@ -381,8 +489,10 @@ void StaticModelGroup::OnWorldBoundingBoxUpdate()
             continue;
 
         const Matrix3x4& worldTransform = node->GetWorldTransform();
-        worldTransforms_[index++] = worldTransform;
-        worldBox.Merge(boundingBox_.Transformed(worldTransform));
+        BoundingBox instanceBox = boundingBox_.Transformed(worldTransform);
+        worldTransforms_[index] = worldTransform;
+        instanceBoxes_[index++] = instanceBox;
+        worldBox.Merge(instanceBox);
     }
 
     worldBoundingBox_ = worldBox;
@@ -394,7 +504,7 @@ void StaticModelGroup::OnWorldBoundingBoxUpdate()
 
 void StaticModelGroup::UpdateNumTransforms()
 {
-    worldTransforms_.Resize(instanceNodes_.Size());
+    UpdateInstanceBuffers();
     numWorldTransforms_ = 0; // Correct amount will be during world bounding box update
     nodeIDsDirty_ = true;
 
@@ -418,4 +528,13 @@ void StaticModelGroup::UpdateNodeIDs() const
     nodeIDsDirty_ = false;
 }
 
+void StaticModelGroup::UpdateInstanceBuffers()
+{
+    unsigned numInstances = instanceNodes_.Size();
+    worldTransforms_.Resize(numInstances);
+    instanceBoxes_.Resize(numInstances);
+    visibleInstances_.Resize(numInstances);
+    visibleLodDistances_.Resize(numInstances);
+}
+
 }
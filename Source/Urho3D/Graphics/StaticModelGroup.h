@@ -50,6 +50,8 @@ public:
     unsigned GetNumOccluderTriangles() override;
     /// Draw to occlusion buffer. Return true if did not run out of triangles.
     bool DrawOcclusion(OcclusionBuffer* buffer) override;
+    /// Set model.
+    void SetModel(Model* model) override;
 
     /// Add an instance scene node. It does not need any drawable components of its own.
     void AddInstanceNode(Node* node);
@@ -57,12 +59,19 @@ public:
     void RemoveInstanceNode(Node* node);
     /// Remove all instance scene nodes.
     void RemoveAllInstanceNodes();
+    /// Set whether instances are frustum culled and choose their LOD level individually. Shadow casting groups only choose
+    /// the LOD, so that instances outside the view frustum keep their shadows. Default true.
+    void SetInstanceCulling(bool enable);
 
     /// Return number of instance nodes.
     unsigned GetNumInstanceNodes() const { return instanceNodes_.Size(); }
 
     /// Return instance node by index.
     Node* GetInstanceNode(unsigned index) const;
+    /// Return whether instances are culled and LOD'ed individually.
+    bool GetInstanceCulling() const { return instanceCulling_; }
+    /// Return number of instances that passed culling in the last batch update.
+    unsigned GetNumVisibleInstances() const { return numVisibleInstances_; }
 
     /// Set node IDs attribute.
     void SetNodeIDsAttr(const VariantVector& value);
@@ -81,15 +90,31 @@ private:
     void UpdateNumTransforms();
     /// Update node IDs attribute from the actual nodes.
     void UpdateNodeIDs() const;
+    /// Size the per-instance culling buffers for the current instance count. Must be called from the main thread.
+    void UpdateInstanceBuffers();
 
     /// Instance nodes.
     Vector<WeakPtr<Node> > instanceNodes_;
     /// World transforms of valid (existing and visible) instances.
     PODVector<Matrix3x4> worldTransforms_;
+    /// World bounding boxes of valid instances.
+    PODVector<BoundingBox> instanceBoxes_;
+    /// Indices of the instances that passed culling.
+    PODVector<unsigned> visibleInstances_;
+    /// LOD distances of the instances that passed culling.
+    PODVector<float> visibleLodDistances_;
+    /// Start of each batch in the culled transforms during compaction.
+    PODVector<unsigned> batchOffsets_;
+    /// Instance transforms that passed culling per view, compacted per geometry and LOD level.
+    StaticModelInstanceViews instanceViews_;
     /// IDs of instance nodes for serialization.
     mutable VariantVector nodeIDsAttr_;
     /// Number of valid instance node transforms.
     unsigned numWorldTransforms_;
+    /// Number of instances that passed culling.
+    unsigned numVisibleInstances_;
+    /// Per-instance culling and LOD flag.
+    bool instanceCulling_;
     /// Whether node IDs have been set and nodes should be searched for during ApplyAttributes.
     mutable bool nodesDirty_;
     /// Whether nodes have been manipulated by the API and node ID attribute should be refreshed.
@@ -0,0 +1,974 @@
+//
+// Copyright (c) 2017-2020 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+
+#include "../Precompiled.h"
+
+#include "../Container/Sort.h"
+#include "../Core/Context.h"
+#include "../Core/Profiler.h"
+#include "../Core/WorkQueue.h"
+#include "../Graphics/Camera.h"
+#include "../Graphics/DebugRenderer.h"
+#include "../Graphics/Geometry.h"
+#include "../Graphics/IndexBuffer.h"
+#include "../Graphics/Material.h"
+#include "../Graphics/StreamingTerrain.h"
+#include "../Graphics/TileSceneManager.h"
+#include "../Graphics/VertexBuffer.h"
+#include "../IO/File.h"
+#include "../IO/FileSystem.h"
+#include "../IO/Log.h"
+#include "../Resource/ResourceCache.h"
+#include "../Scene/Node.h"
+#include "../Scene/Scene.h"
+#include "../Scene/SceneEvents.h"
+
+#include "../DebugNew.h"
+
+namespace Urho3D
+{
+
+extern const char* GEOMETRY_CATEGORY;
+
+static const int DEFAULT_PAGE_SIZE = 64;
+static const int MIN_PAGE_SIZE = 4;
+static const int MAX_PAGE_SIZE = 128;
+static const Vector2 DEFAULT_SPACING(1.0f, 1.0f);
+static const IntVector2 DEFAULT_ROOT_PAGES(1, 1);
+static const unsigned DEFAULT_NUM_LEVELS = 5;
+static const unsigned MAX_LEVELS = 16;
+static const unsigned DEFAULT_PAGE_CACHE_SIZE = 256;
+static const unsigned DEFAULT_MAX_PAGE_LOADS = 4;
+static const float DEFAULT_HEIGHT_SCALE = 1.0f / 64.0f;
+static const float DEFAULT_MAX_PIXEL_ERROR = 2.0f;
+static const unsigned FLOATS_PER_VERTEX = 12;
+
+/// Return a bordered page height. Coordinates -1 and pageSize + 1 are the border.
+static inline float GetPageHeight(const float* heights, int stride, int x, int z)
+{
+    return heights[(z + 1) * stride + x + 1];
+}
+
+/// Write a page vertex, optionally dropped down for a skirt. Return the next vertex.
+static float* WritePageVertex(float* dest, const float* heights, int stride, int x, int z, const Vector2& step, const Vector2& texCoord,
+    float drop)
+{
+    float baseHeight = GetPageHeight(heights, stride, x, z);
+
+    // Position
+    *dest++ = (float)x * step.x_;
+    *dest++ = baseHeight - drop;
+    *dest++ = (float)z * step.y_;
+
+    // Normal, calculated the same way as Terrain does
+    float nSlope = GetPageHeight(heights, stride, x, z - 1) - baseHeight;
+    float neSlope = GetPageHeight(heights, stride, x + 1, z - 1) - baseHeight;
+    float eSlope = GetPageHeight(heights, stride, x + 1, z) - baseHeight;
+    float seSlope = GetPageHeight(heights, stride, x + 1, z + 1) - baseHeight;
+    float sSlope = GetPageHeight(heights, stride, x, z + 1) - baseHeight;
+    float swSlope = GetPageHeight(heights, stride, x - 1, z + 1) - baseHeight;
+    float wSlope = GetPageHeight(heights, stride, x - 1, z) - baseHeight;
+    float nwSlope = GetPageHeight(heights, stride, x - 1, z - 1) - baseHeight;
+    float up = 0.5f * (step.x_ + step.y_);
+
+    Vector3 normal = (Vector3(0.0f, up, nSlope) +
+        Vector3(-neSlope, up, neSlope) +
+        Vector3(-eSlope, up, 0.0f) +
+        Vector3(-seSlope, up, -seSlope) +
+        Vector3(0.0f, up, -sSlope) +
+        Vector3(swSlope, up, -swSlope) +
+        Vector3(wSlope, up, 0.0f) +
+        Vector3(nwSlope, up, nwSlope)).Normalized();
+    *dest++ = normal.x_;
+    *dest++ = normal.y_;
+    *dest++ = normal.z_;
+
+    // Texture coordinate
+    *dest++ = texCoord.x_;
+    *dest++ = texCoord.y_;
+
+    // Tangent
+    Vector3 xyz = (Vector3::RIGHT - normal * normal.DotProduct(Vector3::RIGHT)).Normalized();
+    *dest++ = xyz.x_;
+    *dest++ = xyz.y_;
+    *dest++ = xyz.z_;
+    *dest++ = 1.0f;
+
+    return dest;
+}
+
+static bool CompareRequests(const StreamingTerrainRequest& lhs, const StreamingTerrainRequest& rhs)
+{
+    return lhs.priority_ > rhs.priority_;
+}
+
+void LoadTerrainPageWork(const WorkItem* item, unsigned threadIndex)
+{
+    auto* terrain = reinterpret_cast<StreamingTerrain*>(item->aux_);
+    auto* page = reinterpret_cast<StreamingTerrainPage*>(item->start_);
+    int pageSize = terrain->pageSize_;
+
+    page->loaded_ = page->source_->LoadPage(page->level_, page->position_, pageSize, page->heights_) &&
+        page->heights_.Size() == (unsigned)((pageSize + 3) * (pageSize + 3));
+    if (page->loaded_)
+        terrain->BuildPageData(*page);
+}
+
+FileTerrainPageSource::FileTerrainPageSource(Context* context, const String& directory, float heightScale) :
+    context_(context),
+    directory_(AddTrailingSlash(directory)),
+    heightScale_(heightScale)
+{
+}
+
+bool FileTerrainPageSource::LoadPage(unsigned level, const IntVector2& page, int pageSize, PODVector<float>& heights)
+{
+    auto* cache = context_ ? context_->GetSubsystem<ResourceCache>() : nullptr;
+    if (!cache)
+        return false;
+
+    SharedPtr<File> file = cache->GetFile(GetPageFileName(directory_, level, page), false);
+    if (!file)
+        return false;
+
+    auto numHeights = (unsigned)((pageSize + 3) * (pageSize + 3));
+    if (file->GetSize() != numHeights * sizeof(unsigned short))
+    {
+        URHO3D_LOGERROR("Terrain page " + file->GetName() + " does not match the page size " + String(pageSize));
+        return false;
+    }
+
+    PODVector<unsigned short> data(numHeights);
+    file->Read(&data[0], numHeights * sizeof(unsigned short));
+
+    heights.Resize(numHeights);
+    for (unsigned i = 0; i < numHeights; ++i)
+        heights[i] = (float)data[i] * heightScale_;
+
+    return true;
+}
+
+bool FileTerrainPageSource::SavePage(Context* context, const String& directory, unsigned level, const IntVector2& page,
+    const PODVector<float>& heights, float heightScale)
+{
+    if (heights.Empty() || heightScale <= 0.0f)
+        return false;
+
+    File file(context, GetPageFileName(AddTrailingSlash(directory), level, page), FILE_WRITE);
+    if (!file.IsOpen())
+        return false;
+
+    PODVector<unsigned short> data(heights.Size());
+    for (unsigned i = 0; i < heights.Size(); ++i)
+        data[i] = (unsigned short)Clamp(RoundToInt(heights[i] / heightScale), 0, 65535);
+
+    return file.Write(&data[0], data.Size() * sizeof(unsigned short)) == data.Size() * sizeof(unsigned short);
+}
+
+String FileTerrainPageSource::GetPageFileName(const String& directory, unsigned level, const IntVector2& page)
+{
+    return directory + String(level) + "_" + String(page.x_) + "_" + String(page.y_) + ".hgt";
+}
+
+StreamingTerrainPage::StreamingTerrainPage(unsigned level, const IntVector2& position) :
+    level_(level),
+    position_(position),
+    error_(0.0f),
+    lastUsedFrame_(0),
+    loaded_(false)
+{
+}
+
+StreamingTerrain::StreamingTerrain(Context* context) :
+    Drawable(context, DRAWABLE_GEOMETRY),
+    indexBuffer_(new IndexBuffer(context)),
+    spacing_(DEFAULT_SPACING),
+    rootPages_(DEFAULT_ROOT_PAGES),
+    pageSize_(DEFAULT_PAGE_SIZE),
+    numLevels_(DEFAULT_NUM_LEVELS),
+    pageCacheSize_(DEFAULT_PAGE_CACHE_SIZE),
+    maxPageLoads_(DEFAULT_MAX_PAGE_LOADS),
+    numLoadingPages_(0),
+    cellLevel_(M_MAX_UNSIGNED),
+    heightScale_(DEFAULT_HEIGHT_SCALE),
+    maxPixelError_(DEFAULT_MAX_PIXEL_ERROR),
+    totalLoadLatency_(0),
+    maxLoadLatency_(0),
+    numLoads_(0),
+    pagesDirty_(true),
+    customSource_(false),
+    subscribed_(false)
+{
+    indexBuffer_->SetShadowed(true);
+}
+
+StreamingTerrain::~StreamingTerrain()
+{
+    AbortLoads();
+}
+
+void StreamingTerrain::RegisterObject(Context* context)
+{
+    context->RegisterFactory<StreamingTerrain>(GEOMETRY_CATEGORY);
+
+    URHO3D_ACCESSOR_ATTRIBUTE("Is Enabled", IsEnabled, SetEnabled, bool, true, AM_DEFAULT);
+    URHO3D_MIXED_ACCESSOR_ATTRIBUTE("Material", GetMaterialAttr, SetMaterialAttr, ResourceRef, ResourceRef(Material::GetTypeStatic()),
+        AM_DEFAULT);
+    URHO3D_ACCESSOR_ATTRIBUTE("Page Directory", GetPageDirectory, SetPageDirectory, String, String::EMPTY, AM_DEFAULT);
+    URHO3D_ACCESSOR_ATTRIBUTE("Height Scale", GetHeightScale, SetHeightScale, float, DEFAULT_HEIGHT_SCALE, AM_DEFAULT);
+    URHO3D_ACCESSOR_ATTRIBUTE("Page Size", GetPageSize, SetPageSize, int, DEFAULT_PAGE_SIZE, AM_DEFAULT);
+    URHO3D_ACCESSOR_ATTRIBUTE("Vertex Spacing", GetSpacing, SetSpacing, Vector2, DEFAULT_SPACING, AM_DEFAULT);
+    URHO3D_ACCESSOR_ATTRIBUTE("Levels", GetNumLevels, SetNumLevels, unsigned, DEFAULT_NUM_LEVELS, AM_DEFAULT);
+    URHO3D_ACCESSOR_ATTRIBUTE("Root Pages", GetRootPages, SetRootPages, IntVector2, DEFAULT_ROOT_PAGES, AM_DEFAULT);
+    URHO3D_ACCESSOR_ATTRIBUTE("Page Cache Size", GetPageCacheSize, SetPageCacheSize, unsigned, DEFAULT_PAGE_CACHE_SIZE, AM_DEFAULT);
+    URHO3D_ACCESSOR_ATTRIBUTE("Max Page Loads", GetMaxPageLoads, SetMaxPageLoads, unsigned, DEFAULT_MAX_PAGE_LOADS, AM_DEFAULT);
+    URHO3D_ACCESSOR_ATTRIBUTE("Max Pixel Error", GetMaxPixelError, SetMaxPixelError, float, DEFAULT_MAX_PIXEL_ERROR, AM_DEFAULT);
+    URHO3D_COPY_BASE_ATTRIBUTES(Drawable);
+}
+
+void StreamingTerrain::ApplyAttributes()
+{
+    if (pagesDirty_)
+        ResetPages();
+}
+
+void StreamingTerrain::OnSetEnabled()
+{
+    Drawable::OnSetEnabled();
+
+    UpdateEventSubscription();
+}
+
+void StreamingTerrain::UpdateBatches(const FrameInfo& frame)
+{
+    distance_ = frame.camera_->GetDistance(GetWorldBoundingBox().Center());
+    batches_.Clear();
+
+    if (pagesDirty_ || !indexBuffer_->GetIndexCount())
+        return;
+
+    // Select in the terrain's local space. Errors and distances scale alike, so a uniform node scale does not affect the selection
+    Vector3 cameraPos = node_->GetWorldTransform().Inverse() * frame.camera_->GetNode()->GetWorldPosition();
+    float errorScale = (float)frame.viewSize_.y_ / (2.0f * frame.camera_->GetHalfViewSize());
+    unsigned rootLevel = numLevels_ - 1;
+
+    for (int z = 0; z < rootPages_.y_; ++z)
+    {
+        for (int x = 0; x < rootPages_.x_; ++x)
+        {
+            StreamingTerrainPage* page = GetResidentPage(rootLevel, IntVector2(x, z));
+            if (page)
+                SelectPage(page, frame, cameraPos, errorScale);
+        }
+    }
+}
+
+void StreamingTerrain::DrawDebugGeometry(DebugRenderer* debug, bool depthTest)
+{
+    if (!debug || !node_ || !IsEnabledEffective())
+        return;
+
+    const Matrix3x4& worldTransform = node_->GetWorldTransform();
+
+    for (HashMap<unsigned long long, SharedPtr<StreamingTerrainPage> >::ConstIterator i = pages_.Begin(); i != pages_.End(); ++i)
+    {
+        StreamingTerrainPage* page = i->second_;
+        if (!page->geometry_)
+            continue;
+
+        Vector2 size = GetPageWorldSize(page->level_);
+        Vector3 offset((float)page->position_.x_ * size.x_, 0.0f, (float)page->position_.y_ * size.y_);
+        float t = numLevels_ > 1 ? (float)page->level_ / (float)(numLevels_ - 1) : 0.0f;
+        debug->AddBoundingBox(BoundingBox(page->boundingBox_.min_ + offset, page->boundingBox_.max_ + offset), worldTransform,
+            Color::GREEN.Lerp(Color::RED, t), depthTest);
+    }
+}
+
+void StreamingTerrain::SetPageSource(TerrainPageSource* source)
+{
+    source_ = source;
+    customSource_ = source != nullptr;
+    MarkPagesDirty();
+}
+
+void StreamingTerrain::SetPageDirectory(const String& directory)
+{
+    pageDirectory_ = directory;
+    MarkPagesDirty();
+    MarkNetworkUpdate();
+}
+
+void StreamingTerrain::SetHeightScale(float scale)
+{
+    heightScale_ = Max(scale, M_EPSILON);
+    MarkPagesDirty();
+    MarkNetworkUpdate();
+}
+
+void StreamingTerrain::SetPageSize(int size)
+{
+    if (size < MIN_PAGE_SIZE || size > MAX_PAGE_SIZE || !IsPowerOfTwo((unsigned)size))
+        return;
+
+    pageSize_ = size;
+    MarkPagesDirty();
+    MarkNetworkUpdate();
+}
+
+void StreamingTerrain::SetSpacing(const Vector2& spacing)
+{
+    spacing_ = Vector2(Max(spacing.x_, M_EPSILON), Max(spacing.y_, M_EPSILON));
+    MarkPagesDirty();
+    MarkNetworkUpdate();
+}
+
+void StreamingTerrain::SetNumLevels(unsigned levels)
+{
+    numLevels_ = Clamp(levels, 1U, MAX_LEVELS);
+    MarkPagesDirty();
+    MarkNetworkUpdate();
+}
+
+void StreamingTerrain::SetRootPages(const IntVector2& pages)
+{
+    rootPages_ = IntVector2(Max(pages.x_, 1), Max(pages.y_, 1));
+    MarkPagesDirty();
+    MarkNetworkUpdate();
+}
+
+void StreamingTerrain::SetPageCacheSize(unsigned pages)
+{
+    pageCacheSize_ = pages;
+    MarkNetworkUpdate();
+}
+
+void StreamingTerrain::SetMaxPageLoads(unsigned loads)
+{
+    maxPageLoads_ = Max(loads, 1U);
+    MarkNetworkUpdate();
+}
+
+void StreamingTerrain::SetMaxPixelError(float error)
+{
+    maxPixelError_ = Max(error, M_EPSILON);
+    MarkNetworkUpdate();
+}
+
+void StreamingTerrain::SetMaterial(Material* material)
+{
+    material_ = material;
+    for (unsigned i = 0; i < batches_.Size(); ++i)
+        batches_[i].material_ = material;
+
+    MarkNetworkUpdate();
+}
+
+Material* StreamingTerrain::GetMaterial() const
+{
+    return material_;
+}
+
+Vector2 StreamingTerrain::GetPageWorldSize(unsigned level) const
+{
+    return spacing_ * (float)(pageSize_ << level);
+}
+
+float StreamingTerrain::GetHeight(const Vector3& worldPosition) const
+{
+    if (!node_ || pagesDirty_)
+        return 0.0f;
+
+    Vector3 position = node_->GetWorldTransform().Inverse() * worldPosition;
+
+    // Descend from the coarsest level while the pages are resident
+    StreamingTerrainPage* page = nullptr;
+    for (int level = numLevels_ - 1; level >= 0; --level)
+    {
+        Vector2 size = GetPageWorldSize((unsigned)level);
+        StreamingTerrainPage* child = GetResidentPage((unsigned)level,
+            IntVector2(FloorToInt(position.x_ / size.x_), FloorToInt(position.z_ / size.y_)));
+        if (!child)
+            break;
+        page = child;
+    }
+
+    if (!page)
+        return 0.0f;
+
+    Vector2 size = GetPageWorldSize(page->level_);
+    Vector2 step = spacing_ * (float)(1 << page->level_);
+    float xPos = (position.x_ - (float)page->position_.x_ * size.x_) / step.x_;
+    float zPos = (position.z_ - (float)page->position_.y_ * size.y_) / step.y_;
+    int xIndex = Clamp(FloorToInt(xPos), 0, pageSize_ - 1);
+    int zIndex = Clamp(FloorToInt(zPos), 0, pageSize_ - 1);
+    float xFrac = Clamp(xPos - (float)xIndex, 0.0f, 1.0f);
+    float zFrac = Clamp(zPos - (float)zIndex, 0.0f, 1.0f);
+
+    const float* heights = &page->heights_[0];
+    int stride = pageSize_ + 3;
+    float h1 = Lerp(GetPageHeight(heights, stride, xIndex, zIndex), GetPageHeight(heights, stride, xIndex + 1, zIndex), xFrac);
+    float h2 = Lerp(GetPageHeight(heights, stride, xIndex, zIndex + 1), GetPageHeight(heights, stride, xIndex + 1, zIndex + 1), xFrac);
+    position.y_ = Lerp(h1, h2, zFrac);
+
+    return (node_->GetWorldTransform() * position).y_;
+}
+
+unsigned StreamingTerrain::GetMemoryUse() const
+{
+    unsigned memoryUse = indexBuffer_->GetIndexCount() * indexBuffer_->GetIndexSize();
+
+    for (HashMap<unsigned long long, SharedPtr<StreamingTerrainPage> >::ConstIterator i = pages_.Begin(); i != pages_.End(); ++i)
+    {
+        StreamingTerrainPage* page = i->second_;
+        memoryUse += sizeof(StreamingTerrainPage) + (page->heights_.Capacity() + page->vertexData_.Capacity()) * sizeof(float);
+        if (page->vertexBuffer_)
+            memoryUse += page->vertexBuffer_->GetVertexCount() * page->vertexBuffer_->GetVertexSize();
+    }
+
+    return memoryUse;
+}
+
+void StreamingTerrain::SetMaterialAttr(const ResourceRef& value)
+{
+    auto* cache = GetSubsystem<ResourceCache>();
+    SetMaterial(cache->GetResource<Material>(value.name_));
+}
+
+ResourceRef StreamingTerrain::GetMaterialAttr() const
+{
+    return GetResourceRef(material_, Material::GetTypeStatic());
+}
+
+void StreamingTerrain::OnSceneSet(Scene* scene)
+{
+    Drawable::OnSceneSet(scene);
+
+    if (scene)
+    {
+        UpdateTileManager();
+        UpdateEventSubscription();
+    }
+    else if (subscribed_)
+    {
+        UnsubscribeFromEvent(E_SCENEPOSTUPDATE);
+        subscribed_ = false;
+    }
+}
+
+void StreamingTerrain::OnWorldBoundingBoxUpdate()
+{
+    worldBoundingBox_ = boundingBox_.Transformed(node_->GetWorldTransform());
+}
+
+unsigned long long StreamingTerrain::GetPageKey(unsigned level, const IntVector2& position)
+{
+    return ((unsigned long long)level << 56u) | ((unsigned long long)(position.x_ & 0xfffffff) << 28u) |
+        (unsigned long long)(position.y_ & 0xfffffff);
+}
+
+StreamingTerrainPage* StreamingTerrain::GetResidentPage(unsigned level, const IntVector2& position) const
+{
+    HashMap<unsigned long long, SharedPtr<StreamingTerrainPage> >::ConstIterator i = pages_.Find(GetPageKey(level, position));
+    return i != pages_.End() && i->second_->geometry_ ? i->second_.Get() : nullptr;
+}
+
+void StreamingTerrain::SelectPage(StreamingTerrainPage* page, const FrameInfo& frame, const Vector3& cameraPos, float errorScale)
+{
+    page->lastUsedFrame_ = frame.frameNumber_;
+
+    Vector2 size = GetPageWorldSize(page->level_);
+    Vector3 offset((float)page->position_.x_ * size.x_, 0.0f, (float)page->position_.y_ * size.y_);
+    BoundingBox box(page->boundingBox_.min_ + offset, page->boundingBox_.max_ + offset);
+
+    float pixelError = page->error_ * errorScale;
+    if (!frame.camera_->IsOrthographic())
+    {
+        Vector3 closest(Clamp(cameraPos.x_, box.min_.x_, box.max_.x_), Clamp(cameraPos.y_, box.min_.y_, box.max_.y_),
+            Clamp(cameraPos.z_, box.min_.z_, box.max_.z_));
+        pixelError /= Max((cameraPos - closest).Length(), M_EPSILON);
+    }
+
+    if (page->level_ > 0 && pixelError > maxPixelError_ && CanRefine(page))
+    {
+        StreamingTerrainPage* children[4];
+        bool complete = true;
+
+        for (unsigned i = 0; i < 4; ++i)
+        {
+            IntVector2 childPos(page->position_.x_ * 2 + (int)(i & 1), page->position_.y_ * 2 + (int)(i >> 1));
+            children[i] = GetResidentPage(page->level_ - 1, childPos);
+            if (!children[i])
+            {
+                complete = false;
+                if (!pages_.Contains(GetPageKey(page->level_ - 1, childPos)))
+                {
+                    StreamingTerrainRequest request;
+                    request.level_ = page->level_ - 1;
+                    request.position_ = childPos;
+                    request.priority_ = pixelError;
+                    requests_.Push(request);
+                }
+            }
+        }
+
+        // Draw the children only when all of them are resident, so that there are no holes
+        if (complete)
+        {
+            for (unsigned i = 0; i < 4; ++i)
+                SelectPage(children[i], frame, cameraPos, errorScale);
+            return;
+        }
+    }
+
+    const Matrix3x4& worldTransform = node_->GetWorldTransform();
+    BoundingBox worldBox = box.Transformed(worldTransform);
+
+    // Shadow casters outside the view must still be drawn into the shadow maps
+    if (!castShadows_ && frame.camera_->GetFrustum().IsInsideFast(worldBox) == OUTSIDE)
+        return;
+
+    page->worldTransform_ = worldTransform * Matrix3x4(offset, Quaternion::IDENTITY, Vector3::ONE);
+
+    SourceBatch batch;
+    batch.distance_ = frame.camera_->GetDistance(worldBox.Center());
+    batch.geometry_ = page->geometry_;
+    batch.material_ = material_;
+    batch.worldTransform_ = &page->worldTransform_;
+    batches_.Push(batch);
+}
+
+void StreamingTerrain::RequestPage(unsigned level, const IntVector2& position)
+{
+    SharedPtr<StreamingTerrainPage> page(new StreamingTerrainPage(level, position));
+    page->source_ = source_;
+    pages_[GetPageKey(level, position)] = page;
+    ++numLoadingPages_;
+
+    // Use an unpooled item so that it is not recycled while the page is loading
+    page->loadItem_ = new WorkItem();
+    page->loadItem_->workFunction_ = LoadTerrainPageWork;
+    page->loadItem_->aux_ = this;
+    page->loadItem_->start_ = page.Get();
+    page->loadItem_->priority_ = 0;
+
+    auto* queue = GetSubsystem<WorkQueue>();
+    if (queue)
+        queue->AddWorkItem(page->loadItem_);
+    else
+    {
+        LoadTerrainPageWork(page->loadItem_, 0);
+        page->loadItem_->completed_ = true;
+    }
+}
+
+void StreamingTerrain::BuildPageData(StreamingTerrainPage& page) const
+{
+    int size = pageSize_;
+    int stride = size + 3;
+    const float* heights = &page.heights_[0];
+    Vector2 step = spacing_ * (float)(1 << page.level_);
+
+    // Estimate the error of drawing this page instead of its children from the error of halving its own resolution
+    float minHeight = M_INFINITY;
+    float maxHeight = -M_INFINITY;
+    float error = 0.0f;
+
+    for (int z = 0; z <= size; ++z)
+    {
+        for (int x = 0; x <= size; ++x)
+        {
+            float height = GetPageHeight(heights, stride, x, z);
+            minHeight = Min(minHeight, height);
+            maxHeight = Max(maxHeight, height);
+
+            if ((x | z) & 1)
+            {
+                int x0 = x & ~1;
+                int z0 = z & ~1;
+                int x1 = x0 + (x & 1) * 2;
+                int z1 = z0 + (z & 1) * 2;
+                float halfHeight = 0.25f * (GetPageHeight(heights, stride, x0, z0) + GetPageHeight(heights, stride, x1, z0) +
+                    GetPageHeight(heights, stride, x0, z1) + GetPageHeight(heights, stride, x1, z1));
+                error = Max(error, Abs(height - halfHeight));
+            }
+        }
+    }
+
+    if (page.level_ > 0)
+        page.error_ = Max(error, 0.25f * (step.x_ + step.y_));
+
+    // Skirts hide the cracks towards coarser neighbors
+    float skirtDepth = 2.0f * page.error_ + 0.5f * (step.x_ + step.y_);
+    page.boundingBox_ = BoundingBox(Vector3(0.0f, minHeight - skirtDepth, 0.0f), Vector3((float)size * step.x_, maxHeight,
+        (float)size * step.y_));
+
+    auto row = (unsigned)(size + 1);
+    float levelQuads = (float)(size << (numLevels_ - 1 - page.level_));
+    Vector2 texCoordScale(1.0f / ((float)rootPages_.x_ * levelQuads), 1.0f / ((float)rootPages_.y_ * levelQuads));
+    int originX = page.position_.x_ * size;
+    int originZ = page.position_.y_ * size;
+
+    page.vertexData_.Resize((row * row + 4 * row) * FLOATS_PER_VERTEX);
+    float* dest = &page.vertexData_[0];
+
+    for (int z = 0; z <= size; ++z)
+    {
+        for (int x = 0; x <= size; ++x)
+        {
+            Vector2 texCoord((float)(originX + x) * texCoordScale.x_, 1.0f - (float)(originZ + z) * texCoordScale.y_);
+            dest = WritePageVertex(dest, heights, stride, x, z, step, texCoord, 0.0f);
+        }
+    }
+
+    // Skirts in south, north, west, east order
+    for (unsigned edge = 0; edge < 4; ++edge)
+    {
+        for (int i = 0; i <= size; ++i)
+        {
+            int x = edge < 2 ? i : (edge == 2 ? 0 : size);
+            int z = edge < 2 ? (edge == 0 ? 0 : size) : i;
+            Vector2 texCoord((float)(originX + x) * texCoordScale.x_, 1.0f - (float)(originZ + z) * texCoordScale.y_);
+            dest = WritePageVertex(dest, heights, stride, x, z, step, texCoord, skirtDepth);
+        }
+    }
+}
+
+void StreamingTerrain::CreatePageGeometry(StreamingTerrainPage* page)
+{
+    auto row = (unsigned)(pageSize_ + 1);
+
+    page->vertexBuffer_ = new VertexBuffer(context_);
+    page->vertexBuffer_->SetSize(row * row + 4 * row, MASK_POSITION | MASK_NORMAL | MASK_TEXCOORD1 | MASK_TANGENT);
+    page->vertexBuffer_->SetData(&page->vertexData_[0]);
+
+    page->geometry_ = new Geometry(context_);
+    page->geometry_->SetVertexBuffer(0, page->vertexBuffer_);
+    page->geometry_->SetIndexBuffer(indexBuffer_);
+    page->geometry_->SetDrawRange(TRIANGLE_LIST, 0, indexBuffer_->GetIndexCount(), false);
+
+    // The staging data is no longer needed
+    PODVector<float>().Swap(page->vertexData_);
+}
+
+void StreamingTerrain::CreateIndexData()
+{
+    PODVector<unsigned short> indices;
+    auto row = (unsigned)(pageSize_ + 1);
+    auto size = (unsigned)pageSize_;
+
+    for (unsigned z = 0; z < size; ++z)
+    {
+        for (unsigned x = 0; x < size; ++x)
+        {
+            indices.Push((unsigned short)((z + 1) * row + x));
+            indices.Push((unsigned short)(z * row + x + 1));
+            indices.Push((unsigned short)(z * row + x));
+            indices.Push((unsigned short)((z + 1) * row + x));
+            indices.Push((unsigned short)((z + 1) * row + x + 1));
+            indices.Push((unsigned short)(z * row + x + 1));
+        }
+    }
+
+    // Skirts, facing outwards. Each edge runs from its own grid vertices down to the dropped copies after the grid
+    const unsigned edgeVertices[4][2] = { { 0, 1 }, { size * row, 1 }, { 0, row }, { size, row } };
+    for (unsigned edge = 0; edge < 4; ++edge)
+    {
+        unsigned top = edgeVertices[edge][0];
+        unsigned topStep = edgeVertices[edge][1];
+        unsigned bottom = row * row + edge * row;
+        // Along the south and east edges the vertex order runs left to right as seen from outside
+        bool leftToRight = edge == 0 || edge == 3;
+
+        for (unsigned i = 0; i < size; ++i)
+        {
+            auto t0 = (unsigned short)(top + i * topStep);
+            auto t1 = (unsigned short)(top + (i + 1) * topStep);
+            auto b0 = (unsigned short)(bottom + i);
+            auto b1 = (unsigned short)(bottom + i + 1);
+
+            if (leftToRight)
+            {
+                indices.Push(t0);
+                indices.Push(t1);
+                indices.Push(b0);
+                indices.Push(t1);
+                indices.Push(b1);
+                indices.Push(b0);
+            }
+            else
+            {
+                indices.Push(t0);
+                indices.Push(b0);
+                indices.Push(t1);
+                indices.Push(t1);
+                indices.Push(b0);
+                indices.Push(b1);
+            }
+        }
+    }
+
+    indexBuffer_->SetSize(indices.Size(), false);
+    indexBuffer_->SetData(&indices[0]);
+}
+
+unsigned StreamingTerrain::EvictPages(unsigned numNewPages)
+{
+    unsigned rootLevel = numLevels_ - 1;
+    unsigned frameNumber = GetSubsystem<Time>()->GetFrameNumber();
+    unsigned numCached = 0;
+
+    // Least recently used first. Pages that were missing from the source do not count, as they hold no data
+    PODVector<Pair<unsigned, unsigned long long> > candidates;
+    for (HashMap<unsigned long long, SharedPtr<StreamingTerrainPage> >::ConstIterator i = pages_.Begin(); i != pages_.End(); ++i)
+    {
+        StreamingTerrainPage* page = i->second_;
+        if (page->level_ == rootLevel || (!page->loaded_ && !page->loadItem_))
+            continue;
+
+        ++numCached;
+        // Pages used on the previous frame may be drawn again before the next selection
+        if (!page->loadItem_ && page->lastUsedFrame_ + 1 < frameNumber)
+            candidates.Push(MakePair(page->lastUsedFrame_, i->first_));
+    }
+
+    if (numCached + numNewPages <= pageCacheSize_)
+        return numNewPages;
+
+    unsigned numEvict = Min(numCached + numNewPages - pageCacheSize_, candidates.Size());
+    if (numEvict)
+    {
+        Sort(candidates.Begin(), candidates.End());
+        for (unsigned i = 0; i < numEvict; ++i)
+            pages_.Erase(candidates[i].second_);
+
+        // The batches may refer to the evicted pages
+        batches_.Clear();
+    }
+
+    numCached -= numEvict;
+    return numCached < pageCacheSize_ ? Min(pageCacheSize_ - numCached, numNewPages) : 0;
+}
+
+void StreamingTerrain::AbortLoads()
+{
+    if (!numLoadingPages_)
+        return;
+
+    // The work items point to the pages, so wait for any that have already started
+    auto* queue = GetSubsystem<WorkQueue>();
+    for (HashMap<unsigned long long, SharedPtr<StreamingTerrainPage> >::Iterator i = pages_.Begin(); i != pages_.End(); ++i)
+    {
+        WorkItem* item = i->second_->loadItem_;
+        if (item && queue && !queue->RemoveWorkItem(i->second_->loadItem_))
+        {
+            while (!item->completed_)
+                Time::Sleep(0);
+        }
+    }
+
+    numLoadingPages_ = 0;
+}
+
+void StreamingTerrain::ResetPages()
+{
+    AbortLoads();
+
+    pages_.Clear();
+    requests_.Clear();
+    batches_.Clear();
+    pagesDirty_ = false;
+
+    if (!customSource_)
+        source_ = pageDirectory_.Empty() ? nullptr : new FileTerrainPageSource(context_, pageDirectory_, heightScale_);
+
+    CreateIndexData();
+    UpdateTileManager();
+    UpdateBoundingBox();
+}
+
+void StreamingTerrain::UpdateBoundingBox()
+{
+    unsigned rootLevel = numLevels_ - 1;
+    Vector2 size = GetPageWorldSize(rootLevel);
+    float minHeight = 0.0f;
+    float maxHeight = 0.0f;
+    bool first = true;
+
+    for (int z = 0; z < rootPages_.y_; ++z)
+    {
+        for (int x = 0; x < rootPages_.x_; ++x)
+        {
+            StreamingTerrainPage* page = GetResidentPage(rootLevel, IntVector2(x, z));
+            if (!page)
+                continue;
+
+            minHeight = first ? page->boundingBox_.min_.y_ : Min(minHeight, page->boundingBox_.min_.y_);
+            maxHeight = first ? page->boundingBox_.max_.y_ : Max(maxHeight, page->boundingBox_.max_.y_);
+            first = false;
+        }
+    }
+
+    boundingBox_ = BoundingBox(Vector3(0.0f, minHeight, 0.0f), Vector3((float)rootPages_.x_ * size.x_, maxHeight,
+        (float)rootPages_.y_ * size.y_));
+    if (node_)
+        OnMarkedDirty(node_);
+}
+
+void StreamingTerrain::UpdateTileManager()
+{
+    Scene* scene = GetScene();
+    tileManager_ = scene ? scene->GetComponent<TileSceneManager>() : nullptr;
+    cellLevel_ = M_MAX_UNSIGNED;
+
+    if (!tileManager_)
+        return;
+
+    float cellSize = tileManager_->GetCellSize();
+    for (unsigned i = 0; i < numLevels_; ++i)
+    {
+        Vector2 size = GetPageWorldSize(i);
+        if (Equals(size.x_, cellSize) && Equals(size.y_, cellSize))
+        {
+            cellLevel_ = i;
+            break;
+        }
+    }
+
+    if (cellLevel_ == M_MAX_UNSIGNED)
+        URHO3D_LOGWARNING("Streaming terrain pages do not match the tile scene manager cells, page loading will not follow the cells");
+}
+
+bool StreamingTerrain::CanRefine(StreamingTerrainPage* page) const
+{
+    // Pages finer than a cell are only loaded for the cells the tile manager has streamed in
+    if (!tileManager_ || page->level_ > cellLevel_)
+        return true;
+
+    Vector2 size = GetPageWorldSize(page->level_);
+    Vector3 center(((float)page->position_.x_ + 0.5f) * size.x_, 0.0f, ((float)page->position_.y_ + 0.5f) * size.y_);
+    return tileManager_->IsCellInRange(tileManager_->GetCellIndex(node_->GetWorldTransform() * center));
+}
+
+void StreamingTerrain::UpdateEventSubscription()
+{
+    Scene* scene = GetScene();
+    if (!scene)
+        return;
+
+    bool enabled = IsEnabledEffective();
+
+    if (enabled && !subscribed_)
+    {
+        SubscribeToEvent(scene, E_SCENEPOSTUPDATE, URHO3D_HANDLER(StreamingTerrain, HandleScenePostUpdate));
+        subscribed_ = true;
+    }
+    else if (!enabled && subscribed_)
+    {
+        UnsubscribeFromEvent(scene, E_SCENEPOSTUPDATE);
+        subscribed_ = false;
+    }
+}
+
+void StreamingTerrain::HandleScenePostUpdate(StringHash eventType, VariantMap& eventData)
+{
+    if (pagesDirty_)
+        ResetPages();
+
+    if (!source_)
+        return;
+
+    URHO3D_PROFILE(UpdateStreamingTerrain);
+
+    unsigned rootLevel = numLevels_ - 1;
+    bool rootsChanged = false;
+
+    // Upload the finished loads in the main thread, and drop pages whose GPU data was lost so that they load again
+    for (HashMap<unsigned long long, SharedPtr<StreamingTerrainPage> >::Iterator i = pages_.Begin(); i != pages_.End();)
+    {
+        StreamingTerrainPage* page = i->second_;
+
+        if (page->loadItem_ && page->loadItem_->completed_)
+        {
+            page->loadItem_.Reset();
+            --numLoadingPages_;
+
+            if (page->loaded_)
+            {
+                CreatePageGeometry(page);
+
+                long long latency = page->loadTimer_.GetUSec(false);
+                totalLoadLatency_ += latency;
+                maxLoadLatency_ = Max(maxLoadLatency_, latency);
+                ++numLoads_;
+                rootsChanged |= page->level_ == rootLevel;
+            }
+            else
+                URHO3D_LOGWARNING("Streaming terrain page " + String(page->level_) + " " + page->position_.ToString() + " is missing");
+        }
+        else if (page->vertexBuffer_ && page->vertexBuffer_->IsDataLost())
+        {
+            i = pages_.Erase(i);
+            batches_.Clear();
+            rootsChanged = true;
+            continue;
+        }
+
+        ++i;
+    }
+
+    // The coarsest level is always resident
+    for (int z = 0; z < rootPages_.y_; ++z)
+    {
+        for (int x = 0; x < rootPages_.x_; ++x)
+        {
+            if (!pages_.Contains(GetPageKey(rootLevel, IntVector2(x, z))))
+                RequestPage(rootLevel, IntVector2(x, z));
+        }
+    }
+
+    // Start loading the pages with the largest screen-space error first
+    if (!requests_.Empty())
+    {
+        Sort(requests_.Begin(), requests_.End(), CompareRequests);
+
+        unsigned numFreeLoads = maxPageLoads_ > numLoadingPages_ ? maxPageLoads_ - numLoadingPages_ : 0;
+        unsigned numSlots = numFreeLoads ? EvictPages(Min(numFreeLoads, requests_.Size())) : 0;
+
+        for (unsigned i = 0; i < requests_.Size() && numSlots; ++i)
+        {
+            const StreamingTerrainRequest& request = requests_[i];
+            if (!pages_.Contains(GetPageKey(request.level_, request.position_)))
+            {
+                RequestPage(request.level_, request.position_);
+                --numSlots;
+            }
+        }
+
+        requests_.Clear();
+    }
+
+    if (rootsChanged)
+        UpdateBoundingBox();
+}
+
+}
@@ -0,0 +1,319 @@
+//
+// Copyright (c) 2017-2020 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+
+#pragma once
+
+#include "../Container/HashMap.h"
+#include "../Core/Timer.h"
+#include "../Graphics/Drawable.h"
+
+namespace Urho3D
+{
+
+class Geometry;
+class IndexBuffer;
+class Material;
+class TileSceneManager;
+class VertexBuffer;
+struct WorkItem;
+
+/// Source of heightmap pages for a streaming terrain.
+class URHO3D_API TerrainPageSource : public RefCounted
+{
+public:
+    /// Fill the heights of a page. Level 0 is the full resolution heightmap and each level above halves the resolution, so that a page covers pageSize << level full resolution quads per side. Heights are (pageSize + 3) * (pageSize + 3) values in row-major order from the south-west, including a border of one sample on each side for calculating normals. Return false if the page does not exist. Called from a worker thread.
+    virtual bool LoadPage(unsigned level, const IntVector2& page, int pageSize, PODVector<float>& heights) = 0;
+};
+
+/// Heightmap page source reading tiled files. Each page is a file of 16-bit unsigned heights named "<level>_<x>_<z>.hgt" in the page directory, found through the resource cache.
+class URHO3D_API FileTerrainPageSource : public TerrainPageSource
+{
+public:
+    /// Construct with the page directory and the height of one 16-bit step.
+    FileTerrainPageSource(Context* context, const String& directory, float heightScale);
+
+    /// Load a page from its file. Called from a worker thread.
+    bool LoadPage(unsigned level, const IntVector2& page, int pageSize, PODVector<float>& heights) override;
+
+    /// Write a page file to a filesystem directory. Return true if successful.
+    static bool SavePage(Context* context, const String& directory, unsigned level, const IntVector2& page, const PODVector<float>& heights,
+        float heightScale);
+    /// Return the file name of a page.
+    static String GetPageFileName(const String& directory, unsigned level, const IntVector2& page);
+
+private:
+    /// Context.
+    WeakPtr<Context> context_;
+    /// Page directory.
+    String directory_;
+    /// Height of one 16-bit step.
+    float heightScale_;
+};
+
+/// Heightmap page of a streaming terrain.
+class StreamingTerrainPage : public RefCounted
+{
+public:
+    /// Construct.
+    StreamingTerrainPage(unsigned level, const IntVector2& position);
+
+    /// Quadtree level. 0 is full resolution.
+    unsigned level_;
+    /// Position in pages of the level.
+    IntVector2 position_;
+    /// Bordered heights.
+    PODVector<float> heights_;
+    /// Vertex data prepared by the worker thread. Released once uploaded.
+    PODVector<float> vertexData_;
+    /// Local bounding box.
+    BoundingBox boundingBox_;
+    /// Estimated height error of drawing this page instead of its children.
+    float error_;
+    /// Vertex buffer.
+    SharedPtr<VertexBuffer> vertexBuffer_;
+    /// Geometry.
+    SharedPtr<Geometry> geometry_;
+    /// World transform.
+    Matrix3x4 worldTransform_;
+    /// Loading work item, null when not loading.
+    SharedPtr<WorkItem> loadItem_;
+    /// Source to load from.
+    SharedPtr<TerrainPageSource> source_;
+    /// Time since the load was requested.
+    HiresTimer loadTimer_;
+    /// Frame number on which the page was last needed.
+    unsigned lastUsedFrame_;
+    /// Whether the data loaded successfully.
+    bool loaded_;
+};
+
+/// Page requested by the LOD selection.
+struct StreamingTerrainRequest
+{
+    /// Quadtree level.
+    unsigned level_;
+    /// Position in pages of the level.
+    IntVector2 position_;
+    /// Screen-space error of the parent page, used to load the most needed pages first.
+    float priority_;
+};
+
+/// Heightmap terrain for large worlds. Draws a quadtree of pages selected by screen-space error, loading the pages on demand from a page source into a cache of bounded size. The terrain extends from the node position towards positive X and Z. When the scene uses a TileSceneManager, pages finer than a cell are only loaded within the streaming distance of the manager.
+class URHO3D_API StreamingTerrain : public Drawable
+{
+    URHO3D_OBJECT(StreamingTerrain, Drawable);
+
+    friend void LoadTerrainPageWork(const WorkItem* item, unsigned threadIndex);
+
+public:
+    /// Construct.
+    explicit StreamingTerrain(Context* context);
+    /// Destruct.
+    ~StreamingTerrain() override;
+    /// Register object factory. Drawable must be registered first.
+    static void RegisterObject(Context* context);
+
+    /// Apply attribute changes that can not be applied immediately.
+    void ApplyAttributes() override;
+    /// Handle enabled/disabled state change.
+    void OnSetEnabled() override;
+    /// Select the pages to draw. May be called from worker thread(s).
+    void UpdateBatches(const FrameInfo& frame) override;
+    /// Visualize the component as debug geometry.
+    void DrawDebugGeometry(DebugRenderer* debug, bool depthTest) override;
+
+    /// Set the page source. Replaces the page directory attribute, for example with procedurally generated pages.
+    void SetPageSource(TerrainPageSource* source);
+    /// Set page directory to load pages from with a FileTerrainPageSource.
+    void SetPageDirectory(const String& directory);
+    /// Set height of one 16-bit step in page files.
+    void SetHeightScale(float scale);
+    /// Set page quads per side. Must be a power of two between 4 and 128.
+    void SetPageSize(int size);
+    /// Set full resolution vertex spacing on the XZ-plane.
+    void SetSpacing(const Vector2& spacing);
+    /// Set number of quadtree levels.
+    void SetNumLevels(unsigned levels);
+    /// Set number of coarsest level pages on each axis.
+    void SetRootPages(const IntVector2& pages);
+    /// Set maximum number of pages kept in memory, not counting the coarsest level which is always resident.
+    void SetPageCacheSize(unsigned pages);
+    /// Set maximum number of pages loading at once.
+    void SetMaxPageLoads(unsigned loads);
+    /// Set screen-space error in pixels above which a page is replaced by its children.
+    void SetMaxPixelError(float error);
+    /// Set material.
+    void SetMaterial(Material* material);
+
+    /// Return page source.
+    TerrainPageSource* GetPageSource() const { return source_; }
+
+    /// Return page directory.
+    const String& GetPageDirectory() const { return pageDirectory_; }
+
+    /// Return height of one 16-bit step in page files.
+    float GetHeightScale() const { return heightScale_; }
+
+    /// Return page quads per side.
+    int GetPageSize() const { return pageSize_; }
+
+    /// Return full resolution vertex spacing.
+    const Vector2& GetSpacing() const { return spacing_; }
+
+    /// Return number of quadtree levels.
+    unsigned GetNumLevels() const { return numLevels_; }
+
+    /// Return number of coarsest level pages on each axis.
+    const IntVector2& GetRootPages() const { return rootPages_; }
+
+    /// Return page cache size.
+    unsigned GetPageCacheSize() const { return pageCacheSize_; }
+
+    /// Return maximum number of pages loading at once.
+    unsigned GetMaxPageLoads() const { return maxPageLoads_; }
+
+    /// Return maximum screen-space error in pixels.
+    float GetMaxPixelError() const { return maxPixelError_; }
+
+    /// Return material.
+    Material* GetMaterial() const;
+    /// Return world size of a page on a level.
+    Vector2 GetPageWorldSize(unsigned level) const;
+    /// Return height at world coordinates from the finest resident page.
+    float GetHeight(const Vector3& worldPosition) const;
+
+    /// Return number of pages in memory, including pages being loaded.
+    unsigned GetNumPages() const { return pages_.Size(); }
+
+    /// Return number of pages being loaded.
+    unsigned GetNumLoadingPages() const { return numLoadingPages_; }
+
+    /// Return number of pages drawn on the last update.
+    unsigned GetNumDrawnPages() const { return batches_.Size(); }
+
+    /// Return memory used by resident pages in bytes, including GPU memory.
+    unsigned GetMemoryUse() const;
+
+    /// Return average time from a page request to its upload in microseconds.
+    float GetAverageLoadLatency() const { return numLoads_ ? (float)totalLoadLatency_ / (float)numLoads_ : 0.0f; }
+
+    /// Return longest time from a page request to its upload in microseconds.
+    long long GetMaxLoadLatency() const { return maxLoadLatency_; }
+
+    /// Return number of pages loaded.
+    unsigned GetNumLoads() const { return numLoads_; }
+
+    /// Set material attribute.
+    void SetMaterialAttr(const ResourceRef& value);
+    /// Return material attribute.
+    ResourceRef GetMaterialAttr() const;
+
+protected:
+    /// Handle scene being assigned.
+    void OnSceneSet(Scene* scene) override;
+    /// Recalculate the world-space bounding box.
+    void OnWorldBoundingBoxUpdate() override;
+
+private:
+    /// Return key of a page in the cache.
+    static unsigned long long GetPageKey(unsigned level, const IntVector2& position);
+    /// Return resident page, or null if not loaded.
+    StreamingTerrainPage* GetResidentPage(unsigned level, const IntVector2& position) const;
+    /// Select the pages to draw under a page, recursively.
+    void SelectPage(StreamingTerrainPage* page, const FrameInfo& frame, const Vector3& cameraPos, float errorScale);
+    /// Start loading a page.
+    void RequestPage(unsigned level, const IntVector2& position);
+    /// Generate vertex data of a loaded page. Called from a worker thread.
+    void BuildPageData(StreamingTerrainPage& page) const;
+    /// Upload a loaded page.
+    void CreatePageGeometry(StreamingTerrainPage* page);
+    /// Create the index buffer shared by all pages.
+    void CreateIndexData();
+    /// Evict least recently used pages until the cache has room for a number of new pages. Return the number of free slots.
+    unsigned EvictPages(unsigned numNewPages);
+    /// Cancel or wait for the pages being loaded.
+    void AbortLoads();
+    /// Clear the cache and recreate the shared data after a structural change.
+    void ResetPages();
+    /// Update the local bounding box from the coarsest level.
+    void UpdateBoundingBox();
+    /// Find the scene's tile manager and the level whose pages match its cells.
+    void UpdateTileManager();
+    /// Return whether pages below a page may be loaded.
+    bool CanRefine(StreamingTerrainPage* page) const;
+    /// Subscribe to or unsubscribe from the scene update.
+    void UpdateEventSubscription();
+    /// Handle scene post-update event. Uploads loaded pages and starts new loads.
+    void HandleScenePostUpdate(StringHash eventType, VariantMap& eventData);
+    /// Mark the page structure dirty.
+    void MarkPagesDirty() { pagesDirty_ = true; }
+
+    /// Page source.
+    SharedPtr<TerrainPageSource> source_;
+    /// Index buffer shared by all pages.
+    SharedPtr<IndexBuffer> indexBuffer_;
+    /// Material.
+    SharedPtr<Material> material_;
+    /// Resident and loading pages.
+    HashMap<unsigned long long, SharedPtr<StreamingTerrainPage> > pages_;
+    /// Pages requested by the last LOD selection.
+    PODVector<StreamingTerrainRequest> requests_;
+    /// Tile scene manager of the scene.
+    WeakPtr<TileSceneManager> tileManager_;
+    /// Page directory.
+    String pageDirectory_;
+    /// Full resolution vertex spacing.
+    Vector2 spacing_;
+    /// Number of coarsest level pages on each axis.
+    IntVector2 rootPages_;
+    /// Page quads per side.
+    int pageSize_;
+    /// Number of quadtree levels.
+    unsigned numLevels_;
+    /// Maximum number of non-root pages in memory.
+    unsigned pageCacheSize_;
+    /// Maximum number of pages loading at once.
+    unsigned maxPageLoads_;
+    /// Number of pages loading.
+    unsigned numLoadingPages_;
+    /// Level whose pages are the size of a tile manager cell, or M_MAX_UNSIGNED if none.
+    unsigned cellLevel_;
+    /// Height of one 16-bit step in page files.
+    float heightScale_;
+    /// Maximum screen-space error in pixels.
+    float maxPixelError_;
+    /// Sum of load latencies in microseconds.
+    long long totalLoadLatency_;
+    /// Longest load latency in microseconds.
+    long long maxLoadLatency_;
+    /// Number of pages loaded.
+    unsigned numLoads_;
+    /// Page structure dirty flag.
+    bool pagesDirty_;
+    /// Whether the source was set from code rather than from the page directory.
+    bool customSource_;
+    /// Whether subscribed to the scene update.
+    bool subscribed_;
+};
+
+}
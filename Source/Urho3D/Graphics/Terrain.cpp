@@ -24,6 +24,7 @@
 
 #include "../Core/Context.h"
 #include "../Core/Profiler.h"
+#include "../Core/WorkQueue.h"
 #include "../Graphics/DrawableEvents.h"
 #include "../Graphics/Geometry.h"
 #include "../Graphics/IndexBuffer.h"
@@ -39,6 +40,10 @@
 #include "../Scene/Node.h"
 #include "../Scene/Scene.h"
 
+#ifdef URHO3D_SSE
+#include <emmintrin.h>
+#endif
+
 #include "../DebugNew.h"
 
 namespace Urho3D
@@ -56,6 +61,22 @@ static const unsigned STITCH_NORTH = 1;
 static const unsigned STITCH_SOUTH = 2;
 static const unsigned STITCH_WEST = 4;
 static const unsigned STITCH_EAST = 8;
+static const unsigned PATCHES_PER_WORK_ITEM = 4;
+
+/// Patch geometry built on a worker thread, waiting for upload in the main thread.
+struct TerrainPatchBuildData
+{
+    /// Patch being built.
+    TerrainPatch* patch_;
+    /// Interleaved vertex data for the vertex buffer.
+    PODVector<float> vertexData_;
+    /// CPU-side positions for raycasts.
+    SharedArrayPtr<unsigned char> cpuVertexData_;
+    /// CPU-side positions for occlusion.
+    SharedArrayPtr<unsigned char> occlusionCpuVertexData_;
+    /// Patch bounding box.
+    BoundingBox box_;
+};
 
 inline void GrowUpdateRegion(IntRect& updateRegion, int x, int y)
 {
@@ -77,6 +98,23 @@ inline void GrowUpdateRegion(IntRect& updateRegion, int x, int y)
     }
 }
 
+void SmoothTerrainWork(const WorkItem* item, unsigned threadIndex)
+{
+    auto* terrain = reinterpret_cast<Terrain*>(item->aux_);
+    auto* rows = reinterpret_cast<IntRect*>(item->start_);
+    terrain->SmoothHeightData(rows->left_, rows->top_, rows->right_, rows->bottom_);
+}
+
+void BuildTerrainPatchesWork(const WorkItem* item, unsigned threadIndex)
+{
+    auto* terrain = reinterpret_cast<Terrain*>(item->aux_);
+    auto* start = reinterpret_cast<TerrainPatchBuildData*>(item->start_);
+    auto* end = reinterpret_cast<TerrainPatchBuildData*>(item->end_);
+
+    while (start != end)
+        terrain->BuildPatchData(*start++);
+}
+
 Terrain::Terrain(Context* context) :
     Component(context),
     indexBuffer_(new IndexBuffer(context)),
@@ -515,6 +553,48 @@ void Terrain::ApplyHeightMap()
         CreateGeometry();
 }
 
+void Terrain::ApplyHeightMapRegion(const IntRect& region)
+{
+    if (!heightMap_ || !node_)
+        return;
+
+    // Any change that affects more than the heights needs a full recreate
+    if (recreateTerrain_ || !heightData_ || patches_.Size() != (unsigned)(numPatches_.x_ * numPatches_.y_) ||
+        numVertices_ != IntVector2((heightMap_->GetWidth() - 1) / patchSize_ * patchSize_ + 1,
+            (heightMap_->GetHeight() - 1) / patchSize_ * patchSize_ + 1) || (smoothing_ && !sourceHeightData_) ||
+        spacing_ != lastSpacing_ || patchSize_ != lastPatchSize_)
+    {
+        CreateGeometry();
+        return;
+    }
+
+    URHO3D_PROFILE(ApplyHeightMapRegion);
+
+    // Flip the image rectangle to the bottom-up height data rows
+    IntRect rect(Max(region.left_, 0), Max(numVertices_.y_ - region.bottom_, 0), Min(region.right_, numVertices_.x_),
+        Min(numVertices_.y_ - region.top_, numVertices_.y_));
+    if (rect.left_ >= rect.right_ || rect.top_ >= rect.bottom_)
+        return;
+
+    IntRect updateRegion(-1, -1, -1, -1);
+    ReadHeightMap(rect, true, updateRegion);
+    if (updateRegion.left_ < 0)
+        return;
+
+    PODVector<bool> dirtyPatches((unsigned)(numPatches_.x_ * numPatches_.y_));
+    for (unsigned i = 0; i < dirtyPatches.Size(); ++i)
+        dirtyPatches[i] = false;
+
+    MarkDirtyPatches(updateRegion, dirtyPatches);
+    UpdatePatches(dirtyPatches);
+
+    using namespace TerrainCreated;
+
+    VariantMap& eventData = GetEventDataMap();
+    eventData[P_NODE] = node_;
+    node_->SendEvent(E_TERRAINCREATED, eventData);
+}
+
 Image* Terrain::GetHeightMap() const
 {
     return heightMap_;
@@ -619,6 +699,150 @@ Vector3 Terrain::GetNormal(const Vector3& worldPosition) const
         return Vector3::UP;
 }
 
+void Terrain::GetHeights(const Vector3* worldPositions, unsigned count, float* heights, Vector3* normals) const
+{
+    if (!node_ || !heightData_)
+    {
+        float height = node_ ? node_->GetWorldPosition().y_ : 0.0f;
+        Vector3 normal = node_ ? node_->GetWorldRotation() * Vector3::UP : Vector3::UP;
+        for (unsigned i = 0; i < count; ++i)
+        {
+            heights[i] = height;
+            if (normals)
+                normals[i] = normal;
+        }
+        return;
+    }
+
+    /// \todo This assumes that the terrain scene node is upright, like GetHeight()
+    Matrix3x4 inverse = node_->GetWorldTransform().Inverse();
+    float heightScale = node_->GetWorldScale().y_;
+    float heightOffset = node_->GetWorldPosition().y_;
+    Quaternion rotation = node_->GetWorldRotation();
+    const float* heightData = heightData_.Get();
+    int rowSize = numVertices_.x_;
+    auto maxX = (float)(numVertices_.x_ - 1);
+    auto maxZ = (float)(numVertices_.y_ - 1);
+
+    // Only the X & Z rows of the world to heightmap transform are needed
+    float xRow[4] = { inverse.m00_ / spacing_.x_, inverse.m01_ / spacing_.x_, inverse.m02_ / spacing_.x_,
+        (inverse.m03_ - patchWorldOrigin_.x_) / spacing_.x_ };
+    float zRow[4] = { inverse.m20_ / spacing_.z_, inverse.m21_ / spacing_.z_, inverse.m22_ / spacing_.z_,
+        (inverse.m23_ - patchWorldOrigin_.y_) / spacing_.z_ };
+
+    unsigned i = 0;
+
+#ifdef URHO3D_SSE
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 maxXv = _mm_set1_ps(maxX);
+    const __m128 maxZv = _mm_set1_ps(maxZ);
+
+    // Four positions at a time. Only the height loads are scalar, as SSE2 has no gather
+    for (; i + 4 <= count; i += 4)
+    {
+        const Vector3* p = worldPositions + i;
+        __m128 px = _mm_setr_ps(p[0].x_, p[1].x_, p[2].x_, p[3].x_);
+        __m128 py = _mm_setr_ps(p[0].y_, p[1].y_, p[2].y_, p[3].y_);
+        __m128 pz = _mm_setr_ps(p[0].z_, p[1].z_, p[2].z_, p[3].z_);
+
+        __m128 xPos = _mm_add_ps(_mm_add_ps(_mm_mul_ps(px, _mm_set1_ps(xRow[0])), _mm_mul_ps(py, _mm_set1_ps(xRow[1]))),
+            _mm_add_ps(_mm_mul_ps(pz, _mm_set1_ps(xRow[2])), _mm_set1_ps(xRow[3])));
+        __m128 zPos = _mm_add_ps(_mm_add_ps(_mm_mul_ps(px, _mm_set1_ps(zRow[0])), _mm_mul_ps(py, _mm_set1_ps(zRow[1]))),
+            _mm_add_ps(_mm_mul_ps(pz, _mm_set1_ps(zRow[2])), _mm_set1_ps(zRow[3])));
+
+        // Floor by truncating and correcting the negative values
+        __m128 xFloor = _mm_cvtepi32_ps(_mm_cvttps_epi32(xPos));
+        xFloor = _mm_sub_ps(xFloor, _mm_and_ps(_mm_cmpgt_ps(xFloor, xPos), one));
+        __m128 zFloor = _mm_cvtepi32_ps(_mm_cvttps_epi32(zPos));
+        zFloor = _mm_sub_ps(zFloor, _mm_and_ps(_mm_cmpgt_ps(zFloor, zPos), one));
+        __m128 xFrac = _mm_sub_ps(xPos, xFloor);
+        __m128 zFrac = _mm_sub_ps(zPos, zFloor);
+
+        int x0[4], x1[4], z0[4], z1[4];
+        _mm_storeu_si128((__m128i*)x0, _mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(xFloor, zero), maxXv)));
+        _mm_storeu_si128((__m128i*)x1, _mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(_mm_add_ps(xFloor, one), zero), maxXv)));
+        _mm_storeu_si128((__m128i*)z0, _mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(zFloor, zero), maxZv)));
+        _mm_storeu_si128((__m128i*)z1, _mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(_mm_add_ps(zFloor, one), zero), maxZv)));
+
+        __m128 h00 = _mm_setr_ps(heightData[z0[0] * rowSize + x0[0]], heightData[z0[1] * rowSize + x0[1]],
+            heightData[z0[2] * rowSize + x0[2]], heightData[z0[3] * rowSize + x0[3]]);
+        __m128 h10 = _mm_setr_ps(heightData[z0[0] * rowSize + x1[0]], heightData[z0[1] * rowSize + x1[1]],
+            heightData[z0[2] * rowSize + x1[2]], heightData[z0[3] * rowSize + x1[3]]);
+        __m128 h01 = _mm_setr_ps(heightData[z1[0] * rowSize + x0[0]], heightData[z1[1] * rowSize + x0[1]],
+            heightData[z1[2] * rowSize + x0[2]], heightData[z1[3] * rowSize + x0[3]]);
+        __m128 h11 = _mm_setr_ps(heightData[z1[0] * rowSize + x1[0]], heightData[z1[1] * rowSize + x1[1]],
+            heightData[z1[2] * rowSize + x1[2]], heightData[z1[3] * rowSize + x1[3]]);
+
+        // Pick the triangle of the quad the same way as GetHeight()
+        __m128 upper = _mm_cmpge_ps(_mm_add_ps(xFrac, zFrac), one);
+        __m128 h1 = _mm_or_ps(_mm_and_ps(upper, h11), _mm_andnot_ps(upper, h00));
+        __m128 h2 = _mm_or_ps(_mm_and_ps(upper, h01), _mm_andnot_ps(upper, h10));
+        __m128 h3 = _mm_or_ps(_mm_and_ps(upper, h10), _mm_andnot_ps(upper, h01));
+        __m128 wx = _mm_or_ps(_mm_and_ps(upper, _mm_sub_ps(one, xFrac)), _mm_andnot_ps(upper, xFrac));
+        __m128 wz = _mm_or_ps(_mm_and_ps(upper, _mm_sub_ps(one, zFrac)), _mm_andnot_ps(upper, zFrac));
+
+        __m128 h = _mm_add_ps(_mm_mul_ps(h1, _mm_sub_ps(_mm_sub_ps(one, wx), wz)), _mm_add_ps(_mm_mul_ps(h2, wx), _mm_mul_ps(h3, wz)));
+        _mm_storeu_ps(heights + i, _mm_add_ps(_mm_mul_ps(h, _mm_set1_ps(heightScale)), _mm_set1_ps(heightOffset)));
+
+        if (normals)
+        {
+            float xFracs[4], zFracs[4];
+            _mm_storeu_ps(xFracs, xFrac);
+            _mm_storeu_ps(zFracs, zFrac);
+            for (unsigned j = 0; j < 4; ++j)
+                normals[i + j] = rotation * GetQuadNormal(x0[j], z0[j], x1[j], z1[j], xFracs[j], zFracs[j]);
+        }
+    }
+#endif
+
+    for (; i < count; ++i)
+    {
+        const Vector3& p = worldPositions[i];
+        float xPos = xRow[0] * p.x_ + xRow[1] * p.y_ + xRow[2] * p.z_ + xRow[3];
+        float zPos = zRow[0] * p.x_ + zRow[1] * p.y_ + zRow[2] * p.z_ + zRow[3];
+        float xFloor = floorf(xPos);
+        float zFloor = floorf(zPos);
+        float xFrac = xPos - xFloor;
+        float zFrac = zPos - zFloor;
+
+        auto x0 = (int)Clamp(xFloor, 0.0f, maxX);
+        auto x1 = (int)Clamp(xFloor + 1.0f, 0.0f, maxX);
+        auto z0 = (int)Clamp(zFloor, 0.0f, maxZ);
+        auto z1 = (int)Clamp(zFloor + 1.0f, 0.0f, maxZ);
+        float h1, h2, h3;
+
+        if (xFrac + zFrac >= 1.0f)
+        {
+            h1 = heightData[z1 * rowSize + x1];
+            h2 = heightData[z1 * rowSize + x0];
+            h3 = heightData[z0 * rowSize + x1];
+            h1 = h1 * (xFrac + zFrac - 1.0f) + h2 * (1.0f - xFrac) + h3 * (1.0f - zFrac);
+        }
+        else
+        {
+            h1 = heightData[z0 * rowSize + x0];
+            h2 = heightData[z0 * rowSize + x1];
+            h3 = heightData[z1 * rowSize + x0];
+            h1 = h1 * (1.0f - xFrac - zFrac) + h2 * xFrac + h3 * zFrac;
+        }
+
+        heights[i] = h1 * heightScale + heightOffset;
+        if (normals)
+            normals[i] = rotation * GetQuadNormal(x0, z0, x1, z1, xFrac, zFrac);
+    }
+}
+
+void Terrain::GetHeights(const PODVector<Vector3>& worldPositions, PODVector<float>& heights, PODVector<Vector3>* normals) const
+{
+    heights.Resize(worldPositions.Size());
+    if (normals)
+        normals->Resize(worldPositions.Size());
+
+    if (!worldPositions.Empty())
+        GetHeights(&worldPositions[0], worldPositions.Size(), &heights[0], normals ? &normals->At(0) : nullptr);
+}
+
 IntVector2 Terrain::WorldToHeightMap(const Vector3& worldPosition) const
 {
     if (!node_)
@@ -652,28 +876,54 @@ void Terrain::CreatePatchGeometry(TerrainPatch* patch)
 {
     URHO3D_PROFILE(CreatePatchGeometry);
 
+    TerrainPatchBuildData data;
+    PreparePatchBuild(patch, data);
+    BuildPatchData(data);
+    CommitPatchGeometry(data);
+}
+
+void Terrain::PreparePatchBuild(TerrainPatch* patch, TerrainPatchBuildData& data)
+{
     auto row = (unsigned)(patchSize_ + 1);
-    VertexBuffer* vertexBuffer = patch->GetVertexBuffer();
-    Geometry* geometry = patch->GetGeometry();
-    Geometry* maxLodGeometry = patch->GetMaxLodGeometry();
-    Geometry* occlusionGeometry = patch->GetOcclusionGeometry();
+    data.patch_ = patch;
+    data.vertexData_.Resize(row * row * 12);
+    data.cpuVertexData_.Reset();
+    data.occlusionCpuVertexData_.Reset();
 
-    if (vertexBuffer->GetVertexCount() != row * row)
-        vertexBuffer->SetSize(row * row, MASK_POSITION | MASK_NORMAL | MASK_TEXCOORD1 | MASK_TANGENT);
+    // Rewrite the old CPU-side positions in place if the patch size is unchanged, instead of allocating new arrays
+    if (patch->GetVertexBuffer()->GetVertexCount() == row * row)
+    {
+        SharedArrayPtr<unsigned char> indexData;
+        unsigned vertexSize;
+        unsigned indexSize;
+        const PODVector<VertexElement>* elements;
+
+        patch->GetGeometry()->GetRawDataShared(data.cpuVertexData_, vertexSize, indexData, indexSize, elements);
+        if (vertexSize != sizeof(Vector3))
+            data.cpuVertexData_.Reset();
+        patch->GetOcclusionGeometry()->GetRawDataShared(data.occlusionCpuVertexData_, vertexSize, indexData, indexSize, elements);
+        if (vertexSize != sizeof(Vector3))
+            data.occlusionCpuVertexData_.Reset();
+    }
 
-    SharedArrayPtr<unsigned char> cpuVertexData(new unsigned char[row * row * sizeof(Vector3)]);
-    SharedArrayPtr<unsigned char> occlusionCpuVertexData(new unsigned char[row * row * sizeof(Vector3)]);
+    if (!data.cpuVertexData_)
+        data.cpuVertexData_ = new unsigned char[row * row * sizeof(Vector3)];
+    if (!data.occlusionCpuVertexData_)
+        data.occlusionCpuVertexData_ = new unsigned char[row * row * sizeof(Vector3)];
+}
 
-    auto* vertexData = (float*)vertexBuffer->Lock(0, vertexBuffer->GetVertexCount());
-    auto* positionData = (float*)cpuVertexData.Get();
-    auto* occlusionData = (float*)occlusionCpuVertexData.Get();
+void Terrain::BuildPatchData(TerrainPatchBuildData& data)
+{
+    TerrainPatch* patch = data.patch_;
+    float* vertexData = &data.vertexData_[0];
+    auto* positionData = (float*)data.cpuVertexData_.Get();
+    auto* occlusionData = (float*)data.occlusionCpuVertexData_.Get();
     BoundingBox box;
 
     unsigned occlusionLevel = occlusionLodLevel_;
     if (occlusionLevel > numLodLevels_ - 1)
         occlusionLevel = numLodLevels_ - 1;
 
-    if (vertexData)
     {
         const IntVector2& coords = patch->GetCoordinates();
         int lodExpand = (1 << (occlusionLevel)) - 1;
@@ -735,26 +985,45 @@ void Terrain::CreatePatchGeometry(TerrainPatch* patch)
                 *vertexData++ = 1.0f;
             }
         }
+    }
+
+    data.box_ = box;
+    CalculateLodErrors(patch);
+}
+
+void Terrain::CommitPatchGeometry(TerrainPatchBuildData& data)
+{
+    TerrainPatch* patch = data.patch_;
+    auto row = (unsigned)(patchSize_ + 1);
+    VertexBuffer* vertexBuffer = patch->GetVertexBuffer();
+    Geometry* geometry = patch->GetGeometry();
+    Geometry* maxLodGeometry = patch->GetMaxLodGeometry();
+    Geometry* occlusionGeometry = patch->GetOcclusionGeometry();
 
-        vertexBuffer->Unlock();
+    if (vertexBuffer->GetVertexCount() != row * row)
+        vertexBuffer->SetSize(row * row, MASK_POSITION | MASK_NORMAL | MASK_TEXCOORD1 | MASK_TANGENT);
+
+    if (vertexBuffer->SetData(&data.vertexData_[0]))
         vertexBuffer->ClearDataLost();
-    }
 
-    patch->SetBoundingBox(box);
+    patch->SetBoundingBox(data.box_);
 
     if (drawRanges_.Size())
     {
+        unsigned occlusionLevel = occlusionLodLevel_;
+        if (occlusionLevel > numLodLevels_ - 1)
+            occlusionLevel = numLodLevels_ - 1;
         unsigned occlusionDrawRange = occlusionLevel << 4;
 
         geometry->SetIndexBuffer(indexBuffer_);
         geometry->SetDrawRange(TRIANGLE_LIST, drawRanges_[0].first_, drawRanges_[0].second_, false);
-        geometry->SetRawVertexData(cpuVertexData, MASK_POSITION);
+        geometry->SetRawVertexData(data.cpuVertexData_, MASK_POSITION);
         maxLodGeometry->SetIndexBuffer(indexBuffer_);
         maxLodGeometry->SetDrawRange(TRIANGLE_LIST, drawRanges_[0].first_, drawRanges_[0].second_, false);
-        maxLodGeometry->SetRawVertexData(cpuVertexData, MASK_POSITION);
+        maxLodGeometry->SetRawVertexData(data.cpuVertexData_, MASK_POSITION);
         occlusionGeometry->SetIndexBuffer(indexBuffer_);
         occlusionGeometry->SetDrawRange(TRIANGLE_LIST, drawRanges_[occlusionDrawRange].first_, drawRanges_[occlusionDrawRange].second_, false);
-        occlusionGeometry->SetRawVertexData(occlusionCpuVertexData, MASK_POSITION);
+        occlusionGeometry->SetRawVertexData(data.occlusionCpuVertexData_, MASK_POSITION);
     }
 
     patch->ResetLod();
@@ -939,85 +1208,12 @@ void Terrain::CreateGeometry()
     if (heightMap_)
     {
         // Copy heightmap data
-        const unsigned char* src = heightMap_->GetData();
-        float* dest = smoothing_ ? sourceHeightData_ : heightData_;
-        unsigned imgComps = heightMap_->GetComponents();
-        unsigned imgRow = heightMap_->GetWidth() * imgComps;
         IntRect updateRegion(-1, -1, -1, -1);
-
-        if (imgComps == 1)
-        {
-            URHO3D_PROFILE(CopyHeightData);
-
-            for (int z = 0; z < numVertices_.y_; ++z)
-            {
-                for (int x = 0; x < numVertices_.x_; ++x)
-                {
-                    float newHeight = (float)src[imgRow * (numVertices_.y_ - 1 - z) + x] * spacing_.y_;
-
-                    if (updateAll)
-                        *dest = newHeight;
-                    else
-                    {
-                        if (*dest != newHeight)
-                        {
-                            *dest = newHeight;
-                            GrowUpdateRegion(updateRegion, x, z);
-                        }
-                    }
-
-                    ++dest;
-                }
-            }
-        }
-        else
-        {
-            URHO3D_PROFILE(CopyHeightData);
-
-            // If more than 1 component, use the green channel for more accuracy
-            for (int z = 0; z < numVertices_.y_; ++z)
-            {
-                for (int x = 0; x < numVertices_.x_; ++x)
-                {
-                    float newHeight = ((float)src[imgRow * (numVertices_.y_ - 1 - z) + imgComps * x] +
-                                       (float)src[imgRow * (numVertices_.y_ - 1 - z) + imgComps * x + 1] / 256.0f) * spacing_.y_;
-
-                    if (updateAll)
-                        *dest = newHeight;
-                    else
-                    {
-                        if (*dest != newHeight)
-                        {
-                            *dest = newHeight;
-                            GrowUpdateRegion(updateRegion, x, z);
-                        }
-                    }
-
-                    ++dest;
-                }
-            }
-        }
+        ReadHeightMap(IntRect(0, 0, numVertices_.x_, numVertices_.y_), !updateAll, updateRegion);
 
         // If updating a region of the heightmap, check which patches change
         if (!updateAll)
-        {
-            int lodExpand = 1 << (numLodLevels_ - 1);
-            // Expand the right & bottom 1 pixel more, as patches share vertices at the edge
-            updateRegion.left_ -= lodExpand;
-            updateRegion.right_ += lodExpand + 1;
-            updateRegion.top_ -= lodExpand;
-            updateRegion.bottom_ += lodExpand + 1;
-
-            int sX = Max(updateRegion.left_ / patchSize_, 0);
-            int eX = Min(updateRegion.right_ / patchSize_, numPatches_.x_ - 1);
-            int sY = Max(updateRegion.top_ / patchSize_, 0);
-            int eY = Min(updateRegion.bottom_ / patchSize_, numPatches_.y_ - 1);
-            for (int y = sY; y <= eY; ++y)
-            {
-                for (int x = sX; x <= eX; ++x)
-                    dirtyPatches[y * numPatches_.x_ + x] = true;
-            }
-        }
+            MarkDirtyPatches(updateRegion, dirtyPatches);
 
         patches_.Reserve((unsigned)(numPatches_.x_ * numPatches_.y_));
 
@@ -1076,61 +1272,207 @@ void Terrain::CreateGeometry()
         if (updateAll)
             CreateIndexData();
 
-        // Create vertex data for patches. First update smoothing to ensure normals are calculated correctly across patch borders
-        if (smoothing_)
+        UpdatePatches(dirtyPatches);
+
+        for (unsigned i = 0; i < patches_.Size(); ++i)
+            SetPatchNeighbors(patches_[i]);
+    }
+
+    // Send event only if new geometry was generated, or the old was cleared
+    if (patches_.Size() || prevNumPatches)
+    {
+        using namespace TerrainCreated;
+
+        VariantMap& eventData = GetEventDataMap();
+        eventData[P_NODE] = node_;
+        node_->SendEvent(E_TERRAINCREATED, eventData);
+    }
+}
+
+void Terrain::ReadHeightMap(const IntRect& rect, bool compare, IntRect& updateRegion)
+{
+    URHO3D_PROFILE(CopyHeightData);
+
+    const unsigned char* src = heightMap_->GetData();
+    float* dest = smoothing_ ? sourceHeightData_ : heightData_;
+    unsigned imgComps = heightMap_->GetComponents();
+    unsigned imgRow = heightMap_->GetWidth() * imgComps;
+
+    for (int z = rect.top_; z < rect.bottom_; ++z)
+    {
+        const unsigned char* srcRow = src + imgRow * (numVertices_.y_ - 1 - z);
+        float* destRow = dest + z * numVertices_.x_;
+
+        for (int x = rect.left_; x < rect.right_; ++x)
         {
-            URHO3D_PROFILE(UpdateSmoothing);
+            // If more than 1 component, use the green channel for more accuracy
+            float newHeight = imgComps == 1 ? (float)srcRow[x] * spacing_.y_ :
+                ((float)srcRow[imgComps * x] + (float)srcRow[imgComps * x + 1] / 256.0f) * spacing_.y_;
 
-            for (unsigned i = 0; i < patches_.Size(); ++i)
+            if (!compare)
+                destRow[x] = newHeight;
+            else if (destRow[x] != newHeight)
             {
-                if (dirtyPatches[i])
-                {
-                    TerrainPatch* patch = patches_[i];
-                    const IntVector2& coords = patch->GetCoordinates();
-                    int startX = coords.x_ * patchSize_;
-                    int endX = startX + patchSize_;
-                    int startZ = coords.y_ * patchSize_;
-                    int endZ = startZ + patchSize_;
-
-                    for (int z = startZ; z <= endZ; ++z)
-                    {
-                        for (int x = startX; x <= endX; ++x)
-                        {
-                            float smoothedHeight = (
-                                GetSourceHeight(x - 1, z - 1) + GetSourceHeight(x, z - 1) * 2.0f + GetSourceHeight(x + 1, z - 1) +
-                                GetSourceHeight(x - 1, z) * 2.0f + GetSourceHeight(x, z) * 4.0f + GetSourceHeight(x + 1, z) * 2.0f +
-                                GetSourceHeight(x - 1, z + 1) + GetSourceHeight(x, z + 1) * 2.0f + GetSourceHeight(x + 1, z + 1)
-                            ) / 16.0f;
-
-                            heightData_[z * numVertices_.x_ + x] = smoothedHeight;
-                        }
-                    }
-                }
+                destRow[x] = newHeight;
+                GrowUpdateRegion(updateRegion, x, z);
             }
         }
+    }
+}
 
-        for (unsigned i = 0; i < patches_.Size(); ++i)
+void Terrain::MarkDirtyPatches(IntRect updateRegion, PODVector<bool>& dirtyPatches) const
+{
+    if (updateRegion.left_ < 0)
+        return;
+
+    // Smoothing spreads a change one vertex further
+    int lodExpand = (1 << (numLodLevels_ - 1)) + (smoothing_ ? 1 : 0);
+    // Expand the right & bottom 1 pixel more, as patches share vertices at the edge
+    updateRegion.left_ -= lodExpand;
+    updateRegion.right_ += lodExpand + 1;
+    updateRegion.top_ -= lodExpand;
+    updateRegion.bottom_ += lodExpand + 1;
+
+    int sX = Max(updateRegion.left_ / patchSize_, 0);
+    int eX = Min(updateRegion.right_ / patchSize_, numPatches_.x_ - 1);
+    int sY = Max(updateRegion.top_ / patchSize_, 0);
+    int eY = Min(updateRegion.bottom_ / patchSize_, numPatches_.y_ - 1);
+    for (int y = sY; y <= eY; ++y)
+    {
+        for (int x = sX; x <= eX; ++x)
+            dirtyPatches[y * numPatches_.x_ + x] = true;
+    }
+}
+
+void Terrain::UpdatePatches(const PODVector<bool>& dirtyPatches)
+{
+    PODVector<TerrainPatch*> buildPatches;
+    IntRect dirtyRect(M_MAX_INT, M_MAX_INT, -1, -1);
+
+    for (unsigned i = 0; i < patches_.Size(); ++i)
+    {
+        TerrainPatch* patch = patches_[i];
+        if (!dirtyPatches[i] || !patch)
+            continue;
+
+        const IntVector2& coords = patch->GetCoordinates();
+        dirtyRect.left_ = Min(dirtyRect.left_, coords.x_);
+        dirtyRect.top_ = Min(dirtyRect.top_, coords.y_);
+        dirtyRect.right_ = Max(dirtyRect.right_, coords.x_);
+        dirtyRect.bottom_ = Max(dirtyRect.bottom_, coords.y_);
+        buildPatches.Push(patch);
+    }
+
+    if (buildPatches.Empty())
+        return;
+
+    auto* queue = GetSubsystem<WorkQueue>();
+    int numWorkItems = queue ? queue->GetNumThreads() + 1 : 1; // Worker threads + main thread
+
+    // First update smoothing to ensure normals are calculated correctly across patch borders
+    if (smoothing_)
+    {
+        URHO3D_PROFILE(UpdateSmoothing);
+
+        int startX = dirtyRect.left_ * patchSize_;
+        int endX = (dirtyRect.right_ + 1) * patchSize_;
+        int startZ = dirtyRect.top_ * patchSize_;
+        int endZ = (dirtyRect.bottom_ + 1) * patchSize_;
+
+        if (numWorkItems > 1)
         {
-            TerrainPatch* patch = patches_[i];
+            // Split into bands of rows, so that no two threads write the same heights
+            PODVector<IntRect> bands((unsigned)numWorkItems);
+            int rowsPerItem = (endZ - startZ) / numWorkItems + 1;
 
-            if (dirtyPatches[i])
+            for (int i = 0; i < numWorkItems && startZ <= endZ; ++i)
             {
-                CreatePatchGeometry(patch);
-                CalculateLodErrors(patch);
+                bands[i] = IntRect(startX, startZ, endX, Min(startZ + rowsPerItem - 1, endZ));
+
+                SharedPtr<WorkItem> item = queue->GetFreeItem();
+                item->priority_ = M_MAX_UNSIGNED;
+                item->workFunction_ = SmoothTerrainWork;
+                item->aux_ = this;
+                item->start_ = &bands[i];
+                queue->AddWorkItem(item);
+
+                startZ += rowsPerItem;
             }
 
-            SetPatchNeighbors(patch);
+            queue->Complete(M_MAX_UNSIGNED);
         }
+        else
+            SmoothHeightData(startX, startZ, endX, endZ);
     }
 
-    // Send event only if new geometry was generated, or the old was cleared
-    if (patches_.Size() || prevNumPatches)
+    BuildPatches(buildPatches);
+}
+
+void Terrain::SmoothHeightData(int startX, int startZ, int endX, int endZ)
+{
+    for (int z = startZ; z <= endZ; ++z)
     {
-        using namespace TerrainCreated;
+        for (int x = startX; x <= endX; ++x)
+        {
+            float smoothedHeight = (
+                GetSourceHeight(x - 1, z - 1) + GetSourceHeight(x, z - 1) * 2.0f + GetSourceHeight(x + 1, z - 1) +
+                GetSourceHeight(x - 1, z) * 2.0f + GetSourceHeight(x, z) * 4.0f + GetSourceHeight(x + 1, z) * 2.0f +
+                GetSourceHeight(x - 1, z + 1) + GetSourceHeight(x, z + 1) * 2.0f + GetSourceHeight(x + 1, z + 1)
+            ) / 16.0f;
 
-        VariantMap& eventData = GetEventDataMap();
-        eventData[P_NODE] = node_;
-        node_->SendEvent(E_TERRAINCREATED, eventData);
+            heightData_[z * numVertices_.x_ + x] = smoothedHeight;
+        }
+    }
+}
+
+void Terrain::BuildPatches(const PODVector<TerrainPatch*>& patches)
+{
+    URHO3D_PROFILE(BuildPatches);
+
+    auto* queue = GetSubsystem<WorkQueue>();
+    unsigned numWorkItems = queue ? queue->GetNumThreads() + 1 : 1; // Worker threads + main thread
+
+    // Build in batches to bound the staging memory, reusing the vertex arrays from batch to batch
+    unsigned batchSize = Min(numWorkItems * PATCHES_PER_WORK_ITEM, patches.Size());
+    Vector<TerrainPatchBuildData> batch(batchSize);
+
+    for (unsigned batchStart = 0; batchStart < patches.Size(); batchStart += batchSize)
+    {
+        unsigned count = Min(batchSize, patches.Size() - batchStart);
+        for (unsigned i = 0; i < count; ++i)
+            PreparePatchBuild(patches[batchStart + i], batch[i]);
+
+        if (numWorkItems > 1)
+        {
+            TerrainPatchBuildData* start = &batch[0];
+            TerrainPatchBuildData* batchEnd = start + count;
+
+            while (start != batchEnd)
+            {
+                TerrainPatchBuildData* end = Min(start + PATCHES_PER_WORK_ITEM, batchEnd);
+
+                SharedPtr<WorkItem> item = queue->GetFreeItem();
+                item->priority_ = M_MAX_UNSIGNED;
+                item->workFunction_ = BuildTerrainPatchesWork;
+                item->aux_ = this;
+                item->start_ = start;
+                item->end_ = end;
+                queue->AddWorkItem(item);
+
+                start = end;
+            }
+
+            queue->Complete(M_MAX_UNSIGNED);
+        }
+        else
+        {
+            for (unsigned i = 0; i < count; ++i)
+                BuildPatchData(batch[i]);
+        }
+
+        // GPU upload and geometry setup stay in the main thread
+        for (unsigned i = 0; i < count; ++i)
+            CommitPatchGeometry(batch[i]);
     }
 }
 
@@ -1363,10 +1705,30 @@ Vector3 Terrain::GetRawNormal(int x, int z) const
             Vector3(nwSlope, up, nwSlope)).Normalized();
 }
 
-void Terrain::CalculateLodErrors(TerrainPatch* patch)
+Vector3 Terrain::GetQuadNormal(int x0, int z0, int x1, int z1, float xFrac, float zFrac) const
 {
-    URHO3D_PROFILE(CalculateLodErrors);
+    Vector3 n1, n2, n3;
 
+    if (xFrac + zFrac >= 1.0f)
+    {
+        n1 = GetRawNormal(x1, z1);
+        n2 = GetRawNormal(x0, z1);
+        n3 = GetRawNormal(x1, z0);
+        xFrac = 1.0f - xFrac;
+        zFrac = 1.0f - zFrac;
+    }
+    else
+    {
+        n1 = GetRawNormal(x0, z0);
+        n2 = GetRawNormal(x1, z0);
+        n3 = GetRawNormal(x0, z1);
+    }
+
+    return (n1 * (1.0f - xFrac - zFrac) + n2 * xFrac + n3 * zFrac).Normalized();
+}
+
+void Terrain::CalculateLodErrors(TerrainPatch* patch)
+{
     const IntVector2& coords = patch->GetCoordinates();
     PODVector<float>& lodErrors = patch->GetLodErrors();
     lodErrors.Clear();
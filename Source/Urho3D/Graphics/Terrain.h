@@ -33,12 +33,17 @@ class IndexBuffer;
 class Material;
 class Node;
 class TerrainPatch;
+struct TerrainPatchBuildData;
+struct WorkItem;
 
 /// Heightmap terrain component.
 class URHO3D_API Terrain : public Component
 {
     URHO3D_OBJECT(Terrain, Component);
 
+    friend void SmoothTerrainWork(const WorkItem* item, unsigned threadIndex);
+    friend void BuildTerrainPatchesWork(const WorkItem* item, unsigned threadIndex);
+
 public:
     /// Construct.
     explicit Terrain(Context* context);
@@ -100,6 +105,8 @@ public:
     void SetOccludee(bool enable);
     /// Apply changes from the heightmap image.
     void ApplyHeightMap();
+    /// Apply changes from a rectangle of the heightmap image, in image pixel coordinates. Only the patches the rectangle touches are rebuilt. Recreates the whole terrain if its size or settings have changed.
+    void ApplyHeightMapRegion(const IntRect& region);
 
     /// Return patch quads per side.
     int GetPatchSize() const { return patchSize_; }
@@ -136,6 +143,10 @@ public:
     float GetHeight(const Vector3& worldPosition) const;
     /// Return normal at world coordinates.
     Vector3 GetNormal(const Vector3& worldPosition) const;
+    /// Return heights, and optionally normals, at a number of world coordinates. Positions outside the terrain clamp to its edges. Faster than querying point by point, especially for spatially coherent positions. Safe to call from worker threads as long as the terrain and its node are not modified at the same time.
+    void GetHeights(const Vector3* worldPositions, unsigned count, float* heights, Vector3* normals = nullptr) const;
+    /// Return heights, and optionally normals, at a number of world coordinates. Resizes the destination vectors.
+    void GetHeights(const PODVector<Vector3>& worldPositions, PODVector<float>& heights, PODVector<Vector3>* normals = nullptr) const;
     /// Convert world position to heightmap pixel position. Note that the internal height data representation is reversed vertically, but in the heightmap image north is at the top.
     IntVector2 WorldToHeightMap(const Vector3& worldPosition) const;
     /// Convert heightmap pixel position to world position.
@@ -216,6 +227,22 @@ private:
     void CreateGeometry();
     /// Create index data shared by all patches.
     void CreateIndexData();
+    /// Copy a rectangle of the heightmap image into the height data. Optionally compare against the old heights and grow the update region where they change.
+    void ReadHeightMap(const IntRect& rect, bool compare, IntRect& updateRegion);
+    /// Mark the patches affected by a changed height data region dirty.
+    void MarkDirtyPatches(IntRect updateRegion, PODVector<bool>& dirtyPatches) const;
+    /// Smooth and rebuild the dirty patches.
+    void UpdatePatches(const PODVector<bool>& dirtyPatches);
+    /// Smooth the height data rows from startZ to endZ inclusive, between startX and endX inclusive.
+    void SmoothHeightData(int startX, int startZ, int endX, int endZ);
+    /// Build patches on the worker threads and upload them in the main thread.
+    void BuildPatches(const PODVector<TerrainPatch*>& patches);
+    /// Prepare a patch for building, reusing its old CPU-side vertex data if possible.
+    void PreparePatchBuild(TerrainPatch* patch, TerrainPatchBuildData& data);
+    /// Generate patch vertex data and LOD errors. Safe to call from worker threads.
+    void BuildPatchData(TerrainPatchBuildData& data);
+    /// Upload built patch vertex data and set up the patch geometries.
+    void CommitPatchGeometry(TerrainPatchBuildData& data);
     /// Return an uninterpolated terrain height value, clamping to edges.
     float GetRawHeight(int x, int z) const;
     /// Return a source terrain height value, clamping to edges. The source data is used for smoothing.
@@ -224,6 +251,8 @@ private:
     float GetLodHeight(int x, int z, unsigned lodLevel) const;
     /// Get slope-based terrain normal at position.
     Vector3 GetRawNormal(int x, int z) const;
+    /// Interpolate the vertex normals of the triangle containing a point of a quad. The quad corners must already be clamped.
+    Vector3 GetQuadNormal(int x0, int z0, int x1, int z1, float xFrac, float zFrac) const;
     /// Calculate LOD errors for a patch.
     void CalculateLodErrors(TerrainPatch* patch);
     /// Set neighbors for a patch.
@@ -301,10 +301,7 @@ namespace Urho3D
 
     void TileSceneManager::AddDrawable(Drawable* drawable)
     {
-        auto worldPos = drawable->GetNode()->GetWorldPosition();
-        IntVector2 pos = { (int)floorf(worldPos.x_ / cellSize_), (int)floorf(worldPos.z_ / cellSize_) };
-
-        pos += position_;
+        IntVector2 pos = GetCellIndex(drawable->GetNode()->GetWorldPosition());
 
         int idx = pos.y_ * gridSize_.x_ + pos.x_;
         cells_[idx]->octree_->AddDrawable(drawable);
@@ -312,15 +309,28 @@ namespace Urho3D
 
     void TileSceneManager::InsertDrawable(Drawable* drawable)
     {
-        auto worldPos = drawable->GetNode()->GetWorldPosition();
-        IntVector2 pos = { (int)floorf(worldPos.x_ / cellSize_), (int)floorf(worldPos.z_ / cellSize_) };
-
-        pos += position_;
+        IntVector2 pos = GetCellIndex(drawable->GetNode()->GetWorldPosition());
 
         int idx = pos.y_ * gridSize_.x_ + pos.x_;
         cells_[idx]->octree_->InsertDrawable(drawable);
     }
 
+    IntVector2 TileSceneManager::GetCellIndex(const Vector3& worldPos) const
+    {
+        IntVector2 pos = { (int)floorf(worldPos.x_ / cellSize_), (int)floorf(worldPos.z_ / cellSize_) };
+        return pos + position_;
+    }
+
+    bool TileSceneManager::IsCellInRange(const IntVector2& cell) const
+    {
+        if (cell.x_ < 0 || cell.y_ < 0 || cell.x_ >= gridSize_.x_ || cell.y_ >= gridSize_.y_)
+            return false;
+
+        // Same test as UpdateCamera uses to stream cells in
+        const auto posDiff = position_ - cell;
+        return Abs(posDiff.x_) <= distance_ && Abs(posDiff.y_) <= distance_;
+    }
+
     void TileSceneManager::LoadCell(Cell* cell, bool threaded)
     {
         if (threaded)
@@ -395,6 +405,7 @@ namespace Urho3D
         frame.frameNumber_ = GetSubsystem<Time>()->GetFrameNumber();
         frame.timeStep_ = eventData[P_TIMESTEP].GetFloat();
         frame.camera_ = nullptr;
+        frame.lodPolicy_ = nullptr;
 
         Update(frame);
     }
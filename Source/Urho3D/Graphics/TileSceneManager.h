@@ -54,6 +54,13 @@ namespace Urho3D
 
         void UpdateCamera(Camera* camera, bool isTeleport);
 
+        /// Return the world size of a cell.
+        float GetCellSize() const { return cellSize_; }
+        /// Return the grid position of the cell containing a world position.
+        IntVector2 GetCellIndex(const Vector3& worldPos) const;
+        /// Return whether a cell is within the streaming distance of the camera's cell.
+        bool IsCellInRange(const IntVector2& cell) const;
+
     private:
         void LoadCell(Cell*, bool threaded);
         void UnloadCell(Cell*);
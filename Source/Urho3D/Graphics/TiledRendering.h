@@ -7,41 +7,24 @@
 
 #include <Urho3D/Math/Sphere.h>
 
-#include <atomic>
-
 namespace Urho3D
 {
 
 	class Camera;
-	class StructuredBuffer;
 	class Light;
 
+	/// Light record of the clustered light tables, in GPU layout (64 bytes.)
 	struct ClusteredLightData {
-		Vector4 position_;
-		Vector4 shapeData_;
-		Vector4 color_;
-		int data_[4];
+		Vector4 position_;  // xyz = world position, w = range
+		Vector4 shapeData_; // xyz = world direction, w = cosine of the spot half angle, -1 for point lights
+		Vector4 color_;     // rgb = effective color, w = effective specular intensity
+		int data_[4];       // light type, light mask, unused, unused
 	};
 	struct ClusteredDecalData {
 		Vector4 position_;  // w = texture array index
 		Vector4 direction_; // 
 		Vector4 cross_;
 	};
-	struct ClusteredCellData {
-		std::atomic_int16_t lightCount_;
-		std::atomic_int16_t decalCount_;
-	};
-	struct CellClusters {
-		ClusteredCellData* data_;
-		ClusteredLightData* lights_;
-		ClusteredLightData* decals_;
-		IntVector3 dim_;
-
-		CellClusters(IntVector3 dim);
-		~CellClusters();
-
-		void Reset();
-	};
 
 	class TiledRendering
 	{
@@ -64,7 +47,8 @@ namespace Urho3D
 			return ret;
 		}
 
-		static void RecordLight(CellClusters* target, Camera* cam, Light* light);
+		/// Fill the clustered record of a light. Return the light's bounding sphere.
+		static Sphere RecordLight(ClusteredLightData& dest, Light* light);
 
 	private:
 
@@ -0,0 +1,354 @@
+//
+// Copyright (c) 2017-2020 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+
+#include "../Precompiled.h"
+
+#include "../Graphics/TriangleBVH.h"
+#include "../Math/Frustum.h"
+#include "../Math/Ray.h"
+
+#include "../DebugNew.h"
+
+namespace Urho3D
+{
+
+static const unsigned MAX_LEAF_TRIANGLES = 4;
+static const unsigned NUM_SAH_BINS = 12;
+static const unsigned MAX_BVH_DEPTH = 48;
+static const float QUANTIZE_RANGE = 65535.0f;
+
+/// Half the surface area of a box, enough for comparing split costs.
+static float GetHalfArea(const BoundingBox& box)
+{
+    if (!box.Defined())
+        return 0.0f;
+    Vector3 size = box.Size();
+    return size.x_ * size.y_ + size.y_ * size.z_ + size.z_ * size.x_;
+}
+
+TriangleBVH::TriangleBVH() :
+    quantizeStep_(Vector3::ZERO)
+{
+}
+
+bool TriangleBVH::Build(const unsigned char* vertexData, unsigned vertexSize, const unsigned char* indexData, unsigned indexSize,
+    unsigned start, unsigned count)
+{
+    nodes_.Clear();
+    indices_.Clear();
+    boundingBox_.Clear();
+
+    if (!vertexData || count < 3)
+        return false;
+
+    const unsigned numTriangles = count / 3;
+    PODVector<unsigned> triangleIndices(numTriangles * 3);
+    PODVector<BoundingBox> triangleBoxes(numTriangles);
+    PODVector<Vector3> centers(numTriangles);
+    PODVector<unsigned> order(numTriangles);
+
+    for (unsigned i = 0; i < numTriangles; ++i)
+    {
+        unsigned* tri = &triangleIndices[i * 3];
+        for (unsigned j = 0; j < 3; ++j)
+        {
+            const unsigned k = start + i * 3 + j;
+            if (!indexData)
+                tri[j] = k;
+            else if (indexSize == sizeof(unsigned short))
+                tri[j] = ((const unsigned short*)indexData)[k];
+            else
+                tri[j] = ((const unsigned*)indexData)[k];
+        }
+
+        BoundingBox& box = triangleBoxes[i];
+        box.Clear();
+        for (unsigned j = 0; j < 3; ++j)
+            box.Merge(*((const Vector3*)(&vertexData[tri[j] * vertexSize])));
+
+        centers[i] = box.Center();
+        order[i] = i;
+        boundingBox_.Merge(box);
+    }
+
+    quantizeStep_ = boundingBox_.Size() / QUANTIZE_RANGE;
+
+    nodes_.Reserve(numTriangles * 2 / MAX_LEAF_TRIANGLES + 1);
+    indices_.Reserve(numTriangles * 3);
+    BuildNode(triangleBoxes, centers, triangleIndices, order, 0, numTriangles, 0);
+    return true;
+}
+
+unsigned TriangleBVH::BuildNode(const PODVector<BoundingBox>& triangleBoxes, const PODVector<Vector3>& centers,
+    const PODVector<unsigned>& triangleIndices, PODVector<unsigned>& order, unsigned begin, unsigned end, unsigned depth)
+{
+    const unsigned nodeIndex = nodes_.Size();
+    nodes_.Resize(nodeIndex + 1);
+
+    BoundingBox box;
+    BoundingBox centerBox;
+    for (unsigned i = begin; i < end; ++i)
+    {
+        box.Merge(triangleBoxes[order[i]]);
+        centerBox.Merge(centers[order[i]]);
+    }
+    QuantizeBounds(nodes_[nodeIndex], box);
+
+    const unsigned count = end - begin;
+    unsigned mid = begin;
+
+    if (count > MAX_LEAF_TRIANGLES && depth < MAX_BVH_DEPTH)
+    {
+        // Binned surface area heuristic over triangle centers on each axis
+        const Vector3 centerSize = centerBox.Size();
+        float bestCost = GetHalfArea(box) * count;
+        unsigned bestAxis = M_MAX_UNSIGNED;
+        unsigned bestSplit = 0;
+
+        for (unsigned axis = 0; axis < 3; ++axis)
+        {
+            const float extent = centerSize.Data()[axis];
+            if (extent <= M_EPSILON)
+                continue;
+
+            const float binScale = NUM_SAH_BINS / extent;
+            const float axisMin = centerBox.min_.Data()[axis];
+            BoundingBox binBoxes[NUM_SAH_BINS];
+            unsigned binCounts[NUM_SAH_BINS] = {};
+
+            for (unsigned i = begin; i < end; ++i)
+            {
+                const unsigned bin = Min((unsigned)((centers[order[i]].Data()[axis] - axisMin) * binScale), NUM_SAH_BINS - 1);
+                binBoxes[bin].Merge(triangleBoxes[order[i]]);
+                ++binCounts[bin];
+            }
+
+            // Sweep from the right to get the cost of each right side, then from the left
+            float rightCosts[NUM_SAH_BINS];
+            BoundingBox rightBox;
+            unsigned rightCount = 0;
+            for (unsigned bin = NUM_SAH_BINS - 1; bin > 0; --bin)
+            {
+                rightBox.Merge(binBoxes[bin]);
+                rightCount += binCounts[bin];
+                rightCosts[bin] = GetHalfArea(rightBox) * rightCount;
+            }
+
+            BoundingBox leftBox;
+            unsigned leftCount = 0;
+            for (unsigned split = 1; split < NUM_SAH_BINS; ++split)
+            {
+                leftBox.Merge(binBoxes[split - 1]);
+                leftCount += binCounts[split - 1];
+                if (!leftCount || leftCount == count)
+                    continue;
+
+                const float cost = GetHalfArea(leftBox) * leftCount + rightCosts[split];
+                if (cost < bestCost)
+                {
+                    bestCost = cost;
+                    bestAxis = axis;
+                    bestSplit = split;
+                }
+            }
+        }
+
+        if (bestAxis != M_MAX_UNSIGNED)
+        {
+            // Partition the range in place by bin
+            const float binScale = NUM_SAH_BINS / centerSize.Data()[bestAxis];
+            const float axisMin = centerBox.min_.Data()[bestAxis];
+            mid = begin;
+            for (unsigned i = begin; i < end; ++i)
+            {
+                const unsigned bin = Min((unsigned)((centers[order[i]].Data()[bestAxis] - axisMin) * binScale), NUM_SAH_BINS - 1);
+                if (bin < bestSplit)
+                    Swap(order[i], order[mid++]);
+            }
+        }
+        else if (count > MAX_LEAF_TRIANGLES * 4)
+        {
+            // Splitting does not pay off by area, but keep large leaves from degrading queries to a linear scan
+            mid = begin + count / 2;
+        }
+    }
+
+    if (mid == begin || mid == end)
+    {
+        TriangleBVHNode& node = nodes_[nodeIndex];
+        node.offset_ = indices_.Size() / 3;
+        node.count_ = count;
+        for (unsigned i = begin; i < end; ++i)
+        {
+            const unsigned* tri = &triangleIndices[order[i] * 3];
+            indices_.Push(tri[0]);
+            indices_.Push(tri[1]);
+            indices_.Push(tri[2]);
+        }
+        return nodeIndex;
+    }
+
+    // The first child follows the node, so only the second child's index is stored
+    BuildNode(triangleBoxes, centers, triangleIndices, order, begin, mid, depth + 1);
+    const unsigned secondChild = BuildNode(triangleBoxes, centers, triangleIndices, order, mid, end, depth + 1);
+    nodes_[nodeIndex].offset_ = secondChild;
+    nodes_[nodeIndex].count_ = 0;
+    return nodeIndex;
+}
+
+void TriangleBVH::QuantizeBounds(TriangleBVHNode& node, const BoundingBox& box) const
+{
+    for (unsigned axis = 0; axis < 3; ++axis)
+    {
+        const float step = quantizeStep_.Data()[axis];
+        if (step <= 0.0f)
+        {
+            node.min_[axis] = 0;
+            node.max_[axis] = 0;
+            continue;
+        }
+
+        const float base = boundingBox_.min_.Data()[axis];
+        node.min_[axis] = (unsigned short)Clamp(floorf((box.min_.Data()[axis] - base) / step), 0.0f, QUANTIZE_RANGE);
+        node.max_[axis] = (unsigned short)Clamp(ceilf((box.max_.Data()[axis] - base) / step), 0.0f, QUANTIZE_RANGE);
+    }
+}
+
+BoundingBox TriangleBVH::GetNodeBox(const TriangleBVHNode& node) const
+{
+    const Vector3& base = boundingBox_.min_;
+    return BoundingBox(
+        base + quantizeStep_ * Vector3(node.min_[0], node.min_[1], node.min_[2]),
+        base + quantizeStep_ * Vector3(node.max_[0], node.max_[1], node.max_[2]));
+}
+
+float TriangleBVH::GetHitDistance(const Ray& ray, const unsigned char* vertexData, unsigned vertexSize, Vector3* outNormal,
+    Vector2* outUV, unsigned uvOffset) const
+{
+    float nearest = M_INFINITY;
+    if (nodes_.Empty() || !vertexData)
+        return nearest;
+
+    Vector3 nearestNormal;
+    Vector3 nearestBary;
+    const unsigned* nearestTriangle = nullptr;
+
+    unsigned stack[MAX_BVH_DEPTH + 2];
+    unsigned stackSize = 0;
+    stack[stackSize++] = 0;
+
+    while (stackSize)
+    {
+        const TriangleBVHNode& node = nodes_[stack[--stackSize]];
+        if (ray.HitDistance(GetNodeBox(node)) >= nearest)
+            continue;
+
+        if (node.count_)
+        {
+            const unsigned* tri = &indices_[node.offset_ * 3];
+            for (unsigned i = 0; i < node.count_; ++i, tri += 3)
+            {
+                const Vector3& v0 = *((const Vector3*)(&vertexData[tri[0] * vertexSize]));
+                const Vector3& v1 = *((const Vector3*)(&vertexData[tri[1] * vertexSize]));
+                const Vector3& v2 = *((const Vector3*)(&vertexData[tri[2] * vertexSize]));
+                Vector3 normal;
+                Vector3 bary;
+                const float distance = ray.HitDistance(v0, v1, v2, &normal, &bary);
+                if (distance < nearest)
+                {
+                    nearest = distance;
+                    nearestNormal = normal;
+                    nearestBary = bary;
+                    nearestTriangle = tri;
+                }
+            }
+        }
+        else
+        {
+            const unsigned firstChild = (unsigned)(&node - &nodes_[0]) + 1;
+            stack[stackSize++] = node.offset_;
+            stack[stackSize++] = firstChild;
+        }
+    }
+
+    if (nearestTriangle)
+    {
+        if (outNormal)
+            *outNormal = nearestNormal;
+        if (outUV)
+        {
+            if (uvOffset == M_MAX_UNSIGNED)
+                *outUV = Vector2::ZERO;
+            else
+            {
+                const Vector2& uv0 = *((const Vector2*)(&vertexData[nearestTriangle[0] * vertexSize + uvOffset]));
+                const Vector2& uv1 = *((const Vector2*)(&vertexData[nearestTriangle[1] * vertexSize + uvOffset]));
+                const Vector2& uv2 = *((const Vector2*)(&vertexData[nearestTriangle[2] * vertexSize + uvOffset]));
+                *outUV = uv0 * nearestBary.x_ + uv1 * nearestBary.y_ + uv2 * nearestBary.z_;
+            }
+        }
+    }
+
+    return nearest;
+}
+
+template <class T> void TriangleBVH::CollectTriangles(PODVector<unsigned>& dest, const T& volume) const
+{
+    if (nodes_.Empty())
+        return;
+
+    unsigned stack[MAX_BVH_DEPTH + 2];
+    unsigned stackSize = 0;
+    stack[stackSize++] = 0;
+
+    while (stackSize)
+    {
+        const unsigned nodeIndex = stack[--stackSize];
+        const TriangleBVHNode& node = nodes_[nodeIndex];
+        if (volume.IsInsideFast(GetNodeBox(node)) == OUTSIDE)
+            continue;
+
+        if (node.count_)
+        {
+            const unsigned* tri = &indices_[node.offset_ * 3];
+            dest.Insert(dest.End(), tri, tri + node.count_ * 3);
+        }
+        else
+        {
+            stack[stackSize++] = node.offset_;
+            stack[stackSize++] = nodeIndex + 1;
+        }
+    }
+}
+
+void TriangleBVH::GetTriangles(PODVector<unsigned>& dest, const BoundingBox& box) const
+{
+    CollectTriangles(dest, box);
+}
+
+void TriangleBVH::GetTriangles(PODVector<unsigned>& dest, const Frustum& frustum) const
+{
+    CollectTriangles(dest, frustum);
+}
+
+}
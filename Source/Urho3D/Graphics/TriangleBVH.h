@@ -0,0 +1,100 @@
+//
+// Copyright (c) 2017-2020 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+
+#pragma once
+
+#include "../Container/Ptr.h"
+#include "../Math/BoundingBox.h"
+
+namespace Urho3D
+{
+
+class Frustum;
+class Ray;
+
+/// Bounding volume hierarchy node with bounds quantized to 16 bits relative to the hierarchy's bounding box.
+struct TriangleBVHNode
+{
+    /// Quantized minimum bounds, rounded down.
+    unsigned short min_[3];
+    /// Quantized maximum bounds, rounded up.
+    unsigned short max_[3];
+    /// Index of the second child for interior nodes, whose first child follows the node. First triangle for leaves.
+    unsigned offset_;
+    /// Number of triangles for leaves, 0 for interior nodes.
+    unsigned count_;
+};
+
+/// Bounding volume hierarchy over the triangles of CPU-side geometry data, built with the surface area heuristic. Stores vertex indices only, so queries take the vertex data it was built from.
+class URHO3D_API TriangleBVH : public RefCounted
+{
+public:
+    /// Construct empty.
+    TriangleBVH();
+
+    /// Build from a triangle list. Without index data, count triangles' worth of vertices from start are used, otherwise count indices from start. Return true if any triangles were found.
+    bool Build(const unsigned char* vertexData, unsigned vertexSize, const unsigned char* indexData, unsigned indexSize,
+        unsigned start, unsigned count);
+
+    /// Return ray hit distance or infinity if no hit. Optionally return hit normal, and hit UV if the vertex data has texture coordinates at uvOffset.
+    float GetHitDistance(const Ray& ray, const unsigned char* vertexData, unsigned vertexSize, Vector3* outNormal = nullptr,
+        Vector2* outUV = nullptr, unsigned uvOffset = M_MAX_UNSIGNED) const;
+    /// Return vertex index triples of the triangles in leaves intersecting a box. Triangles may still be outside the box.
+    void GetTriangles(PODVector<unsigned>& dest, const BoundingBox& box) const;
+    /// Return vertex index triples of the triangles in leaves intersecting a frustum. Triangles may still be outside the frustum.
+    void GetTriangles(PODVector<unsigned>& dest, const Frustum& frustum) const;
+
+    /// Return bounding box of all triangles.
+    const BoundingBox& GetBoundingBox() const { return boundingBox_; }
+
+    /// Return number of triangles.
+    unsigned GetNumTriangles() const { return indices_.Size() / 3; }
+
+    /// Return number of nodes.
+    unsigned GetNumNodes() const { return nodes_.Size(); }
+
+    /// Return memory use in bytes.
+    unsigned GetMemoryUse() const { return nodes_.Size() * sizeof(TriangleBVHNode) + indices_.Size() * sizeof(unsigned); }
+
+private:
+    /// Build a node from a range of triangles and return its index.
+    unsigned BuildNode(const PODVector<BoundingBox>& triangleBoxes, const PODVector<Vector3>& centers,
+        const PODVector<unsigned>& triangleIndices, PODVector<unsigned>& order, unsigned begin, unsigned end, unsigned depth);
+    /// Quantize bounds into a node.
+    void QuantizeBounds(TriangleBVHNode& node, const BoundingBox& box) const;
+    /// Return dequantized bounds of a node.
+    BoundingBox GetNodeBox(const TriangleBVHNode& node) const;
+    /// Collect triangles from leaves accepted by a volume test.
+    template <class T> void CollectTriangles(PODVector<unsigned>& dest, const T& volume) const;
+
+    /// Nodes, root first.
+    PODVector<TriangleBVHNode> nodes_;
+    /// Vertex index triples in leaf order.
+    PODVector<unsigned> indices_;
+    /// Bounding box of all triangles.
+    BoundingBox boundingBox_;
+    /// Size of one quantization step on each axis.
+    Vector3 quantizeStep_;
+};
+
+}
@@ -31,12 +31,16 @@
 #include "../Graphics/GraphicsEvents.h"
 #include "../Graphics/GraphicsImpl.h"
 #include "../Graphics/ImmediateRender.h"
+#ifdef URHO3D_COMPUTE
+#include "../Graphics/LightTiler.h"
+#endif
 #include "../Graphics/Material.h"
 #include "../Graphics/OcclusionBuffer.h"
 #include "../Graphics/Octree.h"
 #include "../Graphics/Renderer.h"
 #include "../Graphics/RenderPath.h"
 #include "../Graphics/ShaderVariation.h"
+#include "../Graphics/ShadowMapCache.h"
 #include "../Graphics/Skybox.h"
 #include "../Graphics/Technique.h"
 #include "../Graphics/Texture2D.h"
@@ -56,6 +60,11 @@
 namespace Urho3D
 {
 
+/// Azimuth, inclination and depth cells of the clustered light tables.
+static const IntVector3 CLUSTER_CELLS(16, 8, 24);
+/// Maximum lights, probes or decals in a clustered light table cell.
+static const unsigned CLUSTER_ITEMS_PER_CELL = 64;
+
 /// %Frustum octree query for shadowcasters.
 class ShadowCasterOctreeQuery : public FrustumOctreeQuery
 {
@@ -275,7 +284,38 @@ void SortShadowQueueWork(const WorkItem* item, unsigned threadIndex)
 {
     auto* start = reinterpret_cast<LightBatchQueue*>(item->start_);
     for (unsigned i = 0; i < start->shadowSplits_.Size(); ++i)
+    {
         start->shadowSplits_[i].shadowBatches_.SortFrontToBack();
+        start->shadowSplits_[i].staticShadowBatches_.SortFrontToBack();
+    }
+}
+
+/// Return the mask of point light shadow faces a bounding box may intersect, in the shadow camera order +X, -X, +Y, -Y, +Z, -Z.
+static unsigned GetPointLightFaces(const BoundingBox& box, const Vector3& lightPosition, float nearClip)
+{
+    Vector3 min = box.min_ - lightPosition;
+    Vector3 max = box.max_ - lightPosition;
+    const float* minData = min.Data();
+    const float* maxData = max.Data();
+
+    // Distance from the light to the box along each axis, zero if the box straddles the light
+    float closest[3];
+    for (unsigned axis = 0; axis < 3; ++axis)
+        closest[axis] = minData[axis] > 0.0f ? minData[axis] : (maxData[axis] < 0.0f ? -maxData[axis] : 0.0f);
+
+    // A face's 90 degree frustum holds the points whose distance along its axis is at least the distance along the two other
+    // axes. As the axes are independent, testing the farthest extent against the closest other distances is exact
+    unsigned faces = 0;
+    for (unsigned axis = 0; axis < 3; ++axis)
+    {
+        float threshold = Max(Max(closest[(axis + 1) % 3], closest[(axis + 2) % 3]), nearClip);
+        if (maxData[axis] >= threshold)
+            faces |= 1u << (axis * 2);
+        if (-minData[axis] >= threshold)
+            faces |= 1u << (axis * 2 + 1);
+    }
+
+    return faces;
 }
 
 StringHash ParseTextureTypeXml(ResourceCache* cache, const String& filename);
@@ -293,6 +333,10 @@ View::View(Context* context) :
     occlusionBuffer_(nullptr),
     renderTarget_(nullptr),
     substituteRenderTarget_(nullptr),
+    numLightQueries_(0),
+    numCachedLightQueries_(0),
+    numPrimitives_(0),
+    clusteredLightsCommand_(nullptr),
     passCommand_(nullptr)
 {
     // Create octree query and scene results vector for each thread
@@ -300,6 +344,7 @@ View::View(Context* context) :
     tempDrawables_.Resize(numThreads);
     sceneResults_.Resize(numThreads);
     frame_.camera_ = nullptr;
+    frame_.lodPolicy_ = nullptr;
 }
 
 View::~View() = default;
@@ -363,6 +408,7 @@ bool View::Define(RenderSurface* renderTarget, Viewport* viewport)
             noStencil_ = sourceView_->noStencil_;
             lightVolumeCommand_ = sourceView_->lightVolumeCommand_;
             forwardLightsCommand_ = sourceView_->forwardLightsCommand_;
+            clusteredLightsCommand_ = sourceView_->clusteredLightsCommand_;
             sceneManager_ = sourceView_->sceneManager_;
             return true;
         }
@@ -388,6 +434,7 @@ bool View::Define(RenderSurface* renderTarget, Viewport* viewport)
     noStencil_ = false;
     lightVolumeCommand_ = nullptr;
     forwardLightsCommand_ = nullptr;
+    clusteredLightsCommand_ = nullptr;
 
     scenePasses_.Clear();
     geometriesUpdated_ = false;
@@ -421,12 +468,13 @@ bool View::Define(RenderSurface* renderTarget, Viewport* viewport)
         if (!command.enabled_)
             continue;
 
-        if (command.type_ == CMD_SCENEPASS)
+        if (command.IsScenePass())
         {
             hasScenePasses_ = true;
 
             ScenePassInfo info{};
-            info.passIndex_ = command.passIndex_ = Technique::GetPassIndex(command.pass_);
+            info.passIndex_ = command.passIndex_ =
+                Technique::GetPassIndex(command.type_ == CMD_CLUSTEREDLIGHTS && command.pass_.Empty() ? String("base") : command.pass_);
             info.allowInstancing_ = command.sortMode_ != SORT_BACKTOFRONT;
             info.markToStencil_ = !noStencil_ && command.markToStencil_;
             info.vertexLights_ = command.vertexLights_;
@@ -456,6 +504,12 @@ bool View::Define(RenderSurface* renderTarget, Viewport* viewport)
             SetQueueShaderDefines(*info.batchQueue_, command);
 
             scenePasses_.Push(info);
+
+#ifdef URHO3D_COMPUTE
+            // Without compute the light tables can not be built, and the command is an ordinary scene pass
+            if (command.type_ == CMD_CLUSTEREDLIGHTS)
+                clusteredLightsCommand_ = &command;
+#endif
         }
         // Allow a custom forward light pass
         else if (command.type_ == CMD_FORWARDLIGHTS && !command.pass_.Empty())
@@ -493,7 +547,7 @@ bool View::Define(RenderSurface* renderTarget, Viewport* viewport)
             continue;
 
         // Check if ambient pass and G-buffer rendering happens at the same time
-        if (command.type_ == CMD_SCENEPASS && command.outputs_.Size() > 1)
+        if (command.IsScenePass() && command.outputs_.Size() > 1)
         {
             if (CheckViewportWrite(command))
                 deferredAmbient_ = true;
@@ -510,6 +564,17 @@ bool View::Define(RenderSurface* renderTarget, Viewport* viewport)
         }
     }
 
+#ifdef URHO3D_COMPUTE
+    if (clusteredLightsCommand_)
+    {
+        // Lit base batches would replace the base pass batches that shade the clustered lights, so the remaining light
+        // queues are drawn additively
+        useLitBase_ = false;
+        if (!lightTiler_)
+            lightTiler_ = new LightTiler(context_, CLUSTER_CELLS, CLUSTER_ITEMS_PER_CELL);
+    }
+#endif
+
     drawShadows_ = renderer_->GetDrawShadows();
     materialQuality_ = renderer_->GetMaterialQuality();
     maxOccluderTriangles_ = renderer_->GetMaxOccluderTriangles();
@@ -543,6 +608,7 @@ void View::Update(const FrameInfo& frame)
     frame_.timeStep_ = frame.timeStep_;
     frame_.frameNumber_ = frame.frameNumber_;
     frame_.viewSize_ = viewSize_;
+    frame_.lodPolicy_ = frame.lodPolicy_;
 
     using namespace BeginViewUpdate;
 
@@ -582,6 +648,9 @@ void View::Render()
 {
     SendViewEvent(E_BEGINVIEWRENDER);
 
+    numPrimitives_ = 0;
+    unsigned startPrimitives = graphics_->GetNumPrimitives();
+
     if (hasScenePasses_ && (!sceneManager_ || !camera_))
     {
         SendViewEvent(E_ENDVIEWRENDER);
@@ -711,6 +780,8 @@ void View::Render()
     if (currentRenderTarget_ != renderTarget_)
         BlitFramebuffer(currentRenderTarget_->GetParentTexture(), renderTarget_, !usedResolve_);
 
+    numPrimitives_ = graphics_->GetNumPrimitives() - startPrimitives;
+
     SendViewEvent(E_ENDVIEWRENDER);
 }
 
@@ -729,6 +800,23 @@ View* View::GetSourceView() const
     return sourceView_;
 }
 
+unsigned View::GetNumLitBatches() const
+{
+    unsigned numBatches = 0;
+    for (Vector<LightBatchQueue>::ConstIterator i = lightQueues_.Begin(); i != lightQueues_.End(); ++i)
+        numBatches += i->litBaseBatches_.GetNumBatches() + i->litBatches_.GetNumBatches();
+    return numBatches;
+}
+
+unsigned View::GetNumClusteredLights() const
+{
+#ifdef URHO3D_COMPUTE
+    return clusteredLights_.Size();
+#else
+    return 0;
+#endif
+}
+
 void View::SetGlobalShaderParameters()
 {
     graphics_->SetShaderParameter(VSP_DELTATIME, frame_.timeStep_);
@@ -1125,6 +1213,39 @@ void View::GetDrawables()
     }
 
     Sort(lights_.Begin(), lights_.End(), CompareLights);
+
+    demotedLights_.Clear();
+    unsigned lightBudget = (unsigned)renderer_->GetLightBudget();
+    if (lightBudget)
+        ApplyLightBudget(lightBudget);
+    else
+        budgetedLights_.Clear();
+}
+
+void View::ApplyLightBudget(unsigned budget)
+{
+    URHO3D_PROFILE(ApplyLightBudget);
+
+    // Clustered lights cost the same regardless of count, so only lights that need light queues are budgeted
+    lightImportances_.Clear();
+    for (PODVector<Light*>::ConstIterator i = lights_.Begin(); i != lights_.End(); ++i)
+    {
+        Light* light = *i;
+        if (!light->GetPerVertex() && !IsClusteredLight(light))
+            lightImportances_.Push(LightImportance{light, GetLightImportance(light, cullCamera_)});
+    }
+
+    if (lightImportances_.Size() > budget)
+        SortLightsByImportance(lightImportances_, budgetedLights_, renderer_->GetLightBudgetHysteresis());
+
+    budgetedLights_.Clear();
+    for (unsigned i = 0; i < lightImportances_.Size(); ++i)
+    {
+        if (i < budget)
+            budgetedLights_.Insert(lightImportances_[i].light_);
+        else
+            demotedLights_.Insert(lightImportances_[i].light_);
+    }
 }
 
 void View::GetBatches()
@@ -1134,6 +1255,7 @@ void View::GetBatches()
 
     nonThreadedGeometries_.Clear();
     threadedGeometries_.Clear();
+    stagedGeometries_.Clear();
 
     ProcessLights();
     GetLightBatches();
@@ -1146,17 +1268,40 @@ void View::ProcessLights()
     URHO3D_PROFILE(ProcessLights);
 
     auto* queue = GetSubsystem<WorkQueue>();
-    lightQueryResults_.Resize(lights_.Size());
 
-    for (unsigned i = 0; i < lightQueryResults_.Size(); ++i)
+    // Clustered lights are shaded from the light tables, so they need no lit geometries, shadow casters or light queues
+    unsigned numProcessedLights = lights_.Size();
+#ifdef URHO3D_COMPUTE
+    clusteredLights_.Clear();
+    if (clusteredLightsCommand_)
     {
+        for (PODVector<Light*>::ConstIterator i = lights_.Begin(); i != lights_.End(); ++i)
+        {
+            if (IsClusteredLight(*i))
+                clusteredLights_.Push(SharedPtr<Light>(*i));
+        }
+        numProcessedLights -= clusteredLights_.Size();
+    }
+#endif
+    lightQueryResults_.Resize(numProcessedLights);
+
+    unsigned queryIndex = 0;
+    for (unsigned i = 0; i < lights_.Size(); ++i)
+    {
+        if (IsClusteredLight(lights_[i]))
+            continue;
+
         SharedPtr<WorkItem> item = queue->GetFreeItem();
         item->priority_ = M_MAX_UNSIGNED;
         item->workFunction_ = ProcessLightWork;
         item->aux_ = this;
 
-        LightQueryResult& query = lightQueryResults_[i];
+        LightQueryResult& query = lightQueryResults_[queryIndex++];
         query.light_ = lights_[i];
+        // The influence cache is a hash map, so look up the entry here in the main thread
+        query.influence_ = query.light_->GetLightType() != LIGHT_DIRECTIONAL ? renderer_->GetLightInfluence(query.light_) : nullptr;
+        query.influenceQueried_ = false;
+        query.perVertex_ = query.light_->GetPerVertex() || demotedLights_.Contains(query.light_);
 
         item->start_ = &query;
         queue->AddWorkItem(item);
@@ -1164,6 +1309,33 @@ void View::ProcessLights()
 
     // Ensure all lights have been processed before proceeding
     queue->Complete(M_MAX_UNSIGNED);
+
+    numLightQueries_ = 0;
+    numCachedLightQueries_ = 0;
+    for (Vector<LightQueryResult>::ConstIterator i = lightQueryResults_.Begin(); i != lightQueryResults_.End(); ++i)
+    {
+        if (i->influenceQueried_)
+            ++numLightQueries_;
+        else if (i->influence_)
+            ++numCachedLightQueries_;
+    }
+
+#ifdef URHO3D_COMPUTE
+    if (clusteredLightsCommand_)
+    {
+        // The head camera comes first, followed by the eyes which widen the tables to cover both
+        Camera* cameras[] = { cullCamera_, leftEye_, rightEye_ };
+        lightTiler_->BuildLightTables_Radial(cameras, IsVR() ? 3 : 1, clusteredLights_);
+#ifdef _DEBUG
+        // A light anywhere in view, including directly above or below the view axis, must land in a cell, and every cell a
+        // light touches must list it
+        if (unsigned missing = lightTiler_->ValidateViewCoverage())
+            URHO3D_LOGWARNING("Light grid misses " + String(missing) + " sampled view directions");
+        if (unsigned missing = lightTiler_->ValidateLightTables())
+            URHO3D_LOGWARNING("Light tables miss " + String(missing) + " light entries");
+#endif
+    }
+#endif
 }
 
 void View::GetLightBatches()
@@ -1179,7 +1351,7 @@ void View::GetLightBatches()
         unsigned usedLightQueues = 0;
         for (Vector<LightQueryResult>::ConstIterator i = lightQueryResults_.Begin(); i != lightQueryResults_.End(); ++i)
         {
-            if (!i->light_->GetPerVertex() && i->litGeometries_.Size())
+            if (!i->perVertex_ && i->litGeometries_.Size())
                 ++numLightQueues;
         }
 
@@ -1198,7 +1370,7 @@ void View::GetLightBatches()
             Light* light = query.light_;
 
             // Per-pixel light
-            if (!light->GetPerVertex())
+            if (!query.perVertex_)
             {
                 unsigned shadowSplits = query.numSplits_;
 
@@ -1208,6 +1380,8 @@ void View::GetLightBatches()
                 lightQueue.light_ = light;
                 lightQueue.negative_ = light->IsNegative();
                 lightQueue.shadowMap_ = nullptr;
+                lightQueue.shadowMapRegion_ = IntRect::ZERO;
+                lightQueue.shadowCache_ = nullptr;
                 lightQueue.litBaseBatches_.Clear(maxSortedInstances);
                 lightQueue.litBatches_.Clear(maxSortedInstances);
                 if (forwardLightsCommand_)
@@ -1231,6 +1405,21 @@ void View::GetLightBatches()
                         shadowSplits = 0;
                 }
 
+                // Find the light's region of the shadow atlas, or use the whole shadow map
+                unsigned shadowRegionId = 0;
+                if (shadowSplits > 0 && !renderer_->GetShadowAtlasRegion(light, lightQueue.shadowMapRegion_, shadowRegionId))
+                {
+                    lightQueue.shadowMapRegion_ =
+                        IntRect(0, 0, lightQueue.shadowMap_->GetWidth(), lightQueue.shadowMap_->GetHeight());
+                }
+
+                // Use the static shadow cache if enabled. Directional light splits follow the view, so they can not be cached
+                ShadowMapCache* shadowCache = light->GetShadowMapCache();
+                if (shadowSplits > 0 && shadowCache && light->GetLightType() != LIGHT_DIRECTIONAL &&
+                    shadowCache->BeginView(this, frame_.frameNumber_, lightQueue.shadowMap_, light->GetShadowBias(),
+                        shadowRegionId ? renderer_->GetStaticShadowAtlas() : nullptr, shadowRegionId))
+                    lightQueue.shadowCache_ = shadowCache;
+
                 // Setup shadow batch queues
                 lightQueue.shadowSplits_.Resize(shadowSplits);
                 for (unsigned j = 0; j < shadowSplits; ++j)
@@ -1241,10 +1430,13 @@ void View::GetLightBatches()
                     shadowQueue.nearSplit_ = query.shadowNearSplits_[j];
                     shadowQueue.farSplit_ = query.shadowFarSplits_[j];
                     shadowQueue.shadowBatches_.Clear(maxSortedInstances);
+                    shadowQueue.staticShadowBatches_.Clear(maxSortedInstances);
 
                     // Setup the shadow split viewport and finalize shadow camera parameters
-                    shadowQueue.shadowViewport_ = GetShadowMapViewport(light, j, lightQueue.shadowMap_);
+                    shadowQueue.shadowViewport_ = GetShadowMapViewport(light, j, lightQueue.shadowMapRegion_);
                     FinalizeShadowCamera(shadowCamera, light, shadowQueue.shadowViewport_, query.shadowCasterBox_[j]);
+                    if (lightQueue.shadowCache_)
+                        lightQueue.shadowCache_->AddSplit(shadowCamera, shadowQueue.shadowViewport_);
 
                     // Loop through shadow casters
                     for (PODVector<Drawable*>::ConstIterator k = query.shadowCasters_.Begin() + query.shadowCasterBegin_[j];
@@ -1260,28 +1452,32 @@ void View::GetLightBatches()
                                 nonThreadedGeometries_.Push(drawable);
                             else if (type == UPDATE_WORKER_THREAD)
                                 threadedGeometries_.Push(drawable);
+                            else if (type == UPDATE_WORKER_THREAD_STAGED)
+                            {
+                                threadedGeometries_.Push(drawable);
+                                stagedGeometries_.Push(drawable);
+                            }
                         }
 
-                        const Vector<SourceBatch>& batches = drawable->GetBatches();
+                        // Static casters are only recorded now; their batches are needed only if the cache must be re-rendered
+                        if (lightQueue.shadowCache_ && lightQueue.shadowCache_->IsStaticCaster(drawable))
+                            lightQueue.shadowCache_->AddStaticCaster(drawable, j);
+                        else
+                            GetShadowBatches(drawable, shadowQueue.shadowBatches_);
+                    }
+                }
 
-                        for (unsigned l = 0; l < batches.Size(); ++l)
+                // Collect the static casters' batches if they changed since the cache was last rendered
+                if (lightQueue.shadowCache_ && lightQueue.shadowCache_->EndView())
+                {
+                    for (unsigned j = 0; j < shadowSplits; ++j)
+                    {
+                        ShadowBatchQueue& shadowQueue = lightQueue.shadowSplits_[j];
+                        for (PODVector<Drawable*>::ConstIterator k = query.shadowCasters_.Begin() + query.shadowCasterBegin_[j];
+                             k < query.shadowCasters_.Begin() + query.shadowCasterEnd_[j]; ++k)
                         {
-                            const SourceBatch& srcBatch = batches[l];
-
-                            Technique* tech = GetTechnique(drawable, srcBatch.material_);
-                            if (!srcBatch.geometry_ || !srcBatch.numWorldTransforms_ || !tech)
-                                continue;
-
-                            Pass* pass = tech->GetSupportedPass(Technique::shadowPassIndex);
-                            // Skip if material has no shadow pass
-                            if (!pass)
-                                continue;
-
-                            Batch destBatch(srcBatch);
-                            destBatch.pass_ = pass;
-                            destBatch.zone_ = nullptr;
-
-                            AddBatchToQueue(shadowQueue.shadowBatches_, destBatch, tech);
+                            if (lightQueue.shadowCache_->IsStaticCaster(*k))
+                                GetShadowBatches(*k, shadowQueue.staticShadowBatches_);
                         }
                     }
                 }
@@ -1367,6 +1563,11 @@ void View::GetBaseBatches()
             nonThreadedGeometries_.Push(drawable);
         else if (type == UPDATE_WORKER_THREAD)
             threadedGeometries_.Push(drawable);
+        else if (type == UPDATE_WORKER_THREAD_STAGED)
+        {
+            threadedGeometries_.Push(drawable);
+            stagedGeometries_.Push(drawable);
+        }
 
         const Vector<SourceBatch>& batches = drawable->GetBatches();
         bool vertexLightsProcessed = false;
@@ -1464,7 +1665,7 @@ void View::UpdateGeometries()
             if (!IsNecessary(command))
                 continue;
 
-            if (command.type_ == CMD_SCENEPASS)
+            if (command.IsScenePass())
             {
                 SharedPtr<WorkItem> item = queue->GetFreeItem();
                 item->priority_ = M_MAX_UNSIGNED;
@@ -1539,9 +1740,39 @@ void View::UpdateGeometries()
 
     // Finally ensure all threaded work has completed
     queue->Complete(M_MAX_UNSIGNED);
+
+    // Upload the data that worker threads prepared into staging memory
+    for (PODVector<Drawable*>::ConstIterator i = stagedGeometries_.Begin(); i != stagedGeometries_.End(); ++i)
+        (*i)->CommitGeometry(frame_);
+
     geometriesUpdated_ = true;
 }
 
+void View::GetShadowBatches(Drawable* drawable, BatchQueue& shadowBatches)
+{
+    const Vector<SourceBatch>& batches = drawable->GetBatches();
+
+    for (unsigned i = 0; i < batches.Size(); ++i)
+    {
+        const SourceBatch& srcBatch = batches[i];
+
+        Technique* tech = GetTechnique(drawable, srcBatch.material_);
+        if (!srcBatch.geometry_ || !srcBatch.numWorldTransforms_ || !tech)
+            continue;
+
+        Pass* pass = tech->GetSupportedPass(Technique::shadowPassIndex);
+        // Skip if material has no shadow pass
+        if (!pass)
+            continue;
+
+        Batch destBatch(srcBatch);
+        destBatch.pass_ = pass;
+        destBatch.zone_ = nullptr;
+
+        AddBatchToQueue(shadowBatches, destBatch, tech);
+    }
+}
+
 void View::GetLitBatches(Drawable* drawable, LightBatchQueue& lightQueue, BatchQueue* alphaQueue)
 {
     Light* light = lightQueue.light_;
@@ -1608,7 +1839,7 @@ void View::GetLitBatches(Drawable* drawable, LightBatchQueue& lightQueue, BatchQ
         {
             // Transparent batches can not be instanced, and shadows on transparencies can only be rendered if shadow maps are
             // not reused
-            AddBatchToQueue(*alphaQueue, destBatch, tech, false, !renderer_->GetReuseShadowMaps());
+            AddBatchToQueue(*alphaQueue, destBatch, tech, false, !IsReusingShadowMaps());
         }
     }
 }
@@ -1618,14 +1849,19 @@ void View::ExecuteRenderPathCommands()
     View* actualView = sourceView_ ? sourceView_ : this;
 
     // If not reusing shadowmaps, render all of them first
-    if (!renderer_->GetReuseShadowMaps() && renderer_->GetDrawShadows() && !actualView->lightQueues_.Empty())
+    if (!IsReusingShadowMaps() && renderer_->GetDrawShadows() && !actualView->lightQueues_.Empty())
     {
         URHO3D_PROFILE(RenderShadowMaps);
 
-        for (Vector<LightBatchQueue>::Iterator i = actualView->lightQueues_.Begin(); i != actualView->lightQueues_.End(); ++i)
+        if (renderer_->IsShadowAtlasEnabled())
+            RenderShadowAtlas(actualView->lightQueues_);
+        else
         {
-            if (NeedRenderShadowMap(*i))
-                RenderShadowMap(*i);
+            for (Vector<LightBatchQueue>::Iterator i = actualView->lightQueues_.Begin(); i != actualView->lightQueues_.End(); ++i)
+            {
+                if (NeedRenderShadowMap(*i))
+                    RenderShadowMap(*i);
+            }
         }
     }
 
@@ -1750,6 +1986,7 @@ void View::ExecuteRenderPathCommands()
                 break;
 
             case CMD_SCENEPASS:
+            case CMD_CLUSTEREDLIGHTS:
                 {
                     
                     BatchQueue& queue = actualView->batchQueues_[command.passIndex_];
@@ -1759,6 +1996,17 @@ void View::ExecuteRenderPathCommands()
 
                         SetRenderTargets(command);
                         bool allowDepthWrite = SetTextures(command);
+#ifdef URHO3D_COMPUTE
+                        // Bind the light tables to the light texture units, which the base pass does not otherwise use
+                        if (command.type_ == CMD_CLUSTEREDLIGHTS && actualView->lightTiler_)
+                        {
+                            LightTiler* tiler = actualView->lightTiler_;
+                            graphics_->SetReadBuffer(TU_LIGHTRAMP, tiler->cellsUBO_);
+                            graphics_->SetReadBuffer(TU_LIGHTSHAPE, tiler->lightsUBO_);
+                            graphics_->SetReadBuffer(TU_SHADOWMAP, tiler->lightIndexesUBO_);
+                            graphics_->SetReadBuffer(TU_LIGHTBUFFER, tiler->clusterInfo_);
+                        }
+#endif
                         graphics_->SetClipPlane(camera_->GetUseClipping(), camera_->GetClipPlane(), camera_->GetView(),
                             camera_->GetGPUProjection());
 
@@ -1798,7 +2046,7 @@ void View::ExecuteRenderPathCommands()
                     for (Vector<LightBatchQueue>::Iterator i = actualView->lightQueues_.Begin(); i != actualView->lightQueues_.End(); ++i)
                     {
                         // If reusing shadowmaps, render each of them before the lit batches
-                        if (renderer_->GetReuseShadowMaps() && NeedRenderShadowMap(*i))
+                        if (IsReusingShadowMaps() && NeedRenderShadowMap(*i))
                         {
                             RenderShadowMap(*i);
                             SetRenderTargets(command);
@@ -1844,7 +2092,7 @@ void View::ExecuteRenderPathCommands()
                     for (Vector<LightBatchQueue>::Iterator i = actualView->lightQueues_.Begin(); i != actualView->lightQueues_.End(); ++i)
                     {
                         // If reusing shadowmaps, render each of them before the lit batches
-                        if (renderer_->GetReuseShadowMaps() && NeedRenderShadowMap(*i))
+                        if (IsReusingShadowMaps() && NeedRenderShadowMap(*i))
                         {
                             RenderShadowMap(*i);
                             SetRenderTargets(command);
@@ -2100,7 +2348,7 @@ void View::RenderQuad(RenderPathCommand& command)
 bool View::IsNecessary(const RenderPathCommand& command)
 {
     return command.enabled_ && command.outputs_.Size() &&
-           (command.type_ != CMD_SCENEPASS || !batchQueues_[command.passIndex_].IsEmpty());
+           (!command.IsScenePass() || !batchQueues_[command.passIndex_].IsEmpty());
 }
 
 bool View::CheckViewportRead(const RenderPathCommand& command)
@@ -2176,7 +2424,7 @@ void View::AllocateScreenBuffers()
             hasPingpong = true;
         if (command.depthStencilName_.Length())
             hasCustomDepth = true;
-        if (!hasScenePassToRTs && command.type_ == CMD_SCENEPASS)
+        if (!hasScenePassToRTs && command.IsScenePass())
         {
             for (unsigned j = 0; j < command.outputs_.Size(); ++j)
             {
@@ -2482,7 +2730,7 @@ void View::ProcessLight(LightQueryResult& query, unsigned threadIndex)
     const Frustum& frustum = cullCamera_->GetFrustum();
 
     // Check if light should be shadowed
-    bool isShadowed = drawShadows_ && light->GetCastShadows() && !light->GetPerVertex() && light->GetShadowIntensity() < 1.0f;
+    bool isShadowed = drawShadows_ && light->GetCastShadows() && !query.perVertex_ && light->GetShadowIntensity() < 1.0f;
     // If shadow distance non-zero, check it
     if (isShadowed && light->GetShadowDistance() > 0.0f && light->GetDistance() > light->GetShadowDistance())
         isShadowed = false;
@@ -2506,27 +2754,40 @@ void View::ProcessLight(LightQueryResult& query, unsigned threadIndex)
         break;
 
     case LIGHT_SPOT:
+    case LIGHT_POINT:
         {
-            FrustumOctreeQuery octreeQuery(tempDrawables, light->GetFrustum(), DRAWABLE_GEOMETRY,
-                cullCamera_->GetViewMask());
-            sceneManager_->GetDrawables(octreeQuery);
-            for (unsigned i = 0; i < tempDrawables.Size(); ++i)
+            // The geometries in the light volume are the same for every view, so query them only in the first view that
+            // processes the light this frame, with all view mask bits. Stereo eyes and cube map faces reuse the result
+            LightInfluence& influence = *query.influence_;
+            if (influence.frameNumber_ != frame_.frameNumber_)
             {
-                if (tempDrawables[i]->IsInView(frame_, IsVR()) && (GetLightMask(tempDrawables[i]) & lightMask))
-                    query.litGeometries_.Push(tempDrawables[i]);
+                if (type == LIGHT_SPOT)
+                {
+                    FrustumOctreeQuery octreeQuery(influence.geometries_, light->GetFrustum(), DRAWABLE_GEOMETRY);
+                    sceneManager_->GetDrawables(octreeQuery);
+                }
+                else
+                {
+                    SphereOctreeQuery octreeQuery(influence.geometries_, Sphere(light->GetNode()->GetWorldPosition(),
+                        light->GetRange()), DRAWABLE_GEOMETRY);
+                    sceneManager_->GetDrawables(octreeQuery);
+                }
+                influence.frameNumber_ = frame_.frameNumber_;
+                query.influenceQueried_ = true;
             }
-        }
-        break;
 
-    case LIGHT_POINT:
-        {
-            SphereOctreeQuery octreeQuery(tempDrawables, Sphere(light->GetNode()->GetWorldPosition(), light->GetRange()),
-                DRAWABLE_GEOMETRY, cullCamera_->GetViewMask());
-            sceneManager_->GetDrawables(octreeQuery);
-            for (unsigned i = 0; i < tempDrawables.Size(); ++i)
+            // Intersect with this view's visible set through the in-view flags. The geometries in this view's mask are also
+            // the shadow caster candidates
+            unsigned viewMask = cullCamera_->GetViewMask();
+            tempDrawables.Clear();
+            for (PODVector<Drawable*>::ConstIterator i = influence.geometries_.Begin(); i != influence.geometries_.End(); ++i)
             {
-                if (tempDrawables[i]->IsInView(frame_, IsVR()) && (GetLightMask(tempDrawables[i]) & lightMask))
-                    query.litGeometries_.Push(tempDrawables[i]);
+                Drawable* drawable = *i;
+                if (!(drawable->GetViewMask() & viewMask))
+                    continue;
+                tempDrawables.Push(drawable);
+                if (drawable->IsInView(frame_, IsVR()) && (GetLightMask(drawable) & lightMask))
+                    query.litGeometries_.Push(drawable);
             }
         }
         break;
@@ -2542,115 +2803,215 @@ void View::ProcessLight(LightQueryResult& query, unsigned threadIndex)
     // Determine number of shadow cameras and setup their initial positions
     SetupShadowCameras(query);
 
-    // Process each split for shadow casters
-    query.shadowCasters_.Clear();
+    // Find the splits that can contribute to the view
+    unsigned activeSplits = 0;
     for (unsigned i = 0; i < query.numSplits_; ++i)
     {
-        Camera* shadowCamera = query.shadowCameras_[i];
-        const Frustum& shadowCameraFrustum = shadowCamera->GetFrustum();
-        query.shadowCasterBegin_[i] = query.shadowCasterEnd_[i] = query.shadowCasters_.Size();
-
         // For point light check that the face is visible: if not, can skip the split
-        if (type == LIGHT_POINT && frustum.IsInsideFast(BoundingBox(shadowCameraFrustum)) == OUTSIDE)
+        if (type == LIGHT_POINT && frustum.IsInsideFast(BoundingBox(query.shadowCameras_[i]->GetFrustum())) == OUTSIDE)
             continue;
 
         // For directional light check that the split is inside the visible scene: if not, can skip the split
-        if (type == LIGHT_DIRECTIONAL)
-        {
-            if (minZ_ > query.shadowFarSplits_[i])
-                continue;
-            if (maxZ_ < query.shadowNearSplits_[i])
-                continue;
+        if (type == LIGHT_DIRECTIONAL && (minZ_ > query.shadowFarSplits_[i] || maxZ_ < query.shadowNearSplits_[i]))
+            continue;
+
+        activeSplits |= 1u << i;
+    }
 
-            // Reuse lit geometry query for all except directional lights
-            ShadowCasterOctreeQuery query(tempDrawables, shadowCameraFrustum, DRAWABLE_GEOMETRY, cullCamera_->GetViewMask());
-            sceneManager_->GetDrawables(query);
+    // Reuse lit geometry query for all except directional lights. The directional light splits share the light rotation, so
+    // query once with a light-aligned volume enclosing all active splits
+    if (type == LIGHT_DIRECTIONAL)
+        tempDrawables.Clear();
+    if (type == LIGHT_DIRECTIONAL && activeSplits)
+    {
+        const Matrix3x4& lightView = query.shadowCameras_[0]->GetView();
+        BoundingBox splitsBox;
+        for (unsigned i = 0; i < query.numSplits_; ++i)
+        {
+            if (activeSplits & (1u << i))
+                splitsBox.Merge(BoundingBox(query.shadowCameras_[i]->GetFrustum().Transformed(lightView)));
         }
 
-        // Check which shadow casters actually contribute to the shadowing
-        ProcessShadowCasters(query, tempDrawables, i);
+        Frustum splitsFrustum;
+        splitsFrustum.Define(splitsBox, lightView.Inverse());
+        ShadowCasterOctreeQuery octreeQuery(tempDrawables, splitsFrustum, DRAWABLE_GEOMETRY, cullCamera_->GetViewMask());
+        sceneManager_->GetDrawables(octreeQuery);
     }
 
+    // Check which shadow casters actually contribute to the shadowing
+    ProcessShadowCasters(query, tempDrawables, activeSplits);
+
     // If no shadow casters, the light can be rendered unshadowed. At this point we have not allocated a shadow map yet, so the
     // only cost has been the shadow camera setup & queries
     if (query.shadowCasters_.Empty())
         query.numSplits_ = 0;
 }
 
-void View::ProcessShadowCasters(LightQueryResult& query, const PODVector<Drawable*>& drawables, unsigned splitIndex)
+void View::ProcessShadowCasters(LightQueryResult& query, const PODVector<Drawable*>& drawables, unsigned activeSplits)
 {
     Light* light = query.light_;
     unsigned lightMask = light->GetLightMask();
-
-    Camera* shadowCamera = query.shadowCameras_[splitIndex];
-    const Frustum& shadowCameraFrustum = shadowCamera->GetFrustum();
-    const Matrix3x4& lightView = shadowCamera->GetView();
-    const Matrix4& lightProj = shadowCamera->GetProjection();
     LightType type = light->GetLightType();
+    bool focusedSpot = type == LIGHT_SPOT && light->GetShadowFocus().focus_;
 
-    query.shadowCasterBox_[splitIndex].Clear();
+    Frustum lightViewFrustums[MAX_LIGHT_SPLITS];
+    BoundingBox lightViewFrustumBoxes[MAX_LIGHT_SPLITS];
+    // Directional light splits' shadow camera volumes in their view space, and translations from the first split's view space
+    BoundingBox splitViewBoxes[MAX_LIGHT_SPLITS];
+    Vector3 splitOffsets[MAX_LIGHT_SPLITS];
+    unsigned splitCounts[MAX_LIGHT_SPLITS];
 
-    // Transform scene frustum into shadow camera's view space for shadow caster visibility check. For point & spot lights,
-    // we can use the whole scene frustum. For directional lights, use the intersection of the scene frustum and the split
-    // frustum, so that shadow casters do not get rendered into unnecessary splits
-    Frustum lightViewFrustum;
-    if (type != LIGHT_DIRECTIONAL)
-        lightViewFrustum = cullCamera_->GetSplitFrustum(minZ_, maxZ_).Transformed(lightView);
-    else
-        lightViewFrustum = cullCamera_->GetSplitFrustum(Max(minZ_, query.shadowNearSplits_[splitIndex]),
-            Min(maxZ_, query.shadowFarSplits_[splitIndex])).Transformed(lightView);
-
-    BoundingBox lightViewFrustumBox(lightViewFrustum);
+    for (unsigned i = 0; i < query.numSplits_; ++i)
+    {
+        query.shadowCasterBox_[i].Clear();
+        splitCounts[i] = 0;
+        if (!(activeSplits & (1u << i)))
+            continue;
 
-    // Check for degenerate split frustum: in that case there is no need to get shadow casters
-    if (lightViewFrustum.vertices_[0] == lightViewFrustum.vertices_[4])
-        return;
+        Camera* shadowCamera = query.shadowCameras_[i];
+        const Matrix3x4& lightView = shadowCamera->GetView();
 
-    BoundingBox lightViewBox;
-    BoundingBox lightProjBox;
+        // Transform scene frustum into shadow camera's view space for shadow caster visibility check. For point & spot lights,
+        // we can use the whole scene frustum. For directional lights, use the intersection of the scene frustum and the split
+        // frustum, so that shadow casters do not get rendered into unnecessary splits
+        if (type != LIGHT_DIRECTIONAL)
+            lightViewFrustums[i] = cullCamera_->GetSplitFrustum(minZ_, maxZ_).Transformed(lightView);
+        else
+            lightViewFrustums[i] = cullCamera_->GetSplitFrustum(Max(minZ_, query.shadowNearSplits_[i]),
+                Min(maxZ_, query.shadowFarSplits_[i])).Transformed(lightView);
 
-    for (PODVector<Drawable*>::ConstIterator i = drawables.Begin(); i != drawables.End(); ++i)
-    {
-        Drawable* drawable = *i;
-        // In case this is a point or spot light query result reused for optimization, we may have non-shadowcasters included.
-        // Check for that first
-        if (!drawable->GetCastShadows())
-            continue;
-        // Check shadow mask
-        if (!(GetShadowMask(drawable) & lightMask))
-            continue;
-        // For point light, check that this drawable is inside the split shadow camera frustum
-        if (type == LIGHT_POINT && shadowCameraFrustum.IsInsideFast(drawable->GetWorldBoundingBox()) == OUTSIDE)
+        // Check for degenerate split frustum: in that case there is no need to get shadow casters
+        if (lightViewFrustums[i].vertices_[0] == lightViewFrustums[i].vertices_[4])
+        {
+            activeSplits &= ~(1u << i);
             continue;
+        }
 
-        // Check shadow distance
-        // Note: as lights are processed threaded, it is possible a drawable's UpdateBatches() function is called several
-        // times. However, this should not cause problems as no scene modification happens at this point.
-        if (!drawable->IsInView(frame_, true))
-            drawable->UpdateBatches(frame_);
-        float maxShadowDistance = drawable->GetShadowDistance();
-        float drawDistance = drawable->GetDrawDistance();
-        if (drawDistance > 0.0f && (maxShadowDistance <= 0.0f || drawDistance < maxShadowDistance))
-            maxShadowDistance = drawDistance;
-        if (maxShadowDistance > 0.0f && drawable->GetDistance() > maxShadowDistance)
-            continue;
+        lightViewFrustumBoxes[i].Define(lightViewFrustums[i]);
+        if (type == LIGHT_DIRECTIONAL)
+        {
+            splitViewBoxes[i].Define(shadowCamera->GetViewSpaceFrustum());
+            splitOffsets[i] = lightView.Translation() - query.shadowCameras_[0]->GetView().Translation();
+        }
+    }
 
-        // Project shadow caster bounding box to light view space for visibility check
-        lightViewBox = drawable->GetWorldBoundingBox().Transformed(lightView);
+    query.shadowCasterCandidates_.Clear();
+    query.shadowCasterSplits_.Clear();
 
-        if (IsShadowCasterVisible(drawable, lightViewBox, shadowCamera, lightView, lightViewFrustum, lightViewFrustumBox))
+    if (activeSplits)
+    {
+        Vector3 lightPosition = light->GetNode()->GetWorldPosition();
+        float nearClip = query.shadowCameras_[0]->GetNearClip();
+
+        for (PODVector<Drawable*>::ConstIterator i = drawables.Begin(); i != drawables.End(); ++i)
         {
-            // Merge to shadow caster bounding box (only needed for focused spot lights) and add to the list
-            if (type == LIGHT_SPOT && light->GetShadowFocus().focus_)
+            Drawable* drawable = *i;
+            // In case this is a point or spot light query result reused for optimization, we may have non-shadowcasters
+            // included. Check for that first
+            if (!drawable->GetCastShadows())
+                continue;
+            // Check shadow mask
+            if (!(GetShadowMask(drawable) & lightMask))
+                continue;
+
+            // For point light, find the faces this drawable is inside of
+            const BoundingBox& worldBox = drawable->GetWorldBoundingBox();
+            unsigned splits = activeSplits;
+            if (type == LIGHT_POINT)
+            {
+                splits &= GetPointLightFaces(worldBox, lightPosition, nearClip);
+                if (!splits)
+                    continue;
+            }
+
+            // Check shadow distance
+            // Note: as lights are processed threaded, it is possible a drawable's UpdateBatches() function is called several
+            // times. However, this should not cause problems as no scene modification happens at this point.
+            if (!drawable->IsInView(frame_, true))
+                drawable->UpdateBatches(frame_);
+            float maxShadowDistance = drawable->GetShadowDistance();
+            float drawDistance = drawable->GetDrawDistance();
+            if (drawDistance > 0.0f && (maxShadowDistance <= 0.0f || drawDistance < maxShadowDistance))
+                maxShadowDistance = drawDistance;
+            if (maxShadowDistance > 0.0f && drawable->GetDistance() > maxShadowDistance)
+                continue;
+
+            // The directional light splits only differ by the shadow camera position, so transform the bounding box to light
+            // view space once and translate it for each split
+            BoundingBox directionalViewBox;
+            if (type == LIGHT_DIRECTIONAL)
+                directionalViewBox = worldBox.Transformed(query.shadowCameras_[0]->GetView());
+
+            for (unsigned j = 0; j < query.numSplits_; ++j)
+            {
+                unsigned splitBit = 1u << j;
+                if (!(splits & splitBit))
+                    continue;
+
+                // If point light shadow caster is visible, its shadow is too; no need to transform the bounding box
+                if (type == LIGHT_POINT && drawable->IsInView(frame_))
+                    continue;
+
+                Camera* shadowCamera = query.shadowCameras_[j];
+                const Matrix3x4& lightView = shadowCamera->GetView();
+
+                // Project shadow caster bounding box to light view space for visibility check
+                BoundingBox lightViewBox;
+                if (type == LIGHT_DIRECTIONAL)
+                {
+                    lightViewBox.Define(directionalViewBox.min_ + splitOffsets[j], directionalViewBox.max_ + splitOffsets[j]);
+                    if (splitViewBoxes[j].IsInsideFast(lightViewBox) == OUTSIDE)
+                    {
+                        splits &= ~splitBit;
+                        continue;
+                    }
+                }
+                else
+                    lightViewBox = worldBox.Transformed(lightView);
+
+                if (!IsShadowCasterVisible(drawable, lightViewBox, shadowCamera, lightView, lightViewFrustums[j],
+                    lightViewFrustumBoxes[j]))
+                {
+                    splits &= ~splitBit;
+                    continue;
+                }
+
+                // Merge to shadow caster bounding box (only needed for focused spot lights)
+                if (focusedSpot)
+                    query.shadowCasterBox_[j].Merge(lightViewBox.Projected(shadowCamera->GetProjection()));
+            }
+
+            if (splits)
             {
-                lightProjBox = lightViewBox.Projected(lightProj);
-                query.shadowCasterBox_[splitIndex].Merge(lightProjBox);
+                query.shadowCasterCandidates_.Push(drawable);
+                query.shadowCasterSplits_.Push((unsigned char)splits);
+                for (unsigned j = 0; j < query.numSplits_; ++j)
+                {
+                    if (splits & (1u << j))
+                        ++splitCounts[j];
+                }
             }
-            query.shadowCasters_.Push(drawable);
         }
     }
 
-    query.shadowCasterEnd_[splitIndex] = query.shadowCasters_.Size();
+    // Group the casters by split
+    unsigned numCasters = 0;
+    for (unsigned i = 0; i < query.numSplits_; ++i)
+    {
+        query.shadowCasterBegin_[i] = query.shadowCasterEnd_[i] = numCasters;
+        numCasters += splitCounts[i];
+    }
+
+    query.shadowCasters_.Resize(numCasters);
+    for (unsigned i = 0; i < query.shadowCasterCandidates_.Size(); ++i)
+    {
+        unsigned splits = query.shadowCasterSplits_[i];
+        for (unsigned j = 0; j < query.numSplits_; ++j)
+        {
+            if (splits & (1u << j))
+                query.shadowCasters_[query.shadowCasterEnd_[j]++] = query.shadowCasterCandidates_[i];
+        }
+    }
 }
 
 bool View::IsShadowCasterVisible(Drawable* drawable, BoundingBox lightViewBox, Camera* shadowCamera, const Matrix3x4& lightView,
@@ -2689,10 +3050,12 @@ bool View::IsShadowCasterVisible(Drawable* drawable, BoundingBox lightViewBox, C
     }
 }
 
-IntRect View::GetShadowMapViewport(Light* light, int splitIndex, Texture2D* shadowMap)
+IntRect View::GetShadowMapViewport(Light* light, int splitIndex, const IntRect& region)
 {
-    int width = shadowMap->GetWidth();
-    int height = shadowMap->GetHeight();
+    int x = region.left_;
+    int y = region.top_;
+    int width = region.Width();
+    int height = region.Height();
 
     switch (light->GetLightType())
     {
@@ -2700,20 +3063,20 @@ IntRect View::GetShadowMapViewport(Light* light, int splitIndex, Texture2D* shad
         {
             int numSplits = light->GetNumShadowSplits();
             if (numSplits == 1)
-                return {0, 0, width, height};
+                return region;
             else if (numSplits == 2)
-                return {splitIndex * width / 2, 0, (splitIndex + 1) * width / 2, height};
+                return {x + splitIndex * width / 2, y, x + (splitIndex + 1) * width / 2, y + height};
             else
-                return {(splitIndex & 1) * width / 2, (splitIndex / 2) * height / 2,
-                    ((splitIndex & 1) + 1) * width / 2, (splitIndex / 2 + 1) * height / 2};
+                return {x + (splitIndex & 1) * width / 2, y + (splitIndex / 2) * height / 2,
+                    x + ((splitIndex & 1) + 1) * width / 2, y + (splitIndex / 2 + 1) * height / 2};
         }
 
     case LIGHT_SPOT:
-        return {0, 0, width, height};
+        return region;
 
     case LIGHT_POINT:
-        return {(splitIndex & 1) * width / 2, (splitIndex / 2) * height / 3,
-            ((splitIndex & 1) + 1) * width / 2, (splitIndex / 2 + 1) * height / 3};
+        return {x + (splitIndex & 1) * width / 2, y + (splitIndex / 2) * height / 3,
+            x + ((splitIndex & 1) + 1) * width / 2, y + (splitIndex / 2 + 1) * height / 3};
     }
 
     return {};
@@ -3186,7 +3549,10 @@ void View::PrepareInstancingBuffer()
     for (Vector<LightBatchQueue>::Iterator i = lightQueues_.Begin(); i != lightQueues_.End(); ++i)
     {
         for (unsigned j = 0; j < i->shadowSplits_.Size(); ++j)
+        {
             totalInstances += i->shadowSplits_[j].shadowBatches_.GetNumInstances();
+            totalInstances += i->shadowSplits_[j].staticShadowBatches_.GetNumInstances();
+        }
         totalInstances += i->litBaseBatches_.GetNumInstances();
         totalInstances += i->litBatches_.GetNumInstances();
     }
@@ -3205,7 +3571,10 @@ void View::PrepareInstancingBuffer()
     for (Vector<LightBatchQueue>::Iterator i = lightQueues_.Begin(); i != lightQueues_.End(); ++i)
     {
         for (unsigned j = 0; j < i->shadowSplits_.Size(); ++j)
+        {
             i->shadowSplits_[j].shadowBatches_.SetInstancingData(dest, stride, freeIndex);
+            i->shadowSplits_[j].staticShadowBatches_.SetInstancingData(dest, stride, freeIndex);
+        }
         i->litBaseBatches_.SetInstancingData(dest, stride, freeIndex);
         i->litBatches_.SetInstancingData(dest, stride, freeIndex);
     }
@@ -3291,15 +3660,48 @@ void View::RenderShadowMap(const LightBatchQueue& queue)
     // The shadow map is a depth stencil texture
     if (shadowMap->GetUsage() == TEXTURE_DEPTHSTENCIL)
     {
-        graphics_->SetColorWrite(false);
-        graphics_->SetDepthStencil(shadowMap);
+        ShadowMapCache* shadowCache = queue.shadowCache_;
+        bool cacheCopied = false;
 
-        graphics_->SetRenderTarget(0, shadowMap->GetRenderSurface()->GetLinkedRenderTarget());
+        graphics_->SetColorWrite(false);
         // Disable other render targets
         for (unsigned i = 1; i < MAX_RENDERTARGETS; ++i)
             graphics_->SetRenderTarget(i, (RenderSurface*) nullptr);
+
+        // Render the static casters into the cache texture if they changed, then start from a copy of it
+        if (shadowCache && shadowCache->GetTexture())
+        {
+            Texture2D* cacheTexture = shadowCache->GetTexture();
+            if (shadowCache->IsRebuildPending())
+            {
+                URHO3D_PROFILE(RenderShadowMapCache);
+
+                graphics_->SetDepthStencil(cacheTexture);
+                graphics_->SetRenderTarget(0, shadowMap->GetRenderSurface()->GetLinkedRenderTarget());
+                graphics_->SetViewport(IntRect(0, 0, cacheTexture->GetWidth(), cacheTexture->GetHeight()));
+                graphics_->Clear(CLEAR_DEPTH);
+                RenderShadowSplits(queue, parameters, true);
+            }
+
+            cacheCopied = graphics_->CopyTexture(cacheTexture, shadowMap);
+            if (cacheCopied)
+                shadowCache->MarkRendered();
+        }
+
+        graphics_->SetDepthStencil(shadowMap);
+        graphics_->SetRenderTarget(0, shadowMap->GetRenderSurface()->GetLinkedRenderTarget());
         graphics_->SetViewport(IntRect(0, 0, shadowMap->GetWidth(), shadowMap->GetHeight()));
-        graphics_->Clear(CLEAR_DEPTH);
+        if (!cacheCopied)
+        {
+            graphics_->Clear(CLEAR_DEPTH);
+            // If the copy failed, render the static casters directly before disabling the cache
+            if (shadowCache && shadowCache->GetTexture())
+            {
+                URHO3D_LOGWARNING("Texture copy not supported, disabling static shadow caching");
+                RenderShadowSplits(queue, parameters, true);
+                shadowCache->Disable();
+            }
+        }
     }
     else // if the shadow map is a color rendertarget
     {
@@ -3316,10 +3718,164 @@ void View::RenderShadowMap(const LightBatchQueue& queue)
         parameters = BiasParameters(0.0f, 0.0f);
     }
 
-    // Render each of the splits
+    // Render the dynamic casters of each split
+    RenderShadowSplits(queue, parameters, false);
+
+    // Scale filter blur amount to shadow map viewport size so that different shadow map resolutions don't behave differently
+    float blurScale = queue.shadowSplits_[0].shadowViewport_.Width() / 1024.0f;
+    renderer_->ApplyShadowMapFilter(this, shadowMap, blurScale);
+
+    // reset some parameters
+    graphics_->SetColorWrite(true);
+    graphics_->SetDepthBias(0.0f, 0.0f);
+
+    Graphics_IsDrawingShadow = false;
+}
+
+void View::RenderShadowAtlas(const Vector<LightBatchQueue>& lightQueues)
+{
+    Texture2D* atlas = nullptr;
+    for (Vector<LightBatchQueue>::ConstIterator i = lightQueues.Begin(); i != lightQueues.End(); ++i)
+    {
+        if (NeedRenderShadowMap(*i))
+            atlas = i->shadowMap_;
+    }
+    if (!atlas)
+        return;
+
+    Graphics_IsDrawingShadow = true;
+    URHO3D_PROFILE(RenderShadowAtlas);
+
+    graphics_->SetTexture(TU_SHADOWMAP, nullptr);
+    graphics_->SetFillMode(FILL_SOLID);
+    graphics_->SetClipPlane(false);
+    graphics_->SetStencilTest(false);
+    graphics_->SetColorWrite(false);
+    for (unsigned i = 1; i < MAX_RENDERTARGETS; ++i)
+        graphics_->SetRenderTarget(i, (RenderSurface*) nullptr);
+    RenderSurface* dummyColor = atlas->GetRenderSurface()->GetLinkedRenderTarget();
+
+    // Render the changed static layers into their regions of the static atlas. Lights without an atlas region have a static
+    // layer texture of their own
+    Texture2D* staticTarget = nullptr;
+    for (Vector<LightBatchQueue>::ConstIterator i = lightQueues.Begin(); i != lightQueues.End(); ++i)
+    {
+        if (!NeedRenderShadowMap(*i) || !i->shadowCache_ || !i->shadowCache_->IsRebuildPending())
+            continue;
+
+        URHO3D_PROFILE(RenderShadowMapCache);
+
+        if (i->shadowCache_->GetTexture() != staticTarget)
+        {
+            staticTarget = i->shadowCache_->GetTexture();
+            graphics_->SetDepthStencil(staticTarget);
+            graphics_->SetRenderTarget(0, dummyColor);
+        }
+        graphics_->SetViewport(i->shadowMapRegion_);
+        graphics_->Clear(CLEAR_DEPTH);
+        RenderShadowSplits(*i, i->light_->GetShadowBias(), true);
+    }
+
+    // Copy only the regions of the lights rendered this frame from their static layers. Done before binding the atlas, as the
+    // copies may unbind the current depth-stencil
+    PODVector<bool> staticCopied(lightQueues.Size());
+    for (unsigned i = 0; i < lightQueues.Size(); ++i)
+    {
+        const LightBatchQueue& queue = lightQueues[i];
+        ShadowMapCache* shadowCache = queue.shadowCache_;
+        staticCopied[i] = NeedRenderShadowMap(queue) && shadowCache && shadowCache->GetTexture() &&
+            CopyStaticShadowRegion(shadowCache->GetTexture(), atlas, queue.shadowMapRegion_);
+    }
+
+    // Render the dynamic casters of all lights with a single depth-stencil bind
+    graphics_->SetDepthStencil(atlas);
+    graphics_->SetRenderTarget(0, dummyColor);
+    for (unsigned i = 0; i < lightQueues.Size(); ++i)
+    {
+        const LightBatchQueue& queue = lightQueues[i];
+        if (!NeedRenderShadowMap(queue))
+            continue;
+
+        const BiasParameters& parameters = queue.light_->GetShadowBias();
+        ShadowMapCache* shadowCache = queue.shadowCache_;
+        if (staticCopied[i])
+            shadowCache->MarkRendered();
+        else
+        {
+            graphics_->SetViewport(queue.shadowMapRegion_);
+            graphics_->Clear(CLEAR_DEPTH);
+            // If the copy failed, render the static casters directly before disabling the cache
+            if (shadowCache && shadowCache->GetTexture())
+            {
+                URHO3D_LOGWARNING("Texture copy not supported, disabling static shadow caching");
+                RenderShadowSplits(queue, parameters, true);
+                shadowCache->Disable();
+            }
+        }
+
+        RenderShadowSplits(queue, parameters, false);
+    }
+
+    graphics_->SetColorWrite(true);
+    graphics_->SetDepthBias(0.0f, 0.0f);
+
+    Graphics_IsDrawingShadow = false;
+}
+
+bool View::CopyStaticShadowRegion(Texture2D* source, Texture2D* destination, const IntRect& rect)
+{
+    if (graphics_->CopyTextureRegion(source, destination, rect))
+        return true;
+
+#ifdef URHO3D_D3D11
+    // Direct3D11 copies depth-stencil textures only whole. Copy the region with a pass that writes the source depth instead
+    ShaderVariation* vs = graphics_->GetShader(VS, "CopyDepth");
+    ShaderVariation* ps = graphics_->GetShader(PS, "CopyDepth");
+    if (!vs || !ps || source->GetUsage() != TEXTURE_DEPTHSTENCIL || source->GetWidth() != destination->GetWidth() ||
+        source->GetHeight() != destination->GetHeight())
+        return false;
+
+    graphics_->SetDepthStencil(destination);
+    graphics_->SetRenderTarget(0, destination->GetRenderSurface()->GetLinkedRenderTarget());
+    graphics_->SetViewport(rect);
+    graphics_->SetBlendMode(BLEND_REPLACE);
+    graphics_->SetColorWrite(false);
+    graphics_->SetDepthTest(CMP_ALWAYS);
+    graphics_->SetDepthWrite(true);
+    graphics_->SetDepthBias(0.0f, 0.0f);
+    graphics_->SetShaders(vs, ps, nullptr, nullptr, nullptr);
+    graphics_->SetTexture(TU_DEPTHBUFFER, source);
+    DrawFullscreenQuad(true);
+    // Unbind, as the source is rendered to as a depth-stencil when its static layer changes
+    graphics_->SetTexture(TU_DEPTHBUFFER, nullptr);
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool View::IsReusingShadowMaps() const
+{
+    return renderer_->GetReuseShadowMaps() && !renderer_->IsShadowAtlasEnabled();
+}
+
+void View::RenderShadowSplits(const LightBatchQueue& queue, const BiasParameters& parameters, bool staticBatches)
+{
     for (unsigned i = 0; i < queue.shadowSplits_.Size(); ++i)
     {
         const ShadowBatchQueue& shadowQueue = queue.shadowSplits_[i];
+        const BatchQueue* batches = staticBatches ? &shadowQueue.staticShadowBatches_ : &shadowQueue.shadowBatches_;
+
+        // The static batches are collected only when the cache is rebuilt. Otherwise build them now from the cache's casters
+        if (staticBatches && queue.shadowCache_ && !queue.shadowCache_->IsRebuildPending())
+        {
+            fallbackShadowBatches_.Clear(renderer_->GetMaxSortedInstances());
+            const PODVector<Drawable*>& casters = queue.shadowCache_->GetStaticCasters(i);
+            for (PODVector<Drawable*>::ConstIterator j = casters.Begin(); j != casters.End(); ++j)
+                GetShadowBatches(*j, fallbackShadowBatches_);
+            fallbackShadowBatches_.SortFrontToBack();
+            batches = &fallbackShadowBatches_;
+        }
 
         float multiplier = 1.0f;
         // For directional light cascade splits, adjust depth bias according to the far clip ratio of the splits
@@ -3341,22 +3897,12 @@ void View::RenderShadowMap(const LightBatchQueue& queue)
 
         graphics_->SetDepthBias(multiplier * parameters.constantBias_ + addition, multiplier * parameters.slopeScaledBias_);
 
-        if (!shadowQueue.shadowBatches_.IsEmpty())
+        if (!batches->IsEmpty())
         {
             graphics_->SetViewport(shadowQueue.shadowViewport_);
-            shadowQueue.shadowBatches_.Draw(this, shadowQueue.shadowCamera_, false, false, true);
+            batches->Draw(this, shadowQueue.shadowCamera_, false, false, true);
         }
     }
-
-    // Scale filter blur amount to shadow map viewport size so that different shadow map resolutions don't behave differently
-    float blurScale = queue.shadowSplits_[0].shadowViewport_.Width() / 1024.0f;
-    renderer_->ApplyShadowMapFilter(this, shadowMap, blurScale);
-
-    // reset some parameters
-    graphics_->SetColorWrite(true);
-    graphics_->SetDepthBias(0.0f, 0.0f);
-
-    Graphics_IsDrawingShadow = false;
 }
 
 RenderSurface* View::GetDepthStencil(RenderSurface* renderTarget)
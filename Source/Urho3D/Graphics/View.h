@@ -27,6 +27,7 @@
 #include "../Core/Object.h"
 #include "../Graphics/Batch.h"
 #include "../Graphics/Light.h"
+#include "../Graphics/LightBudget.h"
 #include "../Graphics/Zone.h"
 #include "../Math/Polyhedron.h"
 
@@ -40,6 +41,7 @@ namespace Urho3D
 class Camera;
 class DebugRenderer;
 class Light;
+class LightTiler;
 class Drawable;
 class Graphics;
 class OcclusionBuffer;
@@ -52,6 +54,7 @@ class Texture;
 class Texture2D;
 class Viewport;
 class Zone;
+struct LightInfluence;
 struct RenderPathCommand;
 struct WorkItem;
 
@@ -60,10 +63,20 @@ struct LightQueryResult
 {
     /// Light.
     Light* light_;
+    /// Per-frame influence cache entry of spot and point lights, shared with the other views.
+    LightInfluence* influence_;
+    /// Per-vertex flag. Set for per-vertex lights and for lights demoted by the light budget.
+    bool perVertex_;
+    /// Whether this view performed the light's octree query, instead of reusing the influence cache.
+    bool influenceQueried_;
     /// Lit geometries.
     PODVector<Drawable*> litGeometries_;
-    /// Shadow casters.
+    /// Shadow casters, grouped by split.
     PODVector<Drawable*> shadowCasters_;
+    /// Shadow casters before grouping by split.
+    PODVector<Drawable*> shadowCasterCandidates_;
+    /// Mask of the splits each shadow caster candidate is rendered into.
+    PODVector<unsigned char> shadowCasterSplits_;
     /// Shadow cameras.
     Camera* shadowCameras_[MAX_LIGHT_SPLITS];
     /// Shadow caster start indices.
@@ -176,6 +189,18 @@ public:
 
     /// Return light batch queues.
     const Vector<LightBatchQueue>& GetLightQueues() const { return lightQueues_; }
+    /// Return number of batches in the per-pixel light queues. Grows with lit objects times lights, unlike the clustered lights pass.
+    unsigned GetNumLitBatches() const;
+    /// Return number of lights shaded from the clustered light tables instead of light queues.
+    unsigned GetNumClusteredLights() const;
+    /// Return number of lights demoted from per-pixel to vertex lighting by the light budget.
+    unsigned GetNumDemotedLights() const { return demotedLights_.Size(); }
+    /// Return number of spot and point light octree queries performed.
+    unsigned GetNumLightQueries() const { return numLightQueries_; }
+    /// Return number of spot and point light octree queries served from the light influence cache of another view.
+    unsigned GetNumCachedLightQueries() const { return numCachedLightQueries_; }
+    /// Return number of primitives drawn by the last render of the view, including its shadow maps.
+    unsigned GetNumPrimitives() const { return numPrimitives_; }
 
     /// Return the last used software occlusion buffer.
     OcclusionBuffer* GetOcclusionBuffer() const { return occlusionBuffer_; }
@@ -219,6 +244,8 @@ private:
     void GetDrawables();
     /// Construct batches from the drawable objects.
     void GetBatches();
+    /// Keep the most important per-pixel lights within the renderer's light budget and demote the rest to vertex lighting.
+    void ApplyLightBudget(unsigned budget);
     /// Get lit geometries and shadowcasters for visible lights.
     void ProcessLights();
     /// Get batches from lit geometries and shadowcasters.
@@ -227,6 +254,8 @@ private:
     void GetBaseBatches();
     /// Update geometries and sort batches.
     void UpdateGeometries();
+    /// Get shadow caster batches for a drawable.
+    void GetShadowBatches(Drawable* drawable, BatchQueue& shadowBatches);
     /// Get pixel lit batches for a certain light and drawable.
     void GetLitBatches(Drawable* drawable, LightBatchQueue& lightQueue, BatchQueue* alphaQueue);
     /// Execute render commands.
@@ -255,8 +284,8 @@ private:
     void DrawOccluders(OcclusionBuffer* buffer, const PODVector<Drawable*>& occluders);
     /// Query for lit geometries and shadow casters for a light.
     void ProcessLight(LightQueryResult& query, unsigned threadIndex);
-    /// Process shadow casters' visibilities and build their combined view- or projection-space bounding box.
-    void ProcessShadowCasters(LightQueryResult& query, const PODVector<Drawable*>& drawables, unsigned splitIndex);
+    /// Process shadow casters' visibilities in all active splits with one pass over the drawables, and build their combined view- or projection-space bounding boxes.
+    void ProcessShadowCasters(LightQueryResult& query, const PODVector<Drawable*>& drawables, unsigned activeSplits);
     /// Set up initial shadow camera view(s).
     void SetupShadowCameras(LightQueryResult& query);
     /// Set up a directional light shadow camera
@@ -271,7 +300,7 @@ private:
     bool IsShadowCasterVisible(Drawable* drawable, BoundingBox lightViewBox, Camera* shadowCamera, const Matrix3x4& lightView,
         const Frustum& lightViewFrustum, const BoundingBox& lightViewFrustumBox);
     /// Return the viewport for a shadow map split.
-    IntRect GetShadowMapViewport(Light* light, int splitIndex, Texture2D* shadowMap);
+    IntRect GetShadowMapViewport(Light* light, int splitIndex, const IntRect& region);
     /// Find and set a new zone for a drawable when it has moved.
     void FindZone(Drawable* drawable);
     /// Return material technique, considering the drawable's LOD distance.
@@ -290,6 +319,14 @@ private:
     bool NeedRenderShadowMap(const LightBatchQueue& queue);
     /// Render a shadow map.
     void RenderShadowMap(const LightBatchQueue& queue);
+    /// Render the shadow maps of all lights into the shadow atlas.
+    void RenderShadowAtlas(const Vector<LightBatchQueue>& lightQueues);
+    /// Return whether each shadow map is rendered just before its light. Not possible with the shadow atlas, as all lights share it.
+    bool IsReusingShadowMaps() const;
+    /// Copy a region of a static shadow layer into the same region of the shadow atlas. Return true if successful.
+    bool CopyStaticShadowRegion(Texture2D* source, Texture2D* destination, const IntRect& rect);
+    /// Render either the dynamic or the static shadow caster batches of each split of a light.
+    void RenderShadowSplits(const LightBatchQueue& queue, const BiasParameters& parameters, bool staticBatches);
     /// Return the proper depth-stencil surface to use for a rendertarget.
     RenderSurface* GetDepthStencil(RenderSurface* renderTarget);
     /// Helper function to get the render surface from a texture. 2D textures will always return the first face only.
@@ -329,6 +366,15 @@ private:
 
     inline bool IsVR() const { return leftEye_ && rightEye_; }
 
+    /// Return whether a light is shaded by the clustered lights pass. Directional and shadowed lights are not clustered and keep their light queues.
+    bool IsClusteredLight(Light* light) const
+    {
+        if (!clusteredLightsCommand_ || light->GetPerVertex() || light->GetLightType() == LIGHT_DIRECTIONAL)
+            return false;
+        // The clustered pass has no shadow maps, so shadowed point and spot lights stay on the forward path
+        return !(drawShadows_ && light->GetCastShadows() && light->GetShadowIntensity() < 1.0f);
+    }
+
     /// Graphics subsystem.
     WeakPtr<Graphics> graphics_;
     /// Renderer subsystem.
@@ -419,15 +465,29 @@ private:
     PODVector<Drawable*> nonThreadedGeometries_;
     /// Geometry objects that will be updated in worker threads.
     PODVector<Drawable*> threadedGeometries_;
+    /// Geometry objects updated in worker threads that upload their staged data in the main thread afterward.
+    PODVector<Drawable*> stagedGeometries_;
     /// Occluder objects.
     PODVector<Drawable*> occluders_;
     /// Lights.
     PODVector<Light*> lights_;
     /// Number of active occluders.
     unsigned activeOccluders_;
+    /// Number of spot and point light octree queries performed.
+    unsigned numLightQueries_;
+    /// Number of spot and point light octree queries served from the light influence cache.
+    unsigned numCachedLightQueries_;
+    /// Number of primitives drawn by the last render.
+    unsigned numPrimitives_;
 
     /// Drawables that limit their maximum light count.
     HashSet<Drawable*> maxLightsDrawables_;
+    /// Per-pixel light importances for the light budget.
+    PODVector<LightImportance> lightImportances_;
+    /// Lights within the light budget. Kept to the next frame for hysteresis; only used as keys.
+    HashSet<Light*> budgetedLights_;
+    /// Lights demoted to vertex lighting by the light budget on this frame.
+    HashSet<Light*> demotedLights_;
     /// Rendertargets defined by the renderpath.
     HashMap<StringHash, Texture*> renderTargets_;
     /// Intermediate light processing results.
@@ -440,6 +500,8 @@ private:
     HashMap<unsigned long long, LightBatchQueue> vertexLightQueues_;
     /// Batch queues by pass index.
     HashMap<unsigned, BatchQueue> batchQueues_;
+    /// Static shadow caster batches built at render time when a light's static shadow cache could not be copied.
+    BatchQueue fallbackShadowBatches_;
     /// Index of the GBuffer pass.
     unsigned gBufferPassIndex_;
     /// Index of the opaque forward base pass.
@@ -456,12 +518,18 @@ private:
     const RenderPathCommand* lightVolumeCommand_;
     /// Pointer to the forwardlights command if any.
     const RenderPathCommand* forwardLightsCommand_;
+    /// Pointer to the clustered lights command if any. Only used when compute is available.
+    const RenderPathCommand* clusteredLightsCommand_;
     /// Pointer to the current commmand if it contains shader parameters to be set for a render pass.
     const RenderPathCommand* passCommand_;
     /// Flag for scene being resolved from the backbuffer.
     bool usedResolve_;
 #ifdef URHO3D_COMPUTE
     HashMap<StringHash, WeakPtr<ComputeBuffer> > namedBuffers_;
+    /// Clustered light tables, created when the renderpath has a clustered lights command.
+    SharedPtr<LightTiler> lightTiler_;
+    /// Lights binned into the clustered light tables this frame.
+    Vector<SharedPtr<Light> > clusteredLights_;
 #endif
     SharedPtr<Texture2D> vrs_;
 };